@@ -0,0 +1,270 @@
+#include <math.h>
+#include <string.h>
+
+#include "aggregate.h"
+
+static void P2_Init(P2Estimator *estimator, double quantile)
+{
+    memset(estimator, 0, sizeof(*estimator));
+    estimator->quantile = quantile;
+}
+
+static void P2_Reset(P2Estimator *estimator)
+{
+    P2_Init(estimator, estimator->quantile);
+}
+
+static double P2_Parabolic(const P2Estimator *e, int i, double d)
+{
+    const double *q = e->heights;
+    const double *n = e->positions;
+    return q[i] + d / (n[i + 1] - n[i - 1]) *
+                      ((n[i] - n[i - 1] + d) * (q[i + 1] - q[i]) / (n[i + 1] - n[i]) +
+                       (n[i + 1] - n[i] - d) * (q[i] - q[i - 1]) / (n[i] - n[i - 1]));
+}
+
+static double P2_Linear(const P2Estimator *e, int i, int d)
+{
+    const double *q = e->heights;
+    const double *n = e->positions;
+    return q[i] + d * (q[i + d] - q[i]) / (n[i + d] - n[i]);
+}
+
+static void P2_Add(P2Estimator *e, double sample)
+{
+    double *q = e->heights;
+    double *n = e->positions;
+
+    // The first five samples are kept sorted and become the initial markers
+    if (e->count < 5) {
+        uint32_t i = e->count;
+        while (i > 0 && q[i - 1] > sample) {
+            q[i] = q[i - 1];
+            i--;
+        }
+        q[i] = sample;
+        e->count++;
+
+        if (e->count == 5) {
+            double p = e->quantile;
+            for (int m = 0; m < 5; m++) {
+                n[m] = m;
+            }
+            e->desiredPositions[0] = 0;
+            e->desiredPositions[1] = 2 * p;
+            e->desiredPositions[2] = 4 * p;
+            e->desiredPositions[3] = 2 + 2 * p;
+            e->desiredPositions[4] = 4;
+            e->increments[0] = 0;
+            e->increments[1] = p / 2;
+            e->increments[2] = p;
+            e->increments[3] = (1 + p) / 2;
+            e->increments[4] = 1;
+        }
+        return;
+    }
+    e->count++;
+
+    // Find the cell the sample falls in, extending the extremes if needed
+    int k;
+    if (sample < q[0]) {
+        q[0] = sample;
+        k = 0;
+    }
+    else if (sample >= q[4]) {
+        q[4] = sample;
+        k = 3;
+    }
+    else {
+        k = 0;
+        while (sample >= q[k + 1]) {
+            k++;
+        }
+    }
+
+    for (int i = k + 1; i < 5; i++) {
+        n[i]++;
+    }
+    for (int i = 0; i < 5; i++) {
+        e->desiredPositions[i] += e->increments[i];
+    }
+
+    // Nudge the middle markers towards their desired positions
+    for (int i = 1; i < 4; i++) {
+        double offset = e->desiredPositions[i] - n[i];
+        if ((offset >= 1 && n[i + 1] - n[i] > 1) || (offset <= -1 && n[i - 1] - n[i] < -1)) {
+            int d = offset > 0 ? 1 : -1;
+            double height = P2_Parabolic(e, i, d);
+            if (q[i - 1] < height && height < q[i + 1]) {
+                q[i] = height;
+            }
+            else {
+                q[i] = P2_Linear(e, i, d);
+            }
+            n[i] += d;
+        }
+    }
+}
+
+static double P2_Estimate(const P2Estimator *e)
+{
+    if (e->count == 0) {
+        return 0;
+    }
+
+    // Until the markers are set up the samples are all still there, so be exact
+    if (e->count < 5) {
+        return e->heights[(uint32_t)(e->quantile * (e->count - 1) + 0.5)];
+    }
+    return e->heights[2];
+}
+
+/// <summary>
+///     Return the value of rank n (0-based) among values, partially reordering them:
+///     Hoare's quickselect with a median-of-three pivot, O(count) on average.
+/// </summary>
+static double SelectRank(double *values, size_t count, size_t n)
+{
+    size_t left = 0;
+    size_t right = count - 1;
+    while (left < right) {
+        size_t middle = left + (right - left) / 2;
+        double a = values[left], b = values[middle], c = values[right];
+        double pivot = a < b ? (b < c ? b : (a < c ? c : a)) : (a < c ? a : (b < c ? c : b));
+
+        size_t i = left;
+        size_t j = right;
+        while (i <= j) {
+            while (values[i] < pivot) {
+                i++;
+            }
+            while (values[j] > pivot) {
+                j--;
+            }
+            if (i <= j) {
+                double swap = values[i];
+                values[i] = values[j];
+                values[j] = swap;
+                i++;
+                if (j == 0) {
+                    break;
+                }
+                j--;
+            }
+        }
+
+        // values[left..j] <= pivot <= values[i..right], and anything between equals pivot
+        if (n <= j) {
+            right = j;
+        }
+        else if (n >= i) {
+            left = i;
+        }
+        else {
+            return values[n];
+        }
+    }
+    return values[n];
+}
+
+static double ExactQuantile(const Aggregate *aggregate, double quantile)
+{
+    return SelectRank(aggregate->samples, aggregate->count,
+                      (size_t)(quantile * (aggregate->count - 1) + 0.5));
+}
+
+void Aggregate_Init(Aggregate *aggregate, const double *percentiles, size_t percentileCount,
+                    double *storage, size_t capacity)
+{
+    aggregate->samples = storage;
+    aggregate->sampleCapacity = storage == NULL ? 0 : capacity;
+
+    if (percentileCount > AGGREGATE_MAX_PERCENTILES) {
+        percentileCount = AGGREGATE_MAX_PERCENTILES;
+    }
+
+    P2_Init(&aggregate->median, 0.5);
+    aggregate->percentileCount = percentileCount;
+    for (size_t i = 0; i < percentileCount; i++) {
+        P2_Init(&aggregate->percentiles[i], percentiles[i]);
+    }
+
+    Aggregate_Reset(aggregate);
+}
+
+void Aggregate_Reset(Aggregate *aggregate)
+{
+    aggregate->count = 0;
+    aggregate->min = 0;
+    aggregate->max = 0;
+    aggregate->mean = 0;
+    aggregate->sumOfSquaredDeviations = 0;
+
+    P2_Reset(&aggregate->median);
+    for (size_t i = 0; i < aggregate->percentileCount; i++) {
+        P2_Reset(&aggregate->percentiles[i]);
+    }
+}
+
+void Aggregate_Add(Aggregate *aggregate, double sample)
+{
+    aggregate->count++;
+    if (aggregate->count == 1 || sample < aggregate->min) {
+        aggregate->min = sample;
+    }
+    if (aggregate->count == 1 || sample > aggregate->max) {
+        aggregate->max = sample;
+    }
+
+    // Welford's update keeps the variance numerically stable
+    double delta = sample - aggregate->mean;
+    aggregate->mean += delta / aggregate->count;
+    aggregate->sumOfSquaredDeviations += delta * (sample - aggregate->mean);
+
+    if (aggregate->count <= aggregate->sampleCapacity) {
+        aggregate->samples[aggregate->count - 1] = sample;
+    }
+
+    P2_Add(&aggregate->median, sample);
+    for (size_t i = 0; i < aggregate->percentileCount; i++) {
+        P2_Add(&aggregate->percentiles[i], sample);
+    }
+}
+
+double Aggregate_Mean(const Aggregate *aggregate)
+{
+    return aggregate->mean;
+}
+
+double Aggregate_StandardDeviation(const Aggregate *aggregate)
+{
+    if (aggregate->count < 2) {
+        return 0;
+    }
+    return sqrt(aggregate->sumOfSquaredDeviations / (aggregate->count - 1));
+}
+
+bool Aggregate_IsExact(const Aggregate *aggregate)
+{
+    return aggregate->count <= aggregate->sampleCapacity;
+}
+
+double Aggregate_Median(const Aggregate *aggregate)
+{
+    if (aggregate->count != 0 && Aggregate_IsExact(aggregate)) {
+        // The upper median, as the sorted array this replaced reported
+        return SelectRank(aggregate->samples, aggregate->count, aggregate->count / 2);
+    }
+    return P2_Estimate(&aggregate->median);
+}
+
+double Aggregate_Percentile(const Aggregate *aggregate, size_t index)
+{
+    if (index >= aggregate->percentileCount) {
+        return 0;
+    }
+    if (aggregate->count != 0 && Aggregate_IsExact(aggregate)) {
+        return ExactQuantile(aggregate, aggregate->percentiles[index].quantile);
+    }
+    return P2_Estimate(&aggregate->percentiles[index]);
+}
@@ -0,0 +1,77 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define AGGREGATE_MAX_PERCENTILES 4
+
+/// <summary>
+/// Streaming estimate of one quantile using the P-squared algorithm (Jain and Chlamtac,
+/// 1985), which tracks five markers instead of storing the samples.
+/// </summary>
+typedef struct P2Estimator {
+    double quantile;
+    double heights[5];
+    double positions[5];
+    double desiredPositions[5];
+    double increments[5];
+    uint32_t count;
+} P2Estimator;
+
+/// <summary>
+/// Summary statistics of a stream of samples, updated in O(1) per sample: count, min, max,
+/// mean, standard deviation, median and a configurable set of percentiles.
+///
+/// With sample storage, the median and percentiles are exact for as long as the samples fit:
+/// they are selected from the stored samples in O(n) when read. Past that, and without
+/// storage, they are P-squared estimates.
+/// </summary>
+typedef struct Aggregate {
+    uint32_t count;
+    double min;
+    double max;
+    double mean;
+    double sumOfSquaredDeviations; // Welford's M2
+    P2Estimator median;
+    size_t percentileCount;
+    P2Estimator percentiles[AGGREGATE_MAX_PERCENTILES];
+
+    // Caller-supplied; reordered in place by the exact queries, which don't change the set
+    double *samples;
+    size_t sampleCapacity;
+} Aggregate;
+
+/// <summary>
+/// Set up an aggregate to track the given percentiles (each between 0 and 1) in addition to
+/// the median. At most AGGREGATE_MAX_PERCENTILES are kept. storage may be NULL for
+/// estimates only.
+/// </summary>
+void Aggregate_Init(Aggregate *aggregate, const double *percentiles, size_t percentileCount,
+                    double *storage, size_t capacity);
+
+/// <summary>
+/// Discard all samples, keeping the configured percentiles.
+/// </summary>
+void Aggregate_Reset(Aggregate *aggregate);
+
+void Aggregate_Add(Aggregate *aggregate, double sample);
+
+double Aggregate_Mean(const Aggregate *aggregate);
+double Aggregate_StandardDeviation(const Aggregate *aggregate);
+/// <summary>
+/// Whether the median and percentiles are exact, i.e. every sample has been stored.
+/// </summary>
+bool Aggregate_IsExact(const Aggregate *aggregate);
+
+/// <summary>
+/// The median: the upper one, sample count / 2 in sorted order, when there is an even
+/// number of samples.
+/// </summary>
+double Aggregate_Median(const Aggregate *aggregate);
+
+/// <summary>
+/// The index'th configured percentile: the nearest rank, percentile * (count - 1) rounded,
+/// in sorted order.
+/// </summary>
+double Aggregate_Percentile(const Aggregate *aggregate, size_t index);
@@ -0,0 +1,840 @@
+#include <errno.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+
+// applibs_versions.h defines the API struct versions to use for applibs APIs.
+#include "applibs_versions.h"
+#include <applibs/i2c.h>
+#include <applibs/log.h>
+
+#include "eventloop_timer_utilities.h"
+#include "i2c_registers.h"
+#include "log_utils.h"
+#include "loop_profiler.h"
+#include "sample_ring.h"
+#include "sampling_controller.h"
+
+#include "barometer_driver.h"
+#include "bmp180.h"
+#include "bmp280.h"
+#include "bmp388.h"
+
+#include "barometer.h"
+
+// Set to 1 (the BAROMETER_SAMPLING_THREAD CMake option) to run all sensor I/O on a
+// dedicated thread paced with clock_nanosleep, so that slow I2C transactions and conversion
+// waits never hold up the event loop. Otherwise the event loop's timers drive the sensor.
+#ifndef BAROMETER_SAMPLING_THREAD
+#define BAROMETER_SAMPLING_THREAD 0
+#endif
+
+// Backends in detection order, and the addresses each is tried at (all of these Bosch
+// parts answer at 0x77 or, with SDO pulled low, 0x76)
+static const BarometerDriver *const drivers[] = { &Bmp180_Driver, &Bmp280_Driver, &Bmp388_Driver };
+static const I2C_DeviceAddress driverAddresses[] = { 0x77, 0x76 };
+
+// While no sensor is answering, detection is retried with exponential backoff
+static const uint32_t initialProbeBackoffMilliseconds = 250;
+static const uint32_t maximumProbeBackoffMilliseconds = 60 * 1000;
+
+// After this many consecutive failed polls the sensor is treated as lost: the bus is
+// reopened and the sensor re-probed
+#define MAX_CONSECUTIVE_POLL_FAILURES 5
+
+// Physical limits of the supported sensors; anything outside is a corrupted read
+static const int32_t minimumPressure = 30000;     // Pa
+static const int32_t maximumPressure = 110000;    // Pa
+static const int32_t minimumTemperature = -400;   // 0.1 degrees C
+static const int32_t maximumTemperature = 850;    // 0.1 degrees C
+
+// Precision wanted from each one-minute mean; drivers with selectable oversampling are
+// run at the cheapest oversampling and sample rate predicted to meet it
+static const double targetStandardErrorPascals = 0.5;
+
+// Largest batch taken from the sensor in one read; a full BMP388 FIFO is 73 frames
+#define BAROMETER_BATCH_CAPACITY 80
+
+// The sampling thread sleeps in slices no longer than this, so it notices a stop request
+static const int64_t maximumSleepNanoseconds = 100ll * 1000 * 1000;
+
+// Interval between loop blocking reports
+static const int64_t blockingReportInterval = 60ll * 1000 * 1000 * 1000;
+
+// Everything from here to the rings belongs to the sampling side: the event loop's timer
+// handlers, or the sampling thread
+
+static struct {
+    int64_t startNanoseconds;
+    int64_t totalNanoseconds;
+    int64_t maxNanoseconds;
+    uint32_t handlerCalls;
+    uint32_t skippedPolls;
+
+    // Poll timing jitter: how far each interval between poll starts is from the nominal one
+    int64_t previousPollNanoseconds; // 0 after an interval change or a sensor loss
+    int64_t jitterTotalNanoseconds;
+    int64_t jitterMaxNanoseconds;
+    uint32_t jitterIntervals;
+} blockingStats;
+static BarometerSample batch[BAROMETER_BATCH_CAPACITY];
+
+static const BarometerDriver *activeDriver = NULL;
+static uint32_t pollIntervalMilliseconds = 0;
+static uint32_t samplesPerMinute = 0;
+static bool pollInProgress = false;
+static uint32_t consecutivePollFailures = 0;
+static uint32_t probeBackoffMilliseconds = 0;
+static bool sensorWasLost = false;
+
+static SamplingController samplingController;
+static bool samplingControlled = false;
+static bool samplingChangePending = false;
+
+// File descriptors - initialized to invalid value
+static int i2cFd = -1;
+
+static EventLoopTimer* i2cTimer = NULL;
+static EventLoopTimer* conversionTimer = NULL;
+static EventLoopTimer* probeTimer = NULL;
+
+static pthread_t samplingThread;
+static bool samplingThreadStarted = false;
+static atomic_bool stopSampling = false;
+
+// Shared between the two sides. Samples pass through SPSC rings; the rest is published one
+// atomic value at a time, so neither side ever waits for the other.
+#define PRESSURE_RING_CAPACITY 128
+static Sample pressureRingStorage[PRESSURE_RING_CAPACITY];
+static SampleRing pressureRing;
+#define TEMPERATURE_RING_CAPACITY 128
+static Sample temperatureRingStorage[TEMPERATURE_RING_CAPACITY];
+static SampleRing temperatureRing;
+
+static _Atomic uint32_t publishedSamplesPerMinute = 0;
+static _Atomic uint32_t publishedIntervalMilliseconds = 0;
+static _Atomic int32_t publishedOversampling = -1;
+static _Atomic uint32_t publishedNoiseMicropascals = 0;
+static _Atomic uint32_t publishedSamplingChanges = 0;
+
+static struct {
+    _Atomic uint32_t busErrors;
+    _Atomic uint32_t sensorLosses;
+    _Atomic uint32_t recoveries;
+    _Atomic uint32_t probeAttempts;
+    atomic_bool connected;
+} health;
+
+// In thread mode the sampling thread signals this eventfd when it has pushed samples
+static int samplesReadyFd = -1;
+static EventRegistration *samplesReadyRegistration = NULL;
+
+// Event loop side
+static datablock_t* dataBlock = NULL;
+static EventLoop* eventLoop = NULL; // not owned
+
+static int64_t GetMonotonicNanoseconds(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (int64_t)now.tv_sec * 1000 * 1000 * 1000 + now.tv_nsec;
+}
+
+/// <summary>
+///     Accumulates how long the I2C handlers held the event loop (or the sampling thread),
+///     and logs a summary once per reporting period.
+/// </summary>
+static void RecordLoopBlockingTime(int64_t startNanoseconds)
+{
+    int64_t now = GetMonotonicNanoseconds();
+    int64_t elapsed = now - startNanoseconds;
+    blockingStats.totalNanoseconds += elapsed;
+    if (elapsed > blockingStats.maxNanoseconds) {
+        blockingStats.maxNanoseconds = elapsed;
+    }
+    blockingStats.handlerCalls++;
+
+    if (now - blockingStats.startNanoseconds >= blockingReportInterval) {
+        Log_Debug("Barometer %s blocking: %u calls, avg %lld us, max %lld us, %u skipped polls\n",
+                  BAROMETER_SAMPLING_THREAD ? "thread" : "loop", blockingStats.handlerCalls,
+                  (long long)(blockingStats.totalNanoseconds / blockingStats.handlerCalls / 1000),
+                  (long long)(blockingStats.maxNanoseconds / 1000), blockingStats.skippedPolls);
+        if (blockingStats.jitterIntervals != 0) {
+            Log_Debug("Barometer poll jitter: avg %lld us, max %lld us over %u intervals\n",
+                      (long long)(blockingStats.jitterTotalNanoseconds / blockingStats.jitterIntervals / 1000),
+                      (long long)(blockingStats.jitterMaxNanoseconds / 1000), blockingStats.jitterIntervals);
+        }
+        int64_t previousPoll = blockingStats.previousPollNanoseconds;
+        memset(&blockingStats, 0, sizeof(blockingStats));
+        blockingStats.startNanoseconds = now;
+        blockingStats.previousPollNanoseconds = previousPoll;
+
+        I2cRegisterStats busStats;
+        I2cRegisters_GetStats(&busStats);
+        Log_Debug("Barometer I2C: %u transactions (%u failed), %u bytes read, %u bytes written\n",
+                  busStats.transactions, busStats.failures, busStats.bytesRead,
+                  busStats.bytesWritten);
+        I2cRegisters_ResetStats();
+    }
+}
+
+/// <summary>
+///     Record when a poll started, for the jitter figures.
+/// </summary>
+static void RecordPollStart(int64_t now)
+{
+    if (blockingStats.previousPollNanoseconds != 0) {
+        int64_t jitter = now - blockingStats.previousPollNanoseconds - pollIntervalMilliseconds * 1000000ll;
+        if (jitter < 0) {
+            jitter = -jitter;
+        }
+        blockingStats.jitterTotalNanoseconds += jitter;
+        if (jitter > blockingStats.jitterMaxNanoseconds) {
+            blockingStats.jitterMaxNanoseconds = jitter;
+        }
+        blockingStats.jitterIntervals++;
+    }
+    blockingStats.previousPollNanoseconds = now;
+}
+
+/// <summary>
+///     Make the current sampling setup visible to the windows.
+/// </summary>
+static void PublishSamplingState(void)
+{
+    atomic_store_explicit(&publishedSamplesPerMinute, samplesPerMinute, memory_order_relaxed);
+    atomic_store_explicit(&publishedIntervalMilliseconds, pollIntervalMilliseconds, memory_order_relaxed);
+    atomic_store_explicit(&publishedOversampling,
+                          samplingControlled ? (int32_t)samplingController.setting.oversampling : -1,
+                          memory_order_relaxed);
+    atomic_store_explicit(&publishedNoiseMicropascals,
+                          samplingControlled ? (uint32_t)(samplingController.noisePascals * 1e6) : 0,
+                          memory_order_relaxed);
+}
+
+static void SetPollInterval(uint32_t milliseconds)
+{
+    pollIntervalMilliseconds = milliseconds;
+    blockingStats.previousPollNanoseconds = 0;
+    if (BAROMETER_SAMPLING_THREAD) {
+        // The thread paces itself from pollIntervalMilliseconds
+        return;
+    }
+
+    const struct timespec pollingInterval = { .tv_sec = milliseconds / 1000,
+                                              .tv_nsec = (milliseconds % 1000) * 1000 * 1000 };
+    if (SetEventLoopTimerPeriod(i2cTimer, &pollingInterval) != 0) {
+        LogErrno("ERROR: could not set the barometer polling interval");
+    }
+}
+
+/// <summary>
+///     Apply the sampling controller's latest decision. Only called between polls, so a
+///     conversion never straddles two settings.
+/// </summary>
+static void ApplySamplingSetting(void)
+{
+    SamplingSetting setting = samplingController.setting;
+    activeDriver->setOversampling(setting.oversampling);
+    SetPollInterval(setting.intervalMilliseconds);
+    samplesPerMinute = 60000 / setting.intervalMilliseconds;
+    PublishSamplingState();
+    atomic_fetch_add_explicit(&publishedSamplingChanges, 1, memory_order_relaxed);
+    samplingChangePending = false;
+
+    Log_Debug("Barometer sampling: noise %.2f Pa, now oversampling %u every %u ms (%.0f ms/min of conversion and bus time)\n",
+              samplingController.noisePascals, setting.oversampling, setting.intervalMilliseconds,
+              SamplingController_Cost(&samplingController, setting));
+}
+
+/// <summary>
+///     Probe each backend at each address and configure the first one that answers.
+/// </summary>
+static bool DetectSensor(void)
+{
+    for (size_t i = 0; i < sizeof(drivers) / sizeof(drivers[0]); i++) {
+        for (size_t j = 0; j < sizeof(driverAddresses) / sizeof(driverAddresses[0]); j++) {
+            const BarometerDriver *driver = drivers[i];
+            if (!driver->probe(i2cFd, driverAddresses[j])) {
+                continue;
+            }
+            if (!driver->configure(i2cFd, driverAddresses[j])) {
+                Log_Debug("ERROR: found a %s at 0x%02x but could not configure it\n", driver->name,
+                          driverAddresses[j]);
+                continue;
+            }
+
+            Log_Debug("Found a %s at 0x%02x\n", driver->name, driverAddresses[j]);
+            activeDriver = driver;
+            consecutivePollFailures = 0;
+            atomic_store_explicit(&health.connected, true, memory_order_relaxed);
+            samplesPerMinute = driver->samplesPerMinute;
+            SetPollInterval(driver->pollIntervalMilliseconds);
+
+            samplingControlled = driver->oversamplingModeCount != 0;
+            samplingChangePending = false;
+            if (samplingControlled) {
+                const SamplingControllerConfig config = {
+                    .modeCount = driver->oversamplingModeCount,
+                    .noisePascals = driver->oversamplingNoisePascals,
+                    .conversionMilliseconds = driver->oversamplingConversionMilliseconds,
+                    .targetStandardErrorPascals = targetStandardErrorPascals };
+                const SamplingSetting initial = { .oversampling = driver->defaultOversampling,
+                                                  .intervalMilliseconds = driver->pollIntervalMilliseconds };
+                SamplingController_Init(&samplingController, &config, initial);
+                driver->setOversampling(driver->defaultOversampling);
+            }
+            PublishSamplingState();
+            return true;
+        }
+    }
+    return false;
+}
+
+/// <summary>
+///     Move samples from the rings into the active window. Runs on the event loop.
+/// </summary>
+static void DrainSamples(void)
+{
+    PressureWindow *window = DataBlock_ActivePressureWindow(dataBlock);
+    Sample sample;
+    while (SampleRing_Pop(&pressureRing, &sample)) {
+        if (sample.quality == SampleQuality_Good) {
+            Aggregate_Add(&window->samples, sample.value);
+        }
+        else {
+            window->rejectedSamples[sample.quality]++;
+        }
+    }
+
+    uint32_t samplesPerMinuteNow = atomic_load_explicit(&publishedSamplesPerMinute, memory_order_relaxed);
+    if (window->samplesPerMinute == 0 || samplesPerMinuteNow < window->samplesPerMinute) {
+        window->samplesPerMinute = samplesPerMinuteNow;
+    }
+    window->sampleIntervalMilliseconds = atomic_load_explicit(&publishedIntervalMilliseconds, memory_order_relaxed);
+    window->oversampling = atomic_load_explicit(&publishedOversampling, memory_order_relaxed);
+    window->noisePascals = atomic_load_explicit(&publishedNoiseMicropascals, memory_order_relaxed) / 1e6;
+    window->samplingChanges += atomic_exchange_explicit(&publishedSamplingChanges, 0, memory_order_relaxed);
+
+    while (SampleRing_Pop(&temperatureRing, &sample)) {
+        if (sample.quality == SampleQuality_Good) {
+            Aggregate_Add(&window->temperature, sample.value / 10.0);
+        }
+    }
+}
+
+static void SamplesReadyEventHandler(EventLoop *el, int fd, EventLoop_IoEvents events, void *context)
+{
+    uint64_t count;
+    if (read(fd, &count, sizeof(count)) == -1 && errno != EAGAIN) {
+        LogErrno("ERROR: could not read the barometer samples eventfd");
+    }
+
+    DrainSamples();
+}
+
+LOOP_PROFILER_IO_CALLBACK(ProfiledSamplesReadyEventHandler, SamplesReadyEventHandler, "barometer_samples")
+
+/// <summary>
+///     Hand what the sampling side has pushed to the event loop: directly when the event
+///     loop is the sampling side, otherwise by waking it.
+/// </summary>
+static void PublishSamples(void)
+{
+    if (samplingControlled) {
+        PublishSamplingState();
+    }
+
+    if (BAROMETER_SAMPLING_THREAD) {
+        static const uint64_t one = 1;
+        if (write(samplesReadyFd, &one, sizeof(one)) == -1 && errno != EAGAIN) {
+            LogErrno("ERROR: could not signal the barometer samples eventfd");
+        }
+    }
+    else {
+        DrainSamples();
+    }
+}
+
+static void ArmConversionTimer(uint32_t milliseconds)
+{
+    const struct timespec conversionTime = { .tv_sec = milliseconds / 1000,
+                                             .tv_nsec = (milliseconds % 1000) * 1000 * 1000 };
+    pollInProgress = SetEventLoopTimerOneShot(conversionTimer, &conversionTime) == 0;
+}
+
+static void PushPressureSample(int64_t timestampNanoseconds, int32_t pressure, SampleQuality quality)
+{
+    const Sample sample = { .timestampNanoseconds = timestampNanoseconds, .value = pressure, .quality = quality };
+    if (!SampleRing_Push(&pressureRing, &sample)) {
+        Log_Debug("WARNING: pressure sample ring overflowed (%u samples lost)\n", SampleRing_Overflows(&pressureRing));
+    }
+}
+
+static void ScheduleProbe(void)
+{
+    if (BAROMETER_SAMPLING_THREAD) {
+        // The thread waits out probeBackoffMilliseconds itself
+        return;
+    }
+
+    const struct timespec delay = { .tv_sec = probeBackoffMilliseconds / 1000,
+                                    .tv_nsec = (probeBackoffMilliseconds % 1000) * 1000 * 1000 };
+    if (SetEventLoopTimerOneShot(probeTimer, &delay) != 0) {
+        LogErrno("ERROR: could not schedule a barometer probe");
+    }
+}
+
+static bool OpenBus(void);
+
+/// <summary>
+///     Stop polling a sensor that has stopped answering, reset the bus and start probing
+///     for it again.
+/// </summary>
+static void SensorLost(void)
+{
+    Log_Debug("ERROR: %s stopped responding (%d: %s), reopening the I2C bus\n", activeDriver->name,
+              errno, strerror(errno));
+    atomic_fetch_add_explicit(&health.sensorLosses, 1, memory_order_relaxed);
+    atomic_store_explicit(&health.connected, false, memory_order_relaxed);
+    sensorWasLost = true;
+
+    activeDriver = NULL;
+    samplingControlled = false;
+    pollInProgress = false;
+    consecutivePollFailures = 0;
+    blockingStats.previousPollNanoseconds = 0;
+    if (!BAROMETER_SAMPLING_THREAD) {
+        DisarmEventLoopTimer(i2cTimer);
+        DisarmEventLoopTimer(conversionTimer);
+    }
+
+    // Closing the master resets the ISU's I2C state machine; it is reopened by the probe
+    CloseFdAndLogOnError(i2cFd, "I2C");
+    i2cFd = -1;
+
+    probeBackoffMilliseconds = initialProbeBackoffMilliseconds;
+    ScheduleProbe();
+}
+
+/// <summary>
+///     Account for a poll that failed on the bus; the missing sample is recorded so the
+///     gap shows up in the window's quality counts.
+/// </summary>
+static void PollFailed(int64_t now)
+{
+    atomic_fetch_add_explicit(&health.busErrors, 1, memory_order_relaxed);
+    PushPressureSample(now, 0, SampleQuality_BusError);
+    PublishSamples();
+
+    if (++consecutivePollFailures >= MAX_CONSECUTIVE_POLL_FAILURES) {
+        SensorLost();
+    }
+}
+
+/// <summary>
+///     Take whatever the sensor has ready and pass it on to the windows.
+/// </summary>
+/// <returns>Milliseconds to wait before the poll's next step, 0 once the poll is finished,
+/// or -1 if it failed.</returns>
+static int CollectSamples(int64_t now)
+{
+    uint32_t continueAfterMilliseconds = 0;
+    int count = activeDriver->readBatch(batch, BAROMETER_BATCH_CAPACITY, now, &continueAfterMilliseconds);
+    if (count < 0) {
+        PollFailed(now);
+        return -1;
+    }
+    consecutivePollFailures = 0;
+
+    for (int i = 0; i < count; i++) {
+        if (batch[i].hasPressure) {
+            SampleQuality quality = batch[i].quality;
+            if (quality == SampleQuality_Good &&
+                (batch[i].pressure < minimumPressure || batch[i].pressure > maximumPressure)) {
+                quality = SampleQuality_OutOfRange;
+            }
+            if (quality == SampleQuality_Good && samplingControlled &&
+                SamplingController_Add(&samplingController, batch[i].pressure)) {
+                samplingChangePending = true;
+            }
+            PushPressureSample(batch[i].timestampNanoseconds, batch[i].pressure, quality);
+        }
+        if (batch[i].hasTemperature) {
+            SampleQuality quality = batch[i].quality;
+            if (quality == SampleQuality_Good &&
+                (batch[i].temperature < minimumTemperature || batch[i].temperature > maximumTemperature)) {
+                quality = SampleQuality_OutOfRange;
+            }
+            const Sample sample = { .timestampNanoseconds = batch[i].timestampNanoseconds,
+                                    .value = batch[i].temperature,
+                                    .quality = quality };
+            SampleRing_Push(&temperatureRing, &sample);
+        }
+    }
+    PublishSamples();
+
+    if (continueAfterMilliseconds != 0) {
+        return (int)continueAfterMilliseconds;
+    }
+    if (samplingChangePending) {
+        ApplySamplingSetting();
+    }
+    return 0;
+}
+
+/// <summary>
+///     Probe for a sensor, reopening the bus first if it was reset, and update the backoff
+///     for the next attempt.
+/// </summary>
+static bool ProbeSensor(void)
+{
+    atomic_fetch_add_explicit(&health.probeAttempts, 1, memory_order_relaxed);
+    if ((i2cFd != -1 || OpenBus()) && DetectSensor()) {
+        if (sensorWasLost) {
+            atomic_fetch_add_explicit(&health.recoveries, 1, memory_order_relaxed);
+            sensorWasLost = false;
+        }
+        probeBackoffMilliseconds = initialProbeBackoffMilliseconds;
+        return true;
+    }
+
+    probeBackoffMilliseconds *= 2;
+    if (probeBackoffMilliseconds > maximumProbeBackoffMilliseconds) {
+        probeBackoffMilliseconds = maximumProbeBackoffMilliseconds;
+    }
+    return false;
+}
+
+static void ConversionTimerEventHandler(EventLoopTimer* timer)
+{
+    int64_t start = GetMonotonicNanoseconds();
+
+    if (ConsumeEventLoopTimerEvent(timer) != 0) {
+        LogErrno("ERROR: cannot consume the timer event");
+        return;
+    }
+
+    if (activeDriver != NULL) {
+        int delay = CollectSamples(start);
+        if (delay > 0) {
+            ArmConversionTimer((uint32_t)delay);
+        }
+        else {
+            pollInProgress = false;
+        }
+    }
+
+    RecordLoopBlockingTime(start);
+}
+
+static void I2cTimerEventHandler(EventLoopTimer* timer)
+{
+    int64_t start = GetMonotonicNanoseconds();
+
+    uint64_t expirations;
+    if (ConsumeEventLoopTimerEventCount(timer, &expirations) != 0) {
+        LogErrno("ERROR: cannot consume the timer event");
+        return;
+    }
+    // Polls the loop was too busy to dispatch. The sensor only holds its latest result, so
+    // they can't be caught up, but they are counted so the gap is visible.
+    blockingStats.skippedPolls += (uint32_t)(expirations - 1);
+
+    if (pollInProgress) {
+        // The previous poll hasn't finished yet, most likely because the loop stalled
+        blockingStats.skippedPolls++;
+        return;
+    }
+
+    if (activeDriver == NULL) {
+        // Polling stops when the sensor is lost, but a tick may already have been pending
+        return;
+    }
+    RecordPollStart(start);
+
+    // Kick off the poll; anything that has to wait for the sensor runs from the
+    // conversion timer so the event loop never sleeps
+    int delay = activeDriver->start(start);
+    if (delay == 0) {
+        delay = CollectSamples(start);
+    }
+    else if (delay < 0) {
+        PollFailed(start);
+    }
+    if (delay > 0) {
+        ArmConversionTimer((uint32_t)delay);
+    }
+
+    RecordLoopBlockingTime(start);
+}
+
+static void ProbeTimerEventHandler(EventLoopTimer* timer)
+{
+    int64_t start = GetMonotonicNanoseconds();
+
+    if (ConsumeEventLoopTimerEvent(timer) != 0) {
+        LogErrno("ERROR: cannot consume the timer event");
+        return;
+    }
+
+    if (!ProbeSensor()) {
+        ScheduleProbe();
+    }
+
+    RecordLoopBlockingTime(start);
+}
+
+/// <summary>
+///     Sleep on the sampling thread until an absolute CLOCK_MONOTONIC time, waking
+///     periodically to check for a stop request.
+/// </summary>
+/// <returns>false if the thread has been asked to stop.</returns>
+static bool SleepUntil(int64_t deadlineNanoseconds)
+{
+    for (;;) {
+        if (atomic_load_explicit(&stopSampling, memory_order_relaxed)) {
+            return false;
+        }
+
+        int64_t now = GetMonotonicNanoseconds();
+        if (now >= deadlineNanoseconds) {
+            return true;
+        }
+
+        int64_t wakeNanoseconds = deadlineNanoseconds - now > maximumSleepNanoseconds
+                                      ? now + maximumSleepNanoseconds
+                                      : deadlineNanoseconds;
+        const struct timespec wake = { .tv_sec = (time_t)(wakeNanoseconds / 1000000000),
+                                       .tv_nsec = (long)(wakeNanoseconds % 1000000000) };
+        int result = clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &wake, NULL);
+        if (result != 0 && result != EINTR) {
+            errno = result;
+            LogErrno("ERROR: barometer sampling thread could not sleep");
+            return false;
+        }
+    }
+}
+
+/// <summary>
+///     One complete poll on the sampling thread, sleeping through the sensor's conversion
+///     time wherever the event loop version would arm the conversion timer.
+/// </summary>
+static void PollOnThread(int64_t start)
+{
+    int delay = activeDriver->start(start);
+    if (delay < 0) {
+        PollFailed(start);
+        return;
+    }
+
+    int64_t now = start;
+    while (delay >= 0) {
+        if (delay > 0) {
+            if (!SleepUntil(now + delay * 1000000ll)) {
+                return;
+            }
+            now = GetMonotonicNanoseconds();
+        }
+        delay = CollectSamples(now);
+        if (delay == 0) {
+            return;
+        }
+    }
+}
+
+static void *SamplingThreadMain(void *unused)
+{
+    int64_t deadline = GetMonotonicNanoseconds();
+    while (!atomic_load_explicit(&stopSampling, memory_order_relaxed)) {
+        if (activeDriver == NULL) {
+            if (!SleepUntil(GetMonotonicNanoseconds() + probeBackoffMilliseconds * 1000000ll)) {
+                break;
+            }
+            int64_t start = GetMonotonicNanoseconds();
+            ProbeSensor();
+            RecordLoopBlockingTime(start);
+            deadline = GetMonotonicNanoseconds();
+            continue;
+        }
+
+        if (!SleepUntil(deadline)) {
+            break;
+        }
+        int64_t start = GetMonotonicNanoseconds();
+        RecordPollStart(start);
+        PollOnThread(start);
+        RecordLoopBlockingTime(start);
+
+        // Pace from the schedule rather than from when the poll finished, so the interval
+        // doesn't drift; polls that were overrun are skipped, not run back to back
+        int64_t interval = pollIntervalMilliseconds * 1000000ll;
+        deadline += interval;
+        int64_t now = GetMonotonicNanoseconds();
+        if (deadline <= now) {
+            int64_t missed = (now - deadline) / interval + 1;
+            blockingStats.skippedPolls += (uint32_t)missed;
+            deadline += missed * interval;
+        }
+    }
+
+    return NULL;
+}
+
+/// <summary>
+///     Reopen the I2C master after a sensor loss. On failure the bus is left closed so the
+///     next probe starts from scratch.
+/// </summary>
+static bool OpenBus(void)
+{
+    i2cFd = I2CMaster_Open(SEEED_MT3620_MDB_J1J2_ISU1_I2C);
+    if (i2cFd == -1) {
+        Log_Debug("ERROR: I2CMaster_Open: errno=%d (%s)\n", errno, strerror(errno));
+        return false;
+    }
+
+    if (I2CMaster_SetBusSpeed(i2cFd, I2C_BUS_SPEED_STANDARD) != 0 || I2CMaster_SetTimeout(i2cFd, 100) != 0) {
+        Log_Debug("ERROR: could not configure the I2C master: errno=%d (%s)\n", errno, strerror(errno));
+        CloseFdAndLogOnError(i2cFd, "I2C");
+        i2cFd = -1;
+        return false;
+    }
+    return true;
+}
+
+void Barometer_GetStats(BarometerStats *statsOut)
+{
+    statsOut->busErrors = atomic_load_explicit(&health.busErrors, memory_order_relaxed);
+    statsOut->sensorLosses = atomic_load_explicit(&health.sensorLosses, memory_order_relaxed);
+    statsOut->recoveries = atomic_load_explicit(&health.recoveries, memory_order_relaxed);
+    statsOut->probeAttempts = atomic_load_explicit(&health.probeAttempts, memory_order_relaxed);
+    statsOut->connected = atomic_load_explicit(&health.connected, memory_order_relaxed);
+}
+
+/// <summary>
+///     Set up the event loop timers that drive the sensor when there is no sampling thread.
+/// </summary>
+static ExitCode CreateSamplingTimers(void)
+{
+    conversionTimer = CreateEventLoopDisarmedTimer(eventLoop, &ConversionTimerEventHandler);
+    if (conversionTimer == NULL) {
+        return ExitCode_BarometerInit_ConversionTimer;
+    }
+    SetEventLoopTimerName(conversionTimer, "barometer_conversion");
+
+    // Armed with the sensor's poll interval once one is detected
+    i2cTimer = CreateEventLoopDisarmedTimer(eventLoop, &I2cTimerEventHandler);
+    if (i2cTimer == NULL) {
+        return ExitCode_BarometerInit_PollTimer;
+    }
+    SetEventLoopTimerName(i2cTimer, "barometer_poll");
+
+    probeTimer = CreateEventLoopDisarmedTimer(eventLoop, &ProbeTimerEventHandler);
+    if (probeTimer == NULL) {
+        return ExitCode_BarometerInit_ProbeTimer;
+    }
+    SetEventLoopTimerName(probeTimer, "barometer_probe");
+    return ExitCode_Success;
+}
+
+/// <summary>
+///     Set up the eventfd the sampling thread wakes the event loop with. The thread itself
+///     is started once the sensor has been probed.
+/// </summary>
+static ExitCode CreateSamplesReadyEvent(void)
+{
+    samplesReadyFd = eventfd(0, EFD_NONBLOCK);
+    if (samplesReadyFd == -1) {
+        LogErrno("ERROR: could not create the barometer samples eventfd");
+        return ExitCode_BarometerInit_EventFd;
+    }
+
+    samplesReadyRegistration = EventLoop_RegisterIo(eventLoop, samplesReadyFd, EventLoop_Input,
+                                                    ProfiledSamplesReadyEventHandler, NULL);
+    if (samplesReadyRegistration == NULL) {
+        LogErrno("ERROR: could not register the barometer samples eventfd");
+        return ExitCode_BarometerInit_RegisterIo;
+    }
+    return ExitCode_Success;
+}
+
+ExitCode Barometer_Init(EventLoop* eventLoopInstance, datablock_t* dataBlockInstance)
+{
+    eventLoop = eventLoopInstance;
+    dataBlock = dataBlockInstance;
+
+    SampleRing_Init(&pressureRing, pressureRingStorage, PRESSURE_RING_CAPACITY, SampleRingOverflow_DropOldest);
+    SampleRing_Init(&temperatureRing, temperatureRingStorage, TEMPERATURE_RING_CAPACITY, SampleRingOverflow_DropOldest);
+    blockingStats.startNanoseconds = GetMonotonicNanoseconds();
+
+    static const double pressurePercentiles[] = { 0.1, 0.9 };
+    for (size_t i = 0; i < 2; i++) {
+        Aggregate_Init(&dataBlock->pressure[i].samples, pressurePercentiles, sizeof(pressurePercentiles) / sizeof(pressurePercentiles[0]),
+                       dataBlock->pressure[i].sampleStorage, PRESSURE_WINDOW_CAPACITY);
+        Aggregate_Init(&dataBlock->pressure[i].temperature, NULL, 0, NULL, 0);
+    }
+
+    i2cFd = I2CMaster_Open(SEEED_MT3620_MDB_J1J2_ISU1_I2C);
+    if (i2cFd == -1) {
+        Log_Debug("ERROR: I2CMaster_Open: errno=%d (%s)\n", errno, strerror(errno));
+        return ExitCode_Init_OpenMaster;
+    }
+
+    int result = I2CMaster_SetBusSpeed(i2cFd, I2C_BUS_SPEED_STANDARD);
+    if (result != 0) {
+        Log_Debug("ERROR: I2CMaster_SetBusSpeed: errno=%d (%s)\n", errno, strerror(errno));
+        return ExitCode_Init_SetBusSpeed;
+    }
+
+    result = I2CMaster_SetTimeout(i2cFd, 100);
+    if (result != 0) {
+        Log_Debug("ERROR: I2CMaster_SetTimeout: errno=%d (%s)\n", errno, strerror(errno));
+        return ExitCode_Init_SetTimeout;
+    }
+
+    ExitCode exitCode = BAROMETER_SAMPLING_THREAD ? CreateSamplesReadyEvent() : CreateSamplingTimers();
+    if (exitCode != ExitCode_Success) {
+        return exitCode;
+    }
+
+    if (!DetectSensor()) {
+        Log_Debug("Error: could not find a barometric sensor, will retry\n");
+        probeBackoffMilliseconds = initialProbeBackoffMilliseconds;
+        ScheduleProbe();
+    }
+
+    if (BAROMETER_SAMPLING_THREAD) {
+        // From here on only the thread touches the bus and the sampling state
+        if (pthread_create(&samplingThread, NULL, SamplingThreadMain, NULL) != 0) {
+            Log_Debug("ERROR: Could not start the barometer sampling thread\n");
+            return ExitCode_BarometerInit_Thread;
+        }
+        samplingThreadStarted = true;
+    }
+
+    return ExitCode_Success;
+}
+
+void Barometer_Fini(void)
+{
+    if (samplingThreadStarted) {
+        atomic_store(&stopSampling, true);
+        pthread_join(samplingThread, NULL);
+        samplingThreadStarted = false;
+    }
+    if (samplesReadyRegistration != NULL) {
+        EventLoop_UnregisterIo(eventLoop, samplesReadyRegistration);
+    }
+    CloseFdAndLogOnError(samplesReadyFd, "Barometer eventfd");
+
+    DisposeEventLoopTimer(probeTimer);
+    DisposeEventLoopTimer(i2cTimer);
+    DisposeEventLoopTimer(conversionTimer);
+
+    Log_Debug("Closing file descriptors.\n");
+    CloseFdAndLogOnError(i2cFd, "I2C");
+}
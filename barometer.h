@@ -0,0 +1,30 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include <applibs/eventloop.h>
+#include "main.h"
+
+/// <summary>
+/// Counters describing how reliably the barometric sensor has been answering.
+/// </summary>
+typedef struct BarometerStats {
+    uint32_t busErrors;     // polls that failed on the I2C bus
+    uint32_t sensorLosses;  // times the sensor stopped answering and the bus was reset
+    uint32_t recoveries;    // times a lost sensor was found again
+    uint32_t probeAttempts; // detection attempts made after start-up
+    bool connected;
+} BarometerStats;
+
+/// <summary>
+/// Open the I2C bus, detect which barometric sensor is attached and start sampling it
+/// into the data block's pressure windows.
+/// </summary>
+ExitCode Barometer_Init(EventLoop* eventLoopInstance, datablock_t* dataBlockInstance);
+void Barometer_Fini(void);
+
+/// <summary>
+/// Copy the sensor health counters accumulated since start-up.
+/// </summary>
+void Barometer_GetStats(BarometerStats *stats);
@@ -0,0 +1,80 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// applibs_versions.h defines the API struct versions to use for applibs APIs.
+#include "applibs_versions.h"
+#include <applibs/i2c.h>
+
+#include "sample_ring.h"
+
+/// <summary>
+/// One compensated result from a barometric sensor. A sensor may return pressure and
+/// temperature together or separately.
+/// </summary>
+typedef struct BarometerSample {
+    int64_t timestampNanoseconds; // CLOCK_MONOTONIC time the measurement was taken
+    int32_t pressure;             // Pa
+    int32_t temperature;          // 0.1 degrees C
+    bool hasPressure;
+    bool hasTemperature;
+    SampleQuality quality; // drivers flag stale results; range checks are done centrally
+} BarometerSample;
+
+/// <summary>
+/// Operations a barometric sensor backend provides. The generic layer in barometer.c
+/// probes each backend in turn, configures the first one that answers and then drives it
+/// from the event loop: start() once per poll, then readBatch() after the delay start()
+/// asked for, and again for as long as readBatch() asks to continue.
+///
+/// Functions that touch the bus return -1 (or false) on an I2C failure, with errno set.
+/// </summary>
+typedef struct BarometerDriver {
+    const char *name;
+
+    // Interval between polls, and the number of samples the sensor delivers per minute
+    // at that rate
+    uint32_t pollIntervalMilliseconds;
+    uint32_t samplesPerMinute;
+
+    // Drivers that take one sample per poll and whose oversampling is chosen per
+    // conversion can hand both to the adaptive sampling controller. The tables give the
+    // RMS noise and conversion time of each mode, from the datasheet. Zero modes means
+    // the chip's configuration is fixed.
+    uint8_t oversamplingModeCount;
+    uint8_t defaultOversampling;
+    const double *oversamplingNoisePascals;
+    const uint8_t *oversamplingConversionMilliseconds;
+
+    /// <summary>Check the chip id at the given address.</summary>
+    bool (*probe)(int i2cFd, I2C_DeviceAddress address);
+
+    /// <summary>
+    /// Read the calibration data and put the chip into its measurement configuration.
+    /// Only called after a successful probe at the same address.
+    /// </summary>
+    bool (*configure)(int i2cFd, I2C_DeviceAddress address);
+
+    /// <summary>
+    /// Change the oversampling mode for subsequent conversions. Only called between polls,
+    /// and only if oversamplingModeCount is nonzero.
+    /// </summary>
+    void (*setOversampling)(uint8_t mode);
+
+    /// <summary>
+    /// Begin a poll.
+    /// </summary>
+    /// <returns>Milliseconds to wait before calling readBatch, or -1.</returns>
+    int (*start)(int64_t nowNanoseconds);
+
+    /// <summary>
+    /// Collect whatever the sensor has ready.
+    /// </summary>
+    /// <param name="continueAfterMilliseconds">Set to a nonzero delay if the poll has
+    /// another step, in which case readBatch is called again after that delay.</param>
+    /// <returns>The number of samples written, or -1.</returns>
+    int (*readBatch)(BarometerSample *samples, size_t capacity, int64_t nowNanoseconds,
+                     uint32_t *continueAfterMilliseconds);
+} BarometerDriver;
@@ -4,27 +4,22 @@
 #include <errno.h>
 #include <stdbool.h>
 #include <string.h>
-#include <signal.h>
 #include <math.h>
-#include <time.h>
 
 // applibs_versions.h defines the API struct versions to use for applibs APIs.
 #include "applibs_versions.h"
 #include <applibs/i2c.h>
 #include <applibs/log.h>
 
-#include "eventloop_timer_utilities.h"
-#include "log_utils.h"
+#include "i2c_registers.h"
 
 #include "bmp180.h"
 
 #define BMP180_DEBUG 0 // Debug mode
 
-static const uint8_t BMP180_I2CADDR = 0x77; // BMP180 I2C address
+static const uint8_t BMP180_CHIPID_VALUE = 0x55; // Contents of the chip id register
 
-static const uint8_t BMP180_ULTRALOWPOWER = 0; // Ultra low power mode
-static const uint8_t BMP180_STANDARD = 1;      // Standard mode
-static const uint8_t BMP180_HIGHRES = 2;       // High-res mode
+// Oversampling modes run from 0 (ultra low power) through 1 (standard) and 2 (high-res) to
 static const uint8_t BMP180_ULTRAHIGHRES = 3;  // Ultra high-res mode
 
 static const uint8_t BMP180_CAL_AC1 = 0xAA;    // R   Calibration data (16 bits)
@@ -38,60 +33,70 @@ static const uint8_t BMP180_CAL_B2 = 0xB8;     // R   Calibration data (16 bits)
 static const uint8_t BMP180_CAL_MB = 0xBA;     // R   Calibration data (16 bits)
 static const uint8_t BMP180_CAL_MC = 0xBC;     // R   Calibration data (16 bits)
 static const uint8_t BMP180_CAL_MD = 0xBE;     // R   Calibration data (16 bits)
+#define BMP180_CAL_LENGTH 22                   // AC1 through MD, read as one block
 
 static const uint8_t BMP180_CONTROL = 0xF4;         // Control register
 static const uint8_t BMP180_TEMPDATA = 0xF6;        // Temperature data register
-static const uint8_t BMP180_PRESSUREDATA = 0xF6;    // Pressure data register
+static const uint8_t BMP180_PRESSUREDATA = 0xF6;    // Pressure data register (MSB, LSB, XLSB)
+static const uint8_t BMP180_CHIPID = 0xD0;          // Chip id register
 static const uint8_t BMP180_READTEMPCMD = 0x2E;     // Read temperature control register value
 static const uint8_t BMP180_READPRESSURECMD = 0x34; // Read pressure control register value
 
 static int32_t computeB5(int32_t UT);
-static uint8_t read8(uint8_t addr);
-static uint16_t read16(uint8_t addr);
-static void write8(uint8_t addr, uint8_t data);
+static bool readRegisters(uint8_t addr, uint8_t *data, size_t length);
+static bool write8(uint8_t addr, uint8_t data);
 
 static uint8_t oversampling;
-static bool initialized = false;
 
 static int16_t ac1, ac2, ac3, b1, b2, mb, mc, md;
 static uint16_t ac4, ac5, ac6;
 
-// File descriptors - initialized to invalid value
-static int i2cFd = -1;
-
-static datablock_t* dataBlock = NULL;
-static EventLoopTimer* i2cTimer = NULL;
-static EventLoop* eventLoop = NULL; // not owned
-
-uint8_t read8(uint8_t a) {
-    uint8_t ret = 0;
-
-    // send 1 byte, reset i2c, read 1 byte
-    I2CMaster_WriteThenRead(i2cFd, BMP180_I2CADDR, &a, 1, &ret, 1);
-
-    return ret;
+static int i2cFd = -1; // not owned
+static I2C_DeviceAddress i2cAddress = 0;
+
+// Conversion times in milliseconds and RMS pressure noise in Pa, from the datasheet
+static const uint8_t temperatureConversionMilliseconds = 5;
+static const uint8_t pressureConversionMilliseconds[] = { 5, 8, 14, 26 }; // indexed by oversampling
+static const double pressureNoisePascals[] = { 6, 5, 4, 3 };              // indexed by oversampling
+
+typedef enum {
+    ConversionState_Idle,
+    ConversionState_Temperature,
+    ConversionState_Pressure,
+} ConversionState;
+
+static ConversionState conversionState = ConversionState_Idle;
+
+// Temperature changes far more slowly than pressure, so B5 (the temperature term of the
+// pressure compensation) is cached and only refreshed every temperatureRefreshInterval.
+// If the temperature has moved by more than the drift threshold since the previous
+// refresh it is refreshed again on the next sample instead.
+static const int64_t temperatureRefreshInterval = 5ll * 1000 * 1000 * 1000;
+static const int32_t temperatureDriftThreshold = 5; // 0.1 degrees C
+static struct {
+    int32_t b5;
+    int32_t temperature; // 0.1 degrees C
+    int64_t nextRefreshNanoseconds;
+    bool valid;
+} compensation;
+
+// The BMP180 auto-increments the register address, so any run of consecutive registers
+// comes back in a single transaction. On failure errno is left set and data is zeroed.
+bool readRegisters(uint8_t a, uint8_t *data, size_t length) {
+    if (!I2cRegisters_Read(i2cFd, i2cAddress, a, data, length)) {
+        memset(data, 0, length);
+        return false;
+    }
+    return true;
 }
 
-uint16_t read16(uint8_t a) {
-    uint8_t retbuf[2] = {0, 0};
-    uint16_t ret = 0;
-
-    // send 1 byte, reset i2c, read 2 bytes
-    // we could typecast uint16_t as uint8_t array but would need to ensure proper
-    // endianness
-    I2CMaster_WriteThenRead(i2cFd, BMP180_I2CADDR, &a, 1, retbuf, 2);
-
-    // write_then_read uses uint8_t array
-    ret = (uint16_t)(retbuf[1] | (retbuf[0] << 8));
-
-    return ret;
+bool write8(uint8_t a, uint8_t d) {
+    return I2cRegisters_Write8(i2cFd, i2cAddress, a, d);
 }
 
-void write8(uint8_t a, uint8_t d) {
-    const uint8_t sendbuf[2] = {a, d};
-    
-    // send d prefixed with a (a d [stop])
-    I2CMaster_Write(i2cFd, BMP180_I2CADDR, sendbuf, 2);
+// Multi-byte registers are big-endian
+static uint16_t bigEndian16(const uint8_t *bytes) {
+    return (uint16_t)(bytes[0] << 8 | bytes[1]);
 }
 
 static int32_t computeB5(int32_t UT) {
@@ -100,53 +105,40 @@ static int32_t computeB5(int32_t UT) {
     return X1 + X2;
 }
 
-static void delay(int32_t milliseconds) {
-    time_t seconds = milliseconds / 1000;
-    int32_t nanoseconds = (milliseconds % 1000) * 1000 * 1000;
-    struct timespec sleepTime = { .tv_sec = seconds, .tv_nsec = nanoseconds };
-    nanosleep(&sleepTime, NULL);
-}
 
-bool bmp180_begin(uint8_t mode) {
-    if (mode > BMP180_ULTRAHIGHRES)
-        mode = BMP180_ULTRAHIGHRES;
-    oversampling = mode;
+static bool bmp180_probe(int fd, I2C_DeviceAddress address) {
+    i2cFd = fd;
+    i2cAddress = address;
 
-    i2cFd = I2CMaster_Open(SEEED_MT3620_MDB_J1J2_ISU1_I2C);
-    if (i2cFd == -1) {
-        Log_Debug("ERROR: I2CMaster_Open: errno=%d (%s)\n", errno, strerror(errno));
-        return ExitCode_Init_OpenMaster;
-    }
-
-    int result = I2CMaster_SetBusSpeed(i2cFd, I2C_BUS_SPEED_STANDARD);
-    if (result != 0) {
-        Log_Debug("ERROR: I2CMaster_SetBusSpeed: errno=%d (%s)\n", errno, strerror(errno));
-        return ExitCode_Init_SetBusSpeed;
-    }
+    uint8_t chipId = 0;
+    return readRegisters(BMP180_CHIPID, &chipId, 1) && chipId == BMP180_CHIPID_VALUE;
+}
 
-    result = I2CMaster_SetTimeout(i2cFd, 100);
-    if (result != 0) {
-        Log_Debug("ERROR: I2CMaster_SetTimeout: errno=%d (%s)\n", errno, strerror(errno));
-        return ExitCode_Init_SetTimeout;
-    }
+static bool bmp180_configure(int fd, I2C_DeviceAddress address) {
+    i2cFd = fd;
+    i2cAddress = address;
+    conversionState = ConversionState_Idle;
+    compensation.valid = false;
 
-    if (read8(0xD0) != 0x55)
+    /* read calibration data in one block */
+    uint8_t cal[BMP180_CAL_LENGTH];
+    if (!readRegisters(BMP180_CAL_AC1, cal, sizeof(cal)))
         return false;
-
-    /* read calibration data */
-    ac1 = (int16_t)read16(BMP180_CAL_AC1);
-    ac2 = (int16_t)read16(BMP180_CAL_AC2);
-    ac3 = (int16_t)read16(BMP180_CAL_AC3);
-    ac4 = read16(BMP180_CAL_AC4);
-    ac5 = read16(BMP180_CAL_AC5);
-    ac6 = read16(BMP180_CAL_AC6);
-
-    b1 = (int16_t)read16(BMP180_CAL_B1);
-    b2 = (int16_t)read16(BMP180_CAL_B2);
-
-    mb = (int16_t)read16(BMP180_CAL_MB);
-    mc = (int16_t)read16(BMP180_CAL_MC);
-    md = (int16_t)read16(BMP180_CAL_MD);
+#define CAL_WORD(reg) bigEndian16(cal + ((reg) - BMP180_CAL_AC1))
+    ac1 = (int16_t)CAL_WORD(BMP180_CAL_AC1);
+    ac2 = (int16_t)CAL_WORD(BMP180_CAL_AC2);
+    ac3 = (int16_t)CAL_WORD(BMP180_CAL_AC3);
+    ac4 = CAL_WORD(BMP180_CAL_AC4);
+    ac5 = CAL_WORD(BMP180_CAL_AC5);
+    ac6 = CAL_WORD(BMP180_CAL_AC6);
+
+    b1 = (int16_t)CAL_WORD(BMP180_CAL_B1);
+    b2 = (int16_t)CAL_WORD(BMP180_CAL_B2);
+
+    mb = (int16_t)CAL_WORD(BMP180_CAL_MB);
+    mc = (int16_t)CAL_WORD(BMP180_CAL_MC);
+    md = (int16_t)CAL_WORD(BMP180_CAL_MD);
+#undef CAL_WORD
 #if (BMP180_DEBUG == 1)
     Log_Debug("ac1 = %d\n", ac1);
     Log_Debug("ac2 = %d\n", ac2);
@@ -166,63 +158,21 @@ bool bmp180_begin(uint8_t mode) {
     return true;
 }
 
-uint16_t bmp180_readRawTemperature(void) {
-    write8(BMP180_CONTROL, BMP180_READTEMPCMD);
-    delay(5);
-    uint16_t raw = read16(BMP180_TEMPDATA);
-#if BMP180_DEBUG == 1
-    Log_Debug("Raw temp: %d\n", raw);
-#endif
-    return raw;
-}
-
-uint32_t bmp180_readRawPressure(void) {
-    uint32_t raw;
-
-    write8(BMP180_CONTROL, (uint8_t)(BMP180_READPRESSURECMD + (oversampling << 6)));
-
-    if (oversampling == BMP180_ULTRALOWPOWER)
-        delay(5);
-    else if (oversampling == BMP180_STANDARD)
-        delay(8);
-    else if (oversampling == BMP180_HIGHRES)
-        delay(14);
-    else
-        delay(26);
-
-    raw = read16(BMP180_PRESSUREDATA);
-
-    raw <<= 8;
-    raw |= read8((uint8_t)(BMP180_PRESSUREDATA + 2));
-    raw >>= (uint32_t)(8 - oversampling);
-
-    /* this pull broke stuff, look at it later?
-     if (oversampling==0) {
-       raw <<= 8;
-       raw |= read8(BMP180_PRESSUREDATA+2);
-       raw >>= (8 - oversampling);
-     }
-    */
-
-#if BMP180_DEBUG == 1
-    Log_Debug("Raw pressure: %d\n", raw);
-#endif
-    return raw;
+static void bmp180_setOversampling(uint8_t mode) {
+    if (mode > BMP180_ULTRAHIGHRES)
+        mode = BMP180_ULTRAHIGHRES;
+    oversampling = mode;
 }
 
-int32_t bmp180_readPressure(void) {
-    int32_t UT, UP, B3, B5, B6, X1, X2, X3, p;
+static int32_t bmp180_computePressure(int32_t B5, int32_t UP) {
+    int32_t B3, B6, X1, X2, X3, p;
     uint32_t B4, B7;
 
     X1 = 0;
     X2 = 0;
 
-    UT = (int32_t)bmp180_readRawTemperature();
-    UP = (int32_t)bmp180_readRawPressure();
-
 #if BMP180_DEBUG == 1
     // use datasheet numbers!
-    UT = 27898;
     UP = 23843;
     ac6 = 23153;
     ac5 = 32757;
@@ -235,10 +185,9 @@ int32_t bmp180_readPressure(void) {
     ac1 = 408;
     ac4 = 32741;
     oversampling = 0;
+    B5 = computeB5(27898);
 #endif
 
-    B5 = computeB5(UT);
-
 #if BMP180_DEBUG == 1
     Log_Debug("X1 = %d\n", X1);
     Log_Debug("X2 = %d\n", X2);
@@ -295,89 +244,138 @@ int32_t bmp180_readPressure(void) {
     return p;
 }
 
-int32_t bmp180_readSealevelPressure(float altitude_meters) {
-    float pressure = (float)bmp180_readPressure();
-    return (int32_t)(pressure / pow(1.0 - altitude_meters / 44330, 5.255));
-}
-
-float bmp180_readTemperature(void) {
-    int32_t UT, B5; // following ds convention
-    float temp;
 
-    UT = bmp180_readRawTemperature();
+static bool bmp180_startTemperatureConversion(void) {
+    return write8(BMP180_CONTROL, BMP180_READTEMPCMD);
+}
 
+static bool bmp180_readRawTemperature(int32_t *raw) {
+    uint8_t data[2];
+    if (!readRegisters(BMP180_TEMPDATA, data, sizeof(data)))
+        return false;
+    *raw = bigEndian16(data);
 #if BMP180_DEBUG == 1
-    // use datasheet numbers!
-    UT = 27898;
-    ac6 = 23153;
-    ac5 = 32757;
-    mc = -8711;
-    md = 2868;
+    Log_Debug("Raw temp: %d\n", *raw);
 #endif
-
-    B5 = computeB5(UT);
-    temp = (float)((B5 + 8) >> 4);
-    temp /= 10;
-
-    return temp;
+    return true;
 }
 
-float bmp180_readAltitude(float sealevelPressure) {
-    float altitude;
-
-    if (sealevelPressure == 0) {
-        sealevelPressure = 101325;
-    }
-    float pressure = (float)bmp180_readPressure();
+static bool bmp180_startPressureConversion(void) {
+    return write8(BMP180_CONTROL, (uint8_t)(BMP180_READPRESSURECMD + (oversampling << 6)));
+}
 
-    altitude = (float)(44330 * (1.0 - pow(pressure / sealevelPressure, 0.1903)));
+static bool bmp180_readRawPressure(int32_t *raw) {
+    // MSB, LSB and XLSB in one transaction
+    uint8_t data[3];
+    if (!readRegisters(BMP180_PRESSUREDATA, data, sizeof(data)))
+        return false;
 
-    return altitude;
+    *raw = (int32_t)(((uint32_t)data[0] << 16 | (uint32_t)data[1] << 8 | data[2]) >> (8 - oversampling));
+#if BMP180_DEBUG == 1
+    Log_Debug("Raw pressure: %d\n", *raw);
+#endif
+    return true;
 }
 
-static void I2cTimerEventHandler(EventLoopTimer* timer)
+/// <summary>
+///     Cache the compensation term from a fresh temperature conversion and decide when
+///     the next one is due.
+/// </summary>
+static void UpdateCompensation(int32_t UT, int64_t now)
 {
-    if (ConsumeEventLoopTimerEvent(timer) != 0) {
-        LogErrno("ERROR: cannot consume the timer event");
-        return;
-    }
+    int32_t b5 = computeB5(UT);
+    int32_t temperature = (b5 + 8) >> 4;
 
-    if (!initialized) {
-        initialized = bmp180_begin(BMP180_ULTRAHIGHRES);
+    int32_t drift = temperature - compensation.temperature;
+    if (compensation.valid && (drift > temperatureDriftThreshold || drift < -temperatureDriftThreshold)) {
+        compensation.nextRefreshNanoseconds = now;
     }
-
-    uint32_t pressure = (uint32_t)bmp180_readPressure();
-    if (errno == EBUSY || errno == ENXIO) {
-        return;
+    else {
+        compensation.nextRefreshNanoseconds = now + temperatureRefreshInterval;
     }
-    dataBlock->pressureSamples[dataBlock->pressureSamplesReceived] = pressure;
-    dataBlock->pressureSamplesReceived++;
+    compensation.b5 = b5;
+    compensation.temperature = temperature;
+    compensation.valid = true;
 }
 
-ExitCode Bmp180_Init(EventLoop* eventLoopInstance, datablock_t* dataBlockInstance)
+static int StartPressureConversion(void)
 {
-    eventLoop = eventLoopInstance;
-    dataBlock = dataBlockInstance;
-
-    initialized = bmp180_begin(BMP180_ULTRAHIGHRES);
-    if (!initialized) {
-        Log_Debug("Error: could not initialize the BMP180, will retry\n");
-    };
+    if (!bmp180_startPressureConversion()) {
+        conversionState = ConversionState_Idle;
+        return -1;
+    }
+    conversionState = ConversionState_Pressure;
+    return pressureConversionMilliseconds[oversampling];
+}
 
-    static const struct timespec pollingInterval = { .tv_sec = 0, .tv_nsec = 100 * 1000 * 1000 };
-    i2cTimer = CreateEventLoopPeriodicTimer(eventLoop, &I2cTimerEventHandler, &pollingInterval);
+// Temperature is only converted when the cached compensation is due for a refresh
+static int bmp180_start(int64_t now) {
+    if (!compensation.valid || now >= compensation.nextRefreshNanoseconds) {
+        if (!bmp180_startTemperatureConversion()) {
+            return -1;
+        }
+        conversionState = ConversionState_Temperature;
+        return temperatureConversionMilliseconds;
+    }
+    return StartPressureConversion();
+}
 
-    if (i2cTimer == NULL) {
-        return ExitCode_UploadInit_Timer;
+static int bmp180_readBatch(BarometerSample *samples, size_t capacity, int64_t now,
+                            uint32_t *continueAfterMilliseconds) {
+    *continueAfterMilliseconds = 0;
+    if (capacity == 0) {
+        return 0;
     }
 
-    return ExitCode_Success;
-}
+    switch (conversionState) {
+    case ConversionState_Temperature: {
+        int32_t rawTemperature;
+        if (!bmp180_readRawTemperature(&rawTemperature)) {
+            conversionState = ConversionState_Idle;
+            return -1;
+        }
+        UpdateCompensation(rawTemperature, now);
+        samples[0] = (BarometerSample){ .timestampNanoseconds = now,
+                                        .temperature = compensation.temperature,
+                                        .hasTemperature = true };
+
+        int delay = StartPressureConversion();
+        if (delay < 0) {
+            return -1;
+        }
+        *continueAfterMilliseconds = (uint32_t)delay;
+        return 1;
+    }
 
-void Bmp180_Fini(void)
-{
-    DisposeEventLoopTimer(i2cTimer);
+    case ConversionState_Pressure: {
+        int32_t rawPressure;
+        conversionState = ConversionState_Idle;
+        if (!bmp180_readRawPressure(&rawPressure)) {
+            return -1;
+        }
+        samples[0] = (BarometerSample){ .timestampNanoseconds = now,
+                                        .pressure = bmp180_computePressure(compensation.b5, rawPressure),
+                                        .hasPressure = true };
+        return 1;
+    }
 
-    Log_Debug("Closing file descriptors.\n");
-    CloseFdAndLogOnError(i2cFd, "I2C");
+    case ConversionState_Idle:
+    default:
+        return 0;
+    }
 }
+
+const BarometerDriver Bmp180_Driver = {
+    .name = "BMP180",
+    .pollIntervalMilliseconds = 100,
+    .samplesPerMinute = 600,
+    .oversamplingModeCount = 4,
+    .defaultOversampling = BMP180_ULTRAHIGHRES,
+    .oversamplingNoisePascals = pressureNoisePascals,
+    .oversamplingConversionMilliseconds = pressureConversionMilliseconds,
+    .probe = bmp180_probe,
+    .configure = bmp180_configure,
+    .setOversampling = bmp180_setOversampling,
+    .start = bmp180_start,
+    .readBatch = bmp180_readBatch,
+};
@@ -1,7 +1,7 @@
 #pragma once
 
-#include <applibs/eventloop.h>
-#include "main.h"
+#include "barometer_driver.h"
 
-ExitCode Bmp180_Init(EventLoop* eventLoopInstance, datablock_t* dataBlockInstance);
-void Bmp180_Fini(void);
\ No newline at end of file
+// Bosch BMP180: chip id 0x55 at 0x77. Conversions are started one at a time, so the
+// driver polls at the output rate and refreshes temperature only occasionally.
+extern const BarometerDriver Bmp180_Driver;
@@ -0,0 +1,281 @@
+#include <errno.h>
+#include <stdbool.h>
+#include <string.h>
+#include <time.h>
+
+// applibs_versions.h defines the API struct versions to use for applibs APIs.
+#include "applibs_versions.h"
+#include <applibs/i2c.h>
+#include <applibs/log.h>
+
+#include "i2c_registers.h"
+
+#include "bmp280.h"
+
+static const uint8_t BMP280_CHIPID = 0xD0;    // Chip id register
+static const uint8_t BMP280_RESET = 0xE0;     // Soft reset register
+static const uint8_t BMP280_CTRL_HUM = 0xF2;  // Humidity control (BME280 only)
+static const uint8_t BMP280_STATUS = 0xF3;    // Conversion and NVM copy status
+static const uint8_t BMP280_CTRL_MEAS = 0xF4; // Temperature and pressure control
+static const uint8_t BMP280_CONFIG = 0xF5;    // Standby time and IIR filter
+static const uint8_t BMP280_DATA = 0xF7;      // Pressure then temperature, 3 bytes each
+static const uint8_t BMP280_CALIBRATION = 0x88;
+#define BMP280_CALIBRATION_LENGTH 24          // dig_T1 through dig_P9, little-endian
+
+static const uint8_t BMP280_CHIPID_VALUE = 0x58;
+static const uint8_t BME280_CHIPID_VALUE = 0x60;
+static const uint8_t BMP280_RESET_VALUE = 0xB6;
+static const uint8_t BMP280_STATUS_IM_UPDATE = 1 << 0; // calibration being copied from NVM
+
+// The chip takes 2 ms to start up after a reset, and ignores writes until it has; after
+// that it is given this many further milliseconds to finish copying its calibration
+static const long BMP280_STARTUP_MILLISECONDS = 2;
+static const int BMP280_MAX_NVM_COPY_MILLISECONDS = 10;
+
+// Temperature x1, pressure x8, normal mode: about 22 ms per measurement with 0.5 ms
+// standby, so a fresh filtered result is always waiting at the 10 Hz poll
+static const uint8_t BMP280_CTRL_MEAS_VALUE = (1 << 5) | (4 << 2) | 3;
+// Standby 0.5 ms, IIR filter coefficient 4
+static const uint8_t BMP280_CONFIG_VALUE = (0 << 5) | (2 << 2);
+
+// Raw value the chip reports for a measurement that hasn't happened yet. It is also the
+// registers' reset value, so a chip that browns out reads as skipped from then on.
+static const int32_t BMP280_SKIPPED = 0x80000;
+static const uint8_t BMP280_MODE_MASK = 3;
+static const uint8_t BMP280_MODE_NORMAL = 3;
+
+// A measurement takes 22 ms, so only the first poll after configuration should find none;
+// more in a row than this means the chip has stopped measuring
+static const uint32_t BMP280_MAX_SKIPPED_READS = 3;
+
+static uint16_t dig_T1;
+static int16_t dig_T2, dig_T3;
+static uint16_t dig_P1;
+static int16_t dig_P2, dig_P3, dig_P4, dig_P5, dig_P6, dig_P7, dig_P8, dig_P9;
+
+static int i2cFd = -1; // not owned
+static I2C_DeviceAddress i2cAddress = 0;
+static uint8_t chipId = 0;
+
+// Raw readings from the previous poll. With the ADC's noise it is vanishingly unlikely that
+// both repeat exactly, so a repeat means the chip stopped converting (e.g. a brown-out
+// dropped it back to sleep mode) and the registers are stale.
+static int32_t previousAdcP = BMP280_SKIPPED;
+static int32_t previousAdcT = BMP280_SKIPPED;
+static uint32_t consecutiveSkippedReads = 0;
+
+static uint16_t littleEndian16(const uint8_t *bytes)
+{
+    return (uint16_t)(bytes[1] << 8 | bytes[0]);
+}
+
+static bool bmp280_probe(int fd, I2C_DeviceAddress address)
+{
+    chipId = 0;
+    return I2cRegisters_Read(fd, address, BMP280_CHIPID, &chipId, 1) &&
+           (chipId == BMP280_CHIPID_VALUE || chipId == BME280_CHIPID_VALUE);
+}
+
+static void SleepMilliseconds(long milliseconds)
+{
+    struct timespec delay = {.tv_sec = 0, .tv_nsec = milliseconds * 1000 * 1000};
+    while (nanosleep(&delay, &delay) == -1 && errno == EINTR) {
+    }
+}
+
+// Soft reset the chip and wait for it to come back, so that it starts from a known state
+// in sleep mode with its calibration loaded
+static bool bmp280_reset(void)
+{
+    if (!I2cRegisters_Write8(i2cFd, i2cAddress, BMP280_RESET, BMP280_RESET_VALUE)) {
+        return false;
+    }
+    SleepMilliseconds(BMP280_STARTUP_MILLISECONDS);
+
+    for (int waited = 0;; waited++) {
+        uint8_t status;
+        if (!I2cRegisters_Read(i2cFd, i2cAddress, BMP280_STATUS, &status, 1)) {
+            return false;
+        }
+        if ((status & BMP280_STATUS_IM_UPDATE) == 0) {
+            return true;
+        }
+        if (waited == BMP280_MAX_NVM_COPY_MILLISECONDS) {
+            Log_Debug("ERROR: BMP280 still loading its calibration after reset\n");
+            errno = EIO;
+            return false;
+        }
+        SleepMilliseconds(1);
+    }
+}
+
+// Write a control register and read it back, since a write the chip wasn't ready for is
+// silently dropped
+static bool bmp280_writeAndVerify(uint8_t reg, uint8_t value)
+{
+    uint8_t readBack;
+    if (!I2cRegisters_Write8(i2cFd, i2cAddress, reg, value) ||
+        !I2cRegisters_Read(i2cFd, i2cAddress, reg, &readBack, 1)) {
+        return false;
+    }
+    if (readBack != value) {
+        Log_Debug("ERROR: BMP280 register 0x%02X reads back 0x%02X, not 0x%02X\n", reg, readBack,
+                  value);
+        errno = EIO;
+        return false;
+    }
+    return true;
+}
+
+static bool bmp280_configure(int fd, I2C_DeviceAddress address)
+{
+    i2cFd = fd;
+    i2cAddress = address;
+    previousAdcP = BMP280_SKIPPED;
+    previousAdcT = BMP280_SKIPPED;
+    consecutiveSkippedReads = 0;
+
+    // Reset first, so that the calibration is read once the chip has finished loading it
+    if (!bmp280_reset()) {
+        return false;
+    }
+
+    uint8_t cal[BMP280_CALIBRATION_LENGTH];
+    if (!I2cRegisters_Read(i2cFd, i2cAddress, BMP280_CALIBRATION, cal, sizeof(cal))) {
+        return false;
+    }
+    dig_T1 = littleEndian16(cal + 0);
+    dig_T2 = (int16_t)littleEndian16(cal + 2);
+    dig_T3 = (int16_t)littleEndian16(cal + 4);
+    dig_P1 = littleEndian16(cal + 6);
+    dig_P2 = (int16_t)littleEndian16(cal + 8);
+    dig_P3 = (int16_t)littleEndian16(cal + 10);
+    dig_P4 = (int16_t)littleEndian16(cal + 12);
+    dig_P5 = (int16_t)littleEndian16(cal + 14);
+    dig_P6 = (int16_t)littleEndian16(cal + 16);
+    dig_P7 = (int16_t)littleEndian16(cal + 18);
+    dig_P8 = (int16_t)littleEndian16(cal + 20);
+    dig_P9 = (int16_t)littleEndian16(cal + 22);
+
+    // The config register is only reliably written in sleep mode, which is where the reset
+    // left the chip; ctrl_hum only takes effect on the next ctrl_meas write
+    if (!bmp280_writeAndVerify(BMP280_CONFIG, BMP280_CONFIG_VALUE)) {
+        return false;
+    }
+    if (chipId == BME280_CHIPID_VALUE && !bmp280_writeAndVerify(BMP280_CTRL_HUM, 0)) {
+        return false;
+    }
+    return bmp280_writeAndVerify(BMP280_CTRL_MEAS, BMP280_CTRL_MEAS_VALUE);
+}
+
+// Compensation from the BMP280 datasheet, section 8.2. Returns the fine temperature that
+// the pressure compensation needs, and the temperature in 0.01 degrees C.
+static int32_t bmp280_compensateTemperature(int32_t adc_T, int32_t *temperature)
+{
+    int32_t var1 = ((((adc_T >> 3) - ((int32_t)dig_T1 << 1))) * ((int32_t)dig_T2)) >> 11;
+    int32_t var2 = (((((adc_T >> 4) - ((int32_t)dig_T1)) * ((adc_T >> 4) - ((int32_t)dig_T1))) >> 12) *
+                    ((int32_t)dig_T3)) >> 14;
+    int32_t t_fine = var1 + var2;
+    *temperature = (t_fine * 5 + 128) >> 8;
+    return t_fine;
+}
+
+// Pressure in Pa as unsigned Q24.8, or 0 if the calibration is unusable
+static uint32_t bmp280_compensatePressure(int32_t adc_P, int32_t t_fine)
+{
+    // Left shifts of possibly negative values are written as multiplications
+    int64_t var1 = ((int64_t)t_fine) - 128000;
+    int64_t var2 = var1 * var1 * (int64_t)dig_P6;
+    var2 = var2 + ((var1 * (int64_t)dig_P5) * (1ll << 17));
+    var2 = var2 + (((int64_t)dig_P4) * (1ll << 35));
+    var1 = ((var1 * var1 * (int64_t)dig_P3) >> 8) + ((var1 * (int64_t)dig_P2) * (1ll << 12));
+    var1 = (((((int64_t)1) << 47) + var1)) * ((int64_t)dig_P1) >> 33;
+    if (var1 == 0) {
+        return 0;
+    }
+    int64_t p = 1048576 - adc_P;
+    p = (((p * (1ll << 31)) - var2) * 3125) / var1;
+    var1 = (((int64_t)dig_P9) * (p >> 13) * (p >> 13)) >> 25;
+    var2 = (((int64_t)dig_P8) * p) >> 19;
+    p = ((p + var1 + var2) >> 8) + (((int64_t)dig_P7) * (1 << 4));
+    return (uint32_t)p;
+}
+
+// The chip measures continuously, so the latest result can be read straight away
+static int bmp280_start(int64_t now)
+{
+    return 0;
+}
+
+// No measurement in the data registers: either the first one since configuration hasn't
+// finished, or the chip has been reset behind our back and is asleep. The latter is a
+// failure, so that the generic layer treats the sensor as lost and reconfigures it.
+static int bmp280_checkSkippedRead(void)
+{
+    uint8_t ctrlMeas;
+    if (!I2cRegisters_Read(i2cFd, i2cAddress, BMP280_CTRL_MEAS, &ctrlMeas, 1)) {
+        return -1;
+    }
+    if ((ctrlMeas & BMP280_MODE_MASK) != BMP280_MODE_NORMAL) {
+        Log_Debug("ERROR: BMP280 has left normal mode (ctrl_meas 0x%02X), it was probably reset\n",
+                  ctrlMeas);
+        errno = EIO;
+        return -1;
+    }
+    if (++consecutiveSkippedReads > BMP280_MAX_SKIPPED_READS) {
+        Log_Debug("ERROR: BMP280 has not completed a measurement in %u polls\n",
+                  consecutiveSkippedReads);
+        errno = EIO;
+        return -1;
+    }
+    return 0;
+}
+
+static int bmp280_readBatch(BarometerSample *samples, size_t capacity, int64_t now,
+                            uint32_t *continueAfterMilliseconds)
+{
+    *continueAfterMilliseconds = 0;
+    if (capacity == 0) {
+        return 0;
+    }
+
+    uint8_t data[6];
+    if (!I2cRegisters_Read(i2cFd, i2cAddress, BMP280_DATA, data, sizeof(data))) {
+        return -1;
+    }
+    int32_t adc_P = (int32_t)((uint32_t)data[0] << 12 | (uint32_t)data[1] << 4 | data[2] >> 4);
+    int32_t adc_T = (int32_t)((uint32_t)data[3] << 12 | (uint32_t)data[4] << 4 | data[5] >> 4);
+    if (adc_P == BMP280_SKIPPED || adc_T == BMP280_SKIPPED) {
+        return bmp280_checkSkippedRead();
+    }
+    consecutiveSkippedReads = 0;
+
+    bool stale = adc_P == previousAdcP && adc_T == previousAdcT;
+    previousAdcP = adc_P;
+    previousAdcT = adc_T;
+
+    int32_t temperature;
+    int32_t t_fine = bmp280_compensateTemperature(adc_T, &temperature);
+    uint32_t pressure = bmp280_compensatePressure(adc_P, t_fine);
+    if (pressure == 0) {
+        return 0;
+    }
+
+    samples[0] = (BarometerSample){ .timestampNanoseconds = now,
+                                    .pressure = (int32_t)((pressure + 128) / 256),
+                                    .temperature = (temperature + 5) / 10,
+                                    .hasPressure = true,
+                                    .hasTemperature = true,
+                                    .quality = stale ? SampleQuality_Stale : SampleQuality_Good };
+    return 1;
+}
+
+const BarometerDriver Bmp280_Driver = {
+    .name = "BMP280/BME280",
+    .pollIntervalMilliseconds = 100,
+    .samplesPerMinute = 600,
+    .probe = bmp280_probe,
+    .configure = bmp280_configure,
+    .start = bmp280_start,
+    .readBatch = bmp280_readBatch,
+};
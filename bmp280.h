@@ -0,0 +1,8 @@
+#pragma once
+
+#include "barometer_driver.h"
+
+// Bosch BMP280 (chip id 0x58) and BME280 (chip id 0x60, humidity unused). The chip runs
+// continuously with its own oversampling and IIR filter, and each poll reads the latest
+// result in a single burst.
+extern const BarometerDriver Bmp280_Driver;
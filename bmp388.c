@@ -0,0 +1,214 @@
+#include <math.h>
+#include <stdbool.h>
+#include <string.h>
+
+// applibs_versions.h defines the API struct versions to use for applibs APIs.
+#include "applibs_versions.h"
+#include <applibs/i2c.h>
+#include <applibs/log.h>
+
+#include "i2c_registers.h"
+
+#include "bmp388.h"
+
+static const uint8_t BMP388_CHIPID = 0x00;        // Chip id register
+static const uint8_t BMP388_FIFO_LENGTH = 0x12;   // FIFO fill level in bytes, 9 bits LSB first
+static const uint8_t BMP388_FIFO_DATA = 0x14;     // Reading this register pops the FIFO
+static const uint8_t BMP388_FIFO_CONFIG_1 = 0x17; // FIFO enable and contents
+static const uint8_t BMP388_FIFO_CONFIG_2 = 0x18; // FIFO subsampling and data source
+static const uint8_t BMP388_PWR_CTRL = 0x1B;      // Sensor enables and power mode
+static const uint8_t BMP388_OSR = 0x1C;           // Oversampling
+static const uint8_t BMP388_ODR = 0x1D;           // Output data rate
+static const uint8_t BMP388_CONFIG = 0x1F;        // IIR filter
+static const uint8_t BMP388_CALIBRATION = 0x31;
+#define BMP388_CALIBRATION_LENGTH 21              // NVM_PAR_T1 through NVM_PAR_P11, little-endian
+static const uint8_t BMP388_CMD = 0x7E;
+
+static const uint8_t BMP388_CHIPID_VALUE = 0x50;
+static const uint8_t BMP390_CHIPID_VALUE = 0x60;
+
+// Pressure x8, temperature x1: about 19 ms per measurement, well inside the 80 ms period
+static const uint8_t BMP388_OSR_VALUE = (0 << 3) | 3;
+// 200 Hz / 2^4 = 12.5 Hz
+static const uint8_t BMP388_ODR_VALUE = 4;
+#define BMP388_SAMPLE_PERIOD_NANOSECONDS (80ll * 1000 * 1000)
+// IIR filter coefficient 3
+static const uint8_t BMP388_CONFIG_VALUE = 2 << 1;
+// FIFO on, pressure and temperature in each frame, oldest frames overwritten when full
+static const uint8_t BMP388_FIFO_CONFIG_1_VALUE = (1 << 4) | (1 << 3) | 1;
+// Filtered data, no subsampling
+static const uint8_t BMP388_FIFO_CONFIG_2_VALUE = 1 << 3;
+// Pressure and temperature enabled, normal mode
+static const uint8_t BMP388_PWR_CTRL_NORMAL = (3 << 4) | (1 << 1) | 1;
+static const uint8_t BMP388_CMD_FIFO_FLUSH = 0xB0;
+
+// FIFO frame headers
+static const uint8_t BMP388_FRAME_PRESSURE_TEMPERATURE = 0x94;
+static const uint8_t BMP388_FRAME_TEMPERATURE = 0x90;
+static const uint8_t BMP388_FRAME_PRESSURE = 0x84;
+static const uint8_t BMP388_FRAME_SENSOR_TIME = 0xA0;
+static const uint8_t BMP388_FRAME_CONFIG_CHANGE = 0x44;
+static const uint8_t BMP388_FRAME_CONFIG_ERROR = 0x48;
+
+#define BMP388_FIFO_SIZE 512
+// Longest single read; larger FIFO contents are drained in several transactions
+#define BMP388_MAX_TRANSFER 256
+
+// Calibration coefficients, already scaled as in the datasheet's floating point
+// compensation (section 9.2)
+static struct {
+    double t1, t2, t3;
+    double p1, p2, p3, p4, p5, p6, p7, p8, p9, p10, p11;
+} par;
+
+static uint8_t fifoBuffer[BMP388_FIFO_SIZE];
+
+static int i2cFd = -1; // not owned
+static I2C_DeviceAddress i2cAddress = 0;
+
+static uint16_t littleEndian16(const uint8_t *bytes)
+{
+    return (uint16_t)(bytes[1] << 8 | bytes[0]);
+}
+
+static uint32_t littleEndian24(const uint8_t *bytes)
+{
+    return (uint32_t)bytes[2] << 16 | (uint32_t)bytes[1] << 8 | bytes[0];
+}
+
+static bool bmp388_probe(int fd, I2C_DeviceAddress address)
+{
+    uint8_t chipId = 0;
+    return I2cRegisters_Read(fd, address, BMP388_CHIPID, &chipId, 1) &&
+           (chipId == BMP388_CHIPID_VALUE || chipId == BMP390_CHIPID_VALUE);
+}
+
+static bool bmp388_configure(int fd, I2C_DeviceAddress address)
+{
+    i2cFd = fd;
+    i2cAddress = address;
+
+    uint8_t cal[BMP388_CALIBRATION_LENGTH];
+    if (!I2cRegisters_Read(i2cFd, i2cAddress, BMP388_CALIBRATION, cal, sizeof(cal))) {
+        return false;
+    }
+    par.t1 = littleEndian16(cal + 0) * 256.0;
+    par.t2 = littleEndian16(cal + 2) / 1073741824.0;
+    par.t3 = (int8_t)cal[4] / 281474976710656.0;
+    par.p1 = ((int16_t)littleEndian16(cal + 5) - 16384) / 1048576.0;
+    par.p2 = ((int16_t)littleEndian16(cal + 7) - 16384) / 536870912.0;
+    par.p3 = (int8_t)cal[9] / 4294967296.0;
+    par.p4 = (int8_t)cal[10] / 137438953472.0;
+    par.p5 = littleEndian16(cal + 11) * 8.0;
+    par.p6 = littleEndian16(cal + 13) / 64.0;
+    par.p7 = (int8_t)cal[15] / 256.0;
+    par.p8 = (int8_t)cal[16] / 32768.0;
+    par.p9 = (int16_t)littleEndian16(cal + 17) / 281474976710656.0;
+    par.p10 = (int8_t)cal[19] / 281474976710656.0;
+    par.p11 = (int8_t)cal[20] / 36893488147419103232.0;
+
+    // Configure in sleep mode, start from an empty FIFO, then start sampling
+    return I2cRegisters_Write8(i2cFd, i2cAddress, BMP388_PWR_CTRL, 0) &&
+           I2cRegisters_Write8(i2cFd, i2cAddress, BMP388_OSR, BMP388_OSR_VALUE) &&
+           I2cRegisters_Write8(i2cFd, i2cAddress, BMP388_ODR, BMP388_ODR_VALUE) &&
+           I2cRegisters_Write8(i2cFd, i2cAddress, BMP388_CONFIG, BMP388_CONFIG_VALUE) &&
+           I2cRegisters_Write8(i2cFd, i2cAddress, BMP388_FIFO_CONFIG_2, BMP388_FIFO_CONFIG_2_VALUE) &&
+           I2cRegisters_Write8(i2cFd, i2cAddress, BMP388_FIFO_CONFIG_1, BMP388_FIFO_CONFIG_1_VALUE) &&
+           I2cRegisters_Write8(i2cFd, i2cAddress, BMP388_CMD, BMP388_CMD_FIFO_FLUSH) &&
+           I2cRegisters_Write8(i2cFd, i2cAddress, BMP388_PWR_CTRL, BMP388_PWR_CTRL_NORMAL);
+}
+
+// Returns the linearized temperature in degrees C
+static double bmp388_compensateTemperature(uint32_t uncompensated)
+{
+    double partialData1 = (double)uncompensated - par.t1;
+    double partialData2 = partialData1 * par.t2;
+    return partialData2 + (partialData1 * partialData1) * par.t3;
+}
+
+// Returns pressure in Pa
+static double bmp388_compensatePressure(uint32_t uncompensated, double temperature)
+{
+    double t2 = temperature * temperature;
+    double t3 = t2 * temperature;
+    double up = (double)uncompensated;
+
+    double out1 = par.p5 + par.p6 * temperature + par.p7 * t2 + par.p8 * t3;
+    double out2 = up * (par.p1 + par.p2 * temperature + par.p3 * t2 + par.p4 * t3);
+    double out3 = up * up * (par.p9 + par.p10 * temperature) + up * up * up * par.p11;
+    return out1 + out2 + out3;
+}
+
+// Frames accumulate in the FIFO between polls, so there is nothing to wait for
+static int bmp388_start(int64_t now)
+{
+    return 0;
+}
+
+static int bmp388_readBatch(BarometerSample *samples, size_t capacity, int64_t now,
+                            uint32_t *continueAfterMilliseconds)
+{
+    *continueAfterMilliseconds = 0;
+
+    uint8_t lengthBytes[2];
+    if (!I2cRegisters_Read(i2cFd, i2cAddress, BMP388_FIFO_LENGTH, lengthBytes, sizeof(lengthBytes))) {
+        return -1;
+    }
+    size_t length = littleEndian16(lengthBytes) & 0x1FF;
+    if (length > sizeof(fifoBuffer)) {
+        length = sizeof(fifoBuffer);
+    }
+
+    for (size_t offset = 0; offset < length; offset += BMP388_MAX_TRANSFER) {
+        size_t chunk = length - offset < BMP388_MAX_TRANSFER ? length - offset : BMP388_MAX_TRANSFER;
+        if (!I2cRegisters_Read(i2cFd, i2cAddress, BMP388_FIFO_DATA, fifoBuffer + offset, chunk)) {
+            return -1;
+        }
+    }
+
+    // Decode the frames; the newest is taken to have been measured now and earlier ones
+    // one sample period apart
+    size_t count = 0;
+    size_t position = 0;
+    while (position < length && count < capacity) {
+        uint8_t header = fifoBuffer[position++];
+        size_t remaining = length - position;
+
+        if (header == BMP388_FRAME_PRESSURE_TEMPERATURE && remaining >= 6) {
+            double temperature = bmp388_compensateTemperature(littleEndian24(fifoBuffer + position));
+            double pressure = bmp388_compensatePressure(littleEndian24(fifoBuffer + position + 3), temperature);
+            samples[count++] = (BarometerSample){ .pressure = (int32_t)lround(pressure),
+                                                  .temperature = (int32_t)lround(temperature * 10),
+                                                  .hasPressure = true,
+                                                  .hasTemperature = true };
+            position += 6;
+        }
+        else if ((header == BMP388_FRAME_TEMPERATURE || header == BMP388_FRAME_PRESSURE ||
+                  header == BMP388_FRAME_SENSOR_TIME) && remaining >= 3) {
+            // Not configured; pressure can't be compensated without its temperature
+            position += 3;
+        }
+        else if ((header == BMP388_FRAME_CONFIG_CHANGE || header == BMP388_FRAME_CONFIG_ERROR) && remaining >= 1) {
+            position += 1;
+        }
+        else {
+            // An empty frame, or the end of what was read
+            break;
+        }
+    }
+
+    for (size_t i = 0; i < count; i++) {
+        samples[i].timestampNanoseconds = now - (int64_t)(count - 1 - i) * BMP388_SAMPLE_PERIOD_NANOSECONDS;
+    }
+    return (int)count;
+}
+
+const BarometerDriver Bmp388_Driver = {
+    .name = "BMP388/BMP390",
+    .pollIntervalMilliseconds = 1000,
+    .samplesPerMinute = 750,
+    .probe = bmp388_probe,
+    .configure = bmp388_configure,
+    .start = bmp388_start,
+    .readBatch = bmp388_readBatch,
+};
@@ -0,0 +1,7 @@
+#pragma once
+
+#include "barometer_driver.h"
+
+// Bosch BMP388 (chip id 0x50) and BMP390 (chip id 0x60). The chip samples on its own at
+// 12.5 Hz into its FIFO, and each one-second poll drains the FIFO in one burst.
+extern const BarometerDriver Bmp388_Driver;
@@ -0,0 +1,137 @@
+#include <string.h>
+
+#include "cbor.h"
+
+enum {
+    MajorType_Unsigned = 0,
+    MajorType_Negative = 1,
+    MajorType_Text = 3,
+    MajorType_Array = 4,
+    MajorType_Map = 5,
+    MajorType_Tag = 6,
+    MajorType_Simple = 7,
+};
+
+static void WriteBytes(CborWriter *writer, const void *data, size_t length)
+{
+    if (writer->overflow || length > writer->capacity - writer->length) {
+        writer->overflow = true;
+        return;
+    }
+    memcpy(writer->buffer + writer->length, data, length);
+    writer->length += length;
+}
+
+// Every item starts with its major type and an argument in the shortest encoding that fits
+static void WriteTypeAndArgument(CborWriter *writer, uint8_t majorType, uint64_t argument)
+{
+    uint8_t header[9];
+    size_t length;
+
+    if (argument < 24) {
+        header[0] = (uint8_t)(majorType << 5 | argument);
+        length = 1;
+    }
+    else if (argument <= UINT8_MAX) {
+        header[0] = (uint8_t)(majorType << 5 | 24);
+        length = 2;
+    }
+    else if (argument <= UINT16_MAX) {
+        header[0] = (uint8_t)(majorType << 5 | 25);
+        length = 3;
+    }
+    else if (argument <= UINT32_MAX) {
+        header[0] = (uint8_t)(majorType << 5 | 26);
+        length = 5;
+    }
+    else {
+        header[0] = (uint8_t)(majorType << 5 | 27);
+        length = 9;
+    }
+
+    // Big-endian argument follows the initial byte
+    for (size_t i = 1; i < length; i++) {
+        header[i] = (uint8_t)(argument >> (8 * (length - 1 - i)));
+    }
+    WriteBytes(writer, header, length);
+}
+
+void Cbor_InitWriter(CborWriter *writer, uint8_t *buffer, size_t capacity)
+{
+    writer->buffer = buffer;
+    writer->capacity = capacity;
+    writer->length = 0;
+    writer->overflow = false;
+}
+
+void Cbor_WriteMapHeader(CborWriter *writer, size_t pairCount)
+{
+    WriteTypeAndArgument(writer, MajorType_Map, pairCount);
+}
+
+void Cbor_WriteArrayHeader(CborWriter *writer, size_t itemCount)
+{
+    WriteTypeAndArgument(writer, MajorType_Array, itemCount);
+}
+
+void Cbor_WriteUnsigned(CborWriter *writer, uint64_t value)
+{
+    WriteTypeAndArgument(writer, MajorType_Unsigned, value);
+}
+
+void Cbor_WriteSigned(CborWriter *writer, int64_t value)
+{
+    if (value >= 0) {
+        WriteTypeAndArgument(writer, MajorType_Unsigned, (uint64_t)value);
+    }
+    else {
+        // Negative integers are encoded as -1 - n
+        WriteTypeAndArgument(writer, MajorType_Negative, (uint64_t)(-1 - value));
+    }
+}
+
+void Cbor_WriteFloat(CborWriter *writer, float value)
+{
+    uint32_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+
+    uint8_t encoded[5] = {MajorType_Simple << 5 | 26, (uint8_t)(bits >> 24), (uint8_t)(bits >> 16),
+                          (uint8_t)(bits >> 8), (uint8_t)bits};
+    WriteBytes(writer, encoded, sizeof(encoded));
+}
+
+void Cbor_WriteDouble(CborWriter *writer, double value)
+{
+    uint64_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+
+    uint8_t encoded[9] = {MajorType_Simple << 5 | 27};
+    for (size_t i = 1; i < sizeof(encoded); i++) {
+        encoded[i] = (uint8_t)(bits >> (8 * (sizeof(encoded) - 1 - i)));
+    }
+    WriteBytes(writer, encoded, sizeof(encoded));
+}
+
+void Cbor_WriteNull(CborWriter *writer)
+{
+    // Simple value 22
+    uint8_t encoded = MajorType_Simple << 5 | 22;
+    WriteBytes(writer, &encoded, sizeof(encoded));
+}
+
+void Cbor_WriteTag(CborWriter *writer, uint64_t tag)
+{
+    WriteTypeAndArgument(writer, MajorType_Tag, tag);
+}
+
+void Cbor_WriteText(CborWriter *writer, const char *text)
+{
+    size_t length = strlen(text);
+    WriteTypeAndArgument(writer, MajorType_Text, length);
+    WriteBytes(writer, text, length);
+}
+
+size_t Cbor_Finish(const CborWriter *writer)
+{
+    return writer->overflow ? 0 : writer->length;
+}
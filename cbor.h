@@ -0,0 +1,38 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/// <summary>
+/// Minimal CBOR (RFC 8949) encoder that writes into a caller-supplied buffer. Writes past
+/// the end of the buffer are dropped and flagged in overflow rather than reported per call,
+/// so a whole item can be encoded and checked once at the end.
+/// </summary>
+typedef struct CborWriter {
+    uint8_t *buffer;
+    size_t capacity;
+    size_t length;
+    bool overflow;
+} CborWriter;
+
+void Cbor_InitWriter(CborWriter *writer, uint8_t *buffer, size_t capacity);
+
+void Cbor_WriteMapHeader(CborWriter *writer, size_t pairCount);
+void Cbor_WriteArrayHeader(CborWriter *writer, size_t itemCount);
+void Cbor_WriteUnsigned(CborWriter *writer, uint64_t value);
+void Cbor_WriteSigned(CborWriter *writer, int64_t value);
+void Cbor_WriteFloat(CborWriter *writer, float value);
+void Cbor_WriteDouble(CborWriter *writer, double value);
+void Cbor_WriteNull(CborWriter *writer);
+
+/// <summary>
+/// Tag the item written next, e.g. tag 1 for an epoch-based date/time.
+/// </summary>
+void Cbor_WriteTag(CborWriter *writer, uint64_t tag);
+void Cbor_WriteText(CborWriter *writer, const char *text);
+
+/// <summary>
+/// Returns the encoded length, or 0 if the buffer overflowed.
+/// </summary>
+size_t Cbor_Finish(const CborWriter *writer);
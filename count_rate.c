@@ -0,0 +1,125 @@
+#include <math.h>
+#include <string.h>
+
+#include "count_rate.h"
+
+// Counts per minute that correspond to 1 uSv/hr for the tube in use (SBM-20)
+static const double tubeCpmPerMicrosievertPerHour = 175.43;
+
+static const uint32_t windowLengths[CountRateWindow_Count] = {
+    [CountRateWindow_Minute] = 60,
+    [CountRateWindow_TenMinutes] = 600,
+    [CountRateWindow_Hour] = 3600,
+};
+
+// z for a two-sided 95% interval
+static const double confidenceZ = 1.959964;
+
+void CountRate_Init(CountRate *rate)
+{
+    memset(rate, 0, sizeof(*rate));
+    for (int i = 0; i < CountRateWindow_Count; i++) {
+        rate->sums[i].lengthSeconds = windowLengths[i];
+    }
+}
+
+static CountRateSlot *SlotFor(CountRate *rate, uint32_t second)
+{
+    return &rate->slots[second % COUNT_RATE_HISTORY_SECONDS];
+}
+
+static void ExpireThrough(CountRate *rate, CountRateSum *sum, uint32_t second)
+{
+    // After a long gap everything in the window has expired; skip straight to the end
+    if (second >= sum->expiredThrough + sum->lengthSeconds) {
+        sum->expiredThrough = second;
+        sum->counts = 0;
+        sum->coveredSeconds = 0;
+    }
+
+    while (sum->expiredThrough < second) {
+        sum->expiredThrough++;
+        const CountRateSlot *slot = SlotFor(rate, sum->expiredThrough);
+        if (slot->second == sum->expiredThrough + 1) {
+            sum->counts -= slot->counts;
+            sum->coveredSeconds--;
+        }
+    }
+}
+
+void CountRate_Add(CountRate *rate, int64_t timestampNanoseconds, uint32_t counts)
+{
+    if (!rate->started) {
+        rate->firstNanoseconds = timestampNanoseconds;
+        rate->started = true;
+    }
+
+    // The counter reports once a second but arrival times jitter, so two reports can land in
+    // the same second with the neighbouring second empty. Nudge a collision into the next
+    // second, but never more than a second ahead of the clock.
+    uint32_t second = (uint32_t)((timestampNanoseconds - rate->firstNanoseconds) / 1000000000) + 1;
+    if (second <= rate->lastSecond) {
+        second = rate->lastSecond + 1;
+        if (second > (uint32_t)((timestampNanoseconds - rate->firstNanoseconds) / 1000000000) + 2) {
+            // Too far ahead: fold the counts into the last second instead
+            CountRateSlot *last = SlotFor(rate, rate->lastSecond);
+            uint32_t total = last->counts + counts;
+            uint16_t added = (uint16_t)((total > UINT16_MAX ? UINT16_MAX : total) - last->counts);
+            last->counts = (uint16_t)(last->counts + added);
+            for (int i = 0; i < CountRateWindow_Count; i++) {
+                rate->sums[i].counts += added;
+            }
+            return;
+        }
+    }
+
+    for (int i = 0; i < CountRateWindow_Count; i++) {
+        CountRateSum *sum = &rate->sums[i];
+        if (second > sum->lengthSeconds) {
+            ExpireThrough(rate, sum, second - sum->lengthSeconds);
+        }
+    }
+
+    CountRateSlot *slot = SlotFor(rate, second);
+    slot->second = second + 1;
+    slot->counts = counts > UINT16_MAX ? UINT16_MAX : (uint16_t)counts;
+    for (int i = 0; i < CountRateWindow_Count; i++) {
+        rate->sums[i].counts += slot->counts;
+        rate->sums[i].coveredSeconds++;
+    }
+    rate->lastSecond = second;
+}
+
+// Wilson-Hilferty approximation to the exact Poisson interval for an observed count
+static double PoissonLowerBound(double n)
+{
+    if (n <= 0) {
+        return 0;
+    }
+    double t = 1 - 1 / (9 * n) - confidenceZ / (3 * sqrt(n));
+    return n * t * t * t;
+}
+
+static double PoissonUpperBound(double n)
+{
+    double m = n + 1;
+    double t = 1 - 1 / (9 * m) + confidenceZ / (3 * sqrt(m));
+    return m * t * t * t;
+}
+
+void CountRate_GetEstimate(const CountRate *rate, CountRateWindow window, CountRateEstimate *estimate)
+{
+    const CountRateSum *sum = &rate->sums[window];
+    memset(estimate, 0, sizeof(*estimate));
+    if (sum->coveredSeconds == 0) {
+        return;
+    }
+
+    double minutes = sum->coveredSeconds / 60.0;
+    double counts = (double)sum->counts;
+    estimate->cpm = counts / minutes;
+    estimate->cpmLow = PoissonLowerBound(counts) / minutes;
+    estimate->cpmHigh = PoissonUpperBound(counts) / minutes;
+    estimate->microsievertsPerHour = estimate->cpm / tubeCpmPerMicrosievertPerHour;
+    estimate->coverage = (double)sum->coveredSeconds / sum->lengthSeconds;
+}
@@ -0,0 +1,59 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Longest window kept, in seconds; one slot is kept per second
+#define COUNT_RATE_HISTORY_SECONDS 3600
+
+typedef enum {
+    CountRateWindow_Minute,
+    CountRateWindow_TenMinutes,
+    CountRateWindow_Hour,
+    CountRateWindow_Count
+} CountRateWindow;
+
+/// <summary>
+/// Count rate over one sliding window, with a 95% Poisson confidence interval and the
+/// fraction of the window's seconds for which counts were actually received.
+/// </summary>
+typedef struct CountRateEstimate {
+    double cpm;
+    double cpmLow;
+    double cpmHigh;
+    double microsievertsPerHour;
+    double coverage;
+} CountRateEstimate;
+
+typedef struct CountRateSlot {
+    uint32_t second; // second index + 1, so that zero marks an empty slot
+    uint16_t counts;
+} CountRateSlot;
+
+typedef struct CountRateSum {
+    uint32_t lengthSeconds;
+    uint32_t expiredThrough; // seconds up to and including this have left the window
+    uint64_t counts;
+    uint32_t coveredSeconds;
+} CountRateSum;
+
+/// <summary>
+/// Per-second counts from the Geiger counter with running sums over sliding windows, so
+/// that adding a second and reading any window's rate are both O(1) (amortized over gaps).
+/// </summary>
+typedef struct CountRate {
+    CountRateSlot slots[COUNT_RATE_HISTORY_SECONDS];
+    CountRateSum sums[CountRateWindow_Count];
+    int64_t firstNanoseconds;
+    uint32_t lastSecond;
+    bool started;
+} CountRate;
+
+void CountRate_Init(CountRate *rate);
+
+/// <summary>
+/// Record the counts for the second ending at the given CLOCK_MONOTONIC time.
+/// </summary>
+void CountRate_Add(CountRate *rate, int64_t timestampNanoseconds, uint32_t counts);
+
+void CountRate_GetEstimate(const CountRate *rate, CountRateWindow window, CountRateEstimate *estimate);
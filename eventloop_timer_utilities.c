@@ -2,49 +2,310 @@
    Licensed under the MIT License. */
 
 #include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
 #include <stdlib.h>
 
 #include <errno.h>
 #include <string.h>
 #include <unistd.h>
+#include <time.h>
 #include <sys/timerfd.h>
 
 #include <applibs/log.h>
 #include <applibs/eventloop.h>
 
 #include "eventloop_timer_utilities.h"
+#include "loop_profiler.h"
+#include "timer_wheel.h"
 
-static int SetTimerPeriod(int timerFd, const struct timespec *initial,
-                          const struct timespec *repeat);
+// All timers on an event loop are multiplexed onto one timerfd, which is armed for the
+// earliest deadline in a timer wheel. Deadlines are kept in 1 ms ticks.
+#define TICK_NANOSECONDS 1000000LL
 
-static int SetTimerPeriod(int timerFd, const struct timespec *initial,
-                          const struct timespec *repeat)
+// Coalescing: a deadline may be deferred by up to 1/32 of the timer's interval, capped at
+// 16 ms, by rounding it up to a power-of-two number of ticks. Every timer rounds onto the
+// same global grid, so deadlines that are close together land on the same tick and are
+// served by one wakeup. Timers shorter than 64 ms are never deferred.
+#define COALESCING_DIVISOR 32
+#define MAX_COALESCING_TICKS 16
+
+typedef struct TimerScheduler {
+    EventLoop *eventLoop;
+    int fd;
+    EventRegistration *registration;
+    TimerWheel wheel;
+    EventLoopTimer *timers; // every timer on the loop, armed or not, in creation order
+    uint64_t armedTick; // tick the timerfd is armed for, or UINT64_MAX if it is disarmed
+    size_t timerCount;
+    bool dispatching;
+    EventLoopTimer *runningTimer; // cleared if the timer is disposed of by its own handler
+    struct TimerScheduler *next;
+} TimerScheduler;
+
+struct EventLoopTimer {
+    TimerScheduler *scheduler;
+    EventLoopTimerHandler handler;
+    TimerWheelEntry entry;
+    int64_t deadlineNanoseconds;  // CLOCK_MONOTONIC time of the next expiry, before coalescing
+    int64_t scheduledNanoseconds; // the same after coalescing: when the wheel will fire it
+    int64_t periodNanoseconds;    // 0 for a one-shot or disarmed timer
+    uint64_t expirations;         // not yet consumed by the handler
+    const char *name;
+    EventLoopTimerStats stats;
+#if LOOP_PROFILER
+    LoopProfilerSection profile; // time spent in the handler
+#endif
+    struct EventLoopTimer *next;
+};
+
+const uint32_t EventLoopTimerLatenessBucketMicroseconds[EVENT_LOOP_TIMER_LATENESS_BUCKETS - 1] = {
+    100, 500, 1000, 2000, 5000, 10000, 50000};
+
+static TimerScheduler *schedulers = NULL;
+
+static int64_t GetMonotonicNanoseconds(void)
 {
-    static const struct timespec nullTimeSpec = {.tv_sec = 0, .tv_nsec = 0};
-    struct itimerspec newValue = {.it_value = initial ? *initial : nullTimeSpec,
-                                  .it_interval = repeat ? *repeat : nullTimeSpec};
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (int64_t)now.tv_sec * 1000000000LL + now.tv_nsec;
+}
+
+static int64_t TimespecToNanoseconds(const struct timespec *value)
+{
+    return value == NULL ? 0 : (int64_t)value->tv_sec * 1000000000LL + value->tv_nsec;
+}
 
-    if (timerfd_settime(timerFd, /* flags */ 0, &newValue, /* old_value */ NULL) == -1) {
+static EventLoopTimer *TimerFromEntry(TimerWheelEntry *entry)
+{
+    return (EventLoopTimer *)((char *)entry - offsetof(EventLoopTimer, entry));
+}
+
+/// <summary>
+///     Arm the shared timerfd for the earliest deadline in the wheel, or disarm it.
+///     Deferred while timers are being dispatched, since handlers commonly re-arm.
+/// </summary>
+static int ArmScheduler(TimerScheduler *scheduler)
+{
+    if (scheduler->dispatching) {
+        return 0;
+    }
+
+    uint64_t tick;
+    if (!TimerWheel_NextExpiry(&scheduler->wheel, &tick)) {
+        tick = UINT64_MAX;
+    }
+    if (tick == scheduler->armedTick) {
+        return 0;
+    }
+
+    struct itimerspec newValue = {.it_value = {.tv_sec = 0, .tv_nsec = 0},
+                                  .it_interval = {.tv_sec = 0, .tv_nsec = 0}};
+    if (tick != UINT64_MAX) {
+        uint64_t nanoseconds = tick * (uint64_t)TICK_NANOSECONDS;
+        newValue.it_value.tv_sec = (time_t)(nanoseconds / 1000000000);
+        newValue.it_value.tv_nsec = (long)(nanoseconds % 1000000000);
+    }
+
+    if (timerfd_settime(scheduler->fd, TFD_TIMER_ABSTIME, &newValue, /* old_value */ NULL) == -1) {
         Log_Debug("ERROR: Could not set timer period: %s (%d).\n", strerror(errno), errno);
+        scheduler->armedTick = 0; // state unknown, so the next call always re-arms
         return -1;
     }
 
+    scheduler->armedTick = tick;
     return 0;
 }
 
-struct EventLoopTimer {
-    EventLoop *eventLoop;
-    EventLoopTimerHandler handler;
-    int fd;
-    EventRegistration *registration;
-};
+/// <summary>
+///     Put a timer in the wheel at its deadline, rounded up onto the coalescing grid for
+///     its interval. Rounding only ever defers, so a timer never fires early.
+/// </summary>
+static void ScheduleTimer(EventLoopTimer *timer, int64_t intervalNanoseconds)
+{
+    uint64_t granularity = (uint64_t)(intervalNanoseconds / TICK_NANOSECONDS / COALESCING_DIVISOR);
+    uint64_t ticks = 1;
+    while (ticks * 2 <= granularity && ticks < MAX_COALESCING_TICKS) {
+        ticks *= 2;
+    }
+
+    uint64_t tick = (uint64_t)((timer->deadlineNanoseconds + TICK_NANOSECONDS - 1) / TICK_NANOSECONDS);
+    tick = (tick + ticks - 1) & ~(ticks - 1);
+    timer->scheduledNanoseconds = (int64_t)tick * TICK_NANOSECONDS;
+    TimerWheel_Insert(&timer->scheduler->wheel, &timer->entry, tick);
+}
+
+/// <summary>
+///     Record how late a dispatch is relative to the time the wheel scheduled it for, so
+///     the histogram shows loop stalls rather than deliberate coalescing.
+/// </summary>
+static void RecordDispatch(EventLoopTimer *timer, int64_t now)
+{
+    int64_t lateness = now - timer->scheduledNanoseconds;
+    uint32_t latenessMicroseconds = lateness <= 0 ? 0
+                                    : lateness / 1000 > UINT32_MAX ? UINT32_MAX
+                                                                   : (uint32_t)(lateness / 1000);
+
+    size_t bucket = 0;
+    while (bucket < EVENT_LOOP_TIMER_LATENESS_BUCKETS - 1 &&
+           latenessMicroseconds > EventLoopTimerLatenessBucketMicroseconds[bucket]) {
+        bucket++;
+    }
+
+    timer->stats.dispatches++;
+    timer->stats.latenessHistogram[bucket]++;
+    if (latenessMicroseconds > timer->stats.maxLatenessMicroseconds) {
+        timer->stats.maxLatenessMicroseconds = latenessMicroseconds;
+    }
+}
+
+static void DisposeScheduler(TimerScheduler *scheduler)
+{
+    for (TimerScheduler **link = &schedulers; *link != NULL; link = &(*link)->next) {
+        if (*link == scheduler) {
+            *link = scheduler->next;
+            break;
+        }
+    }
+
+    EventLoop_UnregisterIo(scheduler->eventLoop, scheduler->registration);
+    if (scheduler->fd != -1) {
+        close(scheduler->fd);
+    }
+    free(scheduler);
+}
 
 // This satisfies the EventLoopIoCallback signature.
-static void TimerCallback(EventLoop *el, int fd, EventLoop_IoEvents events, void *context)
+static void SchedulerCallback(EventLoop *el, int fd, EventLoop_IoEvents events, void *context)
 {
-    EventLoopTimer *timer = (EventLoopTimer *)context;
+    TimerScheduler *scheduler = (TimerScheduler *)context;
+
+    uint64_t timerData = 0;
+    if (read(scheduler->fd, &timerData, sizeof(timerData)) == -1 && errno != EAGAIN) {
+        Log_Debug("ERROR: Could not read timerfd %s (%d).\n", strerror(errno), errno);
+    }
+    scheduler->armedTick = UINT64_MAX;
+
+    // Only timers due when the pass starts are dispatched, so a slow pass can't run forever
+    uint64_t passTick = (uint64_t)(GetMonotonicNanoseconds() / TICK_NANOSECONDS);
+
+    scheduler->dispatching = true;
+    TimerWheelEntry *entry;
+    while ((entry = TimerWheel_Expire(&scheduler->wheel, passTick)) != NULL) {
+        EventLoopTimer *timer = TimerFromEntry(entry);
+        timer->expirations++;
 
-    timer->handler(timer);
+        // Read the clock for each dispatch, so that the time taken by handlers earlier in
+        // the pass counts towards the lateness and missed periods of the ones after them
+        int64_t now = GetMonotonicNanoseconds();
+        RecordDispatch(timer, now);
+
+        if (timer->periodNanoseconds > 0) {
+            // As with a timerfd, periods missed while the loop was busy are counted in the
+            // expirations rather than delivered back to back
+            timer->deadlineNanoseconds += timer->periodNanoseconds;
+            if (timer->deadlineNanoseconds <= now) {
+                int64_t missed = (now - timer->deadlineNanoseconds) / timer->periodNanoseconds + 1;
+                timer->expirations += (uint64_t)missed;
+                timer->stats.missedExpirations += (uint32_t)missed;
+                timer->deadlineNanoseconds += missed * timer->periodNanoseconds;
+            }
+            ScheduleTimer(timer, timer->periodNanoseconds);
+        }
+
+        // The handler may re-arm or dispose of this or any other timer
+        scheduler->runningTimer = timer;
+#if LOOP_PROFILER
+        int64_t start = LoopProfiler_Begin();
+        timer->handler(timer);
+        LoopProfiler_End(scheduler->runningTimer != NULL ? &timer->profile : NULL, start);
+#else
+        timer->handler(timer);
+#endif
+        scheduler->runningTimer = NULL;
+    }
+    scheduler->dispatching = false;
+
+    if (scheduler->timerCount == 0) {
+        DisposeScheduler(scheduler);
+        return;
+    }
+    ArmScheduler(scheduler);
+}
+
+// Covers the wheel's own work as well as the handlers, which are also profiled individually
+LOOP_PROFILER_IO_CALLBACK(ProfiledSchedulerCallback, SchedulerCallback, "timer_dispatch")
+
+static TimerScheduler *GetScheduler(EventLoop *eventLoop)
+{
+    for (TimerScheduler *scheduler = schedulers; scheduler != NULL; scheduler = scheduler->next) {
+        if (scheduler->eventLoop == eventLoop) {
+            return scheduler;
+        }
+    }
+
+    TimerScheduler *scheduler = malloc(sizeof(TimerScheduler));
+    if (scheduler == NULL) {
+        return NULL;
+    }
+
+    scheduler->eventLoop = eventLoop;
+    scheduler->registration = NULL;
+    scheduler->timers = NULL;
+    scheduler->armedTick = UINT64_MAX;
+    scheduler->timerCount = 0;
+    scheduler->dispatching = false;
+    scheduler->runningTimer = NULL;
+    TimerWheel_Init(&scheduler->wheel, (uint64_t)(GetMonotonicNanoseconds() / TICK_NANOSECONDS));
+
+    scheduler->fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK);
+    if (scheduler->fd == -1) {
+        Log_Debug("ERROR: Unable to create timer: %s (%d).\n", strerror(errno), errno);
+        free(scheduler);
+        return NULL;
+    }
+
+    scheduler->registration = EventLoop_RegisterIo(eventLoop, scheduler->fd, EventLoop_Input,
+                                                   ProfiledSchedulerCallback, scheduler);
+    if (scheduler->registration == NULL) {
+        Log_Debug("ERROR: Unable to register timer event: %s (%d).\n", strerror(errno), errno);
+        close(scheduler->fd);
+        free(scheduler);
+        return NULL;
+    }
+
+    scheduler->next = schedulers;
+    schedulers = scheduler;
+    return scheduler;
+}
+
+/// <summary>
+///     Common implementation of the arming functions; a zero or NULL initial delay
+///     disarms the timer, as it would for timerfd_settime.
+/// </summary>
+static int SetTimer(EventLoopTimer *timer, const struct timespec *initial,
+                    const struct timespec *repeat)
+{
+    int64_t initialNanoseconds = TimespecToNanoseconds(initial);
+    int64_t repeatNanoseconds = TimespecToNanoseconds(repeat);
+    if (initialNanoseconds < 0 || repeatNanoseconds < 0) {
+        errno = EINVAL;
+        Log_Debug("ERROR: Could not set timer period: %s (%d).\n", strerror(errno), errno);
+        return -1;
+    }
+
+    // Expirations from the previous setting are discarded, as timerfd_settime does
+    timer->expirations = 0;
+    timer->periodNanoseconds = repeatNanoseconds;
+    if (initialNanoseconds == 0) {
+        TimerWheel_Remove(&timer->scheduler->wheel, &timer->entry);
+    }
+    else {
+        timer->deadlineNanoseconds = GetMonotonicNanoseconds() + initialNanoseconds;
+        ScheduleTimer(timer, repeatNanoseconds != 0 ? repeatNanoseconds : initialNanoseconds);
+    }
+
+    return ArmScheduler(timer->scheduler);
 }
 
 EventLoopTimer *CreateEventLoopPeriodicTimer(EventLoop *eventLoop, EventLoopTimerHandler handler,
@@ -60,35 +321,39 @@ EventLoopTimer *CreateEventLoopPeriodicTimer(EventLoop *eventLoop, EventLoopTime
         return NULL;
     }
 
-    timer->eventLoop = eventLoop;
     timer->handler = handler;
+    timer->entry.next = NULL;
+    timer->entry.pprev = NULL;
+    timer->deadlineNanoseconds = 0;
+    timer->periodNanoseconds = 0;
+    timer->expirations = 0;
+    timer->name = NULL;
+    memset(&timer->stats, 0, sizeof(timer->stats));
+#if LOOP_PROFILER
+    memset(&timer->profile, 0, sizeof(timer->profile));
+    timer->profile.name = "timer";
+#endif
+    timer->next = NULL;
 
-    // Initialize to unused values in case have to clean up partially initialized object.
-    timer->fd = -1;
-    timer->registration = NULL;
-
-    timer->fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK);
-    if (timer->fd == -1) {
-        Log_Debug("ERROR: Unable to create timer: %s (%d).\n", strerror(errno), errno);
-        goto failed;
+    timer->scheduler = GetScheduler(eventLoop);
+    if (timer->scheduler == NULL) {
+        free(timer);
+        return NULL;
     }
+    timer->scheduler->timerCount++;
 
-    if (SetTimerPeriod(timer->fd, /* initial */ period, /* repeat */ period) == -1) {
-        goto failed;
+    EventLoopTimer **link = &timer->scheduler->timers;
+    while (*link != NULL) {
+        link = &(*link)->next;
     }
+    *link = timer;
 
-    timer->registration =
-        EventLoop_RegisterIo(eventLoop, timer->fd, EventLoop_Input, TimerCallback, timer);
-    if (timer->registration == NULL) {
-        Log_Debug("ERROR: Unable to register timer event: %s (%d).\n", strerror(errno), errno);
-        goto failed;
+    if (SetTimer(timer, /* initial */ period, /* repeat */ period) == -1) {
+        DisposeEventLoopTimer(timer);
+        return NULL;
     }
 
     return timer;
-
-failed:
-    DisposeEventLoopTimer(timer);
-    return NULL;
 }
 
 EventLoopTimer *CreateEventLoopDisarmedTimer(EventLoop *eventLoop, EventLoopTimerHandler handler)
@@ -102,38 +367,89 @@ void DisposeEventLoopTimer(EventLoopTimer *timer)
         return;
     }
 
-    EventLoop_UnregisterIo(timer->eventLoop, timer->registration);
-
-    if (timer->fd != -1) {
-        close(timer->fd);
+    TimerScheduler *scheduler = timer->scheduler;
+    TimerWheel_Remove(&scheduler->wheel, &timer->entry);
+    if (scheduler->runningTimer == timer) {
+        scheduler->runningTimer = NULL;
+    }
+#if LOOP_PROFILER
+    LoopProfiler_RemoveSection(&timer->profile);
+#endif
+    for (EventLoopTimer **link = &scheduler->timers; *link != NULL; link = &(*link)->next) {
+        if (*link == timer) {
+            *link = timer->next;
+            break;
+        }
     }
-
     free(timer);
+
+    // A scheduler that is dispatching is cleaned up when the dispatch finishes
+    if (--scheduler->timerCount == 0 && !scheduler->dispatching) {
+        DisposeScheduler(scheduler);
+    }
+    else {
+        ArmScheduler(scheduler);
+    }
 }
 
 int ConsumeEventLoopTimerEvent(EventLoopTimer *timer)
 {
-    uint64_t timerData = 0;
+    uint64_t expirations;
+    return ConsumeEventLoopTimerEventCount(timer, &expirations);
+}
 
-    if (read(timer->fd, &timerData, sizeof(timerData)) == -1) {
+int ConsumeEventLoopTimerEventCount(EventLoopTimer *timer, uint64_t *expirations)
+{
+    if (timer->expirations == 0) {
+        // Matches reading a timerfd that has not expired
+        errno = EAGAIN;
         Log_Debug("ERROR: Could not read timerfd %s (%d).\n", strerror(errno), errno);
         return -1;
     }
 
+    *expirations = timer->expirations;
+    timer->expirations = 0;
     return 0;
 }
 
+void SetEventLoopTimerName(EventLoopTimer *timer, const char *name)
+{
+    timer->name = name;
+#if LOOP_PROFILER
+    timer->profile.name = name;
+#endif
+}
+
+void ForEachEventLoopTimer(EventLoop *eventLoop, EventLoopTimerVisitor visitor, void *context)
+{
+    for (TimerScheduler *scheduler = schedulers; scheduler != NULL; scheduler = scheduler->next) {
+        if (scheduler->eventLoop != eventLoop) {
+            continue;
+        }
+        for (EventLoopTimer *timer = scheduler->timers; timer != NULL; timer = timer->next) {
+            if (timer->name != NULL) {
+                visitor(timer, timer->name, &timer->stats, context);
+            }
+        }
+    }
+}
+
+void ResetEventLoopTimerStats(EventLoopTimer *timer)
+{
+    memset(&timer->stats, 0, sizeof(timer->stats));
+}
+
 int SetEventLoopTimerPeriod(EventLoopTimer *timer, const struct timespec *period)
 {
-    return SetTimerPeriod(timer->fd, /* initial */ period, /* repeat */ period);
+    return SetTimer(timer, /* initial */ period, /* repeat */ period);
 }
 
 int SetEventLoopTimerOneShot(EventLoopTimer *timer, const struct timespec *delay)
 {
-    return SetTimerPeriod(timer->fd, /* initial */ delay, /* repeat */ NULL);
+    return SetTimer(timer, /* initial */ delay, /* repeat */ NULL);
 }
 
 int DisarmEventLoopTimer(EventLoopTimer *timer)
 {
-    return SetTimerPeriod(timer->fd, /* initial */ NULL, /* repeat */ NULL);
+    return SetTimer(timer, /* initial */ NULL, /* repeat */ NULL);
 }
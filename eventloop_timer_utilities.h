@@ -2,6 +2,7 @@
    Licensed under the MIT License. */
 
 #pragma once
+#include <stdint.h>
 #include <time.h>
 
 #include <unistd.h>
@@ -24,6 +25,25 @@ typedef struct EventLoopTimer EventLoopTimer;
 /// <seealso cref="CreateEventLoopDisarmedTimer" />
 typedef void (*EventLoopTimerHandler)(EventLoopTimer *timer);
 
+/// <summary>
+/// Number of buckets in a timer's dispatch lateness histogram. Bucket i counts dispatches
+/// no later than <see cref="EventLoopTimerLatenessBucketMicroseconds" />[i] after the
+/// scheduled time; the last bucket counts everything later than that.
+/// </summary>
+#define EVENT_LOOP_TIMER_LATENESS_BUCKETS 8
+
+extern const uint32_t EventLoopTimerLatenessBucketMicroseconds[EVENT_LOOP_TIMER_LATENESS_BUCKETS - 1];
+
+/// <summary>
+/// Dispatch statistics kept for every timer.
+/// </summary>
+typedef struct EventLoopTimerStats {
+    uint32_t dispatches;
+    uint32_t missedExpirations; // periods that elapsed while the loop was busy
+    uint32_t latenessHistogram[EVENT_LOOP_TIMER_LATENESS_BUCKETS];
+    uint32_t maxLatenessMicroseconds;
+} EventLoopTimerStats;
+
 /// <summary>
 /// Create a periodic timer which is invoked on the event loop. The timer
 /// will begin firing immediately.
@@ -64,6 +84,41 @@ void DisposeEventLoopTimer(EventLoopTimer *timer);
 /// <returns>0 on success, -1 on failure, in which case errno contains more information.</returns>
 int ConsumeEventLoopTimerEvent(EventLoopTimer *timer);
 
+/// <summary>
+/// Consume the timer event like <see cref="ConsumeEventLoopTimerEvent" />, and report how
+/// many times the timer expired since it was last consumed. A count above one means the
+/// loop was too busy to dispatch every period, so a handler can catch up on the work it
+/// missed.
+/// </summary>
+/// <param name="timer">Successfully allocated timer.</param>
+/// <param name="expirations">Receives the number of expirations, at least one.</param>
+/// <returns>0 on success, -1 on failure, in which case errno contains more information.</returns>
+int ConsumeEventLoopTimerEventCount(EventLoopTimer *timer, uint64_t *expirations);
+
+/// <summary>
+/// Give a timer a name, under which its statistics are reported. The string is not
+/// copied and must outlive the timer.
+/// </summary>
+void SetEventLoopTimerName(EventLoopTimer *timer, const char *name);
+
+/// <summary>
+/// Applications implement a function with this signature to visit timers with
+/// <see cref="ForEachEventLoopTimer" />.
+/// </summary>
+typedef void (*EventLoopTimerVisitor)(EventLoopTimer *timer, const char *name,
+                                      const EventLoopTimerStats *stats, void *context);
+
+/// <summary>
+/// Call the visitor for every named timer on the event loop, in creation order. The
+/// visitor must not create or dispose of timers.
+/// </summary>
+void ForEachEventLoopTimer(EventLoop *eventLoop, EventLoopTimerVisitor visitor, void *context);
+
+/// <summary>
+/// Clear a timer's statistics, typically after they have been reported.
+/// </summary>
+void ResetEventLoopTimerStats(EventLoopTimer *timer);
+
 /// <summary>
 /// Change the timer's period. This function should only be called to change an existing
 /// timer's period. It does not have to be called to set the initial period - that is
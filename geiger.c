@@ -3,8 +3,10 @@
 
 #include <errno.h>
 #include <stdbool.h>
+#include <stdio.h>
 #include <string.h>
 #include <signal.h>
+#include <time.h>
 
 // applibs_versions.h defines the API struct versions to use for applibs APIs.
 #include "applibs_versions.h"
@@ -14,66 +16,156 @@
 
 #include "eventloop_timer_utilities.h"
 #include "log_utils.h"
+#include "loop_profiler.h"
+#include "geiger_parser.h"
+#include "spike_detector.h"
+#include "upload.h"
 
 #include "geiger.h"
 
-static int uartFd = -1;
-static uint8_t messageBuffer[1024];
-static size_t messageBytesReceived = 0;
+// Receive buffer size; a full buffer is followed by another read, so this only bounds how
+// much is handed to the parser at once
+#define GEIGER_RECEIVE_BUFFER_SIZE 1024
+
+// Number of lines between UART statistics reports (about one minute of counter output)
+#define UART_STATS_REPORT_LINES 60
+
+/// <summary>
+/// One Geiger counter on its own UART. Everything that depends on the byte stream (the
+/// parser, the statistics and the spike detector) is kept per counter.
+/// </summary>
+typedef struct GeigerCounter {
+    const char *sensorId;
+    UART_Id uartId;
+
+    uint32_t index;
+    int uartFd;
+    EventRegistration *uartEventReg;
+    GeigerParser parser;
+    SpikeDetector spikeDetector;
+    GeigerUartStats uartStats;
+} GeigerCounter;
+
+// Attached counters. The first keeps the plain "geiger" id so that existing dashboards
+// carry on working. A second tube needs another ISU configured as a UART (ISU1 is taken by
+// the I2C bus on this board), a matching entry in the manifest's Uart capability, and the
+// GEIGER_2_UART CMake setting naming it, which builds with GEIGER_COUNT=2.
+static GeigerCounter counters[] = {
+    {.sensorId = "geiger", .uartId = SEEED_MT3620_MDB_J1_ISU0_UART},
+#if GEIGER_COUNT > 1
+    {.sensorId = "geiger_2", .uartId = GEIGER_2_UART},
+#endif
+};
+
+_Static_assert(sizeof(counters) / sizeof(counters[0]) == GEIGER_COUNT,
+               "GEIGER_COUNT must match the counters table");
+
+// Shared by all counters; handlers run one at a time on the event loop
+static uint8_t receiveBuffer[GEIGER_RECEIVE_BUFFER_SIZE];
 static datablock_t *dataBlock = NULL;
-static EventRegistration* uartEventReg = NULL;
 static EventLoop *eventLoop = NULL; // not owned
 
-static void UartEventHandler(EventLoop* el, int fd, EventLoop_IoEvents events, void* context)
+static void GeigerMessageReceived(const GeigerMessage *message, void *context)
 {
-    const size_t receiveBufferSize = 256;
-    uint8_t receiveBuffer[receiveBufferSize + 1]; // allow extra byte for string termination
-    ssize_t bytesRead;
-
-    // Read incoming UART data. It is expected behavior that messages may be received in multiple
-    // partial chunks.
-    bytesRead = read(uartFd, receiveBuffer, receiveBufferSize);
-    if (bytesRead == -1) {
-        Log_Debug("ERROR: Could not read UART: %s (%d).\n", strerror(errno), errno);
-        return;
+    GeigerCounter *counter = context;
+
+    GeigerWindow *window = DataBlock_ActiveGeigerWindow(dataBlock, counter->index);
+    window->cpm = message->cpm;
+    window->nanosievertsPerHour = message->nanosievertsPerHour;
+    window->cpmMessagesReceived++;
+
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    int64_t nowNanoseconds = (int64_t)now.tv_sec * 1000 * 1000 * 1000 + now.tv_nsec;
+    CountRate *countRate = &dataBlock->countRate[counter->index];
+    CountRate_Add(countRate, nowNanoseconds, message->cps);
+
+    // Test for a spike against the hourly rate rather than waiting for the next upload
+    CountRateEstimate baseline;
+    CountRate_GetEstimate(countRate, CountRateWindow_Hour, &baseline);
+    SpikeAlert alert;
+    if (SpikeDetector_Add(&counter->spikeDetector, nowNanoseconds, message->cps, baseline.cpm / 60,
+                          baseline.coverage, &alert)) {
+        Log_Debug("ALERT: radiation spike on %s, %u counts in %d s (expected %.1f)\n",
+                  counter->sensorId, alert.counts, SPIKE_WINDOW_SECONDS, alert.expectedCounts);
+        const ReadingField fields[] = {
+            {.name = "counts", .value = alert.counts},
+            {.name = "window_seconds", .value = SPIKE_WINDOW_SECONDS},
+            {.name = "expected_counts", .value = alert.expectedCounts, .decimals = 2},
+            {.name = "baseline_cpm", .value = alert.baselineCps * 60, .decimals = 2},
+            {.name = "log10_p_value", .value = alert.log10PValue, .decimals = 2},
+            {.name = "detected_uptime", .value = (double)nowNanoseconds / (1000 * 1000 * 1000), .decimals = 3},
+            {.name = "detected_at", .type = ReadingFieldType_Timestamp, .integer = Upload_GetUtcMilliseconds()}};
+        char sensor[32];
+        snprintf(sensor, sizeof(sensor), "%s_alert", counter->sensorId);
+        Upload_SendAlert(sensor, fields, sizeof(fields) / sizeof(fields[0]));
     }
+}
 
-    if (bytesRead > 0) {
-        // Copy this fragment into the message buffer
-        // TODO: calc min of bytes read or message buffer left
-        strncpy(messageBuffer + messageBytesReceived, receiveBuffer, (size_t)bytesRead);
-        messageBytesReceived += (size_t)bytesRead;
-
-        // Null terminate the read buffer to make it a valid string, and print it
-        receiveBuffer[bytesRead] = 0;
-        //Log_Debug("UART received %d bytes: '%s'\n", bytesRead, (char*)receiveBuffer);
-
-        if (messageBuffer[messageBytesReceived - 1] == '\n') {
-            messageBuffer[messageBytesReceived] = 0;
-            //Log_Debug("Message has %d bytes: '%s'\n", messageBytesReceived, (char*)messageBuffer);
-            messageBytesReceived = 0;
-
-            const char delimiters[2] = ",";
-            char* token = NULL;
-            token = strtok(messageBuffer, delimiters);
-            for (int x = 1; x < 4; x++)
-            {
-                token = strtok(NULL, delimiters);
-            }
-            if (token) {
-                int cpm = atoi(token);
-                dataBlock->cpm = (uint8_t)cpm;
-                dataBlock->cpmMessagesReceived++;
+static void UartEventHandler(EventLoop* el, int fd, EventLoop_IoEvents events, void* context)
+{
+    GeigerCounter *counter = context;
+    GeigerParser *parser = &counter->parser;
+
+    uint32_t linesBefore = parser->messages + parser->framingErrors + parser->checksumErrors;
+    uint32_t framingErrors = parser->framingErrors;
+    uint32_t checksumErrors = parser->checksumErrors;
+    size_t bytesThisWakeup = 0;
+
+    // Read until the UART is drained so that a burst costs one dispatch, not one per buffer.
+    // It is expected behavior that messages may be received in multiple partial chunks; the
+    // parser picks up where the last chunk left off.
+    for (;;) {
+        ssize_t bytesRead = read(counter->uartFd, receiveBuffer, sizeof(receiveBuffer));
+        if (bytesRead == -1) {
+            if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                Log_Debug("ERROR: Could not read %s UART: %s (%d).\n", counter->sensorId,
+                          strerror(errno), errno);
             }
+            break;
+        }
+        if (bytesRead == 0) {
+            break;
+        }
+
+        GeigerParser_Feed(parser, receiveBuffer, (size_t)bytesRead, GeigerMessageReceived, counter);
+        bytesThisWakeup += (size_t)bytesRead;
+
+        // A short read means the driver had nothing more, so skip the read that would fail
+        if ((size_t)bytesRead < sizeof(receiveBuffer)) {
+            break;
         }
     }
+
+    if (parser->framingErrors != framingErrors || parser->checksumErrors != checksumErrors) {
+        Log_Debug("WARNING: %s sent a bad line (%u framing errors, %u checksum errors)\n",
+                  counter->sensorId, parser->framingErrors, parser->checksumErrors);
+    }
+
+    uint32_t linesThisWakeup = parser->messages + parser->framingErrors + parser->checksumErrors - linesBefore;
+    counter->uartStats.wakeups++;
+    counter->uartStats.bytes += bytesThisWakeup;
+    counter->uartStats.lines += linesThisWakeup;
+    if (bytesThisWakeup > counter->uartStats.maxBytesPerWakeup) {
+        counter->uartStats.maxBytesPerWakeup = bytesThisWakeup;
+    }
+    if (linesThisWakeup > counter->uartStats.maxLinesPerWakeup) {
+        counter->uartStats.maxLinesPerWakeup = linesThisWakeup;
+    }
+
+    if (counter->uartStats.lines >= UART_STATS_REPORT_LINES) {
+        Log_Debug("%s UART: %u wakeups for %u lines (%zu bytes), max %zu bytes and %u lines per wakeup\n",
+                  counter->sensorId, counter->uartStats.wakeups, counter->uartStats.lines,
+                  counter->uartStats.bytes, counter->uartStats.maxBytesPerWakeup,
+                  counter->uartStats.maxLinesPerWakeup);
+        memset(&counter->uartStats, 0, sizeof(counter->uartStats));
+    }
 }
 
-ExitCode Geiger_Init(EventLoop *eventLoopInstance, datablock_t *dataBlockInstance)
-{
-    eventLoop = eventLoopInstance;
-    dataBlock = dataBlockInstance;
+LOOP_PROFILER_IO_CALLBACK(ProfiledUartEventHandler, UartEventHandler, "geiger_uart")
 
+static ExitCode OpenCounter(GeigerCounter *counter)
+{
     // Create a UART_Config object, open the UART and set up UART event handler
     UART_Config uartConfig;
     UART_InitConfig(&uartConfig);
@@ -82,22 +174,60 @@ ExitCode Geiger_Init(EventLoop *eventLoopInstance, datablock_t *dataBlockInstanc
     uartConfig.parity = UART_Parity_None;
     uartConfig.stopBits = UART_StopBits_One;
     uartConfig.flowControl = UART_FlowControl_None;
-    uartFd = UART_Open(SEEED_MT3620_MDB_J1_ISU0_UART, &uartConfig);
-    if (uartFd == -1) {
-        Log_Debug("ERROR: Could not open UART: %s (%d).\n", strerror(errno), errno);
+    counter->uartFd = UART_Open(counter->uartId, &uartConfig);
+    if (counter->uartFd == -1) {
+        Log_Debug("ERROR: Could not open %s UART: %s (%d).\n", counter->sensorId, strerror(errno),
+                  errno);
         return ExitCode_Init_UartOpen;
     }
-    uartEventReg = EventLoop_RegisterIo(eventLoop, uartFd, EventLoop_Input, UartEventHandler, NULL);
-    if (uartEventReg == NULL) {
+    counter->uartEventReg = EventLoop_RegisterIo(eventLoop, counter->uartFd, EventLoop_Input,
+                                                 ProfiledUartEventHandler, counter);
+    if (counter->uartEventReg == NULL) {
         return ExitCode_Init_RegisterIo;
     }
     return ExitCode_Success;
 }
 
-void Geiger_Fini(void)
+ExitCode Geiger_Init(EventLoop *eventLoopInstance, datablock_t *dataBlockInstance)
 {
-    EventLoop_UnregisterIo(eventLoop, uartEventReg);
+    eventLoop = eventLoopInstance;
+    dataBlock = dataBlockInstance;
+
+    for (uint32_t i = 0; i < GEIGER_COUNT; i++) {
+        GeigerCounter *counter = &counters[i];
+        counter->index = i;
+        counter->uartFd = -1;
+        counter->uartEventReg = NULL;
+        memset(&counter->uartStats, 0, sizeof(counter->uartStats));
+        GeigerParser_Init(&counter->parser);
+        SpikeDetector_Init(&counter->spikeDetector);
+        CountRate_Init(&dataBlock->countRate[i]);
+    }
+
+    for (uint32_t i = 0; i < GEIGER_COUNT; i++) {
+        ExitCode exitCode = OpenCounter(&counters[i]);
+        if (exitCode != ExitCode_Success) {
+            return exitCode;
+        }
+    }
+    return ExitCode_Success;
+}
 
+void Geiger_Fini(void)
+{
     Log_Debug("Closing file descriptors.\n");
-    CloseFdAndLogOnError(uartFd, "Uart");
+    for (uint32_t i = 0; i < GEIGER_COUNT; i++) {
+        EventLoop_UnregisterIo(eventLoop, counters[i].uartEventReg);
+        CloseFdAndLogOnError(counters[i].uartFd, "Uart");
+    }
+}
+
+const char *Geiger_SensorId(uint32_t counter)
+{
+    return counters[counter].sensorId;
+}
+
+void Geiger_GetUartStats(uint32_t counter, GeigerUartStats *stats)
+{
+    *stats = counters[counter].uartStats;
 }
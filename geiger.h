@@ -3,8 +3,33 @@
 
 #pragma once
 
+#include <stddef.h>
+#include <stdint.h>
+
 #include <applibs/eventloop.h>
 #include "main.h"
 
 ExitCode Geiger_Init(EventLoop *eventLoopInstance, datablock_t *dataBlock);
 void Geiger_Fini(void);
+
+/// <summary>
+/// The id that readings from the given counter are tagged with.
+/// </summary>
+const char *Geiger_SensorId(uint32_t counter);
+
+/// <summary>
+/// How a counter's UART has been read: wakeups of the UART handler and the bytes and lines
+/// they drained. Logged and reset about once a minute, every 60 lines.
+/// </summary>
+typedef struct GeigerUartStats {
+    uint32_t wakeups;
+    uint32_t lines;
+    size_t bytes;
+    size_t maxBytesPerWakeup;
+    uint32_t maxLinesPerWakeup;
+} GeigerUartStats;
+
+/// <summary>
+/// The given counter's UART statistics since they were last reset.
+/// </summary>
+void Geiger_GetUartStats(uint32_t counter, GeigerUartStats *stats);
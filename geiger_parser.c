@@ -0,0 +1,224 @@
+#include <string.h>
+
+#include "geiger_parser.h"
+
+// Lines from the counter are well under this; anything longer is noise
+#define MAX_LINE_LENGTH 128
+
+#define FIELD_COUNT 7
+
+// Even-numbered fields are labels, odd-numbered fields are values, and the last is the mode
+static const char *const labels[] = {"CPS", NULL, "CPM", NULL, "uSv/hr", NULL, NULL};
+static const char *const modeNames[] = {
+    [GeigerMode_Slow] = "SLOW",
+    [GeigerMode_Fast] = "FAST",
+    [GeigerMode_Instant] = "INST",
+};
+#define MODE_COUNT (sizeof(modeNames) / sizeof(modeNames[0]))
+#define ALL_MODES ((uint8_t)((1 << MODE_COUNT) - 1))
+
+static void ResetLine(GeigerParser *parser)
+{
+    parser->lineLength = 0;
+    parser->field = 0;
+    parser->fieldLength = 0;
+    parser->lineValid = true;
+    parser->checksum = 0;
+    parser->inChecksum = false;
+    parser->expectedChecksum = 0;
+    parser->checksumDigits = 0;
+    parser->value = 0;
+    parser->fractionDigits = 0;
+    parser->sawDecimalPoint = false;
+    parser->modeCandidates = ALL_MODES;
+    memset(&parser->message, 0, sizeof(parser->message));
+}
+
+void GeigerParser_Init(GeigerParser *parser)
+{
+    memset(parser, 0, sizeof(*parser));
+    ResetLine(parser);
+}
+
+static int HexValue(uint8_t c)
+{
+    if (c >= '0' && c <= '9') {
+        return c - '0';
+    }
+    if (c >= 'A' && c <= 'F') {
+        return c - 'A' + 10;
+    }
+    if (c >= 'a' && c <= 'f') {
+        return c - 'a' + 10;
+    }
+    return -1;
+}
+
+static void FinishField(GeigerParser *parser)
+{
+    if (parser->field >= FIELD_COUNT || parser->fieldLength == 0) {
+        parser->lineValid = false;
+        return;
+    }
+
+    if (labels[parser->field] != NULL) {
+        // The whole label must have matched, not just a prefix of it
+        if (parser->fieldLength != strlen(labels[parser->field])) {
+            parser->lineValid = false;
+        }
+        return;
+    }
+
+    switch (parser->field) {
+    case 1:
+        parser->message.cps = parser->value;
+        break;
+    case 3:
+        parser->message.cpm = parser->value;
+        break;
+    case 5: {
+        // Scale to thousandths, whatever precision the counter printed
+        uint32_t scaled = parser->value;
+        for (uint32_t digits = parser->fractionDigits; digits < 3; digits++) {
+            scaled *= 10;
+        }
+        for (uint32_t digits = parser->fractionDigits; digits > 3; digits--) {
+            scaled /= 10;
+        }
+        parser->message.nanosievertsPerHour = scaled;
+        break;
+    }
+    case 6:
+        for (size_t mode = 0; mode < MODE_COUNT; mode++) {
+            if ((parser->modeCandidates & (1 << mode)) &&
+                parser->fieldLength == strlen(modeNames[mode])) {
+                parser->message.mode = (GeigerMode)mode;
+                return;
+            }
+        }
+        parser->lineValid = false;
+        break;
+    }
+}
+
+static void ConsumeFieldByte(GeigerParser *parser, uint8_t c)
+{
+    if (parser->field >= FIELD_COUNT) {
+        parser->lineValid = false;
+        return;
+    }
+
+    size_t position = parser->fieldLength++;
+
+    if (labels[parser->field] != NULL) {
+        const char *label = labels[parser->field];
+        if (position >= strlen(label) || label[position] != c) {
+            parser->lineValid = false;
+        }
+        return;
+    }
+
+    if (parser->field == FIELD_COUNT - 1) {
+        // Narrow the set of modes this could still be
+        for (size_t mode = 0; mode < MODE_COUNT; mode++) {
+            if (position >= strlen(modeNames[mode]) || modeNames[mode][position] != c) {
+                parser->modeCandidates &= (uint8_t)~(1 << mode);
+            }
+        }
+        if (parser->modeCandidates == 0) {
+            parser->lineValid = false;
+        }
+        return;
+    }
+
+    if (c == '.' && parser->field == 5 && !parser->sawDecimalPoint) {
+        parser->sawDecimalPoint = true;
+        return;
+    }
+    if (c < '0' || c > '9' || parser->value > (UINT32_MAX - 9) / 10) {
+        parser->lineValid = false;
+        return;
+    }
+    parser->value = parser->value * 10 + (uint32_t)(c - '0');
+    if (parser->sawDecimalPoint) {
+        parser->fractionDigits++;
+    }
+}
+
+static void FinishLine(GeigerParser *parser, GeigerMessageCallback callback, void *context)
+{
+    if (parser->lineLength == 0) {
+        // Blank line, e.g. the \n of a \r\n pair
+        ResetLine(parser);
+        return;
+    }
+
+    if (!parser->inChecksum) {
+        FinishField(parser);
+    }
+
+    if (parser->inChecksum &&
+        (parser->checksumDigits != 2 || parser->checksum != parser->expectedChecksum)) {
+        parser->checksumErrors++;
+    }
+    else if (!parser->lineValid || parser->field != FIELD_COUNT - 1) {
+        parser->framingErrors++;
+    }
+    else {
+        parser->messages++;
+        callback(&parser->message, context);
+    }
+
+    ResetLine(parser);
+}
+
+void GeigerParser_Feed(GeigerParser *parser, const uint8_t *data, size_t length,
+                       GeigerMessageCallback callback, void *context)
+{
+    for (size_t i = 0; i < length; i++) {
+        uint8_t c = data[i];
+
+        if (c == '\n') {
+            FinishLine(parser, callback, context);
+            continue;
+        }
+        if (c == '\r') {
+            continue;
+        }
+
+        if (++parser->lineLength > MAX_LINE_LENGTH) {
+            parser->lineValid = false;
+            continue;
+        }
+
+        if (parser->inChecksum) {
+            int digit = HexValue(c);
+            if (digit < 0 || parser->checksumDigits >= 2) {
+                parser->lineValid = false;
+                continue;
+            }
+            parser->expectedChecksum = (uint8_t)(parser->expectedChecksum << 4 | digit);
+            parser->checksumDigits++;
+            continue;
+        }
+
+        if (c == '*') {
+            FinishField(parser);
+            parser->inChecksum = true;
+            continue;
+        }
+        parser->checksum ^= c;
+
+        if (c == ',') {
+            FinishField(parser);
+            parser->field++;
+            parser->fieldLength = 0;
+            parser->value = 0;
+            parser->fractionDigits = 0;
+            parser->sawDecimalPoint = false;
+        }
+        else if (c != ' ') {
+            ConsumeFieldByte(parser, c);
+        }
+    }
+}
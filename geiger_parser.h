@@ -0,0 +1,61 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/// <summary>
+/// Averaging mode reported by the counter.
+/// </summary>
+typedef enum {
+    GeigerMode_Slow,
+    GeigerMode_Fast,
+    GeigerMode_Instant,
+} GeigerMode;
+
+/// <summary>
+/// One line from the counter, e.g. "CPS, 1, CPM, 19, uSv/hr, 0.10, SLOW".
+/// </summary>
+typedef struct GeigerMessage {
+    uint32_t cps;
+    uint32_t cpm;
+    uint32_t nanosievertsPerHour; // uSv/hr scaled by 1000 to stay in integers
+    GeigerMode mode;
+} GeigerMessage;
+
+typedef void (*GeigerMessageCallback)(const GeigerMessage *message, void *context);
+
+/// <summary>
+/// Incremental parser for the counter's serial output. Bytes are consumed in place as they
+/// arrive, so lines may be split across reads or several may arrive in one read. An
+/// optional NMEA-style "*hh" XOR checksum at the end of a line is verified if present.
+/// </summary>
+typedef struct GeigerParser {
+    // Per-line state
+    size_t lineLength;
+    int field;
+    size_t fieldLength;
+    bool lineValid;
+    uint8_t checksum;
+    bool inChecksum;
+    uint8_t expectedChecksum;
+    int checksumDigits;
+    uint32_t value;
+    uint32_t fractionDigits;
+    bool sawDecimalPoint;
+    uint8_t modeCandidates; // bit per GeigerMode that still matches the mode field
+    GeigerMessage message;
+
+    // Totals
+    uint32_t messages;
+    uint32_t framingErrors;
+    uint32_t checksumErrors;
+} GeigerParser;
+
+void GeigerParser_Init(GeigerParser *parser);
+
+/// <summary>
+/// Consume a chunk of bytes, invoking callback for every complete, valid message.
+/// </summary>
+void GeigerParser_Feed(GeigerParser *parser, const uint8_t *data, size_t length,
+                       GeigerMessageCallback callback, void *context);
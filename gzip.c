@@ -0,0 +1,205 @@
+#include <stdbool.h>
+#include <string.h>
+
+#include "gzip.h"
+
+#define HASH_BITS 12
+#define HASH_SIZE (1 << HASH_BITS)
+#define MIN_MATCH 3
+#define MAX_MATCH 258
+#define WINDOW_SIZE 32768
+
+static const uint16_t lengthBase[] = {3,  4,  5,  6,  7,  8,  9,  10, 11,  13,  15,  17,  19,  23, 27,
+                                      31, 35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258};
+static const uint8_t lengthExtraBits[] = {0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2,
+                                          2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0};
+static const uint16_t distanceBase[] = {1,    2,    3,    4,    5,    7,     9,     13,    17,  25,
+                                        33,   49,   65,   97,   129,  193,   257,   385,   513, 769,
+                                        1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577};
+static const uint8_t distanceExtraBits[] = {0, 0, 0, 0, 1, 1, 2, 2,  3,  3,  4,  4,  5,  5,  6,
+                                            6, 7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13};
+
+// Most recent input position for each 3-byte hash, offset by one so that zero means empty
+static uint32_t hashHeads[HASH_SIZE];
+static uint32_t crcTable[256];
+static bool crcTableReady = false;
+
+typedef struct {
+    uint8_t *output;
+    size_t capacity;
+    size_t length;
+    uint32_t bitBuffer;
+    int bitCount;
+    bool overflow;
+} BitWriter;
+
+static void WriteByte(BitWriter *writer, uint8_t value)
+{
+    if (writer->length >= writer->capacity) {
+        writer->overflow = true;
+        return;
+    }
+    writer->output[writer->length++] = value;
+}
+
+// Deflate packs values least significant bit first
+static void WriteBits(BitWriter *writer, uint32_t value, int count)
+{
+    writer->bitBuffer |= value << writer->bitCount;
+    writer->bitCount += count;
+    while (writer->bitCount >= 8) {
+        WriteByte(writer, (uint8_t)writer->bitBuffer);
+        writer->bitBuffer >>= 8;
+        writer->bitCount -= 8;
+    }
+}
+
+// Huffman codes are defined most significant bit first, so they go out reversed
+static void WriteCode(BitWriter *writer, uint32_t code, int length)
+{
+    uint32_t reversed = 0;
+    for (int i = 0; i < length; i++) {
+        reversed = (reversed << 1) | ((code >> i) & 1);
+    }
+    WriteBits(writer, reversed, length);
+}
+
+static void FlushBits(BitWriter *writer)
+{
+    if (writer->bitCount > 0) {
+        WriteByte(writer, (uint8_t)writer->bitBuffer);
+    }
+    writer->bitBuffer = 0;
+    writer->bitCount = 0;
+}
+
+static void WriteLiteralOrLength(BitWriter *writer, uint32_t symbol)
+{
+    if (symbol < 144) {
+        WriteCode(writer, 0x30 + symbol, 8);
+    }
+    else if (symbol < 256) {
+        WriteCode(writer, 0x190 + symbol - 144, 9);
+    }
+    else if (symbol < 280) {
+        WriteCode(writer, symbol - 256, 7);
+    }
+    else {
+        WriteCode(writer, 0xC0 + symbol - 280, 8);
+    }
+}
+
+static void WriteMatch(BitWriter *writer, uint32_t length, uint32_t distance)
+{
+    int code = 28;
+    while (lengthBase[code] > length) {
+        code--;
+    }
+    WriteLiteralOrLength(writer, 257 + (uint32_t)code);
+    WriteBits(writer, length - lengthBase[code], lengthExtraBits[code]);
+
+    code = 29;
+    while (distanceBase[code] > distance) {
+        code--;
+    }
+    WriteCode(writer, (uint32_t)code, 5);
+    WriteBits(writer, distance - distanceBase[code], distanceExtraBits[code]);
+}
+
+static uint32_t Hash(const uint8_t *data)
+{
+    uint32_t value = (uint32_t)data[0] << 16 | (uint32_t)data[1] << 8 | data[2];
+    return (value * 2654435761u) >> (32 - HASH_BITS);
+}
+
+static uint32_t Crc32(const uint8_t *data, size_t length)
+{
+    if (!crcTableReady) {
+        for (uint32_t i = 0; i < 256; i++) {
+            uint32_t crc = i;
+            for (int bit = 0; bit < 8; bit++) {
+                crc = (crc & 1) ? (crc >> 1) ^ 0xEDB88320u : crc >> 1;
+            }
+            crcTable[i] = crc;
+        }
+        crcTableReady = true;
+    }
+
+    uint32_t crc = 0xFFFFFFFFu;
+    for (size_t i = 0; i < length; i++) {
+        crc = crcTable[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+    }
+    return crc ^ 0xFFFFFFFFu;
+}
+
+static void WriteLittleEndian32(BitWriter *writer, uint32_t value)
+{
+    for (int i = 0; i < 4; i++) {
+        WriteByte(writer, (uint8_t)(value >> (8 * i)));
+    }
+}
+
+size_t Gzip_Compress(const uint8_t *input, size_t inputLength, uint8_t *output, size_t outputCapacity)
+{
+    BitWriter writer = {.output = output, .capacity = outputCapacity};
+
+    // Member header: magic, deflate, no flags, no mtime, no extra flags, unknown OS
+    static const uint8_t header[] = {0x1F, 0x8B, 0x08, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0xFF};
+    for (size_t i = 0; i < sizeof(header); i++) {
+        WriteByte(&writer, header[i]);
+    }
+
+    // A single final block with fixed Huffman codes
+    WriteBits(&writer, 1, 1);
+    WriteBits(&writer, 1, 2);
+
+    memset(hashHeads, 0, sizeof(hashHeads));
+
+    size_t position = 0;
+    while (position < inputLength && !writer.overflow) {
+        uint32_t matchLength = 0;
+        uint32_t matchDistance = 0;
+
+        if (position + MIN_MATCH <= inputLength) {
+            uint32_t hash = Hash(input + position);
+            uint32_t candidate = hashHeads[hash];
+            hashHeads[hash] = (uint32_t)position + 1;
+
+            if (candidate != 0 && position - (candidate - 1) <= WINDOW_SIZE) {
+                const uint8_t *previous = input + candidate - 1;
+                size_t limit = inputLength - position;
+                if (limit > MAX_MATCH) {
+                    limit = MAX_MATCH;
+                }
+                while (matchLength < limit && previous[matchLength] == input[position + matchLength]) {
+                    matchLength++;
+                }
+                matchDistance = (uint32_t)(position - (candidate - 1));
+            }
+        }
+
+        if (matchLength >= MIN_MATCH) {
+            WriteMatch(&writer, matchLength, matchDistance);
+
+            // Index the positions covered by the match so later data can refer back to them
+            size_t end = position + matchLength;
+            for (position++; position < end; position++) {
+                if (position + MIN_MATCH <= inputLength) {
+                    hashHeads[Hash(input + position)] = (uint32_t)position + 1;
+                }
+            }
+        }
+        else {
+            WriteLiteralOrLength(&writer, input[position]);
+            position++;
+        }
+    }
+
+    WriteLiteralOrLength(&writer, 256); // end of block
+    FlushBits(&writer);
+
+    WriteLittleEndian32(&writer, Crc32(input, inputLength));
+    WriteLittleEndian32(&writer, (uint32_t)inputLength);
+
+    return writer.overflow ? 0 : writer.length;
+}
@@ -0,0 +1,16 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+/// <summary>
+/// Compress input into a gzip stream in a single pass, using LZ77 matching and the fixed
+/// Huffman tables from RFC 1951. No memory is allocated; the output is written directly
+/// into the caller's buffer.
+/// </summary>
+/// <param name="input">Data to compress.</param>
+/// <param name="inputLength">Number of bytes of input.</param>
+/// <param name="output">Buffer to receive the gzip stream.</param>
+/// <param name="outputCapacity">Size of the output buffer.</param>
+/// <returns>The length of the gzip stream, or 0 if it did not fit in the output buffer.</returns>
+size_t Gzip_Compress(const uint8_t *input, size_t inputLength, uint8_t *output, size_t outputCapacity);
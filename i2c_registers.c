@@ -0,0 +1,53 @@
+#include <errno.h>
+#include <string.h>
+
+#include "i2c_registers.h"
+
+static I2cRegisterStats stats;
+
+bool I2cRegisters_Read(int fd, I2C_DeviceAddress address, uint8_t firstRegister, uint8_t *data,
+                       size_t length)
+{
+    // Send the register address, then a repeated start and read the block back
+    stats.transactions++;
+    ssize_t result = I2CMaster_WriteThenRead(fd, address, &firstRegister, 1, data, length);
+    if (result != (ssize_t)(1 + length)) {
+        if (result >= 0) {
+            errno = EIO;
+        }
+        stats.failures++;
+        return false;
+    }
+
+    stats.bytesWritten++;
+    stats.bytesRead += (uint32_t)length;
+    return true;
+}
+
+bool I2cRegisters_Write8(int fd, I2C_DeviceAddress address, uint8_t reg, uint8_t value)
+{
+    const uint8_t buffer[2] = {reg, value};
+
+    stats.transactions++;
+    ssize_t result = I2CMaster_Write(fd, address, buffer, sizeof(buffer));
+    if (result != (ssize_t)sizeof(buffer)) {
+        if (result >= 0) {
+            errno = EIO;
+        }
+        stats.failures++;
+        return false;
+    }
+
+    stats.bytesWritten += sizeof(buffer);
+    return true;
+}
+
+void I2cRegisters_GetStats(I2cRegisterStats *statsOut)
+{
+    *statsOut = stats;
+}
+
+void I2cRegisters_ResetStats(void)
+{
+    memset(&stats, 0, sizeof(stats));
+}
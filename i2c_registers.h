@@ -0,0 +1,38 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// applibs_versions.h defines the API struct versions to use for applibs APIs.
+#include "applibs_versions.h"
+#include <applibs/i2c.h>
+
+/// <summary>
+/// Bus traffic since the last reset, counted per I2C transaction (one addressed
+/// write, or one write-then-read with a repeated start).
+/// </summary>
+typedef struct I2cRegisterStats {
+    uint32_t transactions;
+    uint32_t failures;
+    uint32_t bytesRead;
+    uint32_t bytesWritten;
+} I2cRegisterStats;
+
+/// <summary>
+/// Read a contiguous block of registers, starting at firstRegister, in one transaction.
+/// Sensors with auto-incrementing register addresses return the whole block for the cost
+/// of a single register read.
+/// </summary>
+/// <returns>true if every byte was read; otherwise errno describes the failure.</returns>
+bool I2cRegisters_Read(int fd, I2C_DeviceAddress address, uint8_t firstRegister, uint8_t *data,
+                       size_t length);
+
+/// <summary>
+/// Write one register in one transaction.
+/// </summary>
+/// <returns>true if the write completed; otherwise errno describes the failure.</returns>
+bool I2cRegisters_Write8(int fd, I2C_DeviceAddress address, uint8_t reg, uint8_t value);
+
+void I2cRegisters_GetStats(I2cRegisterStats *stats);
+void I2cRegisters_ResetStats(void);
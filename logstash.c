@@ -1,8 +1,11 @@
 #include <assert.h>
 #include <errno.h>
 #include <memory.h>
+#include <stdint.h>
+#include <stdio.h>
 #include <stdlib.h>
 #include <sys/timerfd.h>
+#include <time.h>
 
 #include <curl/curl.h>
 
@@ -12,8 +15,10 @@
 #include <applibs/networking.h>
 
 #include "eventloop_timer_utilities.h"
+#include "gzip.h"
 #include "log_utils.h"
 #include "logstash.h"
+#include "loop_profiler.h"
 #include "main.h"
 
 /// File descriptor for the timerfd running for cURL.
@@ -22,6 +27,30 @@ static EventLoop *eventLoop = NULL; // not owned
 
 static char* logstashPassword = NULL;
 static CURLM *multi_handle = 0;
+static CURLSH *share_handle = NULL;
+static struct curl_slist *requestHeaders[LogstashFormat_Count];
+static struct curl_slist *compressedRequestHeaders[LogstashFormat_Count];
+static const char *contentTypeHeaders[LogstashFormat_Count] = {
+    [LogstashFormat_Json] = "Content-Type: application/x-ndjson",
+    [LogstashFormat_Cbor] = "Content-Type: application/cbor-seq",
+};
+
+// Bodies longer than this are sent gzip-compressed; SIZE_MAX turns compression off. Small
+// bodies aren't worth it because the gzip framing alone is 18 bytes.
+static const size_t compressionThreshold = 256;
+#define COMPRESSION_BUFFER_SIZE 4096
+static uint8_t compressionBuffer[COMPRESSION_BUFFER_SIZE];
+
+// Easy handles are reused between uploads so that their connections and TLS sessions
+// survive from one minute to the next
+#define EASY_HANDLE_POOL_SIZE 4
+
+static struct {
+    CURL *handle;
+    bool inUse;
+    LogstashCompletionCallback callback;
+    void *context;
+} easyHandlePool[EASY_HANDLE_POOL_SIZE];
 
 static bool IsNetworkReady(void)
 {
@@ -43,39 +72,202 @@ static void LogCurlMultiError(const char *message, CURLMcode code)
     Log_Debug(" (curl multi err=%d, '%s')\n", code, curl_multi_strerror(code));
 }
 
-static void CurlTimerEventHandler(EventLoopTimer* timer)
+static CURL *CreateEasyHandle(void)
 {
-    if (ConsumeEventLoopTimerEvent(timer) != 0) {
-        LogErrno("ERROR: cannot consume the timer event");
-        return;
+    char authHeader[64] = {};
+    snprintf(authHeader, sizeof(authHeader), "science_user:%s", logstashPassword);
+
+    CURL* handle = curl_easy_init();
+    if (handle == NULL) {
+        return NULL;
     }
 
-    if (!IsNetworkReady()) {
-        return;
+    // TODO: need to install the public CA cert for LetsEncrypt?
+    curl_easy_setopt(handle, CURLOPT_SSL_VERIFYPEER, false);
+    curl_easy_setopt(handle, CURLOPT_USERAGENT, "libcurl-agent/1.0");
+    curl_easy_setopt(handle, CURLOPT_USERPWD, authHeader);
+    curl_easy_setopt(handle, CURLOPT_SHARE, share_handle);
+    curl_easy_setopt(handle, CURLOPT_TCP_KEEPALIVE, 1L);
+
+    return handle;
+}
+
+static CURL *AcquireEasyHandle(LogstashCompletionCallback callback, void *context)
+{
+    for (size_t i = 0; i < EASY_HANDLE_POOL_SIZE; i++) {
+        if (easyHandlePool[i].inUse) {
+            continue;
+        }
+
+        if (easyHandlePool[i].handle == NULL) {
+            easyHandlePool[i].handle = CreateEasyHandle();
+            if (easyHandlePool[i].handle == NULL) {
+                return NULL;
+            }
+        }
+
+        easyHandlePool[i].inUse = true;
+        easyHandlePool[i].callback = callback;
+        easyHandlePool[i].context = context;
+        return easyHandlePool[i].handle;
     }
 
-    // TODO: need retry logic of some kind
-    
-    int still_running;
-    CURLMcode mc = curl_multi_perform(multi_handle, &still_running);
-    if (mc) {
-        LogCurlMultiError("ERROR: curl_multi_perform failed", mc);
-        return;
+    return NULL;
+}
+
+static void ReleaseEasyHandle(CURL *handle, bool succeeded)
+{
+    for (size_t i = 0; i < EASY_HANDLE_POOL_SIZE; i++) {
+        if (easyHandlePool[i].handle == handle) {
+            LogstashCompletionCallback callback = easyHandlePool[i].callback;
+            void *context = easyHandlePool[i].context;
+
+            // Release before the callback so that it can immediately send again
+            easyHandlePool[i].inUse = false;
+            easyHandlePool[i].callback = NULL;
+            easyHandlePool[i].context = NULL;
+
+            if (callback != NULL) {
+                callback(succeeded, context);
+            }
+            return;
+        }
     }
+}
+
+static void LogTransferTimes(CURL *handle)
+{
+    double nameLookupTime = 0, connectTime = 0, tlsTime = 0, totalTime = 0;
+    curl_easy_getinfo(handle, CURLINFO_NAMELOOKUP_TIME, &nameLookupTime);
+    curl_easy_getinfo(handle, CURLINFO_CONNECT_TIME, &connectTime);
+    curl_easy_getinfo(handle, CURLINFO_APPCONNECT_TIME, &tlsTime);
+    curl_easy_getinfo(handle, CURLINFO_TOTAL_TIME, &totalTime);
+
+    // A reused connection reports zero connect and TLS times
+    Log_Debug("HTTP transfer times (ms): dns %d, connect %d, tls %d, total %d\n",
+              (int)(nameLookupTime * 1000), (int)(connectTime * 1000), (int)(tlsTime * 1000),
+              (int)(totalTime * 1000));
+}
 
+static void CheckMultiInfo(void)
+{
     CURLMsg* msg; /* for picking up messages with the transfer status */
     int msgs_left; /* how many messages are left */
 
     while ((msg = curl_multi_info_read(multi_handle, &msgs_left))) {
         if (msg->msg == CURLMSG_DONE) {
-            Log_Debug("HTTP transfer completed with status %d\n", msg->data.result);
+            CURL *handle = msg->easy_handle;
+            CURLcode result = msg->data.result;
+            long responseCode = 0;
+            curl_easy_getinfo(handle, CURLINFO_RESPONSE_CODE, &responseCode);
+            Log_Debug("HTTP transfer completed with status %d, response code %ld\n", result, responseCode);
 
-            curl_multi_remove_handle(multi_handle, msg->easy_handle);
-            curl_easy_cleanup(msg->easy_handle);
+            LogTransferTimes(handle);
+
+            curl_multi_remove_handle(multi_handle, handle);
+            ReleaseEasyHandle(handle, result == CURLE_OK && responseCode >= 200 && responseCode < 300);
         }
     }
 }
 
+static void CurlSocketEventHandler(EventLoop* el, int fd, EventLoop_IoEvents events, void* context)
+{
+    int action = 0;
+    if (events & EventLoop_Input) {
+        action |= CURL_CSELECT_IN;
+    }
+    if (events & EventLoop_Output) {
+        action |= CURL_CSELECT_OUT;
+    }
+    if (events & EventLoop_Error) {
+        action |= CURL_CSELECT_ERR;
+    }
+
+    int still_running;
+    CURLMcode mc = curl_multi_socket_action(multi_handle, fd, action, &still_running);
+    if (mc) {
+        LogCurlMultiError("ERROR: curl_multi_socket_action failed", mc);
+        return;
+    }
+
+    CheckMultiInfo();
+}
+
+LOOP_PROFILER_IO_CALLBACK(ProfiledCurlSocketEventHandler, CurlSocketEventHandler, "curl_socket")
+
+/// <summary>
+///     Called by curl when it wants to start, change or stop watching a socket. The
+///     socket's EventRegistration is kept as curl's per-socket pointer.
+/// </summary>
+static int CurlSocketCallback(CURL* easy, curl_socket_t s, int what, void* userp, void* socketp)
+{
+    EventRegistration* registration = (EventRegistration*)socketp;
+
+    if (what == CURL_POLL_REMOVE) {
+        if (registration != NULL) {
+            EventLoop_UnregisterIo(eventLoop, registration);
+            curl_multi_assign(multi_handle, s, NULL);
+        }
+        return 0;
+    }
+
+    EventLoop_IoEvents events = EventLoop_None;
+    if (what == CURL_POLL_IN || what == CURL_POLL_INOUT) {
+        events |= EventLoop_Input;
+    }
+    if (what == CURL_POLL_OUT || what == CURL_POLL_INOUT) {
+        events |= EventLoop_Output;
+    }
+
+    if (registration == NULL) {
+        registration = EventLoop_RegisterIo(eventLoop, s, events, ProfiledCurlSocketEventHandler, NULL);
+        if (registration == NULL) {
+            LogErrno("ERROR: Could not register curl socket");
+            return -1;
+        }
+        curl_multi_assign(multi_handle, s, registration);
+    }
+    else if (EventLoop_ModifyIoEvents(eventLoop, registration, events) != 0) {
+        LogErrno("ERROR: Could not modify curl socket events");
+        return -1;
+    }
+
+    return 0;
+}
+
+/// <summary>
+///     Called by curl when it wants its timeout changed. A timeout of -1 means there
+///     is nothing to wait for, so the timer is disarmed rather than left polling.
+/// </summary>
+static int CurlTimerCallback(CURLM* multi, long timeout_ms, void* userp)
+{
+    if (timeout_ms == -1) {
+        return DisarmEventLoopTimer(curlTimer);
+    }
+
+    // A zero timeout means "as soon as possible", but a zero timespec would disarm the timer
+    const struct timespec timeout = {.tv_sec = timeout_ms / 1000,
+                                     .tv_nsec = timeout_ms == 0 ? 1 : (timeout_ms % 1000) * 1000 * 1000};
+    return SetEventLoopTimerOneShot(curlTimer, &timeout);
+}
+
+static void CurlTimerEventHandler(EventLoopTimer* timer)
+{
+    if (ConsumeEventLoopTimerEvent(timer) != 0) {
+        LogErrno("ERROR: cannot consume the timer event");
+        return;
+    }
+
+    int still_running;
+    CURLMcode mc = curl_multi_socket_action(multi_handle, CURL_SOCKET_TIMEOUT, 0, &still_running);
+    if (mc) {
+        LogCurlMultiError("ERROR: curl_multi_socket_action failed", mc);
+        return;
+    }
+
+    CheckMultiInfo();
+}
+
 static ExitCode CurlInit(void)
 {
     if (curl_global_init(CURL_GLOBAL_ALL) != CURLE_OK) {
@@ -89,43 +281,114 @@ static ExitCode CurlInit(void)
         return ExitCode_CurlInit_MultiInit;
     }
 
+    if (curl_multi_setopt(multi_handle, CURLMOPT_SOCKETFUNCTION, CurlSocketCallback) != CURLM_OK) {
+        Log_Debug("curl_multi_setopt(CURLMOPT_SOCKETFUNCTION) failed!\n");
+        return ExitCode_CurlInit_MultiSetOptSocketFunction;
+    }
+
+    if (curl_multi_setopt(multi_handle, CURLMOPT_TIMERFUNCTION, CurlTimerCallback) != CURLM_OK) {
+        Log_Debug("curl_multi_setopt(CURLMOPT_TIMERFUNCTION) failed!\n");
+        return ExitCode_CurlInit_MultiSetOptTimerFunction;
+    }
+
+    // The multi handle already shares connections between its easy handles; the share
+    // handle adds the DNS and TLS session caches so that reconnects are cheap too
+    share_handle = curl_share_init();
+    if (share_handle == NULL) {
+        Log_Debug("curl_share_init() failed!\n");
+        return ExitCode_CurlInit_ShareInit;
+    }
+
+    if (curl_share_setopt(share_handle, CURLSHOPT_SHARE, CURL_LOCK_DATA_DNS) != CURLSHE_OK ||
+        curl_share_setopt(share_handle, CURLSHOPT_SHARE, CURL_LOCK_DATA_SSL_SESSION) != CURLSHE_OK) {
+        Log_Debug("curl_share_setopt(CURLSHOPT_SHARE) failed!\n");
+        return ExitCode_CurlInit_ShareSetOpt;
+    }
+
+    for (size_t format = 0; format < LogstashFormat_Count; format++) {
+        requestHeaders[format] = curl_slist_append(NULL, contentTypeHeaders[format]);
+        compressedRequestHeaders[format] = curl_slist_append(NULL, contentTypeHeaders[format]);
+        compressedRequestHeaders[format] =
+            curl_slist_append(compressedRequestHeaders[format], "Content-Encoding: gzip");
+        if (requestHeaders[format] == NULL || compressedRequestHeaders[format] == NULL) {
+            Log_Debug("curl_slist_append() failed!\n");
+            return ExitCode_CurlInit_Headers;
+        }
+    }
+
     return ExitCode_Success;
 }
 
 static void CurlFini(void)
 {
-    // TODO: clean up transfers
+    for (size_t i = 0; i < EASY_HANDLE_POOL_SIZE; i++) {
+        if (easyHandlePool[i].handle != NULL) {
+            if (easyHandlePool[i].inUse) {
+                curl_multi_remove_handle(multi_handle, easyHandlePool[i].handle);
+            }
+            curl_easy_cleanup(easyHandlePool[i].handle);
+            easyHandlePool[i].handle = NULL;
+            easyHandlePool[i].inUse = false;
+        }
+    }
+
+    curl_multi_cleanup(multi_handle);
+    curl_share_cleanup(share_handle);
+    for (size_t format = 0; format < LogstashFormat_Count; format++) {
+        curl_slist_free_all(requestHeaders[format]);
+        curl_slist_free_all(compressedRequestHeaders[format]);
+    }
     curl_global_cleanup();
 }
 
-void SendToLogstash(char* url, char* postBody)
+bool SendToLogstash(const char* url, LogstashFormat format, const uint8_t* postBody,
+                    size_t postBodyLength, LogstashCompletionCallback callback, void* context)
 {
     if (!IsNetworkReady()) {
         Log_Debug("Network is not ready, skipping send\n");
-        return;
+        return false;
     }
 
-    char authHeader[64] = {};
-    snprintf(authHeader, sizeof(authHeader), "science_user:%s", logstashPassword);
-    CURL* handle = curl_easy_init();
+    CURL* handle = AcquireEasyHandle(callback, context);
+    if (handle == NULL) {
+        Log_Debug("No free upload handle, skipping send\n");
+        return false;
+    }
 
-    struct curl_slist* hs = NULL;
     curl_easy_setopt(handle, CURLOPT_URL, url);
-    // TODO: need to install the public CA cert for LetsEncrypt?
-    curl_easy_setopt(handle, CURLOPT_SSL_VERIFYPEER, false);
-    curl_easy_setopt(handle, CURLOPT_COPYPOSTFIELDS, postBody);
-    curl_easy_setopt(handle, CURLOPT_USERAGENT, "libcurl-agent/1.0");
-    curl_easy_setopt(handle, CURLOPT_USERPWD, authHeader);
-    hs = curl_slist_append(hs, "Content-Type: application/json");
-    curl_easy_setopt(handle, CURLOPT_HTTPHEADER, hs);
 
-    int still_running;
-    curl_multi_add_handle(multi_handle,handle);
-    CURLMcode mc = curl_multi_perform(multi_handle, &still_running);
+    // The body size has to be set before CURLOPT_COPYPOSTFIELDS, which copies that many bytes
+    size_t compressedLength = 0;
+    if (postBodyLength > compressionThreshold) {
+        compressedLength = Gzip_Compress(postBody, postBodyLength, compressionBuffer,
+                                         sizeof(compressionBuffer));
+    }
+
+    // Fall back to the plain body if compression didn't fit or didn't help
+    if (compressedLength != 0 && compressedLength < postBodyLength) {
+        curl_easy_setopt(handle, CURLOPT_HTTPHEADER, compressedRequestHeaders[format]);
+        curl_easy_setopt(handle, CURLOPT_POSTFIELDSIZE, (long)compressedLength);
+        curl_easy_setopt(handle, CURLOPT_COPYPOSTFIELDS, compressionBuffer);
+    }
+    else {
+        curl_easy_setopt(handle, CURLOPT_HTTPHEADER, requestHeaders[format]);
+        curl_easy_setopt(handle, CURLOPT_POSTFIELDSIZE, (long)postBodyLength);
+        curl_easy_setopt(handle, CURLOPT_COPYPOSTFIELDS, postBody);
+    }
+
+    // Adding the handle makes curl request a timeout, which starts the transfer
+    CURLMcode mc = curl_multi_add_handle(multi_handle, handle);
     if (mc) {
-        LogCurlMultiError("ERROR: curl_multi_perform failed", mc);
-        return;
+        LogCurlMultiError("ERROR: curl_multi_add_handle failed", mc);
+        for (size_t i = 0; i < EASY_HANDLE_POOL_SIZE; i++) {
+            if (easyHandlePool[i].handle == handle) {
+                easyHandlePool[i].inUse = false;
+            }
+        }
+        return false;
     }
+
+    return true;
 }
 
 ExitCode Logstash_Init(EventLoop *eventLoopInstance, char *password)
@@ -133,15 +396,14 @@ ExitCode Logstash_Init(EventLoop *eventLoopInstance, char *password)
     eventLoop = eventLoopInstance;
     logstashPassword = password;
 
-    CurlInit();
-
-    static const struct timespec pollingInterval = { .tv_sec = 1, .tv_nsec = 0 };
-    curlTimer = CreateEventLoopPeriodicTimer(eventLoop, &CurlTimerEventHandler, &pollingInterval);
+    // Curl's timeouts are driven by this timer, which is only armed while transfers need it
+    curlTimer = CreateEventLoopDisarmedTimer(eventLoop, &CurlTimerEventHandler);
     if (curlTimer == NULL) {
         return ExitCode_WebClientInit_CurlTimer;
     }
+    SetEventLoopTimerName(curlTimer, "curl");
 
-    return ExitCode_Success;
+    return CurlInit();
 }
 
 void Logstash_Fini(void)
@@ -1,6 +1,33 @@
 #pragma once
 
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include <applibs/eventloop.h>
 #include "main.h"
-void SendToLogstash(char* url, char* postBody);
+
+/// <summary>
+/// Wire format of a request body. JSON bodies are newline-delimited JSON; CBOR bodies are
+/// CBOR sequences (RFC 8742).
+/// </summary>
+typedef enum {
+    LogstashFormat_Json = 0,
+    LogstashFormat_Cbor = 1,
+    LogstashFormat_Count
+} LogstashFormat;
+
+/// <summary>
+/// Called on the event loop when a transfer started by <see cref="SendToLogstash" />
+/// finishes. The transfer succeeded only if the server returned a 2xx response.
+/// </summary>
+typedef void (*LogstashCompletionCallback)(bool succeeded, void *context);
+
+/// <summary>
+/// Start an asynchronous POST of postBody to url. Returns false if the transfer could not
+/// be started (e.g. the network is not ready), in which case callback will not be called.
+/// </summary>
+bool SendToLogstash(const char* url, LogstashFormat format, const uint8_t* postBody,
+                    size_t postBodyLength, LogstashCompletionCallback callback, void* context);
 ExitCode Logstash_Init(EventLoop *eventLoopInstance, char *password);
 void Logstash_Fini(void);
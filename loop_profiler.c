@@ -0,0 +1,119 @@
+#include "loop_profiler.h"
+
+#if LOOP_PROFILER
+
+#include <string.h>
+#include <time.h>
+
+const uint32_t LoopProfilerBucketMicroseconds[LOOP_PROFILER_BUCKETS - 1] = {50,   100,  250,  500,
+                                                                            1000, 5000, 20000};
+
+static LoopProfilerSection *sections = NULL;
+static unsigned depth = 0;
+static int64_t periodStartNanoseconds = 0;
+static int64_t runNanoseconds = 0;
+static int64_t busyNanoseconds = 0;
+static uint32_t iterations = 0;
+
+static int64_t GetMonotonicNanoseconds(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (int64_t)now.tv_sec * 1000000000LL + now.tv_nsec;
+}
+
+int64_t LoopProfiler_Begin(void)
+{
+    depth++;
+    return GetMonotonicNanoseconds();
+}
+
+void LoopProfiler_End(LoopProfilerSection *section, int64_t start)
+{
+    int64_t elapsed = GetMonotonicNanoseconds() - start;
+    if (--depth == 0) {
+        busyNanoseconds += elapsed;
+    }
+    if (section == NULL) {
+        return;
+    }
+
+    if (!section->linked) {
+        section->next = sections;
+        sections = section;
+        section->linked = true;
+    }
+
+    uint32_t microseconds = (uint32_t)(elapsed / 1000);
+    size_t bucket = 0;
+    while (bucket < LOOP_PROFILER_BUCKETS - 1 && microseconds > LoopProfilerBucketMicroseconds[bucket]) {
+        bucket++;
+    }
+
+    section->calls++;
+    section->totalNanoseconds += elapsed;
+    section->histogram[bucket]++;
+    if (elapsed > section->maxNanoseconds) {
+        section->maxNanoseconds = elapsed;
+    }
+}
+
+void LoopProfiler_RemoveSection(LoopProfilerSection *section)
+{
+    if (!section->linked) {
+        return;
+    }
+    for (LoopProfilerSection **link = &sections; *link != NULL; link = &(*link)->next) {
+        if (*link == section) {
+            *link = section->next;
+            break;
+        }
+    }
+    section->linked = false;
+}
+
+int64_t LoopProfiler_RunBegin(void)
+{
+    int64_t now = GetMonotonicNanoseconds();
+    if (periodStartNanoseconds == 0) {
+        periodStartNanoseconds = now;
+    }
+    return now;
+}
+
+void LoopProfiler_RunEnd(int64_t start)
+{
+    runNanoseconds += GetMonotonicNanoseconds() - start;
+    iterations++;
+}
+
+void LoopProfiler_GetSummary(LoopProfilerSummary *summary)
+{
+    summary->wallNanoseconds = periodStartNanoseconds == 0 ? 0 : GetMonotonicNanoseconds() - periodStartNanoseconds;
+    summary->runNanoseconds = runNanoseconds;
+    summary->busyNanoseconds = busyNanoseconds;
+    summary->iterations = iterations;
+}
+
+void LoopProfiler_ForEachSection(LoopProfilerVisitor visitor, void *context)
+{
+    for (const LoopProfilerSection *section = sections; section != NULL; section = section->next) {
+        visitor(section, context);
+    }
+}
+
+void LoopProfiler_Reset(void)
+{
+    for (LoopProfilerSection *section = sections; section != NULL; section = section->next) {
+        section->calls = 0;
+        section->totalNanoseconds = 0;
+        section->maxNanoseconds = 0;
+        memset(section->histogram, 0, sizeof(section->histogram));
+    }
+    periodStartNanoseconds = GetMonotonicNanoseconds();
+    runNanoseconds = 0;
+    busyNanoseconds = 0;
+    iterations = 0;
+}
+
+#endif
@@ -0,0 +1,118 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include <applibs/eventloop.h>
+
+// Set to 0 (the LOOP_PROFILER CMake option) to compile the profiler out entirely
+#ifndef LOOP_PROFILER
+#define LOOP_PROFILER 1
+#endif
+
+/// <summary>
+/// Number of buckets in a section's execution time histogram. Bucket i counts calls that
+/// took no longer than <see cref="LoopProfilerBucketMicroseconds" />[i]; the last bucket
+/// counts everything longer than that.
+/// </summary>
+#define LOOP_PROFILER_BUCKETS 8
+
+/// <summary>
+/// Time spent in one handler, or any other piece of code run from the event loop. Sections
+/// are statically allocated (or embedded in the object they profile) and are linked into
+/// the profiler's list the first time they complete a call.
+/// </summary>
+typedef struct LoopProfilerSection {
+    const char *name;
+    uint32_t calls;
+    int64_t totalNanoseconds;
+    int64_t maxNanoseconds;
+    uint32_t histogram[LOOP_PROFILER_BUCKETS];
+    bool linked;
+    struct LoopProfilerSection *next;
+} LoopProfilerSection;
+
+/// <summary>
+/// Whole-loop figures since the last reset. Busy time is the time spent in outermost
+/// sections; the rest of the time in EventLoop_Run is the loop waiting for events.
+/// </summary>
+typedef struct LoopProfilerSummary {
+    int64_t wallNanoseconds;
+    int64_t runNanoseconds;  // inside EventLoop_Run
+    int64_t busyNanoseconds; // inside profiled handlers
+    uint32_t iterations;     // EventLoop_Run calls
+} LoopProfilerSummary;
+
+typedef void (*LoopProfilerVisitor)(const LoopProfilerSection *section, void *context);
+
+#if LOOP_PROFILER
+
+extern const uint32_t LoopProfilerBucketMicroseconds[LOOP_PROFILER_BUCKETS - 1];
+
+/// <summary>
+/// Start timing a call. Calls nest; only the outermost one counts towards the busy time.
+/// </summary>
+/// <returns>The start time to pass to <see cref="LoopProfiler_End" />.</returns>
+int64_t LoopProfiler_Begin(void);
+
+/// <summary>
+/// Finish timing a call started with <see cref="LoopProfiler_Begin" /> and charge it to the
+/// section. A NULL section counts towards the busy time only, for code whose section was
+/// destroyed during the call.
+/// </summary>
+void LoopProfiler_End(LoopProfilerSection *section, int64_t start);
+
+/// <summary>
+/// Unlink a section that is about to go away, such as one embedded in a disposed timer.
+/// </summary>
+void LoopProfiler_RemoveSection(LoopProfilerSection *section);
+
+/// <summary>
+/// Bracket a call to EventLoop_Run, for the loop's utilization.
+/// </summary>
+int64_t LoopProfiler_RunBegin(void);
+void LoopProfiler_RunEnd(int64_t start);
+
+void LoopProfiler_GetSummary(LoopProfilerSummary *summary);
+
+/// <summary>
+/// Call the visitor for every section that has been used, newest first.
+/// </summary>
+void LoopProfiler_ForEachSection(LoopProfilerVisitor visitor, void *context);
+
+/// <summary>
+/// Zero the summary and every section, to start a new reporting period.
+/// </summary>
+void LoopProfiler_Reset(void);
+
+/// <summary>
+/// Define an EventLoopIoCallback named wrapper that profiles callback under sectionName.
+/// Register the wrapper in place of the callback.
+/// </summary>
+#define LOOP_PROFILER_IO_CALLBACK(wrapper, callback, sectionName)                             \
+    static void wrapper(EventLoop *el, int fd, EventLoop_IoEvents events, void *context)     \
+    {                                                                                         \
+        static LoopProfilerSection section = {.name = sectionName};                          \
+        int64_t start = LoopProfiler_Begin();                                                 \
+        callback(el, fd, events, context);                                                    \
+        LoopProfiler_End(&section, start);                                                    \
+    }
+
+#else
+
+static inline int64_t LoopProfiler_Begin(void)
+{
+    return 0;
+}
+static inline void LoopProfiler_End(LoopProfilerSection *section, int64_t start) {}
+static inline void LoopProfiler_RemoveSection(LoopProfilerSection *section) {}
+static inline int64_t LoopProfiler_RunBegin(void)
+{
+    return 0;
+}
+static inline void LoopProfiler_RunEnd(int64_t start) {}
+
+#define LOOP_PROFILER_IO_CALLBACK(wrapper, callback, sectionName) \
+    static EventLoopIoCallback *const wrapper = callback;
+
+#endif
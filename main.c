@@ -16,17 +16,17 @@
 #include "eventloop_timer_utilities.h"
 #include "main.h"
 #include "logstash.h"
+#include "loop_profiler.h"
 #include "geiger.h"
-#include "bmp180.h"
+#include "barometer.h"
 #include "upload.h"
+#include "upload_queue.h"
 
 static void ParseCommandLineArguments(int argc, char* argv[]);
 
 static char logstashPassword[32];
 static datablock_t dataBlock = {
-    .cpm = 0,
-    .cpmMessagesReceived = 0,
-    .pressureSamplesReceived = 0,
+    .activeWindow = 0,
 };
 static EventLoop* eventLoop = NULL;
 
@@ -72,7 +72,7 @@ static ExitCode InitPeripheralsAndHandlers(void)
         return localExitCode;
     }
 
-    localExitCode = Bmp180_Init(eventLoop, &dataBlock);
+    localExitCode = Barometer_Init(eventLoop, &dataBlock);
     if (localExitCode != ExitCode_Success) {
         return localExitCode;
     }
@@ -82,6 +82,11 @@ static ExitCode InitPeripheralsAndHandlers(void)
         return localExitCode;
     }
 
+    localExitCode = UploadQueue_Init(eventLoop);
+    if (localExitCode != ExitCode_Success) {
+        return localExitCode;
+    }
+
     return ExitCode_Success;
 }
 
@@ -91,9 +96,10 @@ static ExitCode InitPeripheralsAndHandlers(void)
 void ClosePeripheralsAndHandlers(void)
 {
     // Release resources.
-    Bmp180_Fini();
+    Barometer_Fini();
     Geiger_Fini();
     Upload_Fini();
+    UploadQueue_Fini();
     Logstash_Fini();
 
     EventLoop_Close(eventLoop);
@@ -128,7 +134,9 @@ int main(int argc, char** argv)
 
     // Use event loop to wait for events and trigger handlers, until an error or SIGTERM happens
     while (exitCode == ExitCode_Success) {
+        int64_t runStart = LoopProfiler_RunBegin();
         EventLoop_Run_Result result = EventLoop_Run(eventLoop, -1, true);
+        LoopProfiler_RunEnd(runStart);
         // Continue if interrupted by signal, e.g. due to breakpoint being set.
         if (result == EventLoop_Run_Failed && errno != EINTR) {
             exitCode = ExitCode_Main_EventLoopFail;
@@ -5,8 +5,23 @@
 
 #pragma once
 
+#include <stdatomic.h>
+#include <stdint.h>
+
 #include <hw/seeed_mt3620_mdb.h>
 
+#include "aggregate.h"
+#include "count_rate.h"
+#include "sample_ring.h"
+
+// Number of Geiger counters attached, each on its own UART (see geiger.c)
+#ifndef GEIGER_COUNT
+#define GEIGER_COUNT 1
+#endif
+
+// Pressure samples kept per window for an exact median; covers every supported sampling rate
+#define PRESSURE_WINDOW_CAPACITY 1024
+
 /// <summary>
 /// Termination codes for this application. These are used for the
 /// application exit code. They must all be between zero and 255,
@@ -34,6 +49,9 @@ typedef enum {
     ExitCode_CurlInit_MultiInit = 401,
     ExitCode_CurlInit_MultiSetOptSocketFunction = 402,
     ExitCode_CurlInit_MultiSetOptTimerFunction = 403,
+    ExitCode_CurlInit_ShareInit = 404,
+    ExitCode_CurlInit_ShareSetOpt = 405,
+    ExitCode_CurlInit_Headers = 406,
 
     ExitCode_CurlSetupEasy_EasyInit = 500,
     ExitCode_CurlSetupEasy_OptUrl = 501,
@@ -53,11 +71,70 @@ typedef enum {
     ExitCode_Init_SetBusSpeed = 601,
     ExitCode_Init_SetTimeout = 602,
     ExitCode_BPM180_Initialize = 603,
+    ExitCode_BarometerInit_EventFd = 604,
+    ExitCode_BarometerInit_RegisterIo = 605,
+    ExitCode_BarometerInit_Thread = 606,
+    ExitCode_BarometerInit_ConversionTimer = 607,
+    ExitCode_BarometerInit_PollTimer = 608,
+    ExitCode_BarometerInit_ProbeTimer = 609,
+
+    ExitCode_UploadQueueInit_Timer = 700,
+    ExitCode_UploadQueueInit_Thread = 701,
 } ExitCode;
 
+// Window boundaries are CLOCK_MONOTONIC times in nanoseconds, which samples are stamped
+// with too, and UTC times in milliseconds since the epoch. The UTC times are 0 while the
+// wall clock has not been set.
+typedef struct GeigerWindow {
+    int64_t startNanoseconds;
+    int64_t endNanoseconds;
+    int64_t startUtcMilliseconds;
+    int64_t endUtcMilliseconds;
+    uint32_t cpm;
+    uint32_t nanosievertsPerHour;
+    uint32_t cpmMessagesReceived;
+} GeigerWindow;
+
+typedef struct PressureWindow {
+    int64_t startNanoseconds;
+    int64_t endNanoseconds;
+    int64_t startUtcMilliseconds;
+    int64_t endUtcMilliseconds;
+    Aggregate samples;
+    double sampleStorage[PRESSURE_WINDOW_CAPACITY]; // backs samples
+    Aggregate temperature; // degrees C, from the pressure sensor's compensation refreshes
+
+    // How the sensor was being sampled
+    uint32_t samplesPerMinute;           // lowest rate in effect during the window; 0 if no samples
+    uint32_t sampleIntervalMilliseconds; // at the end of the window
+    int32_t oversampling;                // at the end of the window; -1 if the sensor's is fixed
+    double noisePascals;                 // latest measured per-sample noise; 0 if not measured
+    uint32_t samplingChanges;            // adaptive sampling changes during the window
+
+    // Pressure samples left out of the aggregate, by SampleQuality
+    uint32_t rejectedSamples[SampleQuality_Count];
+} PressureWindow;
+
+/// <summary>
+/// Each sensor has two measurement windows. Producers only write to the active one; at
+/// upload time the active index is flipped, so collection continues in the other window
+/// while the finished one is reduced.
+/// </summary>
 typedef struct DataBlock {
-    uint8_t cpm;
-    uint8_t cpmMessagesReceived;
-    uint32_t pressureSamples[1024];
-    uint32_t pressureSamplesReceived;
-} datablock_t;
\ No newline at end of file
+    _Atomic uint32_t activeWindow;
+    GeigerWindow geiger[2][GEIGER_COUNT];
+    PressureWindow pressure[2];
+
+    // Sliding per-second Geiger counts; not windowed, since it already covers the last hour
+    CountRate countRate[GEIGER_COUNT];
+} datablock_t;
+
+static inline GeigerWindow *DataBlock_ActiveGeigerWindow(datablock_t *dataBlock, uint32_t counter)
+{
+    return &dataBlock->geiger[atomic_load_explicit(&dataBlock->activeWindow, memory_order_acquire)][counter];
+}
+
+static inline PressureWindow *DataBlock_ActivePressureWindow(datablock_t *dataBlock)
+{
+    return &dataBlock->pressure[atomic_load_explicit(&dataBlock->activeWindow, memory_order_acquire)];
+}
\ No newline at end of file
@@ -0,0 +1,138 @@
+#include <math.h>
+#include <stdio.h>
+#include <time.h>
+
+#include "cbor.h"
+#include "reading.h"
+
+static int AppendJsonValue(const ReadingField *field, char *buffer, size_t bufferSize)
+{
+    switch (field->type) {
+    case ReadingFieldType_Integer:
+        return snprintf(buffer, bufferSize, "%lld", (long long)field->integer);
+
+    case ReadingFieldType_Timestamp: {
+        if (field->integer == 0) {
+            return snprintf(buffer, bufferSize, "null");
+        }
+        time_t seconds = (time_t)(field->integer / 1000);
+        struct tm utc;
+        char text[24];
+        if (gmtime_r(&seconds, &utc) == NULL || strftime(text, sizeof(text), "%Y-%m-%dT%H:%M:%S", &utc) == 0) {
+            return -1;
+        }
+        return snprintf(buffer, bufferSize, "\"%s.%03dZ\"", text, (int)(field->integer % 1000));
+    }
+
+    case ReadingFieldType_Array: {
+        int length = snprintf(buffer, bufferSize, "[");
+        for (size_t i = 0; i < field->valueCount && length >= 0 && (size_t)length < bufferSize; i++) {
+            length += snprintf(buffer + length, bufferSize - (size_t)length, "%s%.*f", i == 0 ? "" : ", ",
+                               field->decimals, field->values[i]);
+        }
+        if (length >= 0 && (size_t)length < bufferSize) {
+            length += snprintf(buffer + length, bufferSize - (size_t)length, "]");
+        }
+        return length;
+    }
+
+    default:
+        return snprintf(buffer, bufferSize, "%.*f", field->decimals, field->value);
+    }
+}
+
+static size_t EncodeJson(const char *sensor, const ReadingField *fields, size_t fieldCount,
+                         char *buffer, size_t bufferSize)
+{
+    int length = snprintf(buffer, bufferSize, "{ \"sensor\": \"%s\"", sensor);
+    for (size_t i = 0; i < fieldCount && length >= 0 && (size_t)length < bufferSize; i++) {
+        length += snprintf(buffer + length, bufferSize - (size_t)length, ", \"%s\": ", fields[i].name);
+        if (length >= 0 && (size_t)length < bufferSize) {
+            int valueLength = AppendJsonValue(&fields[i], buffer + length, bufferSize - (size_t)length);
+            length = valueLength < 0 ? -1 : length + valueLength;
+        }
+    }
+    if (length >= 0 && (size_t)length < bufferSize) {
+        length += snprintf(buffer + length, bufferSize - (size_t)length, " }");
+    }
+
+    return (length >= 0 && (size_t)length < bufferSize) ? (size_t)length : 0;
+}
+
+/// <summary>
+///     Write a number the way JSON would print it: an integer if it has no decimals, a
+///     single precision float if that rounds to the same decimals, and a double otherwise.
+/// </summary>
+static void WriteCborNumber(CborWriter *writer, double value, int decimals)
+{
+    if (decimals == 0) {
+        Cbor_WriteSigned(writer, llround(value));
+        return;
+    }
+
+    double scale = pow(10, decimals);
+    float single = (float)value;
+    if (llround((double)single * scale) == llround(value * scale)) {
+        Cbor_WriteFloat(writer, single);
+    }
+    else {
+        Cbor_WriteDouble(writer, value);
+    }
+}
+
+static size_t EncodeCbor(const char *sensor, const ReadingField *fields, size_t fieldCount,
+                         uint8_t *buffer, size_t bufferSize)
+{
+    CborWriter writer;
+    Cbor_InitWriter(&writer, buffer, bufferSize);
+
+    Cbor_WriteMapHeader(&writer, fieldCount + 1);
+    Cbor_WriteText(&writer, "sensor");
+    Cbor_WriteText(&writer, sensor);
+    for (size_t i = 0; i < fieldCount; i++) {
+        const ReadingField *field = &fields[i];
+        Cbor_WriteText(&writer, field->name);
+        switch (field->type) {
+        case ReadingFieldType_Integer:
+            Cbor_WriteSigned(&writer, field->integer);
+            break;
+
+        case ReadingFieldType_Timestamp:
+            if (field->integer == 0) {
+                Cbor_WriteNull(&writer);
+                break;
+            }
+            // Whole seconds stay integers; milliseconds need a double to be exact
+            Cbor_WriteTag(&writer, 1);
+            if (field->integer % 1000 == 0) {
+                Cbor_WriteSigned(&writer, field->integer / 1000);
+            }
+            else {
+                Cbor_WriteDouble(&writer, (double)field->integer / 1000);
+            }
+            break;
+
+        case ReadingFieldType_Array:
+            Cbor_WriteArrayHeader(&writer, field->valueCount);
+            for (size_t j = 0; j < field->valueCount; j++) {
+                WriteCborNumber(&writer, field->values[j], field->decimals);
+            }
+            break;
+
+        default:
+            WriteCborNumber(&writer, field->value, field->decimals);
+            break;
+        }
+    }
+
+    return Cbor_Finish(&writer);
+}
+
+size_t Reading_Encode(LogstashFormat format, const char *sensor, const ReadingField *fields,
+                      size_t fieldCount, uint8_t *buffer, size_t bufferSize)
+{
+    if (format == LogstashFormat_Cbor) {
+        return EncodeCbor(sensor, fields, fieldCount, buffer, bufferSize);
+    }
+    return EncodeJson(sensor, fields, fieldCount, (char *)buffer, bufferSize);
+}
@@ -0,0 +1,38 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "logstash.h"
+
+typedef enum {
+    ReadingFieldType_Number = 0, // value, with decimals decimal places
+    ReadingFieldType_Integer,    // integer, exactly
+    ReadingFieldType_Timestamp,  // integer, as UTC milliseconds since the epoch; 0 if unknown
+    ReadingFieldType_Array,      // valueCount numbers from values, each with decimals decimal places
+} ReadingFieldType;
+
+/// <summary>
+/// One named value in a reading. Fields are numbers unless type says otherwise; numbers
+/// with zero decimals are encoded as integers.
+/// </summary>
+typedef struct ReadingField {
+    const char *name;
+    double value;
+    int decimals;
+    ReadingFieldType type;
+    int64_t integer;
+    const double *values;
+    size_t valueCount;
+} ReadingField;
+
+/// <summary>
+/// Encode a reading as a single JSON object or CBOR map of the form
+/// { "sensor": sensor, field.name: field.value, ... }. Timestamps are ISO 8601 strings in
+/// JSON and tag 1 (epoch seconds) items in CBOR, or null where the time is unknown, such
+/// as before the clock has been set. CBOR numbers are sent as single precision
+/// floats only where that keeps every requested decimal place, and as doubles otherwise.
+/// </summary>
+/// <returns>The encoded length, or 0 if it did not fit in the buffer.</returns>
+size_t Reading_Encode(LogstashFormat format, const char *sensor, const ReadingField *fields,
+                      size_t fieldCount, uint8_t *buffer, size_t bufferSize);
@@ -0,0 +1,75 @@
+#include "sample_ring.h"
+
+bool SampleRing_Init(SampleRing *ring, Sample *storage, uint32_t capacity,
+                     SampleRingOverflowPolicy policy)
+{
+    if (capacity == 0 || (capacity & (capacity - 1)) != 0) {
+        return false;
+    }
+
+    ring->slots = storage;
+    ring->capacity = capacity;
+    ring->policy = policy;
+    atomic_init(&ring->writeIndex, 0);
+    atomic_init(&ring->readIndex, 0);
+    atomic_init(&ring->overflows, 0);
+    return true;
+}
+
+bool SampleRing_Push(SampleRing *ring, const Sample *sample)
+{
+    uint32_t write = atomic_load_explicit(&ring->writeIndex, memory_order_relaxed);
+    uint32_t read = atomic_load_explicit(&ring->readIndex, memory_order_acquire);
+    bool lost = false;
+
+    while (write - read >= ring->capacity) {
+        if (ring->policy == SampleRingOverflow_DropNewest) {
+            atomic_fetch_add_explicit(&ring->overflows, 1, memory_order_relaxed);
+            return false;
+        }
+
+        // Claim the oldest slot from the consumer. If the consumer got there first the CAS
+        // fails, read is refreshed, and there may be room after all.
+        if (atomic_compare_exchange_weak_explicit(&ring->readIndex, &read, read + 1,
+                                                  memory_order_acq_rel, memory_order_acquire)) {
+            atomic_fetch_add_explicit(&ring->overflows, 1, memory_order_relaxed);
+            lost = true;
+            break;
+        }
+    }
+
+    ring->slots[write & (ring->capacity - 1)] = *sample;
+    atomic_store_explicit(&ring->writeIndex, write + 1, memory_order_release);
+    return !lost;
+}
+
+bool SampleRing_Pop(SampleRing *ring, Sample *sample)
+{
+    uint32_t read = atomic_load_explicit(&ring->readIndex, memory_order_acquire);
+    for (;;) {
+        uint32_t write = atomic_load_explicit(&ring->writeIndex, memory_order_acquire);
+        if (read == write) {
+            return false;
+        }
+
+        // Copy first, then claim. If the producer dropped this slot in the meantime the CAS
+        // fails and the copy, which may be torn, is discarded.
+        *sample = ring->slots[read & (ring->capacity - 1)];
+        if (atomic_compare_exchange_weak_explicit(&ring->readIndex, &read, read + 1,
+                                                  memory_order_acq_rel, memory_order_acquire)) {
+            return true;
+        }
+    }
+}
+
+uint32_t SampleRing_Count(SampleRing *ring)
+{
+    uint32_t read = atomic_load_explicit(&ring->readIndex, memory_order_acquire);
+    uint32_t write = atomic_load_explicit(&ring->writeIndex, memory_order_acquire);
+    return write - read;
+}
+
+uint32_t SampleRing_Overflows(SampleRing *ring)
+{
+    return atomic_load_explicit(&ring->overflows, memory_order_relaxed);
+}
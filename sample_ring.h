@@ -0,0 +1,68 @@
+#pragma once
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/// <summary>
+/// Whether a sample can be trusted. Only good samples are aggregated; the rest are counted.
+/// </summary>
+typedef enum {
+    SampleQuality_Good,
+    SampleQuality_BusError,   // the read failed, so there is no value
+    SampleQuality_OutOfRange, // outside what the sensor can physically report
+    SampleQuality_Stale,      // the sensor returned its previous result again
+    SampleQuality_Count
+} SampleQuality;
+
+/// <summary>
+/// A sensor value and the CLOCK_MONOTONIC time at which it was taken.
+/// </summary>
+typedef struct Sample {
+    int64_t timestampNanoseconds;
+    int32_t value;
+    uint8_t quality; // SampleQuality
+} Sample;
+
+/// <summary>
+/// What to do when a sample is pushed into a full ring.
+/// </summary>
+typedef enum {
+    SampleRingOverflow_DropOldest, // overwrite the oldest unread sample
+    SampleRingOverflow_DropNewest, // discard the sample being pushed
+} SampleRingOverflowPolicy;
+
+/// <summary>
+/// Bounded lock-free ring of samples for exactly one producer and one consumer, which may
+/// be on different threads. Indices increase monotonically and are reduced modulo the
+/// capacity, which must be a power of two.
+/// </summary>
+typedef struct SampleRing {
+    Sample *slots;
+    uint32_t capacity;
+    SampleRingOverflowPolicy policy;
+    _Atomic uint32_t writeIndex; // only the producer stores this
+    _Atomic uint32_t readIndex;  // the consumer advances this; the producer may too, to drop the oldest
+    _Atomic uint32_t overflows;  // samples lost to the overflow policy
+} SampleRing;
+
+/// <summary>
+/// Set up a ring over caller-owned storage.
+/// </summary>
+/// <returns>false if capacity is not a non-zero power of two.</returns>
+bool SampleRing_Init(SampleRing *ring, Sample *storage, uint32_t capacity,
+                     SampleRingOverflowPolicy policy);
+
+/// <summary>
+/// Producer side. Returns false if a sample was lost to the overflow policy.
+/// </summary>
+bool SampleRing_Push(SampleRing *ring, const Sample *sample);
+
+/// <summary>
+/// Consumer side. Returns false if the ring is empty.
+/// </summary>
+bool SampleRing_Pop(SampleRing *ring, Sample *sample);
+
+uint32_t SampleRing_Count(SampleRing *ring);
+uint32_t SampleRing_Overflows(SampleRing *ring);
@@ -0,0 +1,119 @@
+#include <math.h>
+#include <string.h>
+
+#include "sampling_controller.h"
+
+// Intervals the controller chooses between
+static const uint32_t candidateIntervalsMilliseconds[] = { 100, 200, 250, 500, 1000 };
+
+// Bus time for the I2C transactions of one sample (a command write and a 3-byte read at
+// 100 kHz)
+static const double busMillisecondsPerSample = 0.8;
+
+// Only move to a cheaper setting if it is this much cheaper, and predicted to meet the
+// target with this much to spare, so that estimation noise doesn't cause flapping
+static const double minimumCostImprovement = 0.8;
+static const double precisionMargin = 0.8;
+
+// Weight of each new block in the rolling noise estimate
+static const double noiseSmoothing = 0.25;
+
+// Below this the sensor's 1 Pa resolution dominates and the estimate says nothing useful
+static const double minimumNoisePascals = 0.5;
+
+void SamplingController_Init(SamplingController *controller, const SamplingControllerConfig *config,
+                             SamplingSetting initial)
+{
+    memset(controller, 0, sizeof(*controller));
+    controller->config = *config;
+    controller->setting = initial;
+}
+
+double SamplingController_Cost(const SamplingController *controller, SamplingSetting setting)
+{
+    double samplesPerMinute = 60000.0 / setting.intervalMilliseconds;
+    return samplesPerMinute *
+           (controller->config.conversionMilliseconds[setting.oversampling] + busMillisecondsPerSample);
+}
+
+// Standard error of a one-minute mean at the given setting, scaling the measured noise by
+// the datasheet ratio between modes
+static double PredictStandardError(const SamplingController *controller, SamplingSetting setting)
+{
+    double sigma = controller->noiseRatio * controller->config.noisePascals[setting.oversampling];
+    return sigma / sqrt(60000.0 / setting.intervalMilliseconds);
+}
+
+static SamplingSetting ChooseSetting(const SamplingController *controller)
+{
+    SamplingSetting current = controller->setting;
+    double target = controller->config.targetStandardErrorPascals;
+    bool currentMeetsTarget = PredictStandardError(controller, current) <= target;
+    double currentCost = SamplingController_Cost(controller, current);
+
+    // If nothing is good enough, fall back to the most precise setting
+    SamplingSetting best = {.oversampling = (uint8_t)(controller->config.modeCount - 1),
+                            .intervalMilliseconds = candidateIntervalsMilliseconds[0]};
+    double bestCost = INFINITY;
+    for (uint8_t mode = 0; mode < controller->config.modeCount; mode++) {
+        for (size_t i = 0; i < sizeof(candidateIntervalsMilliseconds) / sizeof(candidateIntervalsMilliseconds[0]); i++) {
+            SamplingSetting candidate = {.oversampling = mode, .intervalMilliseconds = candidateIntervalsMilliseconds[i]};
+            if (PredictStandardError(controller, candidate) > target * precisionMargin) {
+                continue;
+            }
+            double cost = SamplingController_Cost(controller, candidate);
+            if (cost < bestCost) {
+                best = candidate;
+                bestCost = cost;
+            }
+        }
+    }
+
+    if (currentMeetsTarget && !(bestCost < currentCost * minimumCostImprovement)) {
+        return current;
+    }
+    return best;
+}
+
+bool SamplingController_Add(SamplingController *controller, int32_t pressure)
+{
+    if (controller->hasLastSample) {
+        double difference = (double)pressure - controller->lastSample;
+        controller->sumOfSquaredDifferences += difference * difference;
+        controller->differences++;
+    }
+    controller->lastSample = pressure;
+    controller->hasLastSample = true;
+
+    if (controller->differences < SAMPLING_CONTROLLER_BLOCK_SAMPLES) {
+        return false;
+    }
+
+    // Each difference carries the noise of two samples
+    double noise = sqrt(controller->sumOfSquaredDifferences / controller->differences / 2);
+    if (noise < minimumNoisePascals) {
+        noise = minimumNoisePascals;
+    }
+    controller->sumOfSquaredDifferences = 0;
+    controller->differences = 0;
+
+    // The rolling estimate is kept relative to the datasheet noise, so that it carries
+    // over when the oversampling mode changes
+    double ratio = noise / controller->config.noisePascals[controller->setting.oversampling];
+    controller->noiseRatio = controller->noiseRatio == 0 ? ratio
+                                                         : controller->noiseRatio + noiseSmoothing * (ratio - controller->noiseRatio);
+    controller->noisePascals = controller->noiseRatio * controller->config.noisePascals[controller->setting.oversampling];
+
+    SamplingSetting next = ChooseSetting(controller);
+    if (next.oversampling == controller->setting.oversampling &&
+        next.intervalMilliseconds == controller->setting.intervalMilliseconds) {
+        return false;
+    }
+
+    // Samples from different settings don't belong in the same block
+    controller->setting = next;
+    controller->noisePascals = controller->noiseRatio * controller->config.noisePascals[next.oversampling];
+    controller->hasLastSample = false;
+    controller->changes++;
+    return true;
+}
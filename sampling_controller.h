@@ -0,0 +1,63 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Number of sample-to-sample differences used for each noise estimate
+#define SAMPLING_CONTROLLER_BLOCK_SAMPLES 120
+
+/// <summary>
+/// A sensor configuration the controller can choose: an oversampling mode and the
+/// interval between samples.
+/// </summary>
+typedef struct SamplingSetting {
+    uint8_t oversampling;
+    uint32_t intervalMilliseconds;
+} SamplingSetting;
+
+/// <summary>
+/// What the controller knows about the sensor: the RMS noise and conversion time of each
+/// oversampling mode (from the datasheet), and the precision wanted from each one-minute
+/// mean.
+/// </summary>
+typedef struct SamplingControllerConfig {
+    uint8_t modeCount;
+    const double *noisePascals;
+    const uint8_t *conversionMilliseconds;
+    double targetStandardErrorPascals;
+} SamplingControllerConfig;
+
+/// <summary>
+/// Picks the cheapest oversampling mode and sample rate that still meets a precision
+/// target for the one-minute mean. Noise is measured from the spread of consecutive
+/// differences, which ignores slow real pressure changes, smoothed across blocks and
+/// scaled to the other modes by their datasheet noise ratios.
+/// </summary>
+typedef struct SamplingController {
+    SamplingControllerConfig config;
+    SamplingSetting setting;
+
+    int32_t lastSample;
+    bool hasLastSample;
+    double sumOfSquaredDifferences;
+    uint32_t differences;
+
+    double noiseRatio;   // rolling measured noise relative to the datasheet, or 0 if not yet known
+    double noisePascals; // the same, as per-sample noise at the current setting
+    uint32_t changes;
+} SamplingController;
+
+void SamplingController_Init(SamplingController *controller, const SamplingControllerConfig *config,
+                             SamplingSetting initial);
+
+/// <summary>
+/// Add one pressure sample taken at the current setting.
+/// </summary>
+/// <returns>true if the controller has chosen a new setting, which the caller must apply
+/// before the next sample.</returns>
+bool SamplingController_Add(SamplingController *controller, int32_t pressure);
+
+/// <summary>
+/// Estimated cost of a setting, in milliseconds of conversion and bus time per minute.
+/// </summary>
+double SamplingController_Cost(const SamplingController *controller, SamplingSetting setting);
@@ -0,0 +1,89 @@
+#include <math.h>
+#include <string.h>
+
+#include "spike_detector.h"
+
+// A window this unlikely under the baseline is treated as a spike (1 in ten million windows,
+// i.e. roughly one false alarm every four months at one test per second)
+static const double alertLog10PValue = -7.0;
+
+// Don't trust the baseline until this much of it has been observed
+static const double minimumBaselineCoverage = 0.25;
+
+// At most one alert per this many seconds
+static const int64_t minimumAlertIntervalSeconds = 300;
+
+void SpikeDetector_Init(SpikeDetector *detector)
+{
+    memset(detector, 0, sizeof(*detector));
+}
+
+/// <summary>
+///     log10 of P(X >= k) for X ~ Poisson(mean), summing the upper tail directly so that
+///     tiny probabilities don't cancel out.
+/// </summary>
+static double Log10PoissonUpperTail(uint32_t k, double mean)
+{
+    if (k == 0) {
+        return 0;
+    }
+    if (mean <= 0) {
+        return -INFINITY;
+    }
+
+    // Terms relative to the first: term(i+1) = term(i) * mean / (i + 1)
+    double logFirstTerm = k * log(mean) - mean - lgamma(k + 1.0);
+    double sum = 1;
+    double term = 1;
+    for (uint32_t i = k; i < k + 1000; i++) {
+        term *= mean / (i + 1);
+        sum += term;
+        if (term < sum * 1e-12) {
+            break;
+        }
+    }
+
+    double log10Tail = (logFirstTerm + log(sum)) / log(10);
+    return log10Tail > 0 ? 0 : log10Tail;
+}
+
+bool SpikeDetector_Add(SpikeDetector *detector, int64_t timestampNanoseconds, uint32_t cps,
+                       double baselineCps, double baselineCoverage, SpikeAlert *alert)
+{
+    uint16_t counts = cps > UINT16_MAX ? UINT16_MAX : (uint16_t)cps;
+    detector->recentSum -= detector->recent[detector->next];
+    detector->recent[detector->next] = counts;
+    detector->recentSum += counts;
+    detector->next = (detector->next + 1) % SPIKE_WINDOW_SECONDS;
+    if (detector->filled < SPIKE_WINDOW_SECONDS) {
+        detector->filled++;
+    }
+
+    if (baselineCoverage < minimumBaselineCoverage) {
+        return false;
+    }
+
+    // Cheap pre-check: nothing at or below the expected count can be a spike
+    double expected = baselineCps * detector->filled;
+    if (detector->recentSum <= expected) {
+        return false;
+    }
+
+    double log10PValue = Log10PoissonUpperTail(detector->recentSum, expected);
+    if (log10PValue > alertLog10PValue) {
+        return false;
+    }
+
+    if (detector->hasAlerted &&
+        timestampNanoseconds - detector->lastAlertNanoseconds < minimumAlertIntervalSeconds * 1000000000LL) {
+        return false;
+    }
+    detector->hasAlerted = true;
+    detector->lastAlertNanoseconds = timestampNanoseconds;
+
+    alert->counts = detector->recentSum;
+    alert->expectedCounts = expected;
+    alert->baselineCps = baselineCps;
+    alert->log10PValue = log10PValue;
+    return true;
+}
@@ -0,0 +1,43 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Length of the short window that is tested against the baseline, in seconds
+#define SPIKE_WINDOW_SECONDS 10
+
+/// <summary>
+/// Details of a detected spike: the counts seen in the short window, the counts the
+/// baseline rate predicts for it, and how unlikely the excess is under that baseline.
+/// </summary>
+typedef struct SpikeAlert {
+    uint32_t counts;
+    double expectedCounts;
+    double baselineCps;
+    double log10PValue;
+} SpikeAlert;
+
+/// <summary>
+/// Streaming radiation spike detector. Each second's count is added to a short sliding
+/// window, and the window total is tested with a Poisson upper-tail test against a
+/// rolling baseline rate. Alerts are rate limited.
+/// </summary>
+typedef struct SpikeDetector {
+    uint16_t recent[SPIKE_WINDOW_SECONDS];
+    uint32_t next;
+    uint32_t filled;
+    uint32_t recentSum;
+    int64_t lastAlertNanoseconds;
+    bool hasAlerted;
+} SpikeDetector;
+
+void SpikeDetector_Init(SpikeDetector *detector);
+
+/// <summary>
+/// Add one second's count and test the short window.
+/// </summary>
+/// <param name="baselineCps">Long-run count rate, in counts per second.</param>
+/// <param name="baselineCoverage">Fraction of the baseline window actually observed.</param>
+/// <returns>true if an alert should be raised, in which case alert is filled in.</returns>
+bool SpikeDetector_Add(SpikeDetector *detector, int64_t timestampNanoseconds, uint32_t cps,
+                       double baselineCps, double baselineCoverage, SpikeAlert *alert);
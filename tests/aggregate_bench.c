@@ -0,0 +1,68 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "aggregate.h"
+
+// A minute of pressure samples reduced the old way (collect, qsort, index) and through the
+// aggregate (fed per sample, read once at the upload tick)
+
+#define SAMPLES 600
+#define WINDOWS 2000
+
+static int CompareSamples(const void *a, const void *b)
+{
+    uint32_t x = *(const uint32_t *)a;
+    uint32_t y = *(const uint32_t *)b;
+    return (x > y) - (x < y);
+}
+
+static double NowSeconds(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (double)now.tv_sec + now.tv_nsec / 1e9;
+}
+
+int main(void)
+{
+    static uint32_t input[SAMPLES];
+    static uint32_t collected[SAMPLES];
+    for (size_t i = 0; i < SAMPLES; i++) {
+        input[i] = 101325 + (uint32_t)(rand() % 17) - 8;
+    }
+
+    volatile double sink = 0;
+    double start = NowSeconds();
+    for (int w = 0; w < WINDOWS; w++) {
+        for (size_t i = 0; i < SAMPLES; i++) {
+            collected[i] = input[i];
+        }
+        qsort(collected, SAMPLES, sizeof(collected[0]), CompareSamples);
+        sink += collected[SAMPLES / 2];
+    }
+    double qsortSeconds = (NowSeconds() - start) / WINDOWS;
+
+    static double storage[SAMPLES];
+    static const double percentiles[] = {0.1, 0.9};
+    Aggregate aggregate;
+    Aggregate_Init(&aggregate, percentiles, 2, storage, SAMPLES);
+    double addSeconds = 0, readSeconds = 0;
+    for (int w = 0; w < WINDOWS; w++) {
+        Aggregate_Reset(&aggregate);
+        start = NowSeconds();
+        for (size_t i = 0; i < SAMPLES; i++) {
+            Aggregate_Add(&aggregate, input[i]);
+        }
+        double added = NowSeconds();
+        sink += Aggregate_Median(&aggregate) + Aggregate_Percentile(&aggregate, 0) +
+                Aggregate_Percentile(&aggregate, 1);
+        readSeconds += NowSeconds() - added;
+        addSeconds += added - start;
+    }
+
+    printf("qsort median:    %7.1f us per window\n", qsortSeconds * 1e6);
+    printf("aggregate:       %7.3f us per sample, %7.1f us to read median and percentiles\n",
+           addSeconds / WINDOWS / SAMPLES * 1e6, readSeconds / WINDOWS * 1e6);
+    return 0;
+}
@@ -0,0 +1,177 @@
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "aggregate.h"
+#include "test.h"
+
+// Golden checks against the sort-and-index median the aggregate replaced
+
+#define CAPACITY 1024
+
+static const double percentiles[] = {0.1, 0.9};
+
+static int CompareDoubles(const void *a, const void *b)
+{
+    double x = *(const double *)a;
+    double y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+static uint32_t randomState = 12345;
+
+static uint32_t Random(void)
+{
+    randomState ^= randomState << 13;
+    randomState ^= randomState >> 17;
+    randomState ^= randomState << 5;
+    return randomState;
+}
+
+// Roughly Gaussian pressure samples around 101325 Pa, rounded to whole pascals like the drivers'
+static double PressureSample(double sigma)
+{
+    double sum = 0;
+    for (int i = 0; i < 12; i++) {
+        sum += Random() / 4294967296.0;
+    }
+    return round(101325 + (sum - 6) * sigma);
+}
+
+static void CheckWindow(const double *window, size_t count)
+{
+    static double storage[CAPACITY];
+    static double sorted[CAPACITY];
+    Aggregate aggregate;
+    Aggregate_Init(&aggregate, percentiles, 2, storage, CAPACITY);
+    for (size_t i = 0; i < count; i++) {
+        Aggregate_Add(&aggregate, window[i]);
+    }
+
+    memcpy(sorted, window, count * sizeof(double));
+    qsort(sorted, count, sizeof(double), CompareDoubles);
+
+    CHECK(Aggregate_IsExact(&aggregate));
+    CHECK(Aggregate_Median(&aggregate) == sorted[count / 2]);
+    CHECK(Aggregate_Percentile(&aggregate, 0) == sorted[(size_t)(0.1 * (count - 1) + 0.5)]);
+    CHECK(Aggregate_Percentile(&aggregate, 1) == sorted[(size_t)(0.9 * (count - 1) + 0.5)]);
+    // Reading again after the selection reordered the samples gives the same answers
+    CHECK(Aggregate_Median(&aggregate) == sorted[count / 2]);
+    CHECK(aggregate.min == sorted[0] && aggregate.max == sorted[count - 1]);
+
+    double sum = 0;
+    for (size_t i = 0; i < count; i++) {
+        sum += window[i];
+    }
+    double mean = sum / count;
+    double squares = 0;
+    for (size_t i = 0; i < count; i++) {
+        squares += (window[i] - mean) * (window[i] - mean);
+    }
+    CHECK(fabs(Aggregate_Mean(&aggregate) - mean) < 1e-6);
+    if (count > 1) {
+        CHECK(fabs(Aggregate_StandardDeviation(&aggregate) - sqrt(squares / (count - 1))) < 1e-6);
+    }
+}
+
+static void TestExactMedian(void)
+{
+    static double window[CAPACITY];
+
+    // Odd and even counts, tiny windows, and full windows of noisy samples with many ties
+    for (size_t count = 1; count <= 16; count++) {
+        for (int trial = 0; trial < 50; trial++) {
+            for (size_t i = 0; i < count; i++) {
+                window[i] = PressureSample(3);
+            }
+            CheckWindow(window, count);
+        }
+    }
+    const size_t sizes[] = {59, 300, 599, 600, 750, CAPACITY};
+    for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+        for (int trial = 0; trial < 100; trial++) {
+            for (size_t i = 0; i < sizes[s]; i++) {
+                window[i] = PressureSample(trial % 2 == 0 ? 0.5 : 8);
+            }
+            CheckWindow(window, sizes[s]);
+        }
+    }
+
+    // Inputs that trip up naive pivot choices
+    for (size_t i = 0; i < 600; i++) {
+        window[i] = 100000 + (double)i;
+    }
+    CheckWindow(window, 600);
+    for (size_t i = 0; i < 600; i++) {
+        window[i] = 100000 - (double)i;
+    }
+    CheckWindow(window, 600);
+    for (size_t i = 0; i < 600; i++) {
+        window[i] = 101325;
+    }
+    CheckWindow(window, 600);
+    for (size_t i = 0; i < 600; i++) {
+        window[i] = i % 2 == 0 ? 101000 : 102000;
+    }
+    CheckWindow(window, 600);
+}
+
+static void TestEstimateBeyondCapacity(void)
+{
+    // Past the storage the aggregate falls back to the P-squared estimate and says so
+    static double storage[64];
+    static double window[600];
+    static double sorted[600];
+    Aggregate aggregate;
+    Aggregate_Init(&aggregate, percentiles, 2, storage, 64);
+
+    double worstError = 0;
+    for (int trial = 0; trial < 100; trial++) {
+        Aggregate_Reset(&aggregate);
+        for (size_t i = 0; i < 600; i++) {
+            window[i] = PressureSample(3);
+            Aggregate_Add(&aggregate, window[i]);
+        }
+        memcpy(sorted, window, sizeof(window));
+        qsort(sorted, 600, sizeof(double), CompareDoubles);
+
+        CHECK(!Aggregate_IsExact(&aggregate));
+        double error = fabs(Aggregate_Median(&aggregate) - sorted[300]);
+        if (error > worstError) {
+            worstError = error;
+        }
+    }
+    // Within a third of the noise
+    CHECK(worstError <= 1);
+
+    // Without storage it is always an estimate, but exact until the markers are set up
+    Aggregate estimateOnly;
+    Aggregate_Init(&estimateOnly, NULL, 0, NULL, 0);
+    Aggregate_Add(&estimateOnly, 3);
+    Aggregate_Add(&estimateOnly, 1);
+    Aggregate_Add(&estimateOnly, 2);
+    CHECK(!Aggregate_IsExact(&estimateOnly));
+    CHECK(Aggregate_Median(&estimateOnly) == 2);
+}
+
+static void TestReset(void)
+{
+    static double storage[16];
+    Aggregate aggregate;
+    Aggregate_Init(&aggregate, percentiles, 2, storage, 16);
+    for (int i = 0; i < 10; i++) {
+        Aggregate_Add(&aggregate, 1000 + i);
+    }
+    Aggregate_Reset(&aggregate);
+    CHECK(aggregate.count == 0 && Aggregate_Median(&aggregate) == 0);
+    Aggregate_Add(&aggregate, 5);
+    CHECK(Aggregate_Median(&aggregate) == 5 && Aggregate_Percentile(&aggregate, 1) == 5);
+}
+
+int main(void)
+{
+    TestExactMedian();
+    TestEstimateBeyondCapacity();
+    TestReset();
+    return TEST_RESULT();
+}
@@ -0,0 +1,94 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "barometer.h"
+#include "eventloop_timer_utilities.h"
+#include "fake_i2c.h"
+
+// How evenly a BMP280 is polled while other handlers hog the event loop. Built twice, with
+// BAROMETER_SAMPLING_THREAD=0 (polled from event loop timers) and =1 (polled from the
+// sampling thread), so the two can be compared:
+//
+//    barometer_jitter_bench [SECONDS] [STALL_MS]
+//
+// Every transaction on the simulated bus takes 1.5 ms, and a periodic handler blocks the
+// loop for STALL_MS every 270 ms. The measurement times come from the simulated sensor, so
+// they are what the chip would see.
+
+static int64_t previousMeasurement;
+static int64_t totalDeviation;
+static int64_t maxDeviation;
+static uint32_t intervals;
+
+static void MeasurementTaken(int64_t nanoseconds)
+{
+    if (previousMeasurement != 0) {
+        int64_t deviation = nanoseconds - previousMeasurement - 100 * 1000 * 1000;
+        if (deviation < 0) {
+            deviation = -deviation;
+        }
+        totalDeviation += deviation;
+        if (deviation > maxDeviation) {
+            maxDeviation = deviation;
+        }
+        intervals++;
+    }
+    previousMeasurement = nanoseconds;
+}
+
+static int stallMilliseconds;
+
+static void StallTimerEventHandler(EventLoopTimer *timer)
+{
+    ConsumeEventLoopTimerEvent(timer);
+    const struct timespec stall = {.tv_sec = stallMilliseconds / 1000,
+                                   .tv_nsec = (stallMilliseconds % 1000) * 1000 * 1000};
+    nanosleep(&stall, NULL);
+}
+
+static double MonotonicSeconds(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec + now.tv_nsec / 1e9;
+}
+
+int main(int argc, char *argv[])
+{
+    double seconds = argc > 1 ? atof(argv[1]) : 10;
+    stallMilliseconds = argc > 2 ? atoi(argv[2]) : 40;
+
+    EventLoop *eventLoop = EventLoop_Create();
+    if (eventLoop == NULL) {
+        perror("EventLoop_Create");
+        return 1;
+    }
+
+    static const struct timespec stallPeriod = {.tv_nsec = 270 * 1000 * 1000};
+    if (CreateEventLoopPeriodicTimer(eventLoop, StallTimerEventHandler, &stallPeriod) == NULL) {
+        perror("CreateEventLoopPeriodicTimer");
+        return 1;
+    }
+
+    static datablock_t dataBlock;
+    FakeI2c_Attach(FakeSensor_Bmp280, 0x76);
+    FakeI2c_SetTransactionMicroseconds(1500);
+    FakeI2c_SetMeasurementCallback(MeasurementTaken);
+    if (Barometer_Init(eventLoop, &dataBlock) != ExitCode_Success) {
+        fprintf(stderr, "Barometer_Init failed\n");
+        return 1;
+    }
+
+    double start = MonotonicSeconds();
+    while (MonotonicSeconds() - start < seconds) {
+        EventLoop_Run(eventLoop, 100, true);
+    }
+    Barometer_Fini();
+    FakeI2c_SetMeasurementCallback(NULL);
+
+    printf("%s, %d ms stalls: poll jitter avg %.0f us, max %.0f us over %u intervals\n",
+           BAROMETER_SAMPLING_THREAD ? "thread" : "loop", stallMilliseconds,
+           intervals == 0 ? 0 : totalDeviation / 1e3 / intervals, maxDeviation / 1e3, intervals);
+    return 0;
+}
@@ -0,0 +1,253 @@
+#include <string.h>
+
+#include "barometer.h"
+#include "fake_i2c.h"
+#include "fake_timers.h"
+#include "test.h"
+
+// barometer.c and the sensor backends against the simulated bus, driven from the event
+// loop timers with time standing still: each test fires the timers by hand.
+
+static datablock_t dataBlock;
+
+static EventLoopTimer *PollTimer(void)
+{
+    return FakeTimers_Find("barometer_poll");
+}
+
+static EventLoopTimer *ConversionTimer(void)
+{
+    return FakeTimers_Find("barometer_conversion");
+}
+
+static EventLoopTimer *ProbeTimer(void)
+{
+    return FakeTimers_Find("barometer_probe");
+}
+
+static PressureWindow *Window(void)
+{
+    return DataBlock_ActivePressureWindow(&dataBlock);
+}
+
+static bool Connected(void)
+{
+    BarometerStats stats;
+    Barometer_GetStats(&stats);
+    return stats.connected;
+}
+
+// The health counters last for the life of the process, so tests compare against a
+// snapshot taken when they start
+static BarometerStats baseline;
+
+static BarometerStats StatsSinceStart(void)
+{
+    BarometerStats stats;
+    Barometer_GetStats(&stats);
+    stats.busErrors -= baseline.busErrors;
+    stats.sensorLosses -= baseline.sensorLosses;
+    stats.recoveries -= baseline.recoveries;
+    stats.probeAttempts -= baseline.probeAttempts;
+    return stats;
+}
+
+static void Start(FakeSensorModel model, I2C_DeviceAddress address)
+{
+    FakeI2c_Attach(model, address);
+    memset(&dataBlock, 0, sizeof(dataBlock));
+    Barometer_GetStats(&baseline);
+    CHECK(Barometer_Init(NULL, &dataBlock) == ExitCode_Success);
+}
+
+// One poll, with its conversion steps run back to back
+static void Poll(void)
+{
+    FakeTimers_Fire(PollTimer());
+    for (int step = 0; step < 4 && FakeTimers_IsArmed(ConversionTimer()); step++) {
+        FakeTimers_Fire(ConversionTimer());
+    }
+    CHECK(!FakeTimers_IsArmed(ConversionTimer()));
+}
+
+static void CheckWindow(uint32_t samples, int32_t pressure, int32_t temperature)
+{
+    PressureWindow *window = Window();
+    CHECK(window->samples.count == samples);
+    CHECK(window->samples.min >= pressure - 1 && window->samples.max <= pressure + 1);
+    CHECK(window->temperature.count > 0);
+    CHECK(window->temperature.min == temperature / 10.0);
+    CHECK(window->temperature.max == temperature / 10.0);
+    for (int quality = 0; quality < SampleQuality_Count; quality++) {
+        CHECK(window->rejectedSamples[quality] == 0);
+    }
+}
+
+// The BMP180 is polled with a temperature conversion, then a pressure conversion
+static void TestBmp180(void)
+{
+    Start(FakeSensor_Bmp180, 0x77);
+    CHECK(Connected());
+    CHECK(FakeTimers_IsArmed(PollTimer()) && FakeTimers_IsPeriodic(PollTimer()));
+    CHECK(FakeTimers_Milliseconds(PollTimer()) == 100);
+
+    FakeTimers_Fire(PollTimer());
+    CHECK(FakeTimers_IsArmed(ConversionTimer()));
+    CHECK(FakeTimers_Milliseconds(ConversionTimer()) == 5); // temperature
+    FakeTimers_Fire(ConversionTimer());
+    CHECK(FakeTimers_Milliseconds(ConversionTimer()) == 26); // pressure, ultra high res
+    FakeTimers_Fire(ConversionTimer());
+    CHECK(!FakeTimers_IsArmed(ConversionTimer()));
+
+    for (int i = 1; i < 20; i++) {
+        Poll();
+    }
+    CheckWindow(20, FAKE_BMP180_PRESSURE, FAKE_BMP180_TEMPERATURE);
+    Barometer_Fini();
+}
+
+static void TestBmp280(void)
+{
+    Start(FakeSensor_Bmp280, 0x76);
+    CHECK(Connected());
+    CHECK(FakeTimers_Milliseconds(PollTimer()) == 100);
+
+    // Configuration has to have waited out the reset, or the chip would have dropped the
+    // writes that put it in normal mode and the reads would return no measurement
+    for (int i = 0; i < 20; i++) {
+        Poll();
+    }
+    CheckWindow(20, FAKE_BMP280_PRESSURE, FAKE_BMP280_TEMPERATURE);
+    Barometer_Fini();
+}
+
+// The BMP388 buffers frames between polls; each poll drains the FIFO
+static void TestBmp388(void)
+{
+    Start(FakeSensor_Bmp388, 0x77);
+    CHECK(Connected());
+    CHECK(FakeTimers_Milliseconds(PollTimer()) == 1000);
+
+    for (int i = 0; i < 3; i++) {
+        FakeI2c_QueueFrames(12);
+        Poll();
+    }
+    // An empty FIFO is not an error
+    Poll();
+    CheckWindow(36, FAKE_BMP388_PRESSURE, FAKE_BMP388_TEMPERATURE);
+    Barometer_Fini();
+}
+
+// Polls that fail on the bus are counted, but the sensor is only given up on after five in
+// a row
+static void TestTransientBusErrors(void)
+{
+    Start(FakeSensor_Bmp280, 0x76);
+    Poll();
+    FakeI2c_FailTransactions(4);
+    for (int i = 0; i < 5; i++) {
+        Poll();
+    }
+    BarometerStats stats = StatsSinceStart();
+    CHECK(stats.busErrors == 4);
+    CHECK(stats.sensorLosses == 0);
+    CHECK(stats.connected);
+    CHECK(Window()->rejectedSamples[SampleQuality_BusError] == 4);
+    CHECK(Window()->samples.count == 2);
+    Barometer_Fini();
+}
+
+// A sensor that stops answering is dropped, the bus reopened, and detection retried with
+// exponential backoff until it answers again
+static void TestLossAndBackoff(void)
+{
+    Start(FakeSensor_Bmp280, 0x76);
+    Poll();
+    uint32_t opens = FakeI2c_Opens();
+
+    FakeI2c_SetConnected(false);
+    for (int i = 0; i < 4; i++) {
+        Poll();
+    }
+    CHECK(Connected());
+    Poll();
+    BarometerStats stats = StatsSinceStart();
+    CHECK(stats.busErrors == 5);
+    CHECK(stats.sensorLosses == 1);
+    CHECK(!stats.connected);
+    CHECK(!FakeTimers_IsArmed(PollTimer()));
+    CHECK(FakeTimers_IsArmed(ProbeTimer()));
+    CHECK(FakeTimers_Milliseconds(ProbeTimer()) == 250);
+
+    // Each failed attempt doubles the wait, up to a minute
+    static const uint32_t backoff[] = {500, 1000, 2000, 4000, 8000, 16000, 32000, 60000, 60000};
+    for (size_t i = 0; i < sizeof(backoff) / sizeof(backoff[0]); i++) {
+        FakeTimers_Fire(ProbeTimer());
+        CHECK(FakeTimers_IsArmed(ProbeTimer()));
+        CHECK(FakeTimers_Milliseconds(ProbeTimer()) == backoff[i]);
+    }
+    CHECK(!Connected());
+    CHECK(FakeI2c_Opens() > opens);
+
+    FakeI2c_SetConnected(true);
+    FakeTimers_Fire(ProbeTimer());
+    stats = StatsSinceStart();
+    CHECK(stats.connected);
+    CHECK(stats.recoveries == 1);
+    CHECK(stats.probeAttempts == 10);
+    CHECK(!FakeTimers_IsArmed(ProbeTimer()));
+    CHECK(FakeTimers_IsArmed(PollTimer()) && FakeTimers_Milliseconds(PollTimer()) == 100);
+
+    uint32_t samples = Window()->samples.count;
+    Poll();
+    CHECK(Window()->samples.count == samples + 1);
+
+    // The backoff starts again from the beginning on the next loss
+    FakeI2c_SetConnected(false);
+    for (int i = 0; i < 5; i++) {
+        Poll();
+    }
+    CHECK(StatsSinceStart().sensorLosses == 2);
+    CHECK(FakeTimers_Milliseconds(ProbeTimer()) == 250);
+    Barometer_Fini();
+}
+
+// A BMP280 that browns out comes back asleep, with the "no measurement" reset value in its
+// data registers. It still answers, but it has to be treated as lost and reconfigured.
+static void TestBrownOut(void)
+{
+    Start(FakeSensor_Bmp280, 0x76);
+    for (int i = 0; i < 3; i++) {
+        Poll();
+    }
+
+    FakeI2c_PowerCycle();
+    for (int i = 0; i < 5; i++) {
+        Poll();
+    }
+    BarometerStats stats = StatsSinceStart();
+    CHECK(stats.sensorLosses == 1);
+    CHECK(!stats.connected);
+    CHECK(Window()->rejectedSamples[SampleQuality_BusError] == 5);
+
+    FakeTimers_Fire(ProbeTimer());
+    CHECK(Connected());
+    CHECK(StatsSinceStart().recoveries == 1);
+    for (int i = 0; i < 3; i++) {
+        Poll();
+    }
+    CHECK(Window()->samples.count == 6);
+    CHECK(Window()->samples.min >= FAKE_BMP280_PRESSURE - 1);
+    Barometer_Fini();
+}
+
+int main(void)
+{
+    TestBmp180();
+    TestBmp280();
+    TestBmp388();
+    TestTransientBusErrors();
+    TestLossAndBackoff();
+    TestBrownOut();
+    return TEST_RESULT();
+}
@@ -0,0 +1,101 @@
+#include <string.h>
+#include <time.h>
+
+#include "barometer.h"
+#include "fake_i2c.h"
+#include "test.h"
+
+// barometer.c built with BAROMETER_SAMPLING_THREAD=1 against the simulated bus, in real
+// time: the sampling thread paces itself and hands samples to a host event loop through
+// its eventfd. Checks that samples arrive, and that a sensor which stops answering is
+// dropped and picked up again once it comes back.
+
+static datablock_t dataBlock;
+static EventLoop *eventLoop;
+
+static int64_t NowMilliseconds(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (int64_t)now.tv_sec * 1000 + now.tv_nsec / 1000000;
+}
+
+static uint32_t Samples(void)
+{
+    return DataBlock_ActivePressureWindow(&dataBlock)->samples.count;
+}
+
+static bool Connected(void)
+{
+    BarometerStats stats;
+    Barometer_GetStats(&stats);
+    return stats.connected;
+}
+
+static bool Disconnected(void)
+{
+    return !Connected();
+}
+
+static uint32_t samplesTarget;
+
+static bool SamplesReached(void)
+{
+    return Samples() >= samplesTarget;
+}
+
+/// <summary>
+/// Run the event loop until the condition holds, or for at most the given time.
+/// </summary>
+/// <returns>Whether the condition was met.</returns>
+static bool RunUntil(bool (*condition)(void), int64_t timeoutMilliseconds)
+{
+    int64_t deadline = NowMilliseconds() + timeoutMilliseconds;
+    while (!condition()) {
+        if (NowMilliseconds() >= deadline) {
+            return false;
+        }
+        EventLoop_Run(eventLoop, 10, true);
+    }
+    return true;
+}
+
+int main(void)
+{
+    eventLoop = EventLoop_Create();
+    CHECK(eventLoop != NULL);
+
+    FakeI2c_Attach(FakeSensor_Bmp280, 0x76);
+    CHECK(Barometer_Init(eventLoop, &dataBlock) == ExitCode_Success);
+    CHECK(Connected());
+
+    // Polled every 100 ms; the loop only sees the samples through the eventfd
+    samplesTarget = 5;
+    CHECK(RunUntil(SamplesReached, 1000));
+    PressureWindow *window = DataBlock_ActivePressureWindow(&dataBlock);
+    CHECK(window->samples.min >= FAKE_BMP280_PRESSURE - 1);
+    CHECK(window->samples.max <= FAKE_BMP280_PRESSURE + 1);
+
+    // Five failed polls in a row lose the sensor
+    BarometerStats before;
+    Barometer_GetStats(&before);
+    FakeI2c_SetConnected(false);
+    CHECK(RunUntil(Disconnected, 1000));
+    BarometerStats stats;
+    Barometer_GetStats(&stats);
+    CHECK(stats.sensorLosses == before.sensorLosses + 1);
+    CHECK(stats.busErrors >= before.busErrors + 5);
+
+    // The thread probes again after its backoff and resumes polling
+    FakeI2c_SetConnected(true);
+    CHECK(RunUntil(Connected, 2000));
+    Barometer_GetStats(&stats);
+    CHECK(stats.recoveries == before.recoveries + 1);
+
+    samplesTarget = Samples() + 3;
+    CHECK(RunUntil(SamplesReached, 1000));
+
+    Barometer_Fini();
+    EventLoop_Close(eventLoop);
+    return TEST_RESULT();
+}
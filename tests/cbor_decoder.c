@@ -0,0 +1,160 @@
+#include <string.h>
+
+#include "cbor_decoder.h"
+
+void CborReader_Init(CborReader *reader, const uint8_t *data, size_t length)
+{
+    reader->data = data;
+    reader->length = length;
+    reader->offset = 0;
+    reader->error = false;
+}
+
+static bool ReadBytes(CborReader *reader, size_t count, const uint8_t **bytes)
+{
+    if (reader->error || count > reader->length - reader->offset) {
+        reader->error = true;
+        return false;
+    }
+    *bytes = reader->data + reader->offset;
+    reader->offset += count;
+    return true;
+}
+
+static bool ReadBigEndian(CborReader *reader, size_t count, uint64_t *value)
+{
+    const uint8_t *bytes;
+    if (!ReadBytes(reader, count, &bytes)) {
+        return false;
+    }
+    *value = 0;
+    for (size_t i = 0; i < count; i++) {
+        *value = *value << 8 | bytes[i];
+    }
+    return true;
+}
+
+bool CborReader_Next(CborReader *reader, CborItem *item)
+{
+    const uint8_t *initial;
+    if (reader->offset == reader->length || !ReadBytes(reader, 1, &initial)) {
+        return false;
+    }
+
+    uint8_t majorType = *initial >> 5;
+    uint8_t additional = *initial & 0x1f;
+    memset(item, 0, sizeof(*item));
+
+    if (majorType == 7) {
+        uint64_t bits;
+        if (additional == 22) {
+            item->type = CborItem_Null;
+            return true;
+        }
+        if (additional == 26 && ReadBigEndian(reader, 4, &bits)) {
+            uint32_t single = (uint32_t)bits;
+            float value;
+            memcpy(&value, &single, sizeof(value));
+            item->type = CborItem_Float;
+            item->number = value;
+            return true;
+        }
+        if (additional == 27 && ReadBigEndian(reader, 8, &bits)) {
+            memcpy(&item->number, &bits, sizeof(item->number));
+            item->type = CborItem_Double;
+            return true;
+        }
+        reader->error = true;
+        return false;
+    }
+
+    uint64_t argument = additional;
+    if (additional >= 24 && additional <= 27) {
+        if (!ReadBigEndian(reader, (size_t)1 << (additional - 24), &argument)) {
+            return false;
+        }
+    }
+    else if (additional > 27) {
+        // Indefinite lengths and reserved values are never written by the encoder
+        reader->error = true;
+        return false;
+    }
+    item->argument = argument;
+
+    switch (majorType) {
+    case 0:
+        item->type = CborItem_Unsigned;
+        item->integer = (int64_t)argument;
+        return true;
+    case 1:
+        item->type = CborItem_Negative;
+        item->integer = -1 - (int64_t)argument;
+        return true;
+    case 3: {
+        const uint8_t *bytes;
+        if (!ReadBytes(reader, (size_t)argument, &bytes)) {
+            return false;
+        }
+        item->type = CborItem_Text;
+        item->text = (const char *)bytes;
+        return true;
+    }
+    case 4:
+        item->type = CborItem_Array;
+        return true;
+    case 5:
+        item->type = CborItem_Map;
+        return true;
+    case 6:
+        item->type = CborItem_Tag;
+        return true;
+    default:
+        reader->error = true;
+        return false;
+    }
+}
+
+bool CborReader_Skip(CborReader *reader)
+{
+    CborItem item;
+    if (!CborReader_Next(reader, &item)) {
+        return false;
+    }
+
+    uint64_t children = item.type == CborItem_Array ? item.argument
+                        : item.type == CborItem_Map ? 2 * item.argument
+                        : item.type == CborItem_Tag ? 1
+                                                    : 0;
+    for (uint64_t i = 0; i < children; i++) {
+        if (!CborReader_Skip(reader)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool CborReader_Number(CborReader *reader, double *value)
+{
+    CborItem item;
+    if (!CborReader_Next(reader, &item)) {
+        return false;
+    }
+    switch (item.type) {
+    case CborItem_Unsigned:
+    case CborItem_Negative:
+        *value = (double)item.integer;
+        return true;
+    case CborItem_Float:
+    case CborItem_Double:
+        *value = item.number;
+        return true;
+    default:
+        return false;
+    }
+}
+
+bool CborReader_TextEquals(const CborItem *item, const char *text)
+{
+    return item->type == CborItem_Text && item->argument == strlen(text) &&
+           memcmp(item->text, text, item->argument) == 0;
+}
@@ -0,0 +1,58 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/// <summary>
+/// Host-side CBOR (RFC 8949) decoder for checking what cbor.c writes. It reads one data item
+/// header at a time, covering the subset the encoder produces: integers, text, arrays,
+/// maps, tags, null and single and double precision floats.
+/// </summary>
+typedef struct CborReader {
+    const uint8_t *data;
+    size_t length;
+    size_t offset;
+    bool error;
+} CborReader;
+
+typedef enum {
+    CborItem_Unsigned,
+    CborItem_Negative,
+    CborItem_Text,
+    CborItem_Array,
+    CborItem_Map,
+    CborItem_Tag,
+    CborItem_Float,
+    CborItem_Double,
+    CborItem_Null,
+} CborItemType;
+
+typedef struct CborItem {
+    CborItemType type;
+    int64_t integer;   // value of Unsigned and Negative items
+    uint64_t argument; // length of Text, Array and Map items; number of Tag items
+    double number;     // value of Float and Double items
+    const char *text;  // Text items; not NUL terminated
+} CborItem;
+
+void CborReader_Init(CborReader *reader, const uint8_t *data, size_t length);
+
+/// <summary>
+/// Read the next item's header. Text items are consumed whole; arrays, maps and tags are
+/// followed by their contents.
+/// </summary>
+/// <returns>false at the end of the data or on malformed input.</returns>
+bool CborReader_Next(CborReader *reader, CborItem *item);
+
+/// <summary>
+/// Skip the next item including everything nested in it.
+/// </summary>
+bool CborReader_Skip(CborReader *reader);
+
+/// <summary>
+/// Read a number of any encoding the encoder uses for one.
+/// </summary>
+bool CborReader_Number(CborReader *reader, double *value);
+
+bool CborReader_TextEquals(const CborItem *item, const char *text);
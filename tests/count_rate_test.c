@@ -0,0 +1,192 @@
+#include <math.h>
+#include <stdio.h>
+
+#include "count_rate.h"
+#include "test.h"
+
+// Sliding window rates, confidence bounds and coverage from count_rate.c, with reports
+// placed at exact times. The counter reports once a second; times here are seconds after
+// the first report.
+
+static CountRate rate;
+
+static void Add(double seconds, uint32_t counts)
+{
+    CountRate_Add(&rate, 5000000000LL + (int64_t)(seconds * 1e9), counts);
+}
+
+static CountRateEstimate Estimate(CountRateWindow window)
+{
+    CountRateEstimate estimate;
+    CountRate_GetEstimate(&rate, window, &estimate);
+    return estimate;
+}
+
+static bool Near(double value, double expected, double relativeTolerance)
+{
+    return fabs(value - expected) <= relativeTolerance * fabs(expected);
+}
+
+static void TestSteadyRate(void)
+{
+    CountRate_Init(&rate);
+
+    // 0, 1, 2 counts in turn: 60 CPM in every window once it has filled
+    uint32_t second = 0;
+    for (; second < 60; second++) {
+        Add(second + 0.3, second % 3);
+    }
+    CHECK(Estimate(CountRateWindow_Minute).cpm == 60);
+    CHECK(Estimate(CountRateWindow_Minute).coverage == 1);
+    CHECK(Estimate(CountRateWindow_TenMinutes).cpm == 60);
+    CHECK(Near(Estimate(CountRateWindow_TenMinutes).coverage, 0.1, 1e-9));
+    CHECK(Near(Estimate(CountRateWindow_Hour).coverage, 1 / 60.0, 1e-9));
+
+    for (; second < 3600; second++) {
+        Add(second + 0.3, second % 3);
+    }
+    for (int window = 0; window < CountRateWindow_Count; window++) {
+        CountRateEstimate estimate = Estimate((CountRateWindow)window);
+        CHECK(estimate.cpm == 60);
+        CHECK(estimate.coverage == 1);
+        CHECK(Near(estimate.microsievertsPerHour, 60 / 175.43, 1e-9));
+        CHECK(estimate.cpmLow < 60 && estimate.cpmHigh > 60);
+    }
+    CHECK(rate.sums[CountRateWindow_Minute].counts == 60);
+    CHECK(rate.sums[CountRateWindow_TenMinutes].counts == 600);
+    CHECK(rate.sums[CountRateWindow_Hour].counts == 3600);
+
+    // Once the history wraps, the old seconds leave every window exactly once
+    for (; second < 2 * 3600 + 17; second++) {
+        Add(second + 0.3, 2 * (second % 3));
+    }
+    for (int window = 0; window < CountRateWindow_Count; window++) {
+        CountRateEstimate estimate = Estimate((CountRateWindow)window);
+        CHECK(estimate.cpm == 120);
+        CHECK(estimate.coverage == 1);
+    }
+}
+
+static void TestPoissonBounds(void)
+{
+    // Exact (chi-square) 95% intervals for the count in one minute, which the
+    // Wilson-Hilferty approximation should match closely from ten counts up
+    static const struct {
+        uint32_t counts;
+        double low;
+        double high;
+        double tolerance;
+    } expected[] = {
+        {0, 0, 3.6889, 0.01},
+        {10, 4.7954, 18.3904, 0.002},
+        {100, 81.3639, 121.6286, 0.001},
+        {1000, 939.0797, 1063.2378, 0.001},
+    };
+
+    for (size_t i = 0; i < sizeof(expected) / sizeof(expected[0]); i++) {
+        CountRate_Init(&rate);
+        Add(0.5, expected[i].counts);
+        for (uint32_t second = 1; second < 60; second++) {
+            Add(second + 0.5, 0);
+        }
+        CountRateEstimate estimate = Estimate(CountRateWindow_Minute);
+        CHECK(estimate.cpm == expected[i].counts);
+        CHECK(expected[i].low == 0 ? estimate.cpmLow == 0
+                                   : Near(estimate.cpmLow, expected[i].low, expected[i].tolerance));
+        CHECK(Near(estimate.cpmHigh, expected[i].high, expected[i].tolerance));
+
+        // Over ten minutes of the same counts the interval is a tenth as wide in CPM
+        CountRate_Init(&rate);
+        Add(0.5, expected[i].counts);
+        for (uint32_t second = 1; second < 600; second++) {
+            Add(second + 0.5, 0);
+        }
+        estimate = Estimate(CountRateWindow_TenMinutes);
+        CHECK(Near(estimate.cpmHigh, expected[i].high / 10, expected[i].tolerance));
+    }
+}
+
+static void TestCoverageAfterGaps(void)
+{
+    CountRate_Init(&rate);
+    for (uint32_t second = 0; second < 60; second++) {
+        Add(second + 0.5, 1);
+    }
+
+    // Thirty silent seconds: the minute window is half covered, and the rate is taken
+    // over the seconds that were covered
+    for (uint32_t second = 90; second < 120; second++) {
+        Add(second + 0.5, 2);
+    }
+    CountRateEstimate estimate = Estimate(CountRateWindow_Minute);
+    CHECK(Near(estimate.coverage, 0.5, 1e-9));
+    CHECK(estimate.cpm == 120);
+    estimate = Estimate(CountRateWindow_TenMinutes);
+    CHECK(Near(estimate.coverage, 90 / 600.0, 1e-9));
+    CHECK(Near(estimate.cpm, (60 + 60) / 1.5, 1e-9));
+
+    // A gap longer than the minute empties it; the longer windows keep what they had
+    Add(400.5, 3);
+    estimate = Estimate(CountRateWindow_Minute);
+    CHECK(Near(estimate.coverage, 1 / 60.0, 1e-9));
+    CHECK(estimate.cpm == 180);
+    CHECK(rate.sums[CountRateWindow_Minute].counts == 3);
+    CHECK(rate.sums[CountRateWindow_TenMinutes].counts == 123);
+    CHECK(rate.sums[CountRateWindow_TenMinutes].coveredSeconds == 91);
+
+    // And one longer than the hour empties them all
+    Add(4100.5, 4);
+    for (int window = 0; window < CountRateWindow_Count; window++) {
+        CHECK(rate.sums[window].counts == 4);
+        CHECK(rate.sums[window].coveredSeconds == 1);
+    }
+}
+
+static void TestSameSecondCollisions(void)
+{
+    CountRate_Init(&rate);
+
+    // Two reports close together both land in second 2; the later one is nudged into
+    // second 3, which is still no more than a second ahead of the clock
+    Add(0.0, 1);
+    Add(1.9, 2);
+    Add(1.95, 3);
+    CHECK(rate.lastSecond == 3);
+    CHECK(rate.sums[CountRateWindow_Minute].coveredSeconds == 3);
+    CHECK(rate.sums[CountRateWindow_Minute].counts == 6);
+
+    // Another in the same second would be two ahead, so it is folded into second 3
+    Add(1.98, 4);
+    CHECK(rate.lastSecond == 3);
+    CHECK(rate.slots[3].counts == 7);
+    for (int window = 0; window < CountRateWindow_Count; window++) {
+        CHECK(rate.sums[window].counts == 10);
+        CHECK(rate.sums[window].coveredSeconds == 3);
+    }
+
+    // The clock catching up carries on as normal
+    Add(3.0, 5);
+    CHECK(rate.lastSecond == 4);
+    CHECK(rate.sums[CountRateWindow_Minute].counts == 15);
+
+    // A folded second saturates at what a slot can hold, and the sums add only what was
+    // kept, so they still match once it expires
+    Add(3.2, 65000);
+    Add(3.3, 1000);
+    CHECK(rate.slots[5].counts == UINT16_MAX);
+    CHECK(rate.sums[CountRateWindow_Minute].counts == 15 + UINT16_MAX);
+    for (uint32_t second = 5; second < 70; second++) {
+        Add(second + 0.5, 0);
+    }
+    CHECK(rate.sums[CountRateWindow_Minute].counts == 0);
+    CHECK(rate.sums[CountRateWindow_Hour].counts == 15 + UINT16_MAX);
+}
+
+int main(void)
+{
+    TestSteadyRate();
+    TestPoissonBounds();
+    TestCoverageAfterGaps();
+    TestSameSecondCollisions();
+    return TEST_RESULT();
+}
@@ -0,0 +1,78 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/resource.h>
+#include <time.h>
+
+#include "eventloop_timer_utilities.h"
+
+// Wakeups and CPU per expiry for many periodic timers on one event loop, with periods from
+// 100 ms to 10 s spread by a random sub-millisecond offset so that few deadlines coincide
+// exactly:
+//
+//    eventloop_timer_bench [TIMERS] [SECONDS]
+
+static uint32_t expiries;
+
+static void TimerEventHandler(EventLoopTimer *timer)
+{
+    uint64_t count;
+    if (ConsumeEventLoopTimerEventCount(timer, &count) == 0) {
+        expiries += (uint32_t)count;
+    }
+}
+
+static double CpuSeconds(void)
+{
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_utime.tv_sec + usage.ru_stime.tv_sec +
+           (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) / 1e6;
+}
+
+static double MonotonicSeconds(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec + now.tv_nsec / 1e9;
+}
+
+int main(int argc, char *argv[])
+{
+    int timers = argc > 1 ? atoi(argv[1]) : 100;
+    double seconds = argc > 2 ? atof(argv[2]) : 5;
+
+    EventLoop *eventLoop = EventLoop_Create();
+    if (eventLoop == NULL) {
+        perror("EventLoop_Create");
+        return 1;
+    }
+
+    static const int periodsMilliseconds[] = {100, 200, 250, 500, 1000, 2000, 5000, 10000};
+    srand(7);
+    for (int i = 0; i < timers; i++) {
+        int period = periodsMilliseconds[rand() % (sizeof(periodsMilliseconds) / sizeof(periodsMilliseconds[0]))];
+        const struct timespec interval = {.tv_sec = period / 1000,
+                                          .tv_nsec = (period % 1000) * 1000 * 1000 + (rand() % 997) * 1000};
+        if (CreateEventLoopPeriodicTimer(eventLoop, TimerEventHandler, &interval) == NULL) {
+            perror("CreateEventLoopPeriodicTimer");
+            return 1;
+        }
+    }
+
+    // Each run dispatches one event, so every run is one wakeup
+    uint32_t wakeups = 0;
+    double startCpu = CpuSeconds();
+    double start = MonotonicSeconds();
+    while (MonotonicSeconds() - start < seconds) {
+        if (EventLoop_Run(eventLoop, 100, true) == EventLoop_Run_Finished) {
+            wakeups++;
+        }
+    }
+    double elapsed = MonotonicSeconds() - start;
+    double cpu = CpuSeconds() - startCpu;
+
+    printf("%d timers: %.1f wakeups/s, %.1f expiries/s, %.1f%% CPU, %.2f us CPU per expiry\n",
+           timers, wakeups / elapsed, expiries / elapsed, 100 * cpu / elapsed,
+           expiries == 0 ? 0 : 1e6 * cpu / expiries);
+    return 0;
+}
@@ -0,0 +1,352 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "fake_i2c.h"
+
+// The sampling thread and the test both touch the sensor, so everything is serialized
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+
+static struct {
+    FakeSensorModel model;
+    I2C_DeviceAddress address;
+    bool attached;
+    bool connected;
+    uint8_t registers[256];
+    int64_t resetNanoseconds;
+    uint32_t measurements;
+    uint8_t fifo[512];
+    size_t fifoLength;
+} sensor;
+
+static uint32_t failuresPending;
+static uint32_t transactionMicroseconds;
+static uint32_t opens;
+static FakeI2cMeasurementCallback *measurementCallback;
+
+// BMP180 datasheet calibration and raw values
+static const int16_t bmp180Calibration[] = {408,  -72, -14383, 32741, 32757, 23153,
+                                            6190, 4,   -32768, -8711, 2868};
+static const uint16_t bmp180RawTemperature = 27898;
+// 23843 at oversampling 0; the chip returns it with (8 - oversampling) bits of padding
+static const uint8_t bmp180RawPressure[] = {0x5D, 0x23, 0x00};
+
+// BMP280 datasheet calibration and raw values
+static const int32_t bmp280Calibration[] = {27504, 26435, -1000, 36477, -10685, 3024,
+                                            2855,  140,   -7,    15500, -14600, 6000};
+static const uint32_t bmp280RawPressure = 415148;
+static const uint32_t bmp280RawTemperature = 519888;
+static const uint32_t bmp280Skipped = 0x80000;
+static const int64_t bmp280StartupNanoseconds = 2 * 1000 * 1000;
+static const int64_t bmp280NvmCopyNanoseconds = 3 * 1000 * 1000;
+
+// A simple BMP388 calibration: temperature from T1 to T3, pressure linear in the raw value
+static const uint8_t bmp388Calibration[21] = {
+    [0] = 27000 & 0xFF, [1] = 27000 >> 8, // T1
+    [2] = 19000 & 0xFF, [3] = 19000 >> 8, // T2
+    [4] = (uint8_t)-7,                    // T3
+    [5] = 0x00,         [6] = 0x01,       // P1 = 256
+    [7] = 0x00,         [8] = 0x40,       // P2 = 16384, i.e. zero once offset
+    [11] = 25000 & 0xFF, [12] = 25000 >> 8, // P5
+};
+static const uint32_t bmp388RawTemperature = 8327635;
+static const uint32_t bmp388RawPressure = 6415441;
+static const uint8_t bmp388PowerNormal = 0x33;
+
+static int64_t Now(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (int64_t)now.tv_sec * 1000 * 1000 * 1000 + now.tv_nsec;
+}
+
+static void Put16(uint8_t reg, uint16_t value, bool bigEndian)
+{
+    sensor.registers[reg] = (uint8_t)(bigEndian ? value >> 8 : value);
+    sensor.registers[reg + 1] = (uint8_t)(bigEndian ? value : value >> 8);
+}
+
+// 20-bit BMP280 ADC value in MSB, LSB, XLSB order
+static void Put20(uint8_t reg, uint32_t value)
+{
+    sensor.registers[reg] = (uint8_t)(value >> 12);
+    sensor.registers[reg + 1] = (uint8_t)(value >> 4);
+    sensor.registers[reg + 2] = (uint8_t)(value << 4);
+}
+
+static void PowerOn(void)
+{
+    memset(sensor.registers, 0, sizeof(sensor.registers));
+    sensor.resetNanoseconds = Now();
+    sensor.fifoLength = 0;
+
+    switch (sensor.model) {
+    case FakeSensor_Bmp180:
+        sensor.registers[0xD0] = 0x55;
+        for (size_t i = 0; i < sizeof(bmp180Calibration) / sizeof(bmp180Calibration[0]); i++) {
+            Put16((uint8_t)(0xAA + 2 * i), (uint16_t)bmp180Calibration[i], true);
+        }
+        break;
+    case FakeSensor_Bmp280:
+        sensor.registers[0xD0] = 0x58;
+        for (size_t i = 0; i < sizeof(bmp280Calibration) / sizeof(bmp280Calibration[0]); i++) {
+            Put16((uint8_t)(0x88 + 2 * i), (uint16_t)bmp280Calibration[i], false);
+        }
+        Put20(0xF7, bmp280Skipped);
+        Put20(0xFA, bmp280Skipped);
+        break;
+    case FakeSensor_Bmp388:
+        sensor.registers[0x00] = 0x50;
+        memcpy(sensor.registers + 0x31, bmp388Calibration, sizeof(bmp388Calibration));
+        break;
+    }
+}
+
+static void Bmp280Write(uint8_t reg, uint8_t value)
+{
+    if (Now() - sensor.resetNanoseconds < bmp280StartupNanoseconds) {
+        // Still starting up
+        return;
+    }
+    if (reg == 0xE0) {
+        if (value == 0xB6) {
+            PowerOn();
+        }
+        return;
+    }
+    sensor.registers[reg] = value;
+}
+
+static void Bmp280Read(uint8_t reg)
+{
+    sensor.registers[0xF3] = Now() - sensor.resetNanoseconds < bmp280NvmCopyNanoseconds ? 1 : 0;
+    if (reg == 0xF7 && (sensor.registers[0xF4] & 3) == 3) {
+        // A new measurement, with a little noise so that repeats look stale
+        sensor.measurements++;
+        if (measurementCallback != NULL) {
+            measurementCallback(Now());
+        }
+        Put20(0xF7, bmp280RawPressure + (sensor.measurements & 1));
+        Put20(0xFA, bmp280RawTemperature);
+    }
+}
+
+static void Bmp180Write(uint8_t reg, uint8_t value)
+{
+    sensor.registers[reg] = value;
+    if (reg != 0xF4) {
+        return;
+    }
+    if (value == 0x2E) {
+        Put16(0xF6, bmp180RawTemperature, true);
+    }
+    else if ((value & 0x3F) == 0x34) {
+        if (measurementCallback != NULL) {
+            measurementCallback(Now());
+        }
+        memcpy(sensor.registers + 0xF6, bmp180RawPressure, sizeof(bmp180RawPressure));
+    }
+}
+
+static void Bmp388Write(uint8_t reg, uint8_t value)
+{
+    if (reg == 0x7E) {
+        if (value == 0xB0) {
+            sensor.fifoLength = 0;
+        }
+        return;
+    }
+    sensor.registers[reg] = value;
+}
+
+static void Bmp388Read(uint8_t reg, uint8_t *data, size_t length)
+{
+    if (reg == 0x12) {
+        sensor.registers[0x12] = (uint8_t)sensor.fifoLength;
+        sensor.registers[0x13] = (uint8_t)(sensor.fifoLength >> 8);
+        return;
+    }
+    if (reg == 0x14) {
+        // Reads pop the FIFO; past its end the chip returns empty frames
+        size_t popped = length < sensor.fifoLength ? length : sensor.fifoLength;
+        memset(data, 0x80, length);
+        memcpy(data, sensor.fifo, popped);
+        memmove(sensor.fifo, sensor.fifo + popped, sensor.fifoLength - popped);
+        sensor.fifoLength -= popped;
+    }
+}
+
+// Common start of every transaction: bus time, injected failures and the acknowledge
+static bool BeginTransaction(int fd, I2C_DeviceAddress address)
+{
+    if (transactionMicroseconds != 0) {
+        const struct timespec delay = {.tv_nsec = (long)transactionMicroseconds * 1000};
+        nanosleep(&delay, NULL);
+    }
+    if (failuresPending != 0) {
+        failuresPending--;
+        errno = EIO;
+        return false;
+    }
+    if (!sensor.attached || !sensor.connected || address != sensor.address) {
+        errno = ENXIO;
+        return false;
+    }
+    return true;
+}
+
+ssize_t I2CMaster_Write(int fd, I2C_DeviceAddress address, const uint8_t *data, size_t length)
+{
+    pthread_mutex_lock(&lock);
+    if (!BeginTransaction(fd, address)) {
+        pthread_mutex_unlock(&lock);
+        return -1;
+    }
+    // Register writes are address then value; later bytes go to the following registers
+    for (size_t i = 1; i < length; i++) {
+        uint8_t reg = (uint8_t)(data[0] + i - 1);
+        switch (sensor.model) {
+        case FakeSensor_Bmp180:
+            Bmp180Write(reg, data[i]);
+            break;
+        case FakeSensor_Bmp280:
+            Bmp280Write(reg, data[i]);
+            break;
+        case FakeSensor_Bmp388:
+            Bmp388Write(reg, data[i]);
+            break;
+        }
+    }
+    pthread_mutex_unlock(&lock);
+    return (ssize_t)length;
+}
+
+ssize_t I2CMaster_WriteThenRead(int fd, I2C_DeviceAddress address, const uint8_t *writeData,
+                                size_t lenWriteData, uint8_t *readData, size_t lenReadData)
+{
+    pthread_mutex_lock(&lock);
+    if (!BeginTransaction(fd, address) || lenWriteData != 1) {
+        pthread_mutex_unlock(&lock);
+        return -1;
+    }
+    uint8_t reg = writeData[0];
+    if (sensor.model == FakeSensor_Bmp388 && reg == 0x14) {
+        Bmp388Read(reg, readData, lenReadData);
+    }
+    else {
+        if (sensor.model == FakeSensor_Bmp280) {
+            Bmp280Read(reg);
+        }
+        else if (sensor.model == FakeSensor_Bmp388) {
+            Bmp388Read(reg, readData, lenReadData);
+        }
+        for (size_t i = 0; i < lenReadData; i++) {
+            readData[i] = sensor.registers[(uint8_t)(reg + i)];
+        }
+    }
+    pthread_mutex_unlock(&lock);
+    return (ssize_t)(lenWriteData + lenReadData);
+}
+
+ssize_t I2CMaster_Read(int fd, I2C_DeviceAddress address, uint8_t *buffer, size_t maxLength)
+{
+    errno = ENOSYS;
+    return -1;
+}
+
+int I2CMaster_Open(I2C_InterfaceId id)
+{
+    pthread_mutex_lock(&lock);
+    opens++;
+    pthread_mutex_unlock(&lock);
+    // A real descriptor, so that closing it works
+    return open("/dev/null", O_RDWR | O_CLOEXEC);
+}
+
+int I2CMaster_SetBusSpeed(int fd, I2C_BusSpeed speed)
+{
+    return 0;
+}
+
+int I2CMaster_SetTimeout(int fd, uint32_t timeoutInMs)
+{
+    return 0;
+}
+
+void FakeI2c_Attach(FakeSensorModel model, I2C_DeviceAddress address)
+{
+    pthread_mutex_lock(&lock);
+    memset(&sensor, 0, sizeof(sensor));
+    sensor.model = model;
+    sensor.address = address;
+    sensor.attached = true;
+    sensor.connected = true;
+    PowerOn();
+    // Already past its start-up time
+    sensor.resetNanoseconds -= bmp280NvmCopyNanoseconds;
+    failuresPending = 0;
+    pthread_mutex_unlock(&lock);
+}
+
+void FakeI2c_SetConnected(bool connected)
+{
+    pthread_mutex_lock(&lock);
+    sensor.connected = connected;
+    pthread_mutex_unlock(&lock);
+}
+
+void FakeI2c_PowerCycle(void)
+{
+    pthread_mutex_lock(&lock);
+    PowerOn();
+    pthread_mutex_unlock(&lock);
+}
+
+void FakeI2c_FailTransactions(uint32_t count)
+{
+    pthread_mutex_lock(&lock);
+    failuresPending = count;
+    pthread_mutex_unlock(&lock);
+}
+
+void FakeI2c_QueueFrames(uint32_t count)
+{
+    pthread_mutex_lock(&lock);
+    if (sensor.model == FakeSensor_Bmp388 && sensor.registers[0x1B] == bmp388PowerNormal) {
+        for (uint32_t i = 0; i < count && sensor.fifoLength + 7 <= sizeof(sensor.fifo); i++) {
+            uint8_t *frame = sensor.fifo + sensor.fifoLength;
+            frame[0] = 0x94;
+            for (int byte = 0; byte < 3; byte++) {
+                frame[1 + byte] = (uint8_t)(bmp388RawTemperature >> (8 * byte));
+                frame[4 + byte] = (uint8_t)(bmp388RawPressure >> (8 * byte));
+            }
+            sensor.fifoLength += 7;
+        }
+    }
+    pthread_mutex_unlock(&lock);
+}
+
+void FakeI2c_SetTransactionMicroseconds(uint32_t microseconds)
+{
+    pthread_mutex_lock(&lock);
+    transactionMicroseconds = microseconds;
+    pthread_mutex_unlock(&lock);
+}
+
+void FakeI2c_SetMeasurementCallback(FakeI2cMeasurementCallback *callback)
+{
+    pthread_mutex_lock(&lock);
+    measurementCallback = callback;
+    pthread_mutex_unlock(&lock);
+}
+
+uint32_t FakeI2c_Opens(void)
+{
+    pthread_mutex_lock(&lock);
+    uint32_t count = opens;
+    pthread_mutex_unlock(&lock);
+    return count;
+}
@@ -0,0 +1,83 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include <applibs/i2c.h>
+
+// A simulated I2C bus with one barometric sensor on it, implementing the I2CMaster calls
+// for the host tests. Each model has the register map the drivers use: chip id,
+// calibration, control registers and data registers, with enough behaviour behind them
+// to exercise the drivers' error handling:
+//
+//  - BMP180: conversions are started by a control register write; the data registers
+//    then hold the raw result.
+//  - BMP280: a soft reset (or a power cycle) puts the chip back in sleep mode with the
+//    "no measurement" value in its data registers. For 2 ms after a reset it drops
+//    writes, and for 3 ms it reports an NVM copy in its status register. In normal mode
+//    every data read returns a fresh measurement.
+//  - BMP388: frames queued with FakeI2c_QueueFrames are returned through the FIFO
+//    registers while the chip is in normal mode.
+//
+// The raw values and calibration are chosen so that every model compensates to a known
+// reading, below.
+
+typedef enum {
+    FakeSensor_Bmp180,
+    FakeSensor_Bmp280,
+    FakeSensor_Bmp388,
+} FakeSensorModel;
+
+// The BMP180 values are the datasheet's worked example (the pressure at ultra high
+// resolution), the BMP280 ones the datasheet's compensation example
+#define FAKE_BMP180_PRESSURE 69963    // Pa, within 1 Pa at any oversampling
+#define FAKE_BMP180_TEMPERATURE 150   // 0.1 degrees C
+#define FAKE_BMP280_PRESSURE 100653   // Pa
+#define FAKE_BMP280_TEMPERATURE 251   // 0.1 degrees C
+#define FAKE_BMP388_PRESSURE 101325   // Pa
+#define FAKE_BMP388_TEMPERATURE 250   // 0.1 degrees C
+
+/// <summary>
+/// Put a freshly powered-up sensor of the given model on the bus, replacing any other.
+/// </summary>
+void FakeI2c_Attach(FakeSensorModel model, I2C_DeviceAddress address);
+
+/// <summary>
+/// Connect or disconnect the sensor. While disconnected every transaction fails with
+/// ENXIO, as if it had no acknowledge; the sensor keeps its register contents.
+/// </summary>
+void FakeI2c_SetConnected(bool connected);
+
+/// <summary>
+/// Brown the sensor out: its registers go back to their power-on values, as after a reset.
+/// </summary>
+void FakeI2c_PowerCycle(void);
+
+/// <summary>
+/// Fail the next count transactions with EIO.
+/// </summary>
+void FakeI2c_FailTransactions(uint32_t count);
+
+/// <summary>
+/// Add count pressure and temperature frames to the BMP388's FIFO.
+/// </summary>
+void FakeI2c_QueueFrames(uint32_t count);
+
+/// <summary>
+/// Make every transaction take this long, as on a real bus.
+/// </summary>
+void FakeI2c_SetTransactionMicroseconds(uint32_t microseconds);
+
+typedef void FakeI2cMeasurementCallback(int64_t nanoseconds);
+
+/// <summary>
+/// Call back with the CLOCK_MONOTONIC time whenever the sensor takes a pressure
+/// measurement: a BMP280 data read in normal mode, or the start of a BMP180 pressure
+/// conversion. The callback runs on whichever thread is using the bus.
+/// </summary>
+void FakeI2c_SetMeasurementCallback(FakeI2cMeasurementCallback *callback);
+
+/// <summary>
+/// Number of times the bus has been opened.
+/// </summary>
+uint32_t FakeI2c_Opens(void);
@@ -0,0 +1,79 @@
+#include <string.h>
+
+#include "fake_logstash.h"
+
+typedef struct {
+    FakeLogstashRequest request;
+    LogstashCompletionCallback callback;
+    void *context;
+} SentRequest;
+
+static SentRequest sent[FAKE_LOGSTASH_KEPT_REQUESTS];
+static uint32_t requestCount = 0;
+static uint32_t completedCount = 0;
+static bool networkReady = true;
+
+bool SendToLogstash(const char *url, LogstashFormat format, const uint8_t *postBody,
+                    size_t postBodyLength, LogstashCompletionCallback callback, void *context)
+{
+    if (!networkReady || requestCount - completedCount == FAKE_LOGSTASH_KEPT_REQUESTS ||
+        strlen(url) >= sizeof(sent[0].request.url) ||
+        postBodyLength > sizeof(sent[0].request.body)) {
+        return false;
+    }
+
+    SentRequest *entry = &sent[requestCount % FAKE_LOGSTASH_KEPT_REQUESTS];
+    strcpy(entry->request.url, url);
+    entry->request.format = format;
+    memcpy(entry->request.body, postBody, postBodyLength);
+    entry->request.bodyLength = postBodyLength;
+    entry->callback = callback;
+    entry->context = context;
+    requestCount++;
+    return true;
+}
+
+ExitCode Logstash_Init(EventLoop *eventLoopInstance, char *password)
+{
+    return ExitCode_Success;
+}
+
+void Logstash_Fini(void) {}
+
+void FakeLogstash_SetNetworkReady(bool ready)
+{
+    networkReady = ready;
+}
+
+void FakeLogstash_Reset(void)
+{
+    requestCount = completedCount = 0;
+}
+
+uint32_t FakeLogstash_Requests(void)
+{
+    return requestCount;
+}
+
+const FakeLogstashRequest *FakeLogstash_Request(uint32_t index)
+{
+    if (index >= requestCount || requestCount - index > FAKE_LOGSTASH_KEPT_REQUESTS) {
+        return NULL;
+    }
+    return &sent[index % FAKE_LOGSTASH_KEPT_REQUESTS].request;
+}
+
+uint32_t FakeLogstash_Outstanding(void)
+{
+    return requestCount - completedCount;
+}
+
+const FakeLogstashRequest *FakeLogstash_Complete(bool succeeded)
+{
+    if (completedCount == requestCount) {
+        return NULL;
+    }
+    SentRequest *entry = &sent[completedCount++ % FAKE_LOGSTASH_KEPT_REQUESTS];
+    entry->callback(succeeded, entry->context);
+    return &entry->request;
+}
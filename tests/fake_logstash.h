@@ -0,0 +1,48 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "logstash.h"
+
+// Stand-in for logstash.c that sends nothing: it keeps the requests it is given and leaves
+// them outstanding until the test completes them, so a test sees exactly what would have
+// been posted and decides how each request ends.
+
+typedef struct {
+    char url[128];
+    LogstashFormat format;
+    uint8_t body[8192];
+    size_t bodyLength;
+} FakeLogstashRequest;
+
+/// <summary>
+/// While the network is not ready SendToLogstash fails, as the real one does.
+/// </summary>
+void FakeLogstash_SetNetworkReady(bool ready);
+
+/// <summary>
+/// Forget every request, including outstanding ones, whose callbacks are never called.
+/// </summary>
+void FakeLogstash_Reset(void);
+
+/// <summary>
+/// Number of requests started since the last reset.
+/// </summary>
+uint32_t FakeLogstash_Requests(void);
+
+/// <summary>
+/// A request by the order it was started in. Only the most recent
+/// FAKE_LOGSTASH_KEPT_REQUESTS are kept.
+/// </summary>
+#define FAKE_LOGSTASH_KEPT_REQUESTS 64
+const FakeLogstashRequest *FakeLogstash_Request(uint32_t index);
+
+uint32_t FakeLogstash_Outstanding(void);
+
+/// <summary>
+/// Finish the oldest outstanding request and call its callback.
+/// </summary>
+/// <returns>The request that was finished.</returns>
+const FakeLogstashRequest *FakeLogstash_Complete(bool succeeded);
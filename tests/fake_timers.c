@@ -0,0 +1,150 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "fake_timers.h"
+
+struct EventLoopTimer {
+    EventLoopTimerHandler handler;
+    const char *name;
+    bool armed;
+    bool periodic;
+    uint32_t milliseconds;
+    bool pending;
+    EventLoopTimerStats stats;
+    EventLoopTimer *next;
+};
+
+static EventLoopTimer *timers = NULL;
+
+const uint32_t EventLoopTimerLatenessBucketMicroseconds[EVENT_LOOP_TIMER_LATENESS_BUCKETS - 1] = {
+    100, 500, 1000, 2000, 5000, 10000, 50000};
+
+static uint32_t ToMilliseconds(const struct timespec *time)
+{
+    return (uint32_t)(time->tv_sec * 1000 + time->tv_nsec / (1000 * 1000));
+}
+
+EventLoopTimer *CreateEventLoopDisarmedTimer(EventLoop *eventLoop, EventLoopTimerHandler handler)
+{
+    EventLoopTimer *timer = calloc(1, sizeof(*timer));
+    if (timer == NULL) {
+        return NULL;
+    }
+    timer->handler = handler;
+    timer->name = "";
+    timer->next = timers;
+    timers = timer;
+    return timer;
+}
+
+EventLoopTimer *CreateEventLoopPeriodicTimer(EventLoop *eventLoop, EventLoopTimerHandler handler,
+                                             const struct timespec *period)
+{
+    EventLoopTimer *timer = CreateEventLoopDisarmedTimer(eventLoop, handler);
+    if (timer != NULL) {
+        SetEventLoopTimerPeriod(timer, period);
+    }
+    return timer;
+}
+
+void DisposeEventLoopTimer(EventLoopTimer *timer)
+{
+    for (EventLoopTimer **link = &timers; *link != NULL; link = &(*link)->next) {
+        if (*link == timer) {
+            *link = timer->next;
+            free(timer);
+            return;
+        }
+    }
+}
+
+int ConsumeEventLoopTimerEvent(EventLoopTimer *timer)
+{
+    uint64_t expirations;
+    return ConsumeEventLoopTimerEventCount(timer, &expirations);
+}
+
+int ConsumeEventLoopTimerEventCount(EventLoopTimer *timer, uint64_t *expirations)
+{
+    *expirations = timer->pending ? 1 : 0;
+    timer->pending = false;
+    return 0;
+}
+
+void SetEventLoopTimerName(EventLoopTimer *timer, const char *name)
+{
+    timer->name = name;
+}
+
+void ForEachEventLoopTimer(EventLoop *eventLoop, EventLoopTimerVisitor visitor, void *context)
+{
+    for (EventLoopTimer *timer = timers; timer != NULL; timer = timer->next) {
+        visitor(timer, timer->name, &timer->stats, context);
+    }
+}
+
+void ResetEventLoopTimerStats(EventLoopTimer *timer)
+{
+    memset(&timer->stats, 0, sizeof(timer->stats));
+}
+
+int SetEventLoopTimerPeriod(EventLoopTimer *timer, const struct timespec *period)
+{
+    timer->armed = true;
+    timer->periodic = true;
+    timer->milliseconds = ToMilliseconds(period);
+    return 0;
+}
+
+int SetEventLoopTimerOneShot(EventLoopTimer *timer, const struct timespec *delay)
+{
+    timer->armed = true;
+    timer->periodic = false;
+    timer->milliseconds = ToMilliseconds(delay);
+    return 0;
+}
+
+int DisarmEventLoopTimer(EventLoopTimer *timer)
+{
+    timer->armed = false;
+    return 0;
+}
+
+EventLoopTimer *FakeTimers_Find(const char *name)
+{
+    for (EventLoopTimer *timer = timers; timer != NULL; timer = timer->next) {
+        if (strcmp(timer->name, name) == 0) {
+            return timer;
+        }
+    }
+    return NULL;
+}
+
+bool FakeTimers_IsArmed(const EventLoopTimer *timer)
+{
+    return timer->armed;
+}
+
+bool FakeTimers_IsPeriodic(const EventLoopTimer *timer)
+{
+    return timer->periodic;
+}
+
+uint32_t FakeTimers_Milliseconds(const EventLoopTimer *timer)
+{
+    return timer->milliseconds;
+}
+
+void FakeTimers_Fire(EventLoopTimer *timer)
+{
+    if (!timer->periodic) {
+        timer->armed = false;
+    }
+    timer->pending = true;
+    timer->handler(timer);
+}
+
+void FakeTimers_SetStats(EventLoopTimer *timer, const EventLoopTimerStats *stats)
+{
+    timer->stats = *stats;
+}
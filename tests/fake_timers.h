@@ -0,0 +1,36 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "eventloop_timer_utilities.h"
+
+// Stand-in for eventloop_timer_utilities.c in which nothing fires on its own: the test
+// finds a module's timers by the names it gave them, checks how they are armed and fires
+// them itself. Time only moves when the test says so, so timing logic can be checked
+// exactly and instantly.
+
+/// <summary>
+/// The live timer with the given name, or NULL.
+/// </summary>
+EventLoopTimer *FakeTimers_Find(const char *name);
+
+bool FakeTimers_IsArmed(const EventLoopTimer *timer);
+bool FakeTimers_IsPeriodic(const EventLoopTimer *timer);
+
+/// <summary>
+/// The one-shot delay or period the timer was last armed with, in milliseconds.
+/// </summary>
+uint32_t FakeTimers_Milliseconds(const EventLoopTimer *timer);
+
+/// <summary>
+/// Expire an armed timer and run its handler. A one-shot timer is disarmed first, as a
+/// real one would be.
+/// </summary>
+void FakeTimers_Fire(EventLoopTimer *timer);
+
+/// <summary>
+/// Set the dispatch statistics that ForEachEventLoopTimer reports for the timer until they
+/// are reset. Fired timers don't add to them.
+/// </summary>
+void FakeTimers_SetStats(EventLoopTimer *timer, const EventLoopTimerStats *stats);
@@ -0,0 +1,84 @@
+#define _GNU_SOURCE
+#include <fcntl.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <sys/ioctl.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "fake_uart.h"
+
+#define MAX_UARTS 8
+
+static struct {
+    UART_Id id;
+    int masterFd;
+    int readerFd; // the slave side, owned by the module once opened
+} uarts[MAX_UARTS];
+static size_t uartCount = 0;
+
+int UART_Open(UART_Id uartId, const UART_Config *config)
+{
+    size_t index = 0;
+    while (index < uartCount && uarts[index].id != uartId) {
+        index++;
+    }
+    if (index == MAX_UARTS) {
+        return -1;
+    }
+    if (index == uartCount) {
+        uartCount++;
+    }
+    else {
+        close(uarts[index].masterFd);
+    }
+
+    int masterFd = posix_openpt(O_RDWR | O_NOCTTY);
+    if (masterFd == -1 || grantpt(masterFd) != 0 || unlockpt(masterFd) != 0) {
+        return -1;
+    }
+    int readerFd = open(ptsname(masterFd), O_RDWR | O_NOCTTY | O_NONBLOCK);
+    struct termios attributes;
+    if (readerFd == -1 || tcgetattr(readerFd, &attributes) != 0) {
+        return -1;
+    }
+    cfmakeraw(&attributes);
+    tcsetattr(readerFd, TCSANOW, &attributes);
+
+    uarts[index].id = uartId;
+    uarts[index].masterFd = masterFd;
+    uarts[index].readerFd = readerFd;
+    return readerFd;
+}
+
+bool FakeUart_Write(UART_Id uartId, const void *data, size_t length)
+{
+    size_t index = 0;
+    while (index < uartCount && uarts[index].id != uartId) {
+        index++;
+    }
+    if (index == uartCount) {
+        return false;
+    }
+
+    int waiting = 0;
+    if (ioctl(uarts[index].readerFd, FIONREAD, &waiting) != 0 ||
+        write(uarts[index].masterFd, data, length) != (ssize_t)length) {
+        return false;
+    }
+
+    // The tty layer passes the bytes on asynchronously
+    int expected = waiting + (int)length;
+    for (int attempt = 0; attempt < 1000; attempt++) {
+        if (ioctl(uarts[index].readerFd, FIONREAD, &waiting) != 0) {
+            return false;
+        }
+        if (waiting >= expected) {
+            return true;
+        }
+        const struct timespec pause = {.tv_nsec = 1000 * 1000};
+        nanosleep(&pause, NULL);
+    }
+    return false;
+}
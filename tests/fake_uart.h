@@ -0,0 +1,18 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include <applibs/uart.h>
+
+// Stand-in for the UART driver on a pseudo-terminal: UART_Open hands the module the raw,
+// non-blocking slave side of a new pty, and the test plays the device by writing to the
+// master side. Bytes reach the reader through the tty layer, so reads see the chunking a
+// real serial driver would give them.
+
+/// <summary>
+/// Send bytes from the device on the given UART, returning once they are all waiting to
+/// be read, so that the next event loop wakeup sees the whole write.
+/// </summary>
+/// <returns>false if the UART isn't open or the bytes didn't arrive.</returns>
+bool FakeUart_Write(UART_Id uartId, const void *data, size_t length);
@@ -0,0 +1,237 @@
+#include <dirent.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "geiger_parser.h"
+
+// Fuzz target for the geiger line parser. Built with -DGEIGER_PARSER_LIBFUZZER and
+// -fsanitize=fuzzer this is a plain libFuzzer target:
+//
+//    geiger_parser_fuzz -max_len=512 corpus/geiger_parser
+//
+// Otherwise the main below replays the corpus and a fixed-seed set of mutations of it, so
+// ctest runs the same checks on every build.
+//
+// Every input is fed twice, once whole and once split into reads at points taken from the
+// input itself, and the two runs must produce the same messages and error counts. Every
+// terminated non-blank line must be accounted for exactly once, as a message, a framing
+// error or a checksum error.
+
+#define FUZZ_CHECK(condition)                                                                  \
+    do {                                                                                       \
+        if (!(condition)) {                                                                    \
+            fprintf(stderr, "%s:%d: fuzz check failed: %s\n", __FILE__, __LINE__, #condition); \
+            abort();                                                                           \
+        }                                                                                      \
+    } while (0)
+
+typedef struct Digest {
+    uint64_t hash;
+    uint32_t messages;
+} Digest;
+
+static void OnMessage(const GeigerMessage *message, void *context)
+{
+    Digest *digest = context;
+    FUZZ_CHECK(message->mode == GeigerMode_Slow || message->mode == GeigerMode_Fast ||
+               message->mode == GeigerMode_Instant);
+
+    // FNV-1a over the fields, so that the order of messages matters too
+    const uint32_t fields[] = {message->cps, message->cpm, message->nanosievertsPerHour,
+                               (uint32_t)message->mode};
+    for (size_t i = 0; i < sizeof(fields) / sizeof(fields[0]); i++) {
+        digest->hash = (digest->hash ^ fields[i]) * 1099511628211u;
+    }
+    digest->messages++;
+}
+
+static uint32_t CountLines(const uint8_t *data, size_t size)
+{
+    uint32_t lines = 0;
+    bool blank = true;
+    for (size_t i = 0; i < size; i++) {
+        if (data[i] == '\n') {
+            lines += blank ? 0 : 1;
+            blank = true;
+        }
+        else if (data[i] != '\r') {
+            blank = false;
+        }
+    }
+    return lines;
+}
+
+int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size)
+{
+    GeigerParser whole;
+    Digest wholeDigest = {.hash = 14695981039346656037u};
+    GeigerParser_Init(&whole);
+    GeigerParser_Feed(&whole, data, size, OnMessage, &wholeDigest);
+
+    GeigerParser split;
+    Digest splitDigest = {.hash = 14695981039346656037u};
+    GeigerParser_Init(&split);
+    size_t offset = 0;
+    for (size_t i = 0; offset < size; i++) {
+        size_t chunk = (size_t)(data[i % size] % 17);
+        if (chunk == 0) {
+            // Zero-length reads are legal and must be harmless
+            GeigerParser_Feed(&split, data + offset, 0, OnMessage, &splitDigest);
+            chunk = 1;
+        }
+        if (chunk > size - offset) {
+            chunk = size - offset;
+        }
+        GeigerParser_Feed(&split, data + offset, chunk, OnMessage, &splitDigest);
+        offset += chunk;
+    }
+
+    FUZZ_CHECK(wholeDigest.messages == whole.messages);
+    FUZZ_CHECK(splitDigest.messages == split.messages);
+    FUZZ_CHECK(wholeDigest.hash == splitDigest.hash);
+    FUZZ_CHECK(whole.messages == split.messages);
+    FUZZ_CHECK(whole.framingErrors == split.framingErrors);
+    FUZZ_CHECK(whole.checksumErrors == split.checksumErrors);
+    FUZZ_CHECK(whole.messages + whole.framingErrors + whole.checksumErrors ==
+               CountLines(data, size));
+    return 0;
+}
+
+#ifndef GEIGER_PARSER_LIBFUZZER
+
+#define MAX_INPUT_SIZE 1024
+#define MAX_CORPUS 64
+#define MUTATIONS_PER_INPUT 20000
+
+typedef struct Input {
+    uint8_t data[MAX_INPUT_SIZE];
+    size_t size;
+} Input;
+
+static Input corpus[MAX_CORPUS];
+static size_t corpusCount;
+
+static uint32_t Random(uint32_t *state)
+{
+    *state ^= *state << 13;
+    *state ^= *state >> 17;
+    *state ^= *state << 5;
+    return *state;
+}
+
+// Bytes that matter to the parser, so that mutations reach past the first check
+static const uint8_t interesting[] = {'\n', '\r', ',', ' ', '*', '.', '0', '9', 'A', 'f', 'S'};
+
+static void Mutate(Input *input, uint32_t *state)
+{
+    int edits = 1 + (int)(Random(state) % 4);
+    for (int edit = 0; edit < edits; edit++) {
+        size_t position = input->size == 0 ? 0 : Random(state) % input->size;
+        switch (Random(state) % 5) {
+        case 0: // Flip a bit
+            if (input->size > 0) {
+                input->data[position] ^= (uint8_t)(1 << (Random(state) % 8));
+            }
+            break;
+        case 1: // Overwrite with a structural byte
+            if (input->size > 0) {
+                input->data[position] = interesting[Random(state) % sizeof(interesting)];
+            }
+            break;
+        case 2: // Insert a byte
+            if (input->size < MAX_INPUT_SIZE) {
+                memmove(input->data + position + 1, input->data + position, input->size - position);
+                input->data[position] = (uint8_t)Random(state);
+                input->size++;
+            }
+            break;
+        case 3: // Delete a byte
+            if (input->size > 0) {
+                memmove(input->data + position, input->data + position + 1, input->size - position - 1);
+                input->size--;
+            }
+            break;
+        case 4: { // Splice in part of another corpus entry
+            const Input *other = &corpus[Random(state) % corpusCount];
+            if (other->size == 0) {
+                break;
+            }
+            size_t start = Random(state) % other->size;
+            size_t length = 1 + Random(state) % (other->size - start);
+            if (length > MAX_INPUT_SIZE - position) {
+                length = MAX_INPUT_SIZE - position;
+            }
+            memcpy(input->data + position, other->data + start, length);
+            if (position + length > input->size) {
+                input->size = position + length;
+            }
+            break;
+        }
+        }
+    }
+}
+
+static int LoadCorpus(const char *directory)
+{
+    DIR *dir = opendir(directory);
+    if (dir == NULL) {
+        perror(directory);
+        return -1;
+    }
+
+    struct dirent *entry;
+    while ((entry = readdir(dir)) != NULL && corpusCount < MAX_CORPUS) {
+        if (entry->d_name[0] == '.') {
+            continue;
+        }
+        char path[1024];
+        snprintf(path, sizeof(path), "%s/%s", directory, entry->d_name);
+        FILE *file = fopen(path, "rb");
+        if (file == NULL) {
+            perror(path);
+            closedir(dir);
+            return -1;
+        }
+        Input *input = &corpus[corpusCount++];
+        input->size = fread(input->data, 1, MAX_INPUT_SIZE, file);
+        fclose(file);
+    }
+    closedir(dir);
+    return 0;
+}
+
+int main(int argc, char *argv[])
+{
+    if (argc != 2) {
+        fprintf(stderr, "usage: %s CORPUS_DIRECTORY\n", argv[0]);
+        return 1;
+    }
+    if (LoadCorpus(argv[1]) != 0) {
+        return 1;
+    }
+    if (corpusCount == 0) {
+        fprintf(stderr, "%s: empty corpus\n", argv[1]);
+        return 1;
+    }
+
+    for (size_t i = 0; i < corpusCount; i++) {
+        LLVMFuzzerTestOneInput(corpus[i].data, corpus[i].size);
+    }
+
+    uint32_t state = 0x9e3779b9;
+    Input input;
+    for (size_t i = 0; i < corpusCount; i++) {
+        for (int mutation = 0; mutation < MUTATIONS_PER_INPUT; mutation++) {
+            input = corpus[i];
+            Mutate(&input, &state);
+            LLVMFuzzerTestOneInput(input.data, input.size);
+        }
+    }
+
+    printf("%zu corpus inputs, %zu mutations\n", corpusCount,
+           corpusCount * (size_t)MUTATIONS_PER_INPUT);
+    return 0;
+}
+
+#endif
@@ -0,0 +1,192 @@
+#include <stdio.h>
+#include <string.h>
+
+#include "fake_uart.h"
+#include "geiger.h"
+#include "test.h"
+#include "upload.h"
+
+// geiger.c reading a simulated counter on a pseudo-terminal through a host event loop.
+// Checks that lines split across wakeups and bursts longer than the receive buffer are
+// parsed, and that the UART statistics count the wakeups, bytes and lines it took. Built
+// again with GEIGER_COUNT=2 to check that two counters read at once keep separate state.
+
+#define GEIGER_UART SEEED_MT3620_MDB_J1_ISU0_UART
+
+static datablock_t dataBlock;
+static EventLoop *eventLoop;
+static uint32_t alerts;
+
+void Upload_SendAlert(const char *sensor, const ReadingField *fields, size_t fieldCount)
+{
+    alerts++;
+}
+
+int64_t Upload_GetUtcMilliseconds(void)
+{
+    return 0;
+}
+
+static const char line[] = "CPS, 1, CPM, 19, uSv/hr, 0.10, SLOW\r\n";
+#define LINE_LENGTH (sizeof(line) - 1)
+
+/// <summary>
+/// Dispatch everything that is ready, as the app's event loop would.
+/// </summary>
+static void RunLoop(void)
+{
+    EventLoop_Run(eventLoop, 0, false);
+}
+
+static GeigerUartStats UartStats(void)
+{
+    GeigerUartStats stats;
+    Geiger_GetUartStats(0, &stats);
+    return stats;
+}
+
+#if GEIGER_COUNT > 1
+static GeigerUartStats SecondUartStats(void)
+{
+    GeigerUartStats stats;
+    Geiger_GetUartStats(1, &stats);
+    return stats;
+}
+#endif
+
+static void TestChunkedLine(void)
+{
+    // The tail of a line arrives in a later wakeup and completes it
+    CHECK(FakeUart_Write(GEIGER_UART, line, 17));
+    RunLoop();
+    GeigerUartStats stats = UartStats();
+    CHECK(stats.wakeups == 1);
+    CHECK(stats.bytes == 17);
+    CHECK(stats.lines == 0);
+    CHECK(DataBlock_ActiveGeigerWindow(&dataBlock, 0)->cpmMessagesReceived == 0);
+
+    CHECK(FakeUart_Write(GEIGER_UART, line + 17, LINE_LENGTH - 17));
+    RunLoop();
+    stats = UartStats();
+    CHECK(stats.wakeups == 2);
+    CHECK(stats.bytes == LINE_LENGTH);
+    CHECK(stats.lines == 1);
+    CHECK(stats.maxLinesPerWakeup == 1);
+    GeigerWindow *window = DataBlock_ActiveGeigerWindow(&dataBlock, 0);
+    CHECK(window->cpmMessagesReceived == 1);
+    CHECK(window->cpm == 19);
+    CHECK(window->nanosievertsPerHour == 100);
+}
+
+static void TestBurst(void)
+{
+    // Fifty lines at once, more than the 1024 byte receive buffer: one wakeup drains them
+    char burst[50 * LINE_LENGTH];
+    for (size_t i = 0; i < 50; i++) {
+        memcpy(burst + i * LINE_LENGTH, line, LINE_LENGTH);
+    }
+    CHECK(sizeof(burst) > 1024);
+    CHECK(FakeUart_Write(GEIGER_UART, burst, sizeof(burst)));
+    RunLoop();
+    GeigerUartStats stats = UartStats();
+    CHECK(stats.wakeups == 3);
+    CHECK(stats.lines == 51);
+    CHECK(stats.bytes == 51 * LINE_LENGTH);
+    CHECK(stats.maxBytesPerWakeup == sizeof(burst));
+    CHECK(stats.maxLinesPerWakeup == 50);
+    CHECK(DataBlock_ActiveGeigerWindow(&dataBlock, 0)->cpmMessagesReceived == 51);
+    CHECK(dataBlock.countRate[0].sums[CountRateWindow_Minute].counts == 51);
+
+    // Bad lines count as lines too, though they carry no counts
+    static const char badLine[] = "CPS, 1, CPM, 19, uSv/hr, 0.10, SLOW*00\r\n";
+    CHECK(FakeUart_Write(GEIGER_UART, badLine, sizeof(badLine) - 1));
+    RunLoop();
+    stats = UartStats();
+    CHECK(stats.wakeups == 4);
+    CHECK(stats.lines == 52);
+    CHECK(DataBlock_ActiveGeigerWindow(&dataBlock, 0)->cpmMessagesReceived == 51);
+
+    // The sixtieth line reports the statistics and starts them again
+    for (int i = 0; i < 8; i++) {
+        CHECK(FakeUart_Write(GEIGER_UART, line, LINE_LENGTH));
+        RunLoop();
+    }
+    stats = UartStats();
+    CHECK(stats.wakeups == 0);
+    CHECK(stats.lines == 0);
+    CHECK(stats.bytes == 0);
+    CHECK(alerts == 0);
+}
+
+#if GEIGER_COUNT > 1
+static void TestTwoCounters(void)
+{
+    CHECK(strcmp(Geiger_SensorId(0), "geiger") == 0);
+    CHECK(strcmp(Geiger_SensorId(1), "geiger_2") == 0);
+    uint32_t firstMessages = DataBlock_ActiveGeigerWindow(&dataBlock, 0)->cpmMessagesReceived;
+    uint64_t firstCounts = dataBlock.countRate[0].sums[CountRateWindow_Hour].counts;
+    GeigerUartStats firstStats = UartStats();
+
+    // Half lines from both counters, then the other halves: each parser only ever sees its
+    // own counter's bytes
+    static const char secondLine[] = "CPS, 7, CPM, 420, uSv/hr, 2.39, FAST\r\n";
+    CHECK(FakeUart_Write(GEIGER_UART, line, 10));
+    CHECK(FakeUart_Write(GEIGER_2_UART, secondLine, 20));
+    RunLoop();
+    CHECK(FakeUart_Write(GEIGER_2_UART, secondLine + 20, sizeof(secondLine) - 1 - 20));
+    CHECK(FakeUart_Write(GEIGER_UART, line + 10, LINE_LENGTH - 10));
+    RunLoop();
+
+    GeigerWindow *first = DataBlock_ActiveGeigerWindow(&dataBlock, 0);
+    GeigerWindow *second = DataBlock_ActiveGeigerWindow(&dataBlock, 1);
+    CHECK(first->cpmMessagesReceived == firstMessages + 1);
+    CHECK(first->cpm == 19);
+    CHECK(second->cpmMessagesReceived == 1);
+    CHECK(second->cpm == 420);
+    CHECK(second->nanosievertsPerHour == 2390);
+    CHECK(dataBlock.countRate[0].sums[CountRateWindow_Hour].counts == firstCounts + 1);
+    CHECK(dataBlock.countRate[1].sums[CountRateWindow_Hour].counts == 7);
+
+    GeigerUartStats stats = UartStats();
+    CHECK(stats.wakeups == firstStats.wakeups + 2);
+    CHECK(stats.bytes == firstStats.bytes + LINE_LENGTH);
+    CHECK(stats.lines == firstStats.lines + 1);
+    stats = SecondUartStats();
+    CHECK(stats.wakeups == 2);
+    CHECK(stats.bytes == sizeof(secondLine) - 1);
+    CHECK(stats.lines == 1);
+
+    // A burst on one counter leaves the other's statistics alone
+    char burst[20 * (sizeof(secondLine) - 1)];
+    for (size_t i = 0; i < 20; i++) {
+        memcpy(burst + i * (sizeof(secondLine) - 1), secondLine, sizeof(secondLine) - 1);
+    }
+    CHECK(FakeUart_Write(GEIGER_2_UART, burst, sizeof(burst)));
+    RunLoop();
+    stats = SecondUartStats();
+    CHECK(stats.wakeups == 3);
+    CHECK(stats.lines == 21);
+    CHECK(stats.maxLinesPerWakeup == 20);
+    CHECK(UartStats().wakeups == firstStats.wakeups + 2);
+    CHECK(UartStats().maxLinesPerWakeup == 1);
+    CHECK(dataBlock.countRate[1].sums[CountRateWindow_Hour].counts == 7 * 21);
+    CHECK(dataBlock.countRate[0].sums[CountRateWindow_Hour].counts == firstCounts + 1);
+}
+#endif
+
+int main(void)
+{
+    eventLoop = EventLoop_Create();
+    CHECK(eventLoop != NULL);
+    CHECK(Geiger_Init(eventLoop, &dataBlock) == ExitCode_Success);
+
+    TestChunkedLine();
+    TestBurst();
+#if GEIGER_COUNT > 1
+    TestTwoCounters();
+#endif
+
+    Geiger_Fini();
+    EventLoop_Close(eventLoop);
+    return TEST_RESULT();
+}
@@ -0,0 +1,128 @@
+#include <stdio.h>
+#include <time.h>
+
+#include <zlib.h>
+
+#include "gzip.h"
+#include "reading.h"
+
+// Compression ratio and cost of Gzip_Compress on the batches the app uploads, against
+// zlib's fastest and default levels for reference. logstash.c only compresses bodies over
+// 256 bytes, so a single reading is sent as it is.
+
+static uint8_t batch[4096];
+static uint8_t compressed[8192];
+
+static double NowSeconds(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (double)now.tv_sec + now.tv_nsec / 1e9;
+}
+
+static size_t AppendGeiger(LogstashFormat format, uint32_t i, uint8_t *buffer, size_t capacity)
+{
+    const ReadingField fields[] = {
+        {.name = "cpm", .value = 18 + (i * 5) % 9},
+        {.name = "counts", .value = 18 + (i * 5) % 9},
+        {.name = "cpm_10min", .value = 21.4 + (i % 4) * 0.1, .decimals = 1},
+        {.name = "cpm_60min", .value = 21.7, .decimals = 1},
+        {.name = "usv_h", .value = 0.118 + (i % 3) * 0.006, .decimals = 3},
+        {.name = "coverage", .value = 1},
+        {.name = "window_start_utc", .type = ReadingFieldType_Timestamp,
+         .integer = 1791374400000 + i * 60000},
+        {.name = "window_end_utc", .type = ReadingFieldType_Timestamp,
+         .integer = 1791374460000 + i * 60000}};
+    return Reading_Encode(format, "geiger", fields, sizeof(fields) / sizeof(fields[0]), buffer,
+                          capacity);
+}
+
+static size_t AppendPressure(LogstashFormat format, uint32_t i, uint8_t *buffer, size_t capacity)
+{
+    const ReadingField fields[] = {
+        {.name = "pressure", .value = 101325 + (i * 7) % 13},
+        {.name = "sea_level_pressure", .value = 102468 + (i * 7) % 13},
+        {.name = "pressure_min", .value = 101301 + i % 5},
+        {.name = "pressure_max", .value = 101342 - i % 3},
+        {.name = "pressure_stddev", .value = 8.21 + i * 0.37, .decimals = 2},
+        {.name = "samples", .value = 600},
+        {.name = "window_start", .value = 86460.002 + i * 60, .decimals = 3},
+        {.name = "window_end", .value = 86520.001 + i * 60, .decimals = 3},
+        {.name = "window_start_utc", .type = ReadingFieldType_Timestamp,
+         .integer = 1791374400000 + i * 60000},
+        {.name = "window_end_utc", .type = ReadingFieldType_Timestamp,
+         .integer = 1791374460000 + i * 60000}};
+    return Reading_Encode(format, "pressure", fields, sizeof(fields) / sizeof(fields[0]), buffer,
+                          capacity);
+}
+
+/// <summary>
+/// A batch as upload_queue.c builds it, alternating geiger and pressure readings.
+/// </summary>
+static size_t MakeBatch(LogstashFormat format, uint32_t records)
+{
+    size_t length = 0;
+    for (uint32_t i = 0; i < records; i++) {
+        size_t capacity = sizeof(batch) - length - 1;
+        size_t recordLength = i % 2 == 0 ? AppendGeiger(format, i / 2, batch + length, capacity)
+                                         : AppendPressure(format, i / 2, batch + length, capacity);
+        if (recordLength == 0) {
+            break;
+        }
+        length += recordLength;
+        if (format == LogstashFormat_Json) {
+            batch[length++] = '\n';
+        }
+    }
+    return length;
+}
+
+static size_t ZlibCompress(int level, size_t length)
+{
+    z_stream stream = {.next_in = batch,
+                       .avail_in = (uInt)length,
+                       .next_out = compressed,
+                       .avail_out = sizeof(compressed)};
+    deflateInit2(&stream, level, Z_DEFLATED, 16 + MAX_WBITS, 8, Z_DEFAULT_STRATEGY);
+    deflate(&stream, Z_FINISH);
+    size_t compressedLength = stream.total_out;
+    deflateEnd(&stream);
+    return compressedLength;
+}
+
+static void Measure(const char *compressor, int level, size_t length)
+{
+    const int iterations = 20000;
+    size_t compressedLength = 0;
+
+    double start = NowSeconds();
+    for (int i = 0; i < iterations; i++) {
+        compressedLength = level < 0 ? Gzip_Compress(batch, length, compressed, sizeof(compressed))
+                                     : ZlibCompress(level, length);
+    }
+    double elapsed = NowSeconds() - start;
+
+    printf("    %-8s %4zu bytes, ratio %.2f, %6.2f us per KB\n", compressor, compressedLength,
+           (double)length / (double)compressedLength,
+           elapsed / iterations * 1e6 / ((double)length / 1024));
+}
+
+int main(void)
+{
+    static const struct {
+        const char *name;
+        LogstashFormat format;
+    } formats[] = {{"json", LogstashFormat_Json}, {"cbor", LogstashFormat_Cbor}};
+    static const uint32_t batchSizes[] = {2, 4, 16};
+
+    for (size_t f = 0; f < sizeof(formats) / sizeof(formats[0]); f++) {
+        for (size_t b = 0; b < sizeof(batchSizes) / sizeof(batchSizes[0]); b++) {
+            size_t length = MakeBatch(formats[f].format, batchSizes[b]);
+            printf("%s, %u readings, %zu bytes\n", formats[f].name, batchSizes[b], length);
+            Measure("gzip.c", -1, length);
+            Measure("zlib -1", 1, length);
+            Measure("zlib -6", 6, length);
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,131 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include <zlib.h>
+
+#include "gzip.h"
+#include "reading.h"
+#include "test.h"
+
+// Gzip_Compress output inflated again with zlib, which checks the stream structure, the
+// CRC and the length as it goes. Covers the batches the app sends and the edge cases of
+// the matcher: empty input, incompressible input, maximum length matches and matches at
+// the edge of the 32 KB window.
+
+static uint8_t compressed[160 * 1024];
+static uint8_t inflated[160 * 1024];
+
+/// <summary>
+/// Inflate a gzip stream with zlib.
+/// </summary>
+/// <returns>The inflated length, or SIZE_MAX if zlib rejected the stream.</returns>
+static size_t Inflate(const uint8_t *input, size_t inputLength)
+{
+    z_stream stream = {.next_in = (Bytef *)input,
+                       .avail_in = (uInt)inputLength,
+                       .next_out = inflated,
+                       .avail_out = sizeof(inflated)};
+    if (inflateInit2(&stream, 16 + MAX_WBITS) != Z_OK) {
+        return SIZE_MAX;
+    }
+    int result = inflate(&stream, Z_FINISH);
+    size_t length = stream.total_out;
+    bool consumedAll = stream.avail_in == 0;
+    inflateEnd(&stream);
+    return result == Z_STREAM_END && consumedAll ? length : SIZE_MAX;
+}
+
+static void CheckRoundTrip(const char *name, const uint8_t *input, size_t inputLength)
+{
+    size_t compressedLength = Gzip_Compress(input, inputLength, compressed, sizeof(compressed));
+    CHECK(compressedLength != 0);
+    size_t inflatedLength = Inflate(compressed, compressedLength);
+    if (inflatedLength != inputLength || memcmp(inflated, input, inputLength) != 0) {
+        fprintf(stderr, "%s: %zu bytes did not survive the round trip\n", name, inputLength);
+        CHECK(false);
+    }
+}
+
+/// <summary>
+/// A batch of readings as upload_queue.c builds it: one record per line for JSON, records
+/// back to back for CBOR.
+/// </summary>
+static size_t MakeBatch(LogstashFormat format, uint32_t records, uint8_t *batch, size_t capacity)
+{
+    size_t length = 0;
+    for (uint32_t i = 0; i < records; i++) {
+        const ReadingField fields[] = {
+            {.name = "pressure", .value = 101325 + (i * 7) % 13},
+            {.name = "pressure_min", .value = 101301 + i % 5},
+            {.name = "pressure_max", .value = 101342 - i % 3},
+            {.name = "pressure_stddev", .value = 8.21 + i * 0.37, .decimals = 2},
+            {.name = "samples", .value = 600},
+            {.name = "window_start", .value = 86460.002 + i * 60, .decimals = 3},
+            {.name = "window_end", .value = 86520.001 + i * 60, .decimals = 3},
+            {.name = "window_start_utc", .type = ReadingFieldType_Timestamp,
+             .integer = 1791374400000 + i * 60000},
+            {.name = "window_end_utc", .type = ReadingFieldType_Timestamp,
+             .integer = 1791374460000 + i * 60000}};
+        size_t recordLength = Reading_Encode(format, "pressure", fields,
+                                             sizeof(fields) / sizeof(fields[0]), batch + length,
+                                             capacity - length - 1);
+        CHECK(recordLength != 0);
+        length += recordLength;
+        if (format == LogstashFormat_Json) {
+            batch[length++] = '\n';
+        }
+    }
+    return length;
+}
+
+int main(void)
+{
+    static uint8_t input[128 * 1024];
+
+    CheckRoundTrip("empty", input, 0);
+    CheckRoundTrip("one byte", (const uint8_t *)"x", 1);
+    CheckRoundTrip("shorter than a match", (const uint8_t *)"xyxy", 4);
+
+    // What the app sends: batches of up to 4 KB, which have to shrink to be worth sending
+    size_t length = MakeBatch(LogstashFormat_Json, 16, input, sizeof(input));
+    CheckRoundTrip("json batch", input, length);
+    CHECK(Gzip_Compress(input, length, compressed, sizeof(compressed)) < length / 2);
+    length = MakeBatch(LogstashFormat_Cbor, 16, input, sizeof(input));
+    CheckRoundTrip("cbor batch", input, length);
+    CHECK(Gzip_Compress(input, length, compressed, sizeof(compressed)) < length);
+
+    // Incompressible input grows a little, but still decodes
+    srand(1);
+    for (size_t i = 0; i < 4096; i++) {
+        input[i] = (uint8_t)rand();
+    }
+    CheckRoundTrip("random", input, 4096);
+
+    // Runs longer than the longest match, and every byte value
+    memset(input, 'a', 4096);
+    CheckRoundTrip("one byte repeated", input, 4096);
+    CHECK(Gzip_Compress(input, 4096, compressed, sizeof(compressed)) < 64);
+    for (size_t i = 0; i < 4096; i++) {
+        input[i] = (uint8_t)i;
+    }
+    CheckRoundTrip("all byte values", input, 4096);
+
+    // A block that repeats just inside and just outside the 32 KB window
+    for (size_t i = 0; i < 1000; i++) {
+        input[i] = (uint8_t)rand();
+    }
+    memset(input + 1000, 'b', 32768 - 1000);
+    memcpy(input + 32768, input, 1000);
+    memset(input + 33768, 'c', 32769 - 1000);
+    memcpy(input + 33768 + 32769 - 1000, input + 32768, 1000);
+    CheckRoundTrip("window edge", input, 33768 + 32769);
+
+    // Output that doesn't fit is refused rather than truncated
+    length = MakeBatch(LogstashFormat_Json, 16, input, sizeof(input));
+    size_t needed = Gzip_Compress(input, length, compressed, sizeof(compressed));
+    CHECK(Gzip_Compress(input, length, compressed, needed - 1) == 0);
+    CHECK(Gzip_Compress(input, length, compressed, needed) == needed);
+    CHECK(Gzip_Compress(input, length, compressed, 4) == 0);
+
+    return TEST_RESULT();
+}
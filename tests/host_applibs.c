@@ -0,0 +1,29 @@
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <applibs/log.h>
+
+// Log output is only shown with TEST_VERBOSE set, so test output stays readable
+static int Verbose(void)
+{
+    static int verbose = -1;
+    if (verbose == -1) {
+        verbose = getenv("TEST_VERBOSE") != NULL;
+    }
+    return verbose;
+}
+
+int Log_DebugVarArgs(const char *format, va_list args)
+{
+    return Verbose() ? vfprintf(stderr, format, args) : 0;
+}
+
+int Log_Debug(const char *format, ...)
+{
+    va_list args;
+    va_start(args, format);
+    int result = Log_DebugVarArgs(format, args);
+    va_end(args);
+    return result;
+}
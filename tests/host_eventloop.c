@@ -0,0 +1,122 @@
+#include <errno.h>
+#include <stdlib.h>
+#include <sys/epoll.h>
+#include <unistd.h>
+
+#include <applibs/eventloop.h>
+
+// The applibs event loop on epoll, with the same contract: callbacks run on the thread
+// that calls EventLoop_Run, one registration per descriptor.
+
+struct EventLoop {
+    int epollFd;
+    bool stopped;
+};
+
+struct EventRegistration {
+    int fd;
+    EventLoopIoCallback *callback;
+    void *context;
+};
+
+static uint32_t ToEpollEvents(EventLoop_IoEvents events)
+{
+    return ((events & EventLoop_Input) ? EPOLLIN : 0) | ((events & EventLoop_Output) ? EPOLLOUT : 0) |
+           ((events & EventLoop_Error) ? EPOLLERR : 0);
+}
+
+static EventLoop_IoEvents FromEpollEvents(uint32_t events)
+{
+    return ((events & EPOLLIN) ? EventLoop_Input : 0) | ((events & EPOLLOUT) ? EventLoop_Output : 0) |
+           ((events & (EPOLLERR | EPOLLHUP)) ? EventLoop_Error : 0);
+}
+
+EventLoop *EventLoop_Create(void)
+{
+    EventLoop *el = calloc(1, sizeof(*el));
+    if (el == NULL) {
+        return NULL;
+    }
+    el->epollFd = epoll_create1(EPOLL_CLOEXEC);
+    if (el->epollFd == -1) {
+        free(el);
+        return NULL;
+    }
+    return el;
+}
+
+void EventLoop_Close(EventLoop *el)
+{
+    if (el != NULL) {
+        close(el->epollFd);
+        free(el);
+    }
+}
+
+EventLoop_Run_Result EventLoop_Run(EventLoop *el, int durationInMilliseconds, bool processOneEvent)
+{
+    el->stopped = false;
+    bool dispatched = false;
+    do {
+        struct epoll_event events[16];
+        int count = epoll_wait(el->epollFd, events, processOneEvent ? 1 : 16, durationInMilliseconds);
+        if (count == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return EventLoop_Run_Failed;
+        }
+        if (count == 0) {
+            break;
+        }
+        for (int i = 0; i < count; i++) {
+            EventRegistration *reg = events[i].data.ptr;
+            reg->callback(el, reg->fd, FromEpollEvents(events[i].events), reg->context);
+        }
+        dispatched = true;
+    } while (!processOneEvent && !el->stopped);
+    return dispatched ? EventLoop_Run_Finished : EventLoop_Run_FinishedEmpty;
+}
+
+EventRegistration *EventLoop_RegisterIo(EventLoop *el, int fd, EventLoop_IoEvents eventBitmask,
+                                        EventLoopIoCallback *callback, void *context)
+{
+    EventRegistration *reg = malloc(sizeof(*reg));
+    if (reg == NULL) {
+        return NULL;
+    }
+    *reg = (EventRegistration){.fd = fd, .callback = callback, .context = context};
+    struct epoll_event event = {.events = ToEpollEvents(eventBitmask), .data.ptr = reg};
+    if (epoll_ctl(el->epollFd, EPOLL_CTL_ADD, fd, &event) == -1) {
+        free(reg);
+        return NULL;
+    }
+    return reg;
+}
+
+int EventLoop_ModifyIoEvents(EventLoop *el, EventRegistration *reg, EventLoop_IoEvents eventBitmask)
+{
+    struct epoll_event event = {.events = ToEpollEvents(eventBitmask), .data.ptr = reg};
+    return epoll_ctl(el->epollFd, EPOLL_CTL_MOD, reg->fd, &event);
+}
+
+int EventLoop_UnregisterIo(EventLoop *el, EventRegistration *reg)
+{
+    if (reg == NULL) {
+        return 0;
+    }
+    int result = epoll_ctl(el->epollFd, EPOLL_CTL_DEL, reg->fd, NULL);
+    free(reg);
+    return result;
+}
+
+int EventLoop_Stop(EventLoop *el)
+{
+    el->stopped = true;
+    return 0;
+}
+
+int EventLoop_GetWaitDescriptor(EventLoop *el)
+{
+    return el->epollFd;
+}
@@ -0,0 +1,293 @@
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <curl/curl.h>
+#include <openssl/ssl.h>
+#include <openssl/x509.h>
+
+#include <applibs/networking.h>
+
+#include "logstash.h"
+
+// Uploads through logstash.c against a local HTTPS stand-in for Logstash, compared with a
+// fresh curl easy handle per upload, which is what the app did before handles and the
+// DNS/TLS caches were shared:
+//
+//    logstash_bench [UPLOADS] [keepalive|close]
+//
+// With "close" the server drops the connection after every response, as Logstash does
+// once a connection has been idle too long, so every upload reconnects and the saving
+// comes from TLS session resumption alone.
+//
+// Over loopback the times are mostly CPU. The connection and handshake counts are what
+// carry over to the device's link, where each connection costs a round trip and each full
+// handshake another one or two.
+
+static SSL_CTX *serverContext;
+static int listenFd;
+static bool closeAfterResponse;
+
+static atomic_uint connections;
+static atomic_uint fullHandshakes;
+static atomic_uint resumedHandshakes;
+static atomic_uint requests;
+
+int Networking_IsNetworkingReady(bool *outIsNetworkingReady)
+{
+    *outIsNetworkingReady = true;
+    return 0;
+}
+
+static double MonotonicMilliseconds(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec * 1e3 + now.tv_nsec / 1e6;
+}
+
+// A throwaway self-signed certificate; the app doesn't verify the server
+static bool CreateServerContext(void)
+{
+    EVP_PKEY *key = EVP_EC_gen("P-256");
+    X509 *certificate = X509_new();
+    if (key == NULL || certificate == NULL) {
+        return false;
+    }
+    ASN1_INTEGER_set(X509_get_serialNumber(certificate), 1);
+    X509_gmtime_adj(X509_getm_notBefore(certificate), 0);
+    X509_gmtime_adj(X509_getm_notAfter(certificate), 24 * 60 * 60);
+    X509_set_pubkey(certificate, key);
+    X509_NAME *name = X509_get_subject_name(certificate);
+    X509_NAME_add_entry_by_txt(name, "CN", MBSTRING_ASC, (const unsigned char *)"localhost", -1, -1, 0);
+    X509_set_issuer_name(certificate, name);
+    if (X509_sign(certificate, key, EVP_sha256()) == 0) {
+        return false;
+    }
+
+    serverContext = SSL_CTX_new(TLS_server_method());
+    if (serverContext == NULL || SSL_CTX_use_certificate(serverContext, certificate) != 1 ||
+        SSL_CTX_use_PrivateKey(serverContext, key) != 1) {
+        return false;
+    }
+    X509_free(certificate);
+    EVP_PKEY_free(key);
+    return true;
+}
+
+// Reads one request, headers and body; false once the client has gone
+static bool ReadRequest(SSL *ssl)
+{
+    char buffer[8192];
+    size_t length = 0;
+    char *headersEnd = NULL;
+    while (headersEnd == NULL) {
+        int received = SSL_read(ssl, buffer + length, (int)(sizeof(buffer) - 1 - length));
+        if (received <= 0) {
+            return false;
+        }
+        length += (size_t)received;
+        buffer[length] = 0;
+        headersEnd = strstr(buffer, "\r\n\r\n");
+        if (headersEnd == NULL && length == sizeof(buffer) - 1) {
+            return false;
+        }
+    }
+
+    const char *contentLength = strstr(buffer, "Content-Length:");
+    size_t bodyLength = contentLength == NULL ? 0 : strtoul(contentLength + 15, NULL, 10);
+    size_t bodyReceived = length - (size_t)(headersEnd + 4 - buffer);
+    while (bodyReceived < bodyLength) {
+        int received = SSL_read(ssl, buffer, sizeof(buffer));
+        if (received <= 0) {
+            return false;
+        }
+        bodyReceived += (size_t)received;
+    }
+    return true;
+}
+
+static void *ConnectionThreadMain(void *context)
+{
+    int fd = (int)(intptr_t)context;
+    SSL *ssl = SSL_new(serverContext);
+    SSL_set_fd(ssl, fd);
+    if (SSL_accept(ssl) == 1) {
+        atomic_fetch_add(SSL_session_reused(ssl) ? &resumedHandshakes : &fullHandshakes, 1);
+        while (ReadRequest(ssl)) {
+            atomic_fetch_add(&requests, 1);
+            const char *response = closeAfterResponse
+                                       ? "HTTP/1.1 200 OK\r\nContent-Length: 0\r\nConnection: close\r\n\r\n"
+                                       : "HTTP/1.1 200 OK\r\nContent-Length: 0\r\n\r\n";
+            SSL_write(ssl, response, (int)strlen(response));
+            if (closeAfterResponse) {
+                break;
+            }
+        }
+        SSL_shutdown(ssl);
+    }
+    SSL_free(ssl);
+    close(fd);
+    return NULL;
+}
+
+static void *ServerThreadMain(void *unused)
+{
+    for (;;) {
+        int fd = accept(listenFd, NULL, NULL);
+        if (fd == -1) {
+            return NULL;
+        }
+        atomic_fetch_add(&connections, 1);
+        // As real servers do; otherwise Nagle holds the first response behind the TLS
+        // session tickets until the client's delayed ACK
+        int noDelay = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &noDelay, sizeof(noDelay));
+        pthread_t thread;
+        pthread_create(&thread, NULL, ConnectionThreadMain, (void *)(intptr_t)fd);
+        pthread_detach(thread);
+    }
+}
+
+static int StartServer(void)
+{
+    listenFd = socket(AF_INET, SOCK_STREAM, 0);
+    struct sockaddr_in address = {.sin_family = AF_INET, .sin_addr.s_addr = htonl(INADDR_LOOPBACK)};
+    socklen_t addressLength = sizeof(address);
+    if (bind(listenFd, (struct sockaddr *)&address, sizeof(address)) != 0 || listen(listenFd, 16) != 0 ||
+        getsockname(listenFd, (struct sockaddr *)&address, &addressLength) != 0) {
+        perror("server socket");
+        return -1;
+    }
+    pthread_t thread;
+    pthread_create(&thread, NULL, ServerThreadMain, NULL);
+    pthread_detach(thread);
+    return ntohs(address.sin_port);
+}
+
+static void ResetCounters(void)
+{
+    atomic_store(&connections, 0);
+    atomic_store(&fullHandshakes, 0);
+    atomic_store(&resumedHandshakes, 0);
+    atomic_store(&requests, 0);
+}
+
+static void Report(const char *mode, int uploads, int failures, double totalMilliseconds,
+                   double maxMilliseconds)
+{
+    // The server counts a handshake once it completes, a moment after the client's upload
+    usleep(50 * 1000);
+    printf("%-14s %d uploads (%d failed): %u connections, %u full and %u resumed TLS handshakes, "
+           "%.2f ms avg, %.2f ms max\n",
+           mode, uploads, failures, atomic_load(&connections), atomic_load(&fullHandshakes),
+           atomic_load(&resumedHandshakes), totalMilliseconds / uploads, maxMilliseconds);
+}
+
+static const char body[] = "{ \"sensor\": \"pressure\", \"pressure\": 100653, \"samples\": 600 }\n";
+
+static bool uploadDone;
+static bool uploadSucceeded;
+
+static void UploadComplete(bool succeeded, void *context)
+{
+    uploadDone = true;
+    uploadSucceeded = succeeded;
+}
+
+// The app's path: pooled easy handles on the multi interface, driven by the event loop
+static void BenchPooled(EventLoop *eventLoop, const char *url, int uploads)
+{
+    ResetCounters();
+    int failures = 0;
+    double total = 0, max = 0;
+    for (int i = 0; i < uploads; i++) {
+        double start = MonotonicMilliseconds();
+        uploadDone = false;
+        if (!SendToLogstash(url, LogstashFormat_Json, (const uint8_t *)body, sizeof(body) - 1,
+                            UploadComplete, NULL)) {
+            failures++;
+            continue;
+        }
+        while (!uploadDone) {
+            EventLoop_Run(eventLoop, 100, true);
+        }
+        double elapsed = MonotonicMilliseconds() - start;
+        failures += uploadSucceeded ? 0 : 1;
+        total += elapsed;
+        max = elapsed > max ? elapsed : max;
+    }
+    Report("pooled", uploads, failures, total, max);
+}
+
+// What SendToLogstash did before: a new handle, header list and connection per upload
+static void BenchFreshHandles(const char *url, int uploads)
+{
+    ResetCounters();
+    int failures = 0;
+    double total = 0, max = 0;
+    for (int i = 0; i < uploads; i++) {
+        double start = MonotonicMilliseconds();
+        CURL *handle = curl_easy_init();
+        struct curl_slist *headers = curl_slist_append(NULL, "Content-Type: application/x-ndjson");
+        curl_easy_setopt(handle, CURLOPT_URL, url);
+        curl_easy_setopt(handle, CURLOPT_SSL_VERIFYPEER, 0L);
+        curl_easy_setopt(handle, CURLOPT_SSL_VERIFYHOST, 0L);
+        curl_easy_setopt(handle, CURLOPT_USERPWD, "science_user:bench");
+        curl_easy_setopt(handle, CURLOPT_HTTPHEADER, headers);
+        curl_easy_setopt(handle, CURLOPT_POSTFIELDSIZE, (long)(sizeof(body) - 1));
+        curl_easy_setopt(handle, CURLOPT_POSTFIELDS, body);
+        long responseCode = 0;
+        if (curl_easy_perform(handle) != CURLE_OK ||
+            curl_easy_getinfo(handle, CURLINFO_RESPONSE_CODE, &responseCode) != CURLE_OK ||
+            responseCode != 200) {
+            failures++;
+        }
+        curl_easy_cleanup(handle);
+        curl_slist_free_all(headers);
+        double elapsed = MonotonicMilliseconds() - start;
+        total += elapsed;
+        max = elapsed > max ? elapsed : max;
+    }
+    Report("fresh handles", uploads, failures, total, max);
+}
+
+int main(int argc, char *argv[])
+{
+    int uploads = argc > 1 ? atoi(argv[1]) : 50;
+    closeAfterResponse = argc > 2 && strcmp(argv[2], "close") == 0;
+
+    if (!CreateServerContext()) {
+        fprintf(stderr, "could not create the server certificate\n");
+        return 1;
+    }
+    int port = StartServer();
+    if (port == -1) {
+        return 1;
+    }
+    char url[64];
+    snprintf(url, sizeof(url), "https://localhost:%d/readings", port);
+
+    EventLoop *eventLoop = EventLoop_Create();
+    static char password[] = "bench";
+    if (eventLoop == NULL || Logstash_Init(eventLoop, password) != ExitCode_Success) {
+        fprintf(stderr, "could not start logstash.c\n");
+        return 1;
+    }
+
+    printf("server %s\n", closeAfterResponse ? "closes every connection" : "keeps connections alive");
+    BenchPooled(eventLoop, url, uploads);
+    BenchFreshHandles(url, uploads);
+
+    Logstash_Fini();
+    EventLoop_Close(eventLoop);
+    return 0;
+}
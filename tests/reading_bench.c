@@ -0,0 +1,53 @@
+#include <stdio.h>
+#include <time.h>
+
+#include "reading.h"
+
+// Serialization cost and size of a typical pressure reading in each wire format
+
+static const ReadingField fields[] = {
+    {.name = "pressure", .value = 101325},
+    {.name = "sea_level_pressure", .value = 102468},
+    {.name = "pressure_min", .value = 101301},
+    {.name = "pressure_max", .value = 101342},
+    {.name = "pressure_p10", .value = 101312.4, .decimals = 1},
+    {.name = "pressure_p90", .value = 101336.8, .decimals = 1},
+    {.name = "pressure_mean", .value = 101324.7, .decimals = 1},
+    {.name = "pressure_stddev", .value = 8.21, .decimals = 2},
+    {.name = "samples", .value = 600},
+    {.name = "window_start", .value = 86460.002, .decimals = 3},
+    {.name = "window_end", .value = 86520.001, .decimals = 3},
+    {.name = "window_start_utc", .type = ReadingFieldType_Timestamp, .integer = 1791374400000},
+    {.name = "window_end_utc", .type = ReadingFieldType_Timestamp, .integer = 1791374460000},
+    {.name = "sample_interval_ms", .value = 100},
+};
+#define FIELD_COUNT (sizeof(fields) / sizeof(fields[0]))
+
+static double NowSeconds(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (double)now.tv_sec + now.tv_nsec / 1e9;
+}
+
+static void Measure(const char *name, LogstashFormat format)
+{
+    static uint8_t buffer[1024];
+    const int iterations = 200000;
+    size_t length = 0;
+
+    double start = NowSeconds();
+    for (int i = 0; i < iterations; i++) {
+        length = Reading_Encode(format, "pressure", fields, FIELD_COUNT, buffer, sizeof(buffer));
+    }
+    double elapsed = NowSeconds() - start;
+
+    printf("%-5s %4zu bytes per reading, %6.2f us per encode\n", name, length, elapsed / iterations * 1e6);
+}
+
+int main(void)
+{
+    Measure("json", LogstashFormat_Json);
+    Measure("cbor", LogstashFormat_Cbor);
+    return 0;
+}
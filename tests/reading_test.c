@@ -0,0 +1,162 @@
+#include <math.h>
+#include <string.h>
+
+#include "cbor_decoder.h"
+#include "reading.h"
+#include "test.h"
+
+static const double histogram[] = {3, 0, 12.5, 1e6};
+
+static const ReadingField fields[] = {
+    {.name = "cpm", .value = 21},
+    {.name = "usv_per_hour", .value = 0.123, .decimals = 3},
+    // Two days of uptime: too many digits for a single precision float
+    {.name = "window_start", .value = 172800.123, .decimals = 3},
+    {.name = "negative", .value = -4.25, .decimals = 2},
+    {.name = "sequence", .type = ReadingFieldType_Integer, .integer = (1ll << 60) + 1},
+    {.name = "window_start_utc", .type = ReadingFieldType_Timestamp, .integer = 1791374400000},
+    {.name = "window_end_utc", .type = ReadingFieldType_Timestamp, .integer = 1791374460250},
+    {.name = "histogram", .type = ReadingFieldType_Array, .values = histogram, .valueCount = 4, .decimals = 1},
+};
+#define FIELD_COUNT (sizeof(fields) / sizeof(fields[0]))
+
+static void TestJson(void)
+{
+    char buffer[512];
+    size_t length = Reading_Encode(LogstashFormat_Json, "geiger", fields, FIELD_COUNT, (uint8_t *)buffer,
+                                   sizeof(buffer) - 1);
+    CHECK(length != 0);
+    buffer[length] = 0;
+
+    const char *expected =
+        "{ \"sensor\": \"geiger\", \"cpm\": 21, \"usv_per_hour\": 0.123, \"window_start\": 172800.123, "
+        "\"negative\": -4.25, \"sequence\": 1152921504606846977, "
+        "\"window_start_utc\": \"2026-10-07T12:00:00.000Z\", \"window_end_utc\": \"2026-10-07T12:01:00.250Z\", "
+        "\"histogram\": [3.0, 0.0, 12.5, 1000000.0] }";
+    CHECK(strcmp(buffer, expected) == 0);
+    if (strcmp(buffer, expected) != 0) {
+        fprintf(stderr, "got      %s\nexpected %s\n", buffer, expected);
+    }
+
+    // Anything that doesn't fit is reported rather than truncated
+    CHECK(Reading_Encode(LogstashFormat_Json, "geiger", fields, FIELD_COUNT, (uint8_t *)buffer, length) == 0);
+}
+
+static bool ExpectKey(CborReader *reader, const char *name)
+{
+    CborItem item;
+    return CborReader_Next(reader, &item) && CborReader_TextEquals(&item, name);
+}
+
+// A number survives the round trip if it prints the same as the JSON encoding would
+static bool SameAtDecimals(double decoded, double original, int decimals)
+{
+    double scale = pow(10, decimals);
+    return llround(decoded * scale) == llround(original * scale);
+}
+
+static void TestCborRoundTrip(void)
+{
+    uint8_t buffer[512];
+    size_t length = Reading_Encode(LogstashFormat_Cbor, "geiger", fields, FIELD_COUNT, buffer, sizeof(buffer));
+    CHECK(length != 0);
+
+    CborReader reader;
+    CborReader_Init(&reader, buffer, length);
+    CborItem item;
+    CHECK(CborReader_Next(&reader, &item) && item.type == CborItem_Map && item.argument == FIELD_COUNT + 1);
+    CHECK(ExpectKey(&reader, "sensor"));
+    CHECK(CborReader_Next(&reader, &item) && CborReader_TextEquals(&item, "geiger"));
+
+    for (size_t i = 0; i < FIELD_COUNT; i++) {
+        const ReadingField *field = &fields[i];
+        CHECK(ExpectKey(&reader, field->name));
+
+        switch (field->type) {
+        case ReadingFieldType_Integer:
+            CHECK(CborReader_Next(&reader, &item) && item.type == CborItem_Unsigned && item.integer == field->integer);
+            break;
+
+        case ReadingFieldType_Timestamp: {
+            CHECK(CborReader_Next(&reader, &item) && item.type == CborItem_Tag && item.argument == 1);
+            double seconds = 0;
+            CHECK(CborReader_Number(&reader, &seconds));
+            CHECK(llround(seconds * 1000) == field->integer);
+            break;
+        }
+
+        case ReadingFieldType_Array:
+            CHECK(CborReader_Next(&reader, &item) && item.type == CborItem_Array && item.argument == field->valueCount);
+            for (size_t j = 0; j < field->valueCount; j++) {
+                double value = 0;
+                CHECK(CborReader_Number(&reader, &value) && SameAtDecimals(value, field->values[j], field->decimals));
+            }
+            break;
+
+        default: {
+            double value = 0;
+            CHECK(CborReader_Number(&reader, &value) && SameAtDecimals(value, field->value, field->decimals));
+            break;
+        }
+        }
+    }
+    CHECK(!reader.error && reader.offset == length);
+
+    CHECK(Reading_Encode(LogstashFormat_Cbor, "geiger", fields, FIELD_COUNT, buffer, length - 1) == 0);
+}
+
+// Read the value of the one field in an encoded reading
+static bool ReadOnlyFieldValue(const uint8_t *buffer, size_t length, CborItem *item)
+{
+    CborReader reader;
+    CborReader_Init(&reader, buffer, length);
+    return CborReader_Next(&reader, item) && item->type == CborItem_Map && CborReader_Skip(&reader) &&
+           CborReader_Skip(&reader) && CborReader_Skip(&reader) && CborReader_Next(&reader, item);
+}
+
+static void TestCborPrecisionChoice(void)
+{
+    // Single precision where it keeps every decimal, double precision where it wouldn't
+    const ReadingField small = {.name = "x", .value = 0.123, .decimals = 3};
+    const ReadingField large = {.name = "x", .value = 172800.123, .decimals = 3};
+    const ReadingField whole = {.name = "x", .value = 101325.6};
+
+    uint8_t buffer[64];
+    CborItem item;
+
+    size_t length = Reading_Encode(LogstashFormat_Cbor, "s", &small, 1, buffer, sizeof(buffer));
+    CHECK(ReadOnlyFieldValue(buffer, length, &item) && item.type == CborItem_Float);
+
+    length = Reading_Encode(LogstashFormat_Cbor, "s", &large, 1, buffer, sizeof(buffer));
+    CHECK(ReadOnlyFieldValue(buffer, length, &item) && item.type == CborItem_Double && item.number == 172800.123);
+
+    // Zero decimals round like the JSON encoding instead of truncating
+    length = Reading_Encode(LogstashFormat_Cbor, "s", &whole, 1, buffer, sizeof(buffer));
+    CHECK(ReadOnlyFieldValue(buffer, length, &item) && item.type == CborItem_Unsigned && item.integer == 101326);
+}
+
+static void TestUnknownTimestamp(void)
+{
+    // Before NTP has set the clock there is no UTC time to send, rather than 1970
+    const ReadingField unknown = {.name = "t", .type = ReadingFieldType_Timestamp, .integer = 0};
+
+    char text[64];
+    size_t length = Reading_Encode(LogstashFormat_Json, "s", &unknown, 1, (uint8_t *)text, sizeof(text) - 1);
+    CHECK(length != 0);
+    text[length] = 0;
+    CHECK(strcmp(text, "{ \"sensor\": \"s\", \"t\": null }") == 0);
+
+    uint8_t buffer[64];
+    CborItem item;
+    length = Reading_Encode(LogstashFormat_Cbor, "s", &unknown, 1, buffer, sizeof(buffer));
+    CHECK(ReadOnlyFieldValue(buffer, length, &item) && item.type == CborItem_Null);
+}
+
+int main(void)
+{
+    TestJson();
+    TestCborRoundTrip();
+    TestCborPrecisionChoice();
+    TestUnknownTimestamp();
+    return TEST_RESULT();
+}
@@ -0,0 +1,131 @@
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+
+#include "sample_ring.h"
+#include "test.h"
+
+// Two-thread stress test of the SPSC ring. Every field of a pushed sample is derived from
+// its sequence number, so a torn copy shows up as fields that disagree. A small ring keeps
+// the producer overrunning the consumer, exercising the drop paths against concurrent pops.
+
+#define CAPACITY 8
+#define PUSHES 2000000u
+
+static Sample storage[CAPACITY];
+static SampleRing ring;
+static atomic_bool producerDone;
+static uint32_t producerLosses;
+
+// Uneven busy waits and yields on both sides, so each keeps catching up with and falling
+// behind the other, on one core as well as on several
+static void Jitter(uint32_t *state)
+{
+    *state = *state * 1664525 + 1013904223;
+    if ((*state >> 28) == 0) {
+        sched_yield();
+    }
+    for (volatile uint32_t spin = *state >> 26; spin > 0; spin--) {
+    }
+}
+
+static Sample MakeSample(uint32_t sequence)
+{
+    return (Sample){.timestampNanoseconds = (int64_t)sequence * 1000003,
+                    .value = (int32_t)(sequence * 2654435761u),
+                    .quality = (uint8_t)(sequence % SampleQuality_Count)};
+}
+
+static void *Producer(void *unused)
+{
+    uint32_t jitter = 1;
+    for (uint32_t sequence = 1; sequence <= PUSHES; sequence++) {
+        Jitter(&jitter);
+        Sample sample = MakeSample(sequence);
+        if (!SampleRing_Push(&ring, &sample)) {
+            producerLosses++;
+        }
+    }
+    atomic_store(&producerDone, true);
+    return NULL;
+}
+
+static void RunStress(SampleRingOverflowPolicy policy)
+{
+    CHECK(SampleRing_Init(&ring, storage, CAPACITY, policy));
+    atomic_store(&producerDone, false);
+    producerLosses = 0;
+
+    pthread_t producer;
+    CHECK(pthread_create(&producer, NULL, Producer, NULL) == 0);
+
+    uint32_t popped = 0;
+    uint32_t lastSequence = 0;
+    uint32_t torn = 0;
+    uint32_t outOfOrder = 0;
+    uint32_t jitter = 2;
+    Sample sample;
+    for (;;) {
+        Jitter(&jitter);
+        // Sample the flag before popping, so that a final empty pop really is the end
+        bool done = atomic_load(&producerDone);
+        if (!SampleRing_Pop(&ring, &sample)) {
+            if (done) {
+                break;
+            }
+            continue;
+        }
+
+        uint32_t sequence = (uint32_t)(sample.timestampNanoseconds / 1000003);
+        Sample expected = MakeSample(sequence);
+        if (sample.timestampNanoseconds % 1000003 != 0 || sample.value != expected.value ||
+            sample.quality != expected.quality) {
+            torn++;
+        }
+        if (sequence <= lastSequence) {
+            outOfOrder++;
+        }
+        lastSequence = sequence;
+        popped++;
+    }
+    pthread_join(producer, NULL);
+
+    uint32_t overflows = SampleRing_Overflows(&ring);
+    printf("%s: %u popped, %u lost\n", policy == SampleRingOverflow_DropOldest ? "drop oldest" : "drop newest",
+           popped, overflows);
+    CHECK(torn == 0);
+    CHECK(outOfOrder == 0);
+    // Every sample was either delivered or counted as lost, exactly once
+    CHECK(popped + overflows == PUSHES);
+    CHECK(overflows == producerLosses);
+    CHECK(SampleRing_Count(&ring) == 0);
+    if (policy == SampleRingOverflow_DropOldest) {
+        // The newest sample always survives
+        CHECK(lastSequence == PUSHES);
+    }
+}
+
+static void TestSingleThreaded(void)
+{
+    CHECK(!SampleRing_Init(&ring, storage, 6, SampleRingOverflow_DropOldest));
+    CHECK(SampleRing_Init(&ring, storage, 4, SampleRingOverflow_DropOldest));
+    for (uint32_t sequence = 1; sequence <= 6; sequence++) {
+        Sample sample = MakeSample(sequence);
+        CHECK(SampleRing_Push(&ring, &sample) == (sequence <= 4));
+    }
+    CHECK(SampleRing_Count(&ring) == 4 && SampleRing_Overflows(&ring) == 2);
+
+    Sample sample;
+    for (uint32_t sequence = 3; sequence <= 6; sequence++) {
+        CHECK(SampleRing_Pop(&ring, &sample) && sample.timestampNanoseconds == (int64_t)sequence * 1000003);
+    }
+    CHECK(!SampleRing_Pop(&ring, &sample));
+}
+
+int main(void)
+{
+    TestSingleThreaded();
+    RunStress(SampleRingOverflow_DropOldest);
+    RunStress(SampleRingOverflow_DropNewest);
+    return TEST_RESULT();
+}
@@ -0,0 +1,182 @@
+#include <math.h>
+
+#include "sampling_controller.h"
+#include "test.h"
+
+// Convergence of the sampling controller on synthetic noise. A simulated BMP180 returns a
+// slowly changing true pressure plus Gaussian noise at the datasheet level for the current
+// mode, scaled by a profile factor, rounded to the chip's 1 Pa resolution.
+
+#define BLOCKS 60
+
+// The BMP180 tables from bmp180.c
+static const double noisePascals[] = {6, 5, 4, 3};
+static const uint8_t conversionMilliseconds[] = {5, 8, 14, 26};
+static const double targetStandardErrorPascals = 0.5;
+
+static const SamplingSetting initial = {.oversampling = 3, .intervalMilliseconds = 100};
+
+static uint64_t randomState;
+
+static double Uniform(void)
+{
+    randomState ^= randomState << 13;
+    randomState ^= randomState >> 7;
+    randomState ^= randomState << 17;
+    return ((randomState >> 11) + 0.5) / 9007199254740992.0;
+}
+
+static double Gaussian(void)
+{
+    return sqrt(-2 * log(Uniform())) * cos(2 * M_PI * Uniform());
+}
+
+typedef struct Simulation {
+    SamplingController controller;
+    double seconds;
+    uint32_t changes;
+    uint32_t lastChangeBlock;
+} Simulation;
+
+static void Init(Simulation *simulation)
+{
+    static const SamplingControllerConfig config = {
+        .modeCount = 4,
+        .noisePascals = noisePascals,
+        .conversionMilliseconds = conversionMilliseconds,
+        .targetStandardErrorPascals = targetStandardErrorPascals};
+    SamplingController_Init(&simulation->controller, &config, initial);
+    simulation->seconds = 0;
+    simulation->changes = 0;
+    simulation->lastChangeBlock = 0;
+    randomState = 0x2545F4914F6CDD1Dull;
+}
+
+// Run for a number of blocks' worth of samples at the given noise factor. The true pressure
+// drifts by 100 Pa an hour with a slow 30 Pa oscillation on top, which the noise estimate
+// should ignore.
+static void Run(Simulation *simulation, uint32_t blocks, double noiseFactor)
+{
+    SamplingController *controller = &simulation->controller;
+    for (uint32_t block = 0; block < blocks; block++) {
+        for (uint32_t i = 0; i < SAMPLING_CONTROLLER_BLOCK_SAMPLES + 1; i++) {
+            SamplingSetting setting = controller->setting;
+            double truePressure = 100000 + simulation->seconds * 100 / 3600 +
+                                  30 * sin(2 * M_PI * simulation->seconds / 1800);
+            double sigma = noiseFactor * noisePascals[setting.oversampling];
+            int32_t sample = (int32_t)lround(truePressure + sigma * Gaussian());
+            simulation->seconds += setting.intervalMilliseconds / 1000.0;
+
+            if (SamplingController_Add(controller, sample)) {
+                simulation->changes++;
+                simulation->lastChangeBlock = block;
+            }
+        }
+    }
+}
+
+// Standard error of the one-minute mean with the true noise at the chosen setting
+static double TrueStandardError(const SamplingController *controller, double noiseFactor)
+{
+    SamplingSetting setting = controller->setting;
+    double sigma = noiseFactor * noisePascals[setting.oversampling];
+    double quantization = 1 / sqrt(12);
+    return sqrt(sigma * sigma + quantization * quantization) /
+           sqrt(60000.0 / setting.intervalMilliseconds);
+}
+
+static double Cost(const SamplingController *controller)
+{
+    return SamplingController_Cost(controller, controller->setting);
+}
+
+// At a steady noise level the controller settles quickly, stays put, meets the target
+// with the true noise and measures that noise to within its smoothing
+static double Converge(double noiseFactor)
+{
+    Simulation simulation;
+    Init(&simulation);
+    Run(&simulation, BLOCKS, noiseFactor);
+    const SamplingController *controller = &simulation.controller;
+
+    printf("noise x%.1f: oversampling %u every %u ms, measured %.2f Pa, %u changes, cost %.0f ms/min\n",
+           noiseFactor, controller->setting.oversampling, controller->setting.intervalMilliseconds,
+           controller->noisePascals, simulation.changes, Cost(controller));
+
+    CHECK(simulation.changes <= 3);
+    CHECK(simulation.lastChangeBlock < 10);
+    CHECK(TrueStandardError(controller, noiseFactor) <= targetStandardErrorPascals);
+    double trueNoise = noiseFactor * noisePascals[controller->setting.oversampling];
+    if (trueNoise > 1) {
+        CHECK(fabs(controller->noisePascals - trueNoise) < 0.2 * trueNoise);
+    }
+    return Cost(controller);
+}
+
+static void TestSteadyNoise(void)
+{
+    SamplingController reference;
+    static const SamplingControllerConfig config = {.modeCount = 4,
+                                                    .noisePascals = noisePascals,
+                                                    .conversionMilliseconds = conversionMilliseconds};
+    SamplingController_Init(&reference, &config, initial);
+    double initialCost = SamplingController_Cost(&reference, initial);
+
+    // With datasheet noise a much cheaper setting than the fixed one does the job
+    double datasheetCost = Converge(1);
+    CHECK(datasheetCost < initialCost / 4);
+
+    // A quieter sensor is cheaper still
+    double quietCost = Converge(0.2);
+    CHECK(quietCost < datasheetCost);
+
+    // Nothing meets the target for a very noisy sensor, so it gets the most precise setting
+    Simulation simulation;
+    for (int i = 0; i < 2; i++) {
+        double noiseFactor = i == 0 ? 3 : 6;
+        Init(&simulation);
+        Run(&simulation, BLOCKS, noiseFactor);
+        printf("noise x%.0f: oversampling %u every %u ms\n", noiseFactor,
+               simulation.controller.setting.oversampling,
+               simulation.controller.setting.intervalMilliseconds);
+        CHECK(simulation.controller.setting.oversampling == initial.oversampling);
+        CHECK(simulation.controller.setting.intervalMilliseconds == initial.intervalMilliseconds);
+        CHECK(simulation.changes == 0);
+    }
+}
+
+// After the noise steps up the controller follows within a few blocks, and back down again
+static void TestNoiseStep(void)
+{
+    Simulation simulation;
+    Init(&simulation);
+    Run(&simulation, 20, 1);
+    SamplingSetting settled = simulation.controller.setting;
+    CHECK(settled.oversampling != initial.oversampling ||
+          settled.intervalMilliseconds != initial.intervalMilliseconds);
+
+    uint32_t blocks = 0;
+    while (blocks < 20 && (simulation.controller.setting.oversampling != initial.oversampling ||
+                           simulation.controller.setting.intervalMilliseconds !=
+                               initial.intervalMilliseconds)) {
+        Run(&simulation, 1, 3);
+        blocks++;
+    }
+    printf("noise step to x3: followed after %u blocks\n", blocks);
+    CHECK(blocks <= 8);
+
+    blocks = 0;
+    while (blocks < 20 && Cost(&simulation.controller) > SamplingController_Cost(&simulation.controller, settled)) {
+        Run(&simulation, 1, 1);
+        blocks++;
+    }
+    printf("noise step back to x1: followed after %u blocks\n", blocks);
+    CHECK(blocks <= 12);
+}
+
+int main(void)
+{
+    TestSteadyNoise();
+    TestNoiseStep();
+    return TEST_RESULT();
+}
@@ -0,0 +1,122 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "count_rate.h"
+#include "geiger_parser.h"
+#include "spike_detector.h"
+#include "test.h"
+
+// Replays a 1500 s count trace in the counter's line format through the parser, count rate
+// and spike detector the same way geiger.c does, one message per second. The trace is
+// Poisson background at about 20 CPM, with a 6 CPS source for ten or fifteen seconds at:
+//
+//    400 s   before a quarter of the hourly baseline has been seen, so no alert
+//    1000 s  alerts
+//    1150 s  within the five minute rate limit of the previous alert, so no alert
+//    1310 s  more than five minutes after the previous alert, so it alerts again
+
+#define MAX_ALERTS 8
+
+static const uint32_t expectedAlertSeconds[] = {1003, 1314};
+
+static CountRate countRate;
+static SpikeDetector detector;
+static uint32_t seconds;
+static uint32_t alertSeconds[MAX_ALERTS];
+static SpikeAlert alerts[MAX_ALERTS];
+static size_t alertCount;
+
+// Fed the same counts with each second stretched to a thousand, so that its rate limit
+// never bites: it alerts on every window unusual enough to alert on
+static SpikeDetector unlimitedDetector;
+static uint32_t spikeSeconds;
+static uint32_t suppressedSpikeSeconds[2]; // during the 1000 s and 1150 s sources
+static uint32_t earlySpikeSeconds;
+
+static void OnMessage(const GeigerMessage *message, void *context)
+{
+    seconds++;
+    int64_t nowNanoseconds = (int64_t)seconds * 1000 * 1000 * 1000;
+    CountRate_Add(&countRate, nowNanoseconds, message->cps);
+
+    CountRateEstimate baseline;
+    CountRate_GetEstimate(&countRate, CountRateWindow_Hour, &baseline);
+    SpikeAlert alert;
+    if (SpikeDetector_Add(&detector, nowNanoseconds, message->cps, baseline.cpm / 60,
+                          baseline.coverage, &alert)) {
+        if (alertCount < MAX_ALERTS) {
+            alertSeconds[alertCount] = seconds;
+            alerts[alertCount] = alert;
+        }
+        alertCount++;
+    }
+
+    SpikeAlert unlimitedAlert;
+    if (SpikeDetector_Add(&unlimitedDetector, nowNanoseconds * 1000, message->cps,
+                          baseline.cpm / 60, baseline.coverage, &unlimitedAlert)) {
+        spikeSeconds++;
+        if (seconds < 900) {
+            earlySpikeSeconds++;
+        }
+        else if (seconds > expectedAlertSeconds[0] && seconds < 1100) {
+            suppressedSpikeSeconds[0]++;
+        }
+        else if (seconds >= 1150 && seconds < 1200) {
+            suppressedSpikeSeconds[1]++;
+        }
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    if (argc != 2) {
+        fprintf(stderr, "usage: %s TRACE\n", argv[0]);
+        return 1;
+    }
+    FILE *trace = fopen(argv[1], "rb");
+    if (trace == NULL) {
+        perror(argv[1]);
+        return 1;
+    }
+
+    CountRate_Init(&countRate);
+    SpikeDetector_Init(&detector);
+    SpikeDetector_Init(&unlimitedDetector);
+    GeigerParser parser;
+    GeigerParser_Init(&parser);
+
+    // Uneven reads, as from the UART
+    uint8_t buffer[61];
+    size_t length;
+    while ((length = fread(buffer, 1, sizeof(buffer), trace)) > 0) {
+        GeigerParser_Feed(&parser, buffer, length, OnMessage, NULL);
+    }
+    fclose(trace);
+
+    CHECK(parser.messages == 1500);
+    CHECK(parser.framingErrors == 0);
+    CHECK(parser.checksumErrors == 0);
+    CHECK(seconds == 1500);
+
+    CHECK(alertCount == sizeof(expectedAlertSeconds) / sizeof(expectedAlertSeconds[0]));
+    for (size_t i = 0; i < alertCount && i < MAX_ALERTS; i++) {
+        printf("alert at %u s: %u counts, %.2f expected, log10 p %.1f\n", alertSeconds[i],
+               alerts[i].counts, alerts[i].expectedCounts, alerts[i].log10PValue);
+        CHECK(alertSeconds[i] == expectedAlertSeconds[i]);
+        CHECK(alerts[i].log10PValue <= -7);
+        CHECK(alerts[i].counts > alerts[i].expectedCounts);
+    }
+    CHECK(alertSeconds[1] - alertSeconds[0] >= 300);
+
+    // The rate limit, not the data, is what kept the detector quiet after the first alert
+    printf("%u spike seconds, %u and %u rate limited after the first alert and during the "
+           "second source\n",
+           spikeSeconds, suppressedSpikeSeconds[0], suppressedSpikeSeconds[1]);
+    CHECK(suppressedSpikeSeconds[0] > 0);
+    CHECK(suppressedSpikeSeconds[1] > 0);
+
+    // The 400 s source came before the baseline could be trusted
+    CHECK(earlySpikeSeconds == 0);
+
+    return TEST_RESULT();
+}
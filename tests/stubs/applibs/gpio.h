@@ -0,0 +1,3 @@
+#pragma once
+
+// Host stand-in for the Azure Sphere SDK header, which geiger.c includes but makes no calls from
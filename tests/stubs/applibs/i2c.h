@@ -0,0 +1,23 @@
+#pragma once
+
+// Host stand-in for the Azure Sphere SDK header; fake_i2c.c implements the calls against
+// simulated sensors
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+typedef uint32_t I2C_DeviceAddress;
+typedef int I2C_InterfaceId;
+typedef uint32_t I2C_BusSpeed;
+
+#define I2C_BUS_SPEED_STANDARD 100000
+#define I2C_BUS_SPEED_FAST 400000
+
+int I2CMaster_Open(I2C_InterfaceId id);
+int I2CMaster_SetBusSpeed(int fd, I2C_BusSpeed speed);
+int I2CMaster_SetTimeout(int fd, uint32_t timeoutInMs);
+ssize_t I2CMaster_Write(int fd, I2C_DeviceAddress address, const uint8_t *data, size_t length);
+ssize_t I2CMaster_WriteThenRead(int fd, I2C_DeviceAddress address, const uint8_t *writeData,
+                                size_t lenWriteData, uint8_t *readData, size_t lenReadData);
+ssize_t I2CMaster_Read(int fd, I2C_DeviceAddress address, uint8_t *buffer, size_t maxLength);
@@ -0,0 +1,8 @@
+#pragma once
+
+// Host stand-in for the Azure Sphere SDK header; see host_applibs.c
+
+#include <stdarg.h>
+
+int Log_Debug(const char *format, ...) __attribute__((format(printf, 1, 2)));
+int Log_DebugVarArgs(const char *format, va_list args);
@@ -0,0 +1,7 @@
+#pragma once
+
+// Host stand-in for the Azure Sphere SDK header: only the readiness check logstash.c makes
+
+#include <stdbool.h>
+
+int Networking_IsNetworkingReady(bool *outIsNetworkingReady);
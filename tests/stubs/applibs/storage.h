@@ -0,0 +1,5 @@
+#pragma once
+
+// Host stand-in for the Azure Sphere SDK header: the test provides the mutable storage file
+
+int Storage_OpenMutableFile(void);
@@ -0,0 +1,33 @@
+#pragma once
+
+// Host stand-in for the Azure Sphere SDK header: what geiger.c configures. The test
+// provides UART_Open.
+
+#include <stdint.h>
+
+typedef int UART_Id;
+
+typedef enum { UART_BlockingMode_NonBlocking = 0 } UART_BlockingMode;
+typedef enum { UART_DataBits_Eight = 8 } UART_DataBits;
+typedef enum { UART_Parity_None = 0 } UART_Parity;
+typedef enum { UART_StopBits_One = 1 } UART_StopBits;
+typedef enum { UART_FlowControl_None = 0 } UART_FlowControl;
+
+typedef struct UART_Config {
+    uint32_t baudRate;
+    UART_BlockingMode blockingMode;
+    UART_DataBits dataBits;
+    UART_Parity parity;
+    UART_StopBits stopBits;
+    UART_FlowControl flowControl;
+} UART_Config;
+
+static inline void UART_InitConfig(UART_Config *config)
+{
+    *config = (UART_Config){.baudRate = 115200, .dataBits = UART_DataBits_Eight};
+}
+
+/// <summary>
+/// Returns a non-blocking descriptor to read the UART's input from, or -1.
+/// </summary>
+int UART_Open(UART_Id uartId, const UART_Config *config);
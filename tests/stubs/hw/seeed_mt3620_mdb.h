@@ -0,0 +1,6 @@
+#pragma once
+
+// Host stand-in for the hardware definition header
+
+#define SEEED_MT3620_MDB_J1_ISU0_UART 4
+#define SEEED_MT3620_MDB_J1J2_ISU1_I2C 1
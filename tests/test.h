@@ -0,0 +1,17 @@
+#pragma once
+
+#include <stdio.h>
+
+// Minimal checks for the host tests: a failed check is reported and counted, and the test
+// carries on so one run shows every failure.
+static int testFailures = 0;
+
+#define CHECK(condition)                                                                       \
+    do {                                                                                       \
+        if (!(condition)) {                                                                    \
+            fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #condition);      \
+            testFailures++;                                                                    \
+        }                                                                                      \
+    } while (0)
+
+#define TEST_RESULT() (testFailures == 0 ? 0 : 1)
@@ -0,0 +1,170 @@
+#include <string.h>
+#include <time.h>
+
+#include "eventloop_timer_utilities.h"
+#include "test.h"
+
+// Dispatch statistics from eventloop_timer_utilities.c on a host event loop, in real time.
+// A handler that holds the loop makes the timers dispatched after it late, and a loop that
+// doesn't run for several periods makes a periodic timer miss them.
+
+static EventLoop *eventLoop;
+
+static int64_t NowMilliseconds(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (int64_t)now.tv_sec * 1000 + now.tv_nsec / 1000000;
+}
+
+static void Sleep(int milliseconds)
+{
+    const struct timespec duration = {.tv_sec = milliseconds / 1000,
+                                      .tv_nsec = (milliseconds % 1000) * 1000 * 1000};
+    nanosleep(&duration, NULL);
+}
+
+static uint32_t dispatches;
+static EventLoopTimer *dispatchOrder[4];
+static uint64_t lastExpirations;
+
+static void RunUntilDispatches(uint32_t target)
+{
+    int64_t deadline = NowMilliseconds() + 1000;
+    while (dispatches < target && NowMilliseconds() < deadline) {
+        EventLoop_Run(eventLoop, 10, true);
+    }
+    CHECK(dispatches >= target);
+}
+
+// The first handler to run holds the loop for 20 ms
+static void SlowFirstHandler(EventLoopTimer *timer)
+{
+    ConsumeEventLoopTimerEvent(timer);
+    if (dispatches < 4) {
+        dispatchOrder[dispatches] = timer;
+    }
+    if (dispatches++ == 0) {
+        Sleep(20);
+    }
+}
+
+static void CountingHandler(EventLoopTimer *timer)
+{
+    ConsumeEventLoopTimerEventCount(timer, &lastExpirations);
+    dispatches++;
+}
+
+typedef struct {
+    const char *name;
+    EventLoopTimerStats stats;
+    bool found;
+} StatsLookup;
+
+static void FindStats(EventLoopTimer *timer, const char *name, const EventLoopTimerStats *stats,
+                      void *context)
+{
+    StatsLookup *lookup = context;
+    if (strcmp(name, lookup->name) == 0) {
+        lookup->stats = *stats;
+        lookup->found = true;
+    }
+}
+
+static EventLoopTimerStats Stats(const char *name)
+{
+    StatsLookup lookup = {.name = name};
+    ForEachEventLoopTimer(eventLoop, FindStats, &lookup);
+    CHECK(lookup.found);
+    return lookup.stats;
+}
+
+static uint32_t HistogramTotal(const EventLoopTimerStats *stats)
+{
+    uint32_t total = 0;
+    for (size_t i = 0; i < EVENT_LOOP_TIMER_LATENESS_BUCKETS; i++) {
+        total += stats->latenessHistogram[i];
+    }
+    return total;
+}
+
+static void TestLatenessBehindSlowHandler(void)
+{
+    EventLoopTimer *first = CreateEventLoopDisarmedTimer(eventLoop, SlowFirstHandler);
+    EventLoopTimer *second = CreateEventLoopDisarmedTimer(eventLoop, SlowFirstHandler);
+    SetEventLoopTimerName(first, "first");
+    SetEventLoopTimerName(second, "second");
+
+    // Due together; whichever runs second waits out the first's 20 ms
+    dispatches = 0;
+    static const struct timespec delay = {.tv_nsec = 5 * 1000 * 1000};
+    SetEventLoopTimerOneShot(first, &delay);
+    SetEventLoopTimerOneShot(second, &delay);
+    RunUntilDispatches(2);
+
+    EventLoopTimerStats late = Stats(dispatchOrder[1] == first ? "first" : "second");
+    CHECK(late.dispatches == 1);
+    CHECK(late.maxLatenessMicroseconds >= 19000);
+    CHECK(HistogramTotal(&late) == 1);
+    // (10 ms, 50 ms]
+    CHECK(EventLoopTimerLatenessBucketMicroseconds[5] == 10000);
+    CHECK(late.latenessHistogram[6] == 1);
+
+    EventLoopTimerStats onTime = Stats(dispatchOrder[0] == first ? "first" : "second");
+    CHECK(onTime.dispatches == 1);
+    CHECK(HistogramTotal(&onTime) == 1);
+    CHECK(onTime.missedExpirations == 0);
+
+    // Reporting starts them again from zero
+    ResetEventLoopTimerStats(first);
+    EventLoopTimerStats reset = Stats("first");
+    CHECK(reset.dispatches == 0);
+    CHECK(HistogramTotal(&reset) == 0);
+    CHECK(reset.maxLatenessMicroseconds == 0);
+
+    DisposeEventLoopTimer(first);
+    DisposeEventLoopTimer(second);
+}
+
+static void TestMissedExpirations(void)
+{
+    static const struct timespec period = {.tv_nsec = 10 * 1000 * 1000};
+    EventLoopTimer *timer = CreateEventLoopPeriodicTimer(eventLoop, CountingHandler, &period);
+    SetEventLoopTimerName(timer, "periodic");
+
+    dispatches = 0;
+    RunUntilDispatches(1);
+    CHECK(lastExpirations == 1);
+    CHECK(Stats("periodic").missedExpirations == 0);
+
+    // The loop stalls for three and a half periods: three periods fall due, the first is
+    // dispatched 25 ms late and the other two are counted as missed rather than delivered
+    Sleep(35);
+    RunUntilDispatches(2);
+    EventLoopTimerStats stats = Stats("periodic");
+    CHECK(stats.dispatches == 2);
+    CHECK(stats.missedExpirations >= 2 && stats.missedExpirations <= 3);
+    CHECK(lastExpirations == 1 + stats.missedExpirations);
+    CHECK(stats.maxLatenessMicroseconds >= 20000);
+    CHECK(stats.latenessHistogram[6] == 1);
+    CHECK(HistogramTotal(&stats) == 2);
+
+    // And it carries on at its period afterwards
+    RunUntilDispatches(3);
+    CHECK(lastExpirations == 1);
+    CHECK(Stats("periodic").missedExpirations == stats.missedExpirations);
+
+    DisposeEventLoopTimer(timer);
+}
+
+int main(void)
+{
+    eventLoop = EventLoop_Create();
+    CHECK(eventLoop != NULL);
+
+    TestLatenessBehindSlowHandler();
+    TestMissedExpirations();
+
+    EventLoop_Close(eventLoop);
+    return TEST_RESULT();
+}
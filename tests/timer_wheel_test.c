@@ -0,0 +1,132 @@
+#include "timer_wheel.h"
+#include "test.h"
+
+// Randomized check of the timer wheel against a naive reference: a flat array of expiry
+// ticks scanned in full. Inserts, moves and removes are interleaved with clock advances
+// of every scale, from a single tick to past the top level, and after each advance the
+// wheel must have expired exactly the entries the reference says are due, in order.
+
+#define ENTRIES 500
+#define OPERATIONS 300000
+
+static TimerWheelEntry entries[ENTRIES];
+static bool scheduled[ENTRIES];
+static uint64_t expected[ENTRIES]; // the tick each scheduled entry is due at
+
+static uint64_t randomState = 0x9E3779B97F4A7C15ull;
+
+static uint64_t Random(void)
+{
+    randomState ^= randomState << 13;
+    randomState ^= randomState >> 7;
+    randomState ^= randomState << 17;
+    return randomState;
+}
+
+// Delays at every level of the wheel, and beyond it into the overflow list
+static uint64_t RandomDelay(void)
+{
+    switch (Random() % 5) {
+    case 0:
+        return Random() % TIMER_WHEEL_SLOTS;
+    case 1:
+        return Random() % (TIMER_WHEEL_SLOTS * TIMER_WHEEL_SLOTS);
+    case 2:
+        return Random() % (1u << 18);
+    case 3:
+        return Random() % (1ull << 26);
+    default:
+        return 0;
+    }
+}
+
+static bool ReferenceNextExpiry(uint64_t *tick, size_t *count)
+{
+    *count = 0;
+    *tick = UINT64_MAX;
+    for (size_t i = 0; i < ENTRIES; i++) {
+        if (scheduled[i]) {
+            (*count)++;
+            if (expected[i] < *tick) {
+                *tick = expected[i];
+            }
+        }
+    }
+    return *count != 0;
+}
+
+int main(void)
+{
+    TimerWheel wheel;
+    uint64_t now = 123456789;
+    TimerWheel_Init(&wheel, now);
+    uint32_t fired = 0;
+    uint32_t failures = 0;
+
+    for (uint32_t operation = 0; operation < OPERATIONS && failures == 0; operation++) {
+        size_t i = Random() % ENTRIES;
+        uint32_t choice = Random() % 10;
+
+        if (choice < 4) {
+            // Schedule or move; now and then for a tick already processed, meaning as soon
+            // as possible
+            uint64_t tick = Random() % 20 == 0 ? now - 5 : now + 1 + RandomDelay();
+            TimerWheel_Insert(&wheel, &entries[i], tick);
+            scheduled[i] = true;
+            expected[i] = tick < wheel.currentTick ? wheel.currentTick : tick;
+            CHECK(TimerWheel_IsScheduled(&entries[i]));
+            continue;
+        }
+        if (choice < 5) {
+            TimerWheel_Remove(&wheel, &entries[i]);
+            scheduled[i] = false;
+            CHECK(!TimerWheel_IsScheduled(&entries[i]));
+            continue;
+        }
+
+        uint64_t referenceTick;
+        size_t referenceCount;
+        bool referenceDue = ReferenceNextExpiry(&referenceTick, &referenceCount);
+        uint64_t tick;
+        bool due = TimerWheel_NextExpiry(&wheel, &tick);
+        CHECK(wheel.count == referenceCount);
+        CHECK(due == referenceDue);
+        CHECK(!due || tick == referenceTick);
+
+        // Advance to exactly the next expiry, a little past it, or a long way
+        uint64_t step;
+        switch (Random() % 3) {
+        case 0:
+            step = due ? tick - now : 10;
+            break;
+        case 1:
+            step = due && tick > now ? tick - now + Random() % 3 : Random() % 64;
+            break;
+        default:
+            step = Random() % 100000;
+            break;
+        }
+        now += step;
+
+        uint64_t previous = 0;
+        TimerWheelEntry *entry;
+        while ((entry = TimerWheel_Expire(&wheel, now)) != NULL) {
+            size_t j = (size_t)(entry - entries);
+            CHECK(scheduled[j]);
+            CHECK(expected[j] <= now);
+            CHECK(entry->expiresTick >= previous);
+            CHECK(!TimerWheel_IsScheduled(entry));
+            previous = entry->expiresTick;
+            scheduled[j] = false;
+            fired++;
+        }
+        for (size_t j = 0; j < ENTRIES; j++) {
+            CHECK(!scheduled[j] || expected[j] > now);
+        }
+        failures = (uint32_t)testFailures;
+    }
+
+    printf("%u expiries checked\n", fired);
+    CHECK(fired > OPERATIONS / 10);
+    return TEST_RESULT();
+}
@@ -0,0 +1,229 @@
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <applibs/storage.h>
+
+#include "barometer.h"
+#include "fake_logstash.h"
+#include "fake_timers.h"
+#include "geiger.h"
+#include "gzip.h"
+#include "upload.h"
+#include "upload_queue.h"
+
+// Requests and bytes a minute of readings costs, through upload.c and the persistent upload
+// queue, compared with one request per reading, which is how readings were sent before the
+// queue batched them:
+//
+//    upload_bench [MINUTES] [OUTAGE_MINUTES]
+//
+// Every minute one Geiger counter and the barometer deliver a full window. The network is
+// down for the first OUTAGE_MINUTES, so the backlog has to be caught up afterwards. Time is
+// simulated, with clock_gettime wrapped at link time and the timers fired by hand, so an
+// hour runs in moments. Bodies are counted as logstash.c would post them, gzipped when
+// that makes them smaller. Headers and TLS records come on top of every request; see
+// logstash_bench for what a request costs on a connection.
+
+static int64_t monotonicNanoseconds = 100LL * 1000 * 1000 * 1000;
+static int64_t realtimeNanoseconds = 1792152030LL * 1000 * 1000 * 1000; // 2026-10-16T12:00:30Z
+
+int __wrap_clock_gettime(clockid_t clock, struct timespec *time)
+{
+    int64_t nanoseconds = clock == CLOCK_REALTIME ? realtimeNanoseconds : monotonicNanoseconds;
+    time->tv_sec = (time_t)(nanoseconds / (1000 * 1000 * 1000));
+    time->tv_nsec = (long)(nanoseconds % (1000 * 1000 * 1000));
+    return 0;
+}
+
+static void AdvanceMilliseconds(int64_t milliseconds)
+{
+    monotonicNanoseconds += milliseconds * 1000 * 1000;
+    realtimeNanoseconds += milliseconds * 1000 * 1000;
+}
+
+static char storagePath[] = "/tmp/upload_bench_XXXXXX";
+
+int Storage_OpenMutableFile(void)
+{
+    return open(storagePath, O_RDWR);
+}
+
+void Barometer_GetStats(BarometerStats *stats)
+{
+    memset(stats, 0, sizeof(*stats));
+    stats->connected = true;
+}
+
+const char *Geiger_SensorId(uint32_t counter)
+{
+    return "geiger";
+}
+
+typedef struct Totals {
+    uint32_t requests;
+    uint32_t records;
+    size_t bodyBytes;
+    size_t wireBytes;
+} Totals;
+
+static Totals batched;
+static Totals perReading;
+
+// As logstash.c sends them
+static size_t WireLength(const uint8_t *body, size_t length)
+{
+    static const size_t compressionThreshold = 256;
+    static uint8_t compressed[4096];
+    size_t compressedLength = length > compressionThreshold
+                                  ? Gzip_Compress(body, length, compressed, sizeof(compressed))
+                                  : 0;
+    return compressedLength != 0 && compressedLength < length ? compressedLength : length;
+}
+
+static void Count(Totals *totals, const uint8_t *body, size_t length)
+{
+    totals->requests++;
+    totals->bodyBytes += length;
+    totals->wireBytes += WireLength(body, length);
+}
+
+/// <summary>
+/// Count a batch the queue posted, and each of its newline-terminated records as it would
+/// have been posted on its own.
+/// </summary>
+static void CountRequest(const FakeLogstashRequest *request)
+{
+    Count(&batched, request->body, request->bodyLength);
+    const uint8_t *record = request->body;
+    const uint8_t *end = request->body + request->bodyLength;
+    while (record < end) {
+        const uint8_t *newline = memchr(record, '\n', (size_t)(end - record));
+        size_t length = newline == NULL ? (size_t)(end - record) : (size_t)(newline - record) + 1;
+        Count(&perReading, record, length);
+        batched.records++;
+        perReading.records++;
+        record += length;
+    }
+}
+
+static datablock_t dataBlock;
+
+static void InitDataBlock(void)
+{
+    static const double pressurePercentiles[] = {0.1, 0.9};
+    for (size_t i = 0; i < 2; i++) {
+        Aggregate_Init(&dataBlock.pressure[i].samples, pressurePercentiles,
+                       sizeof(pressurePercentiles) / sizeof(pressurePercentiles[0]),
+                       dataBlock.pressure[i].sampleStorage, PRESSURE_WINDOW_CAPACITY);
+        Aggregate_Init(&dataBlock.pressure[i].temperature, NULL, 0, NULL, 0);
+        dataBlock.pressure[i].oversampling = -1;
+    }
+    CountRate_Init(&dataBlock.countRate[0]);
+}
+
+/// <summary>
+/// A minute's worth of Geiger messages and barometer samples in the active windows.
+/// </summary>
+static void FillWindows(uint32_t minute)
+{
+    GeigerWindow *geiger = DataBlock_ActiveGeigerWindow(&dataBlock, 0);
+    geiger->cpm = 17 + minute % 5;
+    geiger->nanosievertsPerHour = 90 + minute % 7;
+    geiger->cpmMessagesReceived = 60;
+    for (int64_t second = 1; second <= 60; second++) {
+        CountRate_Add(&dataBlock.countRate[0], monotonicNanoseconds + second * 1000 * 1000 * 1000,
+                      (uint32_t)(second + minute) % 3);
+    }
+
+    PressureWindow *pressure = DataBlock_ActivePressureWindow(&dataBlock);
+    for (int i = 0; i < 600; i++) {
+        Aggregate_Add(&pressure->samples, 101325 + (i * 7 + (int)minute) % 17 - 8);
+    }
+    for (int i = 0; i < 6; i++) {
+        Aggregate_Add(&pressure->temperature, 21.5 + 0.1 * i);
+    }
+    pressure->samplesPerMinute = 600;
+    pressure->sampleIntervalMilliseconds = 100;
+}
+
+/// <summary>
+/// Let the queue drain until the window ends, completing every request it makes.
+/// </summary>
+/// <returns>The time that took, in milliseconds.</returns>
+static int64_t Drain(int64_t windowMilliseconds)
+{
+    int64_t elapsed = 0;
+    for (;;) {
+        if (FakeLogstash_Outstanding() != 0) {
+            CountRequest(FakeLogstash_Complete(true));
+            continue;
+        }
+        EventLoopTimer *drain = FakeTimers_Find("upload_queue");
+        if (!FakeTimers_IsArmed(drain) || elapsed + FakeTimers_Milliseconds(drain) >= windowMilliseconds) {
+            return elapsed;
+        }
+        AdvanceMilliseconds(FakeTimers_Milliseconds(drain));
+        elapsed += FakeTimers_Milliseconds(drain);
+        FakeTimers_Fire(drain);
+    }
+}
+
+static void Report(const char *name, const Totals *totals, uint32_t minutes)
+{
+    printf("%-18s %6.2f requests/min, %5.0f body bytes/reading, %5.0f bytes/reading on the wire\n",
+           name, (double)totals->requests / minutes,
+           totals->records == 0 ? 0 : (double)totals->bodyBytes / totals->records,
+           totals->records == 0 ? 0 : (double)totals->wireBytes / totals->records);
+}
+
+int main(int argc, char *argv[])
+{
+    uint32_t minutes = argc > 1 ? (uint32_t)atoi(argv[1]) : 60;
+    uint32_t outageMinutes = argc > 2 ? (uint32_t)atoi(argv[2]) : 0;
+
+    int fd = mkstemp(storagePath);
+    if (fd == -1) {
+        perror("mkstemp");
+        return 1;
+    }
+    close(fd);
+
+    InitDataBlock();
+    if (Upload_Init(NULL, &dataBlock) != ExitCode_Success || UploadQueue_Init(NULL) != ExitCode_Success) {
+        fprintf(stderr, "could not start upload.c\n");
+        return 1;
+    }
+
+    // The first window only runs to the minute boundary
+    EventLoopTimer *upload = FakeTimers_Find("upload");
+    EventLoopTimer *reduction = FakeTimers_Find("reduction");
+    AdvanceMilliseconds(FakeTimers_Milliseconds(upload));
+    FakeTimers_Fire(upload);
+    FakeTimers_Fire(reduction);
+
+    int64_t drained = 0;
+    for (uint32_t minute = 0; minute < minutes; minute++) {
+        FakeLogstash_SetNetworkReady(minute >= outageMinutes);
+        FillWindows(minute);
+        AdvanceMilliseconds(FakeTimers_Milliseconds(upload) - drained);
+        FakeTimers_Fire(upload);
+        FakeTimers_Fire(reduction);
+        drained = Drain(FakeTimers_Milliseconds(upload));
+    }
+
+    UploadQueueStats stats;
+    UploadQueue_GetStats(&stats);
+    printf("%u minutes, %u of them offline: %u records sent, %u left queued, %u dropped\n", minutes,
+           outageMinutes, batched.records, stats.depth, stats.dropped);
+    Report("batched", &batched, minutes);
+    Report("one per reading", &perReading, minutes);
+
+    UploadQueue_Fini();
+    Upload_Fini();
+    unlink(storagePath);
+    return 0;
+}
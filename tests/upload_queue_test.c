@@ -0,0 +1,469 @@
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <applibs/storage.h>
+
+#include "fake_logstash.h"
+#include "fake_timers.h"
+#include "test.h"
+#include "upload_queue.h"
+
+// upload_queue.c against a temporary file standing in for mutable storage, with the drain
+// timer fired by hand and every send completed by the test. Restarts are UploadQueue_Fini
+// followed by UploadQueue_Init, which recovers from the file alone.
+//
+// Each record body is { "r": N } for reading N or { "t": N } for telemetry record N, so a
+// batch can be read back as the list of records it carried.
+
+#define SLOT_SIZE 1024
+#define QUEUE_CAPACITY 63
+
+static const char url[] = "https://logstash.example/readings";
+static char storagePath[] = "/tmp/upload_queue_test_XXXXXX";
+
+int Storage_OpenMutableFile(void)
+{
+    return open(storagePath, O_RDWR);
+}
+
+// Records in the order the server received them, as 'r' or 't' and a number
+static char deliveredKinds[1024];
+static uint32_t deliveredNumbers[1024];
+static uint32_t deliveredCount;
+
+/// <summary>
+/// Split a batch body back into its records.
+/// </summary>
+/// <returns>The number of records.</returns>
+static uint32_t ParseBatch(const FakeLogstashRequest *request, char kinds[], uint32_t numbers[])
+{
+    uint32_t count = 0;
+    const char *line = (const char *)request->body;
+    const char *end = line + request->bodyLength;
+    while (line < end) {
+        const char *newline = memchr(line, '\n', (size_t)(end - line));
+        if (newline == NULL || sscanf(line, "{ \"%c\": %u", &kinds[count], &numbers[count]) != 2) {
+            return UINT32_MAX;
+        }
+        count++;
+        line = newline + 1;
+    }
+    return count;
+}
+
+static EventLoopTimer *DrainTimer(void)
+{
+    return FakeTimers_Find("upload_queue");
+}
+
+/// <summary>
+/// Fire the drain timer, expecting a batch to be sent.
+/// </summary>
+/// <returns>The number of records in the batch, or 0 if nothing was sent.</returns>
+static uint32_t SendBatch(void)
+{
+    uint32_t before = FakeLogstash_Requests();
+    FakeTimers_Fire(DrainTimer());
+    if (FakeLogstash_Requests() == before) {
+        return 0;
+    }
+    char kinds[QUEUE_CAPACITY];
+    uint32_t numbers[QUEUE_CAPACITY];
+    return ParseBatch(FakeLogstash_Request(before), kinds, numbers);
+}
+
+/// <summary>
+/// Complete the outstanding send, adding its records to the delivered list if it succeeded.
+/// </summary>
+static void CompleteBatch(bool succeeded)
+{
+    const FakeLogstashRequest *request = FakeLogstash_Complete(succeeded);
+    CHECK(request != NULL);
+    if (request != NULL && succeeded) {
+        uint32_t count = ParseBatch(request, deliveredKinds + deliveredCount,
+                                    deliveredNumbers + deliveredCount);
+        CHECK(count != UINT32_MAX);
+        deliveredCount += count == UINT32_MAX ? 0 : count;
+    }
+}
+
+/// <summary>
+/// Send and acknowledge batches until the queue is empty.
+/// </summary>
+static void DeliverAll(void)
+{
+    for (int round = 0; round < 100 && FakeTimers_IsArmed(DrainTimer()); round++) {
+        if (SendBatch() != 0) {
+            CompleteBatch(true);
+        }
+    }
+    UploadQueueStats stats;
+    UploadQueue_GetStats(&stats);
+    CHECK(stats.depth == 0);
+}
+
+static bool Enqueue(char kind, uint32_t number)
+{
+    char body[UPLOAD_QUEUE_MAX_BODY];
+    int length = snprintf(body, sizeof(body), "{ \"%c\": %u }", kind, number);
+    return UploadQueue_Enqueue(url, LogstashFormat_Json,
+                               kind == 't' ? UploadRecordKind_Telemetry : UploadRecordKind_Reading,
+                               (const uint8_t *)body, (size_t)length);
+}
+
+static bool EnqueuePadded(uint32_t number, size_t bodyLength)
+{
+    char body[UPLOAD_QUEUE_MAX_BODY + 1];
+    int length = snprintf(body, sizeof(body), "{ \"r\": %u, \"pad\": \"", number);
+    memset(body + length, 'x', bodyLength - (size_t)length - 3);
+    memcpy(body + bodyLength - 3, "\" }", 3);
+    return UploadQueue_Enqueue(url, LogstashFormat_Json, UploadRecordKind_Reading,
+                               (const uint8_t *)body, bodyLength);
+}
+
+/// <summary>
+/// Check that the delivered records are exactly the given readings, in order.
+/// </summary>
+static void CheckDeliveredReadings(uint32_t first, uint32_t last)
+{
+    CHECK(deliveredCount == last - first + 1);
+    for (uint32_t i = 0; i < deliveredCount && i <= last - first; i++) {
+        if (deliveredKinds[i] != 'r' || deliveredNumbers[i] != first + i) {
+            fprintf(stderr, "record %u delivered as %c%u, expected r%u\n", i, deliveredKinds[i],
+                    deliveredNumbers[i], first + i);
+            CHECK(false);
+            return;
+        }
+    }
+}
+
+static void StartQueue(bool emptyStorage)
+{
+    if (emptyStorage) {
+        CHECK(truncate(storagePath, 0) == 0);
+    }
+    FakeLogstash_Reset();
+    deliveredCount = 0;
+    CHECK(UploadQueue_Init(NULL) == ExitCode_Success);
+}
+
+/// <summary>
+/// Stop the queue as a restart would, flushing it to storage. Sends still outstanding
+/// never complete.
+/// </summary>
+static void RestartQueue(void)
+{
+    UploadQueue_Fini();
+    StartQueue(false);
+}
+
+static uint32_t HeadSequence(void)
+{
+    UploadQueueStats stats;
+    UploadQueue_GetStats(&stats);
+    return stats.nextSequence - stats.depth;
+}
+
+static void CorruptSlot(uint32_t sequence, off_t offset, size_t length, uint8_t value)
+{
+    uint8_t bytes[SLOT_SIZE];
+    memset(bytes, value, length);
+    int fd = open(storagePath, O_RDWR);
+    CHECK(fd != -1);
+    CHECK(pwrite(fd, bytes, length, (off_t)(1 + sequence % QUEUE_CAPACITY) * SLOT_SIZE + offset) ==
+          (ssize_t)length);
+    close(fd);
+}
+
+static void TestBatchLimits(void)
+{
+    StartQueue(true);
+
+    // Fewer than a full batch wait for the batch latency; the sixteenth sends at once
+    for (uint32_t i = 0; i < 15; i++) {
+        Enqueue('r', i);
+    }
+    CHECK(FakeTimers_IsArmed(DrainTimer()));
+    CHECK(FakeTimers_Milliseconds(DrainTimer()) == 5000);
+    for (uint32_t i = 15; i < 40; i++) {
+        Enqueue('r', i);
+    }
+    CHECK(FakeTimers_Milliseconds(DrainTimer()) == 0);
+
+    CHECK(SendBatch() == 16);
+    CompleteBatch(true);
+    CHECK(FakeTimers_Milliseconds(DrainTimer()) == 2000);
+    CHECK(SendBatch() == 16);
+
+    // A failed send is retried later with the same records
+    CompleteBatch(false);
+    CHECK(FakeTimers_Milliseconds(DrainTimer()) == 30000);
+    FakeLogstash_SetNetworkReady(false);
+    CHECK(SendBatch() == 0);
+    CHECK(FakeTimers_Milliseconds(DrainTimer()) == 30000);
+    FakeLogstash_SetNetworkReady(true);
+    CHECK(SendBatch() == 16);
+    CompleteBatch(true);
+    CHECK(SendBatch() == 8);
+    CompleteBatch(true);
+    CHECK(!FakeTimers_IsArmed(DrainTimer()));
+    CheckDeliveredReadings(0, 39);
+
+    UploadQueueStats stats;
+    UploadQueue_GetStats(&stats);
+    CHECK(stats.sent == 40);
+    CHECK(stats.requests == 3);
+    CHECK(stats.retries == 2);
+
+    // Large records fill the 4096 byte batch buffer before sixteen records do: five
+    // 800 byte lines are 4005 bytes and a sixth would not fit
+    deliveredCount = 0;
+    for (uint32_t i = 0; i < 12; i++) {
+        CHECK(EnqueuePadded(i, 800));
+    }
+    uint32_t firstRequest = FakeLogstash_Requests();
+    DeliverAll();
+    CHECK(FakeLogstash_Requests() == firstRequest + 3);
+    for (uint32_t i = firstRequest; i < FakeLogstash_Requests(); i++) {
+        CHECK(FakeLogstash_Request(i)->bodyLength <= 4096);
+    }
+    CHECK(FakeLogstash_Request(firstRequest)->bodyLength == 5 * 801);
+    CheckDeliveredReadings(0, 11);
+
+    // Records too large for a slot are refused
+    CHECK(!EnqueuePadded(99, UPLOAD_QUEUE_MAX_BODY + 1));
+
+    UploadQueue_Fini();
+}
+
+static void TestRestart(void)
+{
+    StartQueue(true);
+
+    // A batch that was in flight when the app stopped is sent again after the restart
+    for (uint32_t i = 0; i < 20; i++) {
+        Enqueue('r', i);
+    }
+    CHECK(SendBatch() == 16);
+    RestartQueue();
+    UploadQueueStats stats;
+    UploadQueue_GetStats(&stats);
+    CHECK(stats.depth == 20);
+    CHECK(FakeTimers_Milliseconds(DrainTimer()) == 0);
+    DeliverAll();
+    CheckDeliveredReadings(0, 19);
+
+    // Acknowledged records are not
+    for (uint32_t i = 20; i < 40; i++) {
+        Enqueue('r', i);
+    }
+    CHECK(SendBatch() == 16);
+    CompleteBatch(true);
+    RestartQueue();
+    DeliverAll();
+    CheckDeliveredReadings(36, 39);
+
+    // An empty queue stays empty, and carries on from the same sequence number
+    RestartQueue();
+    UploadQueue_GetStats(&stats);
+    CHECK(stats.depth == 0);
+    CHECK(stats.nextSequence == 40);
+    CHECK(!FakeTimers_IsArmed(DrainTimer()));
+
+    UploadQueue_Fini();
+}
+
+static void TestWrapAround(void)
+{
+    StartQueue(true);
+
+    // Sequence numbers run past the end of the slots several times over
+    for (uint32_t i = 0; i < 150; i += 10) {
+        for (uint32_t j = i; j < i + 10; j++) {
+            Enqueue('r', j);
+        }
+        DeliverAll();
+    }
+    CheckDeliveredReadings(0, 149);
+
+    // A backlog that wraps round the end of the file is recovered in order
+    deliveredCount = 0;
+    for (uint32_t i = 150; i < 200; i++) {
+        Enqueue('r', i);
+    }
+    RestartQueue();
+    DeliverAll();
+    CheckDeliveredReadings(150, 199);
+
+    // Overflowing the queue drops the oldest readings
+    deliveredCount = 0;
+    for (uint32_t i = 200; i < 270; i++) {
+        Enqueue('r', i);
+    }
+    UploadQueueStats stats;
+    UploadQueue_GetStats(&stats);
+    CHECK(stats.depth == QUEUE_CAPACITY);
+    CHECK(stats.dropped == 7);
+    CHECK(stats.droppedReadings == 7);
+    RestartQueue();
+    DeliverAll();
+    CheckDeliveredReadings(207, 269);
+
+    UploadQueue_Fini();
+}
+
+static void TestDamagedSlots(void)
+{
+    StartQueue(true);
+
+    for (uint32_t i = 0; i < 30; i++) {
+        Enqueue('r', i);
+    }
+    uint32_t head = HeadSequence();
+    UploadQueue_Fini();
+
+    // The head record torn half way through a write, leaving the rest of the slot erased,
+    // and a byte changed in one further on
+    CorruptSlot(head, SLOT_SIZE / 2, SLOT_SIZE / 2, 0xff);
+    CorruptSlot(head + 12, 40, 1, 0x5a);
+
+    StartQueue(false);
+    UploadQueueStats stats;
+    UploadQueue_GetStats(&stats);
+    CHECK(HeadSequence() == head + 1);
+    CHECK(stats.depth == 29);
+    DeliverAll();
+
+    // Everything else arrives, in order
+    CHECK(deliveredCount == 28);
+    for (uint32_t i = 0, expected = 1; i < deliveredCount; i++, expected++) {
+        expected += expected == 12 ? 1 : 0;
+        CHECK(deliveredKinds[i] == 'r' && deliveredNumbers[i] == expected);
+    }
+
+    // A header from another format version is an empty queue
+    for (uint32_t i = 0; i < 5; i++) {
+        Enqueue('r', i);
+    }
+    UploadQueue_Fini();
+    int fd = open(storagePath, O_RDWR);
+    uint32_t version = 99;
+    CHECK(pwrite(fd, &version, sizeof(version), sizeof(uint32_t)) == sizeof(version));
+    close(fd);
+    StartQueue(false);
+    UploadQueue_GetStats(&stats);
+    CHECK(stats.depth == 0);
+
+    UploadQueue_Fini();
+}
+
+static void TestTelemetryDroppedFirst(void)
+{
+    StartQueue(true);
+
+    // A full queue with three telemetry records among the readings
+    uint32_t reading = 0;
+    for (uint32_t i = 0; i < QUEUE_CAPACITY; i++) {
+        if (i == 5 || i == 20 || i == 40) {
+            Enqueue('t', i);
+        }
+        else {
+            Enqueue('r', reading++);
+        }
+    }
+
+    // New readings push the telemetry out, not the oldest readings
+    for (uint32_t i = 0; i < 3; i++) {
+        Enqueue('r', reading++);
+    }
+    UploadQueueStats stats;
+    UploadQueue_GetStats(&stats);
+    CHECK(stats.depth == QUEUE_CAPACITY);
+    CHECK(stats.dropped == 3);
+    CHECK(stats.droppedReadings == 0);
+
+    // With only readings left, new telemetry is dropped rather than a reading
+    Enqueue('t', 99);
+    UploadQueue_GetStats(&stats);
+    CHECK(stats.dropped == 4);
+    CHECK(stats.droppedReadings == 0);
+
+    // And a new reading replaces the oldest reading
+    Enqueue('r', reading++);
+    UploadQueue_GetStats(&stats);
+    CHECK(stats.dropped == 5);
+    CHECK(stats.droppedReadings == 1);
+
+    // The records moved up to close the gaps are persisted in their new places
+    RestartQueue();
+    DeliverAll();
+    CheckDeliveredReadings(1, reading - 1);
+
+    UploadQueue_Fini();
+}
+
+static void TestTelemetryDroppedWhileSending(void)
+{
+    StartQueue(true);
+
+    // Telemetry queued behind a batch in flight: the batch moves up a place with the
+    // records before it
+    for (uint32_t i = 0; i < 16; i++) {
+        Enqueue('r', i);
+    }
+    CHECK(SendBatch() == 16);
+    Enqueue('t', 0);
+    for (uint32_t i = 16; i < 63; i++) {
+        Enqueue('r', i);
+    }
+    UploadQueueStats stats;
+    UploadQueue_GetStats(&stats);
+    CHECK(stats.dropped == 1);
+    CompleteBatch(true);
+    DeliverAll();
+    CheckDeliveredReadings(0, 62);
+
+    // Telemetry inside the batch in flight: it is sent anyway, and the readings after it
+    // are neither resent nor skipped
+    deliveredCount = 0;
+    Enqueue('t', 1);
+    for (uint32_t i = 0; i < 15; i++) {
+        Enqueue('r', i);
+    }
+    CHECK(SendBatch() == 16);
+    for (uint32_t i = 15; i < 63; i++) {
+        Enqueue('r', i);
+    }
+    UploadQueue_GetStats(&stats);
+    CHECK(stats.dropped == 2);
+    CHECK(stats.droppedReadings == 0);
+    CompleteBatch(true);
+    DeliverAll();
+    CHECK(deliveredCount == 64);
+    CHECK(deliveredKinds[0] == 't' && deliveredNumbers[0] == 1);
+    for (uint32_t i = 1; i < deliveredCount; i++) {
+        CHECK(deliveredKinds[i] == 'r' && deliveredNumbers[i] == i - 1);
+    }
+
+    UploadQueue_Fini();
+}
+
+int main(void)
+{
+    int fd = mkstemp(storagePath);
+    CHECK(fd != -1);
+    close(fd);
+
+    TestBatchLimits();
+    TestRestart();
+    TestWrapAround();
+    TestDamagedSlots();
+    TestTelemetryDroppedFirst();
+    TestTelemetryDroppedWhileSending();
+
+    unlink(storagePath);
+    return TEST_RESULT();
+}
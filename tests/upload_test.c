@@ -0,0 +1,307 @@
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "barometer.h"
+#include "fake_timers.h"
+#include "geiger.h"
+#include "loop_profiler.h"
+#include "test.h"
+#include "upload.h"
+#include "upload_queue.h"
+
+// upload.c with its timers fired by hand and both clocks under the test's control:
+// clock_gettime is wrapped at link time, so that a window can be ended at an exact time.
+// The upload queue is replaced by a list of what was enqueued, in JSON.
+
+static int64_t monotonicNanoseconds = 100LL * 1000 * 1000 * 1000;
+static int64_t realtimeNanoseconds = 100LL * 1000 * 1000 * 1000; // not set by NTP
+
+int __wrap_clock_gettime(clockid_t clock, struct timespec *time)
+{
+    int64_t nanoseconds = clock == CLOCK_REALTIME ? realtimeNanoseconds : monotonicNanoseconds;
+    time->tv_sec = (time_t)(nanoseconds / (1000 * 1000 * 1000));
+    time->tv_nsec = (long)(nanoseconds % (1000 * 1000 * 1000));
+    return 0;
+}
+
+static void AdvanceMilliseconds(int64_t milliseconds)
+{
+    monotonicNanoseconds += milliseconds * 1000 * 1000;
+    realtimeNanoseconds += milliseconds * 1000 * 1000;
+}
+
+// 2026-10-16T12:00:30Z
+static const int64_t syncedUtcMilliseconds = 1792152030000;
+
+#define MAX_READINGS 256
+
+static char readings[MAX_READINGS][UPLOAD_QUEUE_MAX_BODY + 1];
+static UploadRecordKind readingKinds[MAX_READINGS];
+static uint32_t readingCount;
+
+bool UploadQueue_Enqueue(const char *url, LogstashFormat format, UploadRecordKind kind,
+                         const uint8_t *body, size_t bodyLength)
+{
+    CHECK(format == LogstashFormat_Json);
+    if (readingCount < MAX_READINGS && bodyLength <= UPLOAD_QUEUE_MAX_BODY) {
+        memcpy(readings[readingCount], body, bodyLength);
+        readings[readingCount][bodyLength] = 0;
+        readingKinds[readingCount] = kind;
+        readingCount++;
+    }
+    return true;
+}
+
+void UploadQueue_GetStats(UploadQueueStats *stats)
+{
+    memset(stats, 0, sizeof(*stats));
+}
+
+void Barometer_GetStats(BarometerStats *stats)
+{
+    memset(stats, 0, sizeof(*stats));
+}
+
+const char *Geiger_SensorId(uint32_t counter)
+{
+    return "geiger";
+}
+
+/// <summary>
+/// The readings for a sensor enqueued since the given index.
+/// </summary>
+static uint32_t CountReadings(const char *sensor, uint32_t since)
+{
+    char tag[64];
+    snprintf(tag, sizeof(tag), "{ \"sensor\": \"%s\"", sensor);
+    uint32_t count = 0;
+    for (uint32_t i = since; i < readingCount; i++) {
+        count += strncmp(readings[i], tag, strlen(tag)) == 0 ? 1 : 0;
+    }
+    return count;
+}
+
+/// <summary>
+/// The most recent reading for a sensor, or NULL.
+/// </summary>
+static const char *LastReading(const char *sensor, UploadRecordKind *kind)
+{
+    char tag[64];
+    snprintf(tag, sizeof(tag), "{ \"sensor\": \"%s\"", sensor);
+    for (uint32_t i = readingCount; i-- > 0;) {
+        if (strncmp(readings[i], tag, strlen(tag)) == 0) {
+            *kind = readingKinds[i];
+            return readings[i];
+        }
+    }
+    return NULL;
+}
+
+/// <summary>
+/// Whether the most recent reading for a sensor contains the text.
+/// </summary>
+static bool LastReadingContains(const char *sensor, const char *text)
+{
+    UploadRecordKind kind;
+    const char *reading = LastReading(sensor, &kind);
+    return reading != NULL && strstr(reading, text) != NULL;
+}
+
+static void SetUtcMilliseconds(int64_t milliseconds)
+{
+    realtimeNanoseconds = milliseconds * 1000 * 1000;
+}
+
+/// <summary>
+/// Run the clocks on to the end of the current window and close it, reducing it as the
+/// deferred reduction timer would.
+/// </summary>
+static void EndWindow(void)
+{
+    EventLoopTimer *upload = FakeTimers_Find("upload");
+    CHECK(FakeTimers_IsArmed(upload));
+    AdvanceMilliseconds(FakeTimers_Milliseconds(upload));
+    FakeTimers_Fire(upload);
+
+    EventLoopTimer *reduction = FakeTimers_Find("reduction");
+    if (FakeTimers_IsArmed(reduction)) {
+        FakeTimers_Fire(reduction);
+    }
+}
+
+static void TestDiagnostics(void)
+{
+    static datablock_t dataBlock;
+    SetUtcMilliseconds(syncedUtcMilliseconds);
+    CHECK(Upload_Init(NULL, &dataBlock) == ExitCode_Success);
+
+    EventLoopTimer *poll = CreateEventLoopDisarmedTimer(NULL, NULL);
+    SetEventLoopTimerName(poll, "poll");
+
+    // Nothing per timer, and nothing at all for the first nine windows
+    uint32_t first = readingCount;
+    for (int i = 0; i < 9; i++) {
+        EndWindow();
+    }
+    CHECK(CountReadings("diagnostics", first) == 0);
+    CHECK(CountReadings("poll_timer", first) == 0);
+    CHECK(CountReadings("upload_timer", first) == 0);
+    CHECK(CountReadings("barometer_health", first) == 9);
+    CHECK(CountReadings("upload_queue", first) == 9);
+    CHECK(readingCount - first == 18);
+
+    // The tenth sums every timer's statistics into one telemetry reading
+    const EventLoopTimerStats pollStats = {.dispatches = 600,
+                                           .missedExpirations = 2,
+                                           .latenessHistogram = {500, 50, 20, 10, 10, 5, 4, 1},
+                                           .maxLatenessMicroseconds = 70000};
+    const EventLoopTimerStats uploadStats = {.dispatches = 10,
+                                             .missedExpirations = 1,
+                                             .latenessHistogram = {7, 2, 0, 1, 0, 0, 0, 0},
+                                             .maxLatenessMicroseconds = 1800};
+    FakeTimers_SetStats(poll, &pollStats);
+    FakeTimers_SetStats(FakeTimers_Find("upload"), &uploadStats);
+    EndWindow();
+    CHECK(CountReadings("diagnostics", first) == 1);
+    UploadRecordKind kind;
+    const char *diagnostics = LastReading("diagnostics", &kind);
+    CHECK(diagnostics != NULL && kind == UploadRecordKind_Telemetry);
+    if (diagnostics != NULL) {
+        CHECK(strstr(diagnostics, "\"windows\": 10,") != NULL);
+        CHECK(strstr(diagnostics, "\"timer_dispatches\": 610,") != NULL);
+        CHECK(strstr(diagnostics, "\"timer_missed\": 3,") != NULL);
+        CHECK(strstr(diagnostics, "\"timer_max_lateness_us\": 70000,") != NULL);
+        CHECK(strstr(diagnostics, "\"timer_lateness\": [507, 52, 20, 11, 10, 5, 4, 1]") != NULL);
+    }
+
+    // Reported statistics start again from zero
+    for (int i = 0; i < 10; i++) {
+        EndWindow();
+    }
+    CHECK(CountReadings("diagnostics", first) == 2);
+    diagnostics = LastReading("diagnostics", &kind);
+    CHECK(diagnostics != NULL && strstr(diagnostics, "\"timer_dispatches\": 0,") != NULL);
+
+    DisposeEventLoopTimer(poll);
+    Upload_Fini();
+}
+
+static void TestWindowAlignment(void)
+{
+    static datablock_t dataBlock;
+
+    // Windows end on the minute
+    SetUtcMilliseconds(syncedUtcMilliseconds + 12345);
+    CHECK(Upload_Init(NULL, &dataBlock) == ExitCode_Success);
+    CHECK(FakeTimers_Milliseconds(FakeTimers_Find("upload")) == 17655);
+    EndWindow();
+    CHECK(LastReadingContains("barometer_health", "\"window_start_utc\": \"2026-10-16T12:00:42.345Z\""));
+    CHECK(LastReadingContains("barometer_health", "\"window_end_utc\": \"2026-10-16T12:01:00.000Z\""));
+    CHECK(FakeTimers_Milliseconds(FakeTimers_Find("upload")) == 60000);
+    EndWindow();
+    CHECK(LastReadingContains("barometer_health", "\"window_start_utc\": \"2026-10-16T12:01:00.000Z\""));
+    CHECK(LastReadingContains("barometer_health", "\"window_end_utc\": \"2026-10-16T12:02:00.000Z\""));
+
+    // A clock set back keeps the window open until it reaches the boundary again
+    realtimeNanoseconds -= 2000LL * 1000 * 1000;
+    uint32_t first = readingCount;
+    EndWindow();
+    CHECK(readingCount == first);
+    CHECK(FakeTimers_Milliseconds(FakeTimers_Find("upload")) == 2000);
+    EndWindow();
+    CHECK(LastReadingContains("barometer_health", "\"window_end_utc\": \"2026-10-16T12:03:00.000Z\""));
+    Upload_Fini();
+
+    // Starting just before a boundary, the first window runs on to the next one rather than
+    // lasting a moment; just outside the tolerance it ends at the boundary
+    SetUtcMilliseconds(syncedUtcMilliseconds + 29700);
+    CHECK(Upload_Init(NULL, &dataBlock) == ExitCode_Success);
+    CHECK(FakeTimers_Milliseconds(FakeTimers_Find("upload")) == 60300);
+    Upload_Fini();
+    SetUtcMilliseconds(syncedUtcMilliseconds + 29400);
+    CHECK(Upload_Init(NULL, &dataBlock) == ExitCode_Success);
+    CHECK(FakeTimers_Milliseconds(FakeTimers_Find("upload")) == 600);
+    Upload_Fini();
+}
+
+static void TestUnsyncedClock(void)
+{
+    static datablock_t dataBlock;
+
+    // Before NTP has set the clock, windows run for a minute and have no UTC times
+    SetUtcMilliseconds(100 * 1000);
+    CHECK(Upload_Init(NULL, &dataBlock) == ExitCode_Success);
+    CHECK(FakeTimers_Milliseconds(FakeTimers_Find("upload")) == 60000);
+    EndWindow();
+    CHECK(LastReadingContains("barometer_health", "\"window_start_utc\": null"));
+    CHECK(LastReadingContains("barometer_health", "\"window_end_utc\": null"));
+    CHECK(!LastReadingContains("barometer_health", "1970"));
+    CHECK(FakeTimers_Milliseconds(FakeTimers_Find("upload")) == 60000);
+
+    // Once it has been set, the window in progress ends at its time, and the next one at
+    // the following minute boundary
+    SetUtcMilliseconds(syncedUtcMilliseconds - 20000);
+    EndWindow();
+    CHECK(LastReadingContains("barometer_health", "\"window_start_utc\": null"));
+    CHECK(LastReadingContains("barometer_health", "\"window_end_utc\": \"2026-10-16T12:01:10.000Z\""));
+    CHECK(FakeTimers_Milliseconds(FakeTimers_Find("upload")) == 50000);
+    EndWindow();
+    CHECK(LastReadingContains("barometer_health", "\"window_start_utc\": \"2026-10-16T12:01:10.000Z\""));
+    CHECK(LastReadingContains("barometer_health", "\"window_end_utc\": \"2026-10-16T12:02:00.000Z\""));
+    Upload_Fini();
+}
+
+#if LOOP_PROFILER
+static void TestProfilerDiagnostics(void)
+{
+    static datablock_t dataBlock;
+    CHECK(Upload_Init(NULL, &dataBlock) == ExitCode_Success);
+    LoopProfiler_Reset();
+
+    static LoopProfilerSection poll = {.name = "poll"};
+    static LoopProfilerSection geiger = {.name = "geiger"};
+    int64_t run = LoopProfiler_RunBegin();
+    int64_t start = LoopProfiler_Begin();
+    AdvanceMilliseconds(2);
+    LoopProfiler_End(&poll, start);
+    start = LoopProfiler_Begin();
+    AdvanceMilliseconds(30);
+    LoopProfiler_End(&geiger, start);
+    LoopProfiler_RunEnd(run);
+
+    // Handlers are summed into the diagnostics reading, not uploaded one by one each minute
+    uint32_t first = readingCount;
+    for (int i = 0; i < 10; i++) {
+        EndWindow();
+    }
+    CHECK(CountReadings("event_loop", first) == 0);
+    CHECK(CountReadings("poll_handler", first) == 0);
+    CHECK(CountReadings("geiger_handler", first) == 0);
+    CHECK(CountReadings("diagnostics", first) == 1);
+    CHECK(readingCount - first == 21);
+
+    UploadRecordKind kind;
+    const char *diagnostics = LastReading("diagnostics", &kind);
+    CHECK(diagnostics != NULL && kind == UploadRecordKind_Telemetry);
+    if (diagnostics != NULL) {
+        CHECK(strstr(diagnostics, "\"busy_pct\": ") != NULL);
+        CHECK(strstr(diagnostics, "\"iterations\": 1,") != NULL);
+        CHECK(strstr(diagnostics, "\"handler_max_us\": 30000,") != NULL);
+        CHECK(strstr(diagnostics, "\"handler_time\": [0, 0, 0, 0, 0, 1, 0, 1]") != NULL);
+    }
+
+    Upload_Fini();
+}
+#endif
+
+int main(void)
+{
+    TestDiagnostics();
+    TestWindowAlignment();
+    TestUnsyncedClock();
+#if LOOP_PROFILER
+    TestProfilerDiagnostics();
+#endif
+    return TEST_RESULT();
+}
@@ -0,0 +1,219 @@
+#include <string.h>
+
+#include "timer_wheel.h"
+
+#define SLOT_MASK (TIMER_WHEEL_SLOTS - 1)
+
+// Values of TimerWheelEntry.level for entries that are not in a slot
+#define LEVEL_OVERFLOW 0xfe
+#define LEVEL_EXPIRED 0xff
+
+void TimerWheel_Init(TimerWheel *wheel, uint64_t nowTick)
+{
+    memset(wheel, 0, sizeof(*wheel));
+    wheel->currentTick = nowTick;
+    wheel->expiredTail = &wheel->expired;
+}
+
+static void ListPush(TimerWheelEntry **head, TimerWheelEntry *entry)
+{
+    entry->next = *head;
+    if (*head != NULL) {
+        (*head)->pprev = &entry->next;
+    }
+    *head = entry;
+    entry->pprev = head;
+}
+
+static void ListUnlink(TimerWheelEntry *entry)
+{
+    *entry->pprev = entry->next;
+    if (entry->next != NULL) {
+        entry->next->pprev = entry->pprev;
+    }
+    entry->next = NULL;
+    entry->pprev = NULL;
+}
+
+/// <summary>
+///     Put an entry in the lowest level whose current block contains its expiry.
+/// </summary>
+static void Place(TimerWheel *wheel, TimerWheelEntry *entry)
+{
+    if (entry->expiresTick < wheel->currentTick) {
+        entry->expiresTick = wheel->currentTick;
+    }
+
+    for (uint8_t level = 0; level < TIMER_WHEEL_LEVELS; level++) {
+        unsigned blockShift = TIMER_WHEEL_SLOT_BITS * (level + 1u);
+        if ((entry->expiresTick >> blockShift) == (wheel->currentTick >> blockShift)) {
+            uint8_t slot = (uint8_t)((entry->expiresTick >> (blockShift - TIMER_WHEEL_SLOT_BITS)) & SLOT_MASK);
+            entry->level = level;
+            entry->slot = slot;
+            ListPush(&wheel->slots[level][slot], entry);
+            wheel->occupied[level] |= 1ULL << slot;
+            return;
+        }
+    }
+
+    entry->level = LEVEL_OVERFLOW;
+    ListPush(&wheel->overflow, entry);
+}
+
+void TimerWheel_Insert(TimerWheel *wheel, TimerWheelEntry *entry, uint64_t expiresTick)
+{
+    TimerWheel_Remove(wheel, entry);
+    entry->expiresTick = expiresTick;
+    Place(wheel, entry);
+    wheel->count++;
+}
+
+void TimerWheel_Remove(TimerWheel *wheel, TimerWheelEntry *entry)
+{
+    if (!TimerWheel_IsScheduled(entry)) {
+        return;
+    }
+
+    if (entry->level == LEVEL_EXPIRED && entry->next == NULL) {
+        wheel->expiredTail = entry->pprev;
+    }
+    ListUnlink(entry);
+    if (entry->level < TIMER_WHEEL_LEVELS && wheel->slots[entry->level][entry->slot] == NULL) {
+        wheel->occupied[entry->level] &= ~(1ULL << entry->slot);
+    }
+    wheel->count--;
+}
+
+/// <summary>
+///     Find the next tick at which the wheel has work to do: the expiry of a level 0 slot,
+///     or the start of the block a higher level slot covers, when it has to be cascaded.
+///     Level TIMER_WHEEL_LEVELS stands for the overflow list.
+/// </summary>
+static bool NextEvent(const TimerWheel *wheel, uint64_t *tick, unsigned *level, unsigned *slot)
+{
+    bool found = false;
+    for (unsigned k = 0; k < TIMER_WHEEL_LEVELS; k++) {
+        unsigned shift = TIMER_WHEEL_SLOT_BITS * k;
+        unsigned current = (unsigned)((wheel->currentTick >> shift) & SLOT_MASK);
+        uint64_t candidates = wheel->occupied[k] & (~0ULL << current);
+        if (candidates == 0) {
+            continue;
+        }
+
+        unsigned first = (unsigned)__builtin_ctzll(candidates);
+        uint64_t blockStart = (wheel->currentTick >> (shift + TIMER_WHEEL_SLOT_BITS)) << (shift + TIMER_WHEEL_SLOT_BITS);
+        uint64_t eventTick = blockStart | ((uint64_t)first << shift);
+        // On a tie the higher level goes first, so cascaded entries join the lower slot
+        if (!found || eventTick <= *tick) {
+            *tick = eventTick;
+            *level = k;
+            *slot = first;
+            found = true;
+        }
+    }
+
+    if (wheel->overflow != NULL) {
+        const unsigned topShift = TIMER_WHEEL_SLOT_BITS * TIMER_WHEEL_LEVELS;
+        uint64_t wrapTick = ((wheel->currentTick >> topShift) + 1) << topShift;
+        if (!found || wrapTick <= *tick) {
+            *tick = wrapTick;
+            *level = TIMER_WHEEL_LEVELS;
+            found = true;
+        }
+    }
+    return found;
+}
+
+/// <summary>
+///     Process every event up to nowTick, moving due entries onto the expired list.
+///     Empty stretches are skipped, so the cost depends on the number of occupied slots
+///     rather than on how long the wheel has been idle.
+/// </summary>
+static void Advance(TimerWheel *wheel, uint64_t nowTick)
+{
+    uint64_t tick = 0;
+    unsigned level = 0, slot = 0;
+    while (NextEvent(wheel, &tick, &level, &slot) && tick <= nowTick) {
+        if (tick > wheel->currentTick) {
+            wheel->currentTick = tick;
+        }
+
+        TimerWheelEntry *list;
+        if (level == TIMER_WHEEL_LEVELS) {
+            list = wheel->overflow;
+            wheel->overflow = NULL;
+        }
+        else {
+            list = wheel->slots[level][slot];
+            wheel->slots[level][slot] = NULL;
+            wheel->occupied[level] &= ~(1ULL << slot);
+        }
+
+        while (list != NULL) {
+            TimerWheelEntry *entry = list;
+            list = entry->next;
+            entry->next = NULL;
+            if (level == 0) {
+                entry->level = LEVEL_EXPIRED;
+                entry->pprev = wheel->expiredTail;
+                *wheel->expiredTail = entry;
+                wheel->expiredTail = &entry->next;
+            }
+            else {
+                Place(wheel, entry);
+            }
+        }
+    }
+
+    if (wheel->currentTick <= nowTick) {
+        wheel->currentTick = nowTick + 1;
+    }
+}
+
+static uint64_t ListMinimum(const TimerWheelEntry *list)
+{
+    uint64_t minimum = UINT64_MAX;
+    for (; list != NULL; list = list->next) {
+        if (list->expiresTick < minimum) {
+            minimum = list->expiresTick;
+        }
+    }
+    return minimum;
+}
+
+bool TimerWheel_NextExpiry(const TimerWheel *wheel, uint64_t *tick)
+{
+    if (wheel->expired != NULL) {
+        *tick = wheel->expired->expiresTick;
+        return true;
+    }
+
+    // Only the first occupied slot of each level can hold that level's earliest entry
+    uint64_t earliest = ListMinimum(wheel->overflow);
+    for (unsigned k = 0; k < TIMER_WHEEL_LEVELS; k++) {
+        unsigned current = (unsigned)((wheel->currentTick >> (TIMER_WHEEL_SLOT_BITS * k)) & SLOT_MASK);
+        uint64_t candidates = wheel->occupied[k] & (~0ULL << current);
+        if (candidates != 0) {
+            uint64_t minimum = ListMinimum(wheel->slots[k][__builtin_ctzll(candidates)]);
+            if (minimum < earliest) {
+                earliest = minimum;
+            }
+        }
+    }
+
+    *tick = earliest;
+    return earliest != UINT64_MAX;
+}
+
+TimerWheelEntry *TimerWheel_Expire(TimerWheel *wheel, uint64_t nowTick)
+{
+    if (wheel->expired == NULL) {
+        Advance(wheel, nowTick);
+    }
+
+    TimerWheelEntry *entry = wheel->expired;
+    if (entry != NULL) {
+        TimerWheel_Remove(wheel, entry);
+    }
+    return entry;
+}
@@ -0,0 +1,73 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Each level has 64 slots, so one 64-bit word records which slots are occupied. Four
+// levels cover 2^24 ticks (about 4.7 hours at 1 ms); anything further out waits in an
+// overflow list until the top level wraps.
+#define TIMER_WHEEL_LEVELS 4
+#define TIMER_WHEEL_SLOT_BITS 6
+#define TIMER_WHEEL_SLOTS (1 << TIMER_WHEEL_SLOT_BITS)
+
+/// <summary>
+/// Link embedded in whatever is being scheduled. Entries form intrusive lists with a
+/// back-pointer to the previous link, so removal is O(1) and a slot head is one pointer.
+/// </summary>
+typedef struct TimerWheelEntry {
+    struct TimerWheelEntry *next;
+    struct TimerWheelEntry **pprev; // NULL when the entry is not scheduled
+    uint64_t expiresTick;
+    uint8_t level; // slot position, or one of the list markers in timer_wheel.c
+    uint8_t slot;
+} TimerWheelEntry;
+
+/// <summary>
+/// Hierarchical timing wheel (Varghese and Lauck). Level k holds entries that expire in
+/// a later 64^k-tick block of the current 64^(k+1)-tick block; they are cascaded down a
+/// level when their block starts. Insert and remove are O(1), and finding the next expiry
+/// is a bit scan per level plus a walk of one slot.
+///
+/// Ticks are an absolute, caller-defined clock. The wheel never reads a clock itself.
+/// </summary>
+typedef struct TimerWheel {
+    uint64_t currentTick; // first tick not yet processed
+    uint64_t occupied[TIMER_WHEEL_LEVELS];
+    TimerWheelEntry *slots[TIMER_WHEEL_LEVELS][TIMER_WHEEL_SLOTS];
+    TimerWheelEntry *overflow;
+    TimerWheelEntry *expired; // due entries waiting to be taken by TimerWheel_Expire, in order
+    TimerWheelEntry **expiredTail;
+    size_t count;             // scheduled entries, including expired ones not yet taken
+} TimerWheel;
+
+void TimerWheel_Init(TimerWheel *wheel, uint64_t nowTick);
+
+/// <summary>
+/// Schedule an entry, moving it if it is already scheduled. A tick that has already been
+/// processed means "as soon as possible".
+/// </summary>
+void TimerWheel_Insert(TimerWheel *wheel, TimerWheelEntry *entry, uint64_t expiresTick);
+
+/// <summary>
+/// Unschedule an entry. Safe to call on an entry that is not scheduled.
+/// </summary>
+void TimerWheel_Remove(TimerWheel *wheel, TimerWheelEntry *entry);
+
+static inline bool TimerWheel_IsScheduled(const TimerWheelEntry *entry)
+{
+    return entry->pprev != NULL;
+}
+
+/// <summary>
+/// Earliest tick at which an entry is due.
+/// </summary>
+/// <returns>false if nothing is scheduled.</returns>
+bool TimerWheel_NextExpiry(const TimerWheel *wheel, uint64_t *tick);
+
+/// <summary>
+/// Take one entry that is due at or before nowTick, in expiry order. The entry is
+/// unscheduled before it is returned, so the caller may reinsert it.
+/// </summary>
+/// <returns>NULL once nothing more is due.</returns>
+TimerWheelEntry *TimerWheel_Expire(TimerWheel *wheel, uint64_t nowTick);
@@ -5,6 +5,7 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <math.h>
+#include <time.h>
 
 // applibs_versions.h defines the API struct versions to use for applibs APIs.
 #include "applibs_versions.h"
@@ -14,68 +15,541 @@
 #include "eventloop_timer_utilities.h"
 #include "log_utils.h"
 
+#include "barometer.h"
+#include "geiger.h"
 #include "logstash.h"
+#include "loop_profiler.h"
+#include "reading.h"
 #include "upload.h"
+#include "upload_queue.h"
+
+// All readings go to one endpoint, tagged by sensor, so that the upload queue can batch
+// them into a single request. The wire format is chosen per endpoint; CBOR needs the
+// cbor codec on the Logstash input.
+static const struct {
+    const char *url;
+    LogstashFormat format;
+} readingsEndpoint = {.url = "https://logstash.saintgimp.org/readings", .format = LogstashFormat_Json};
+
+// Reduce finished windows from a separate zero-delay timer rather than in the upload tick
+static const bool deferReduction = true;
+
+// Windows close on wall-clock minute boundaries, so that readings from different stations
+// cover the same minutes
+static const int64_t windowMilliseconds = 60 * 1000;
+
+// A boundary this close is treated as reached, so that timer slack and clock slewing
+// don't leave sliver windows
+static const int64_t alignmentToleranceMilliseconds = 500;
+
+// Event loop diagnostics are summed over this many windows and uploaded as one reading
+static const uint32_t diagnosticsWindows = 10;
+
+// Wall clock times before 2020-01-01 mean the clock has not been set by NTP yet
+static const time_t earliestValidWallClock = 1577836800;
+
+static uint8_t alertBuffer[768];
+static size_t alertLength = 0;
+static bool alertInFlight = false;
 
 static datablock_t* dataBlock = NULL;
+static uint32_t finishedWindow = 0;
 static EventLoopTimer *uploadTimer = NULL;
+static EventLoopTimer *reductionTimer = NULL;
+static int64_t windowEndUtcMilliseconds = 0; // boundary the upload timer is armed for; 0 if unaligned
+static int64_t wallClockOffsetMilliseconds = 0; // UTC minus monotonic time at the last window end
+static uint32_t windowsSinceDiagnostics = 0;
 static EventLoop *eventLoop = NULL; // not owned
 
-static int qsort_comp(const void* elem1, const void* elem2)
+static size_t EncodeReading(const char *sensor, const ReadingField *fields, size_t fieldCount,
+                            uint8_t *buffer, size_t bufferSize)
 {
-    int f = *((int*)elem1);
-    int s = *((int*)elem2);
-    if (f > s) return  1;
-    if (f < s) return -1;
-    return 0;
+    size_t length = Reading_Encode(readingsEndpoint.format, sensor, fields, fieldCount, buffer,
+                                   bufferSize - 1);
+    if (length == 0) {
+        Log_Debug("ERROR: %s reading does not fit in the upload buffer\n", sensor);
+        return 0;
+    }
+
+    if (readingsEndpoint.format == LogstashFormat_Json) {
+        buffer[length] = 0;
+        Log_Debug("%s\n", (char *)buffer);
+    }
+    else {
+        Log_Debug("Encoded %s reading in %zu bytes\n", sensor, length);
+    }
+    return length;
 }
 
-static void UploadTimerEventHandler(EventLoopTimer *timer)
+static void EnqueueReading(const char *sensor, UploadRecordKind kind, const ReadingField *fields,
+                           size_t fieldCount)
 {
-    char buffer[256];
+    uint8_t buffer[768];
 
-    if (ConsumeEventLoopTimerEvent(timer) != 0) {
-        LogErrno("ERROR: cannot consume the timer event");
+    size_t length = EncodeReading(sensor, fields, fieldCount, buffer, sizeof(buffer));
+    if (length != 0) {
+        UploadQueue_Enqueue(readingsEndpoint.url, readingsEndpoint.format, kind, buffer, length);
+    }
+}
+
+static void AlertSendCompleteCallback(bool succeeded, void *context)
+{
+    if (!succeeded) {
+        // Don't lose it; the queue will retry
+        Log_Debug("Alert upload failed, queueing it\n");
+        UploadQueue_Enqueue(readingsEndpoint.url, readingsEndpoint.format, UploadRecordKind_Reading,
+                            alertBuffer, alertLength);
+    }
+    alertInFlight = false;
+}
+
+void Upload_SendAlert(const char *sensor, const ReadingField *fields, size_t fieldCount)
+{
+    // Only one alert is sent directly at a time; the buffer has to outlive the transfer
+    // in case it fails and needs queueing
+    if (alertInFlight) {
+        EnqueueReading(sensor, UploadRecordKind_Reading, fields, fieldCount);
         return;
     }
 
-    Log_Debug("Uploading data\n");
+    alertLength = EncodeReading(sensor, fields, fieldCount, alertBuffer, sizeof(alertBuffer));
+    if (alertLength == 0) {
+        return;
+    }
+
+    // NDJSON bodies end every record with a newline, as the queue's batches do. The record
+    // is queued without it if the send fails, since the queue adds its own. EncodeReading
+    // leaves room for it.
+    size_t sendLength = alertLength;
+    if (readingsEndpoint.format == LogstashFormat_Json) {
+        alertBuffer[sendLength++] = '\n';
+    }
 
-    if (dataBlock->cpmMessagesReceived >= 59) {
+    if (SendToLogstash(readingsEndpoint.url, readingsEndpoint.format, alertBuffer, sendLength,
+                       AlertSendCompleteCallback, NULL)) {
+        alertInFlight = true;
+    }
+    else {
+        UploadQueue_Enqueue(readingsEndpoint.url, readingsEndpoint.format, UploadRecordKind_Reading,
+                            alertBuffer, alertLength);
+    }
+}
+
+static int64_t GetMonotonicNanoseconds(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (int64_t)now.tv_sec * 1000 * 1000 * 1000 + now.tv_nsec;
+}
+
+int64_t Upload_GetUtcMilliseconds(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_REALTIME, &now);
+    if (now.tv_sec < earliestValidWallClock) {
+        return 0;
+    }
+    return (int64_t)now.tv_sec * 1000 + now.tv_nsec / (1000 * 1000);
+}
+
+static double NanosecondsToSeconds(int64_t nanoseconds)
+{
+    return (double)nanoseconds / (1000 * 1000 * 1000);
+}
+
+static void ReduceGeigerWindow(uint32_t counter, const GeigerWindow *window)
+{
+    if (window->cpmMessagesReceived >= 59) {
         // Geiger counter has been running for a full minute
         // (allow one missing message to account for timing mismatch)
-        snprintf(buffer, sizeof(buffer), "{ \"cpm\": %d }", dataBlock->cpm);
-        Log_Debug("%s\n", buffer);
-        SendToLogstash("https://logstash.saintgimp.org/geiger", buffer);
+        // The counter's own averages, followed by ours over each sliding window
+        ReadingField fields[7 + 5 * CountRateWindow_Count] = {
+            {.name = "cpm", .value = window->cpm},
+            {.name = "usv_per_hour", .value = window->nanosievertsPerHour / 1000.0, .decimals = 3},
+            {.name = "samples", .value = window->cpmMessagesReceived},
+            {.name = "window_start", .value = NanosecondsToSeconds(window->startNanoseconds), .decimals = 3},
+            {.name = "window_end", .value = NanosecondsToSeconds(window->endNanoseconds), .decimals = 3},
+            {.name = "window_start_utc", .type = ReadingFieldType_Timestamp, .integer = window->startUtcMilliseconds},
+            {.name = "window_end_utc", .type = ReadingFieldType_Timestamp, .integer = window->endUtcMilliseconds}};
+        size_t fieldCount = 7;
+
+        static const char *const rateFieldNames[CountRateWindow_Count][5] = {
+            [CountRateWindow_Minute] = {"cpm_1m", "cpm_1m_low", "cpm_1m_high", "usv_1m", "coverage_1m"},
+            [CountRateWindow_TenMinutes] = {"cpm_10m", "cpm_10m_low", "cpm_10m_high", "usv_10m", "coverage_10m"},
+            [CountRateWindow_Hour] = {"cpm_1h", "cpm_1h_low", "cpm_1h_high", "usv_1h", "coverage_1h"},
+        };
+        for (int w = 0; w < CountRateWindow_Count; w++) {
+            CountRateEstimate estimate;
+            CountRate_GetEstimate(&dataBlock->countRate[counter], (CountRateWindow)w, &estimate);
+            const char *const *names = rateFieldNames[w];
+            fields[fieldCount++] = (ReadingField){.name = names[0], .value = estimate.cpm, .decimals = 2};
+            fields[fieldCount++] = (ReadingField){.name = names[1], .value = estimate.cpmLow, .decimals = 2};
+            fields[fieldCount++] = (ReadingField){.name = names[2], .value = estimate.cpmHigh, .decimals = 2};
+            fields[fieldCount++] = (ReadingField){.name = names[3], .value = estimate.microsievertsPerHour, .decimals = 4};
+            fields[fieldCount++] = (ReadingField){.name = names[4], .value = estimate.coverage, .decimals = 3};
+        }
+        EnqueueReading(Geiger_SensorId(counter), UploadRecordKind_Reading, fields, fieldCount);
     }
     else {
         // Geiger counter is probably not running
-        Log_Debug("cpm not valid\n");
+        Log_Debug("%s cpm not valid\n", Geiger_SensorId(counter));
     }
-    dataBlock->cpmMessagesReceived = 0;
+}
 
-    if (dataBlock->pressureSamplesReceived >= 590)
+static void ReducePressureWindow(const PressureWindow *window)
+{
+    const Aggregate *samples = &window->samples;
+    uint32_t expectedSamples = window->samplesPerMinute;
+    if (expectedSamples != 0 && samples->count >= expectedSamples - expectedSamples / 60)
     {
         // Pressure sensor has been running for a full minute
-        // (allow a few missing samples to account for timing mismatch)
-        // TODO: the logic to turn the sample set into final numbers should live
-        // in the pressure module
-        qsort(dataBlock->pressureSamples, dataBlock->pressureSamplesReceived, sizeof(*dataBlock->pressureSamples), qsort_comp);
-        uint32_t pressure = dataBlock->pressureSamples[dataBlock->pressureSamplesReceived / 2];
+        // (allow a second's worth of missing samples to account for timing mismatch)
+        uint32_t pressure = (uint32_t)lround(Aggregate_Median(samples));
         float altitude_meters = 95;
         uint32_t seaLevelPressure = (uint32_t)(pressure / pow(1.0 - altitude_meters / 44330, 5.255));
-        
-        snprintf(buffer, sizeof(buffer), "{ \"pressure\": %d, \"sea_level_pressure\": %d }", pressure, seaLevelPressure);
-        Log_Debug("%s\n", buffer);
-        SendToLogstash("https://logstash.saintgimp.org/pressure", buffer);
 
-        Log_Debug("Number of pressure samples = %d\n", dataBlock->pressureSamplesReceived);
+        ReadingField fields[21] = {{.name = "pressure", .value = pressure},
+                                       {.name = "sea_level_pressure", .value = seaLevelPressure},
+                                       {.name = "pressure_min", .value = samples->min},
+                                       {.name = "pressure_max", .value = samples->max},
+                                       {.name = "pressure_p10", .value = Aggregate_Percentile(samples, 0), .decimals = 1},
+                                       {.name = "pressure_p90", .value = Aggregate_Percentile(samples, 1), .decimals = 1},
+                                       {.name = "pressure_mean", .value = Aggregate_Mean(samples), .decimals = 1},
+                                       {.name = "pressure_stddev", .value = Aggregate_StandardDeviation(samples), .decimals = 2},
+                                       {.name = "samples", .value = samples->count},
+                                       {.name = "median_exact", .value = Aggregate_IsExact(samples)},
+                                       {.name = "window_start", .value = NanosecondsToSeconds(window->startNanoseconds), .decimals = 3},
+                                       {.name = "window_end", .value = NanosecondsToSeconds(window->endNanoseconds), .decimals = 3},
+                                       {.name = "window_start_utc", .type = ReadingFieldType_Timestamp, .integer = window->startUtcMilliseconds},
+                                       {.name = "window_end_utc", .type = ReadingFieldType_Timestamp, .integer = window->endUtcMilliseconds},
+                                       {.name = "sample_interval_ms", .value = window->sampleIntervalMilliseconds},
+                                       {.name = "rejected_bus", .value = window->rejectedSamples[SampleQuality_BusError]},
+                                       {.name = "rejected_range", .value = window->rejectedSamples[SampleQuality_OutOfRange]},
+                                       {.name = "rejected_stale", .value = window->rejectedSamples[SampleQuality_Stale]}};
+        size_t fieldCount = 18;
+
+        // Adaptive sampling decisions, for sensors that have them
+        if (window->oversampling >= 0) {
+            fields[fieldCount++] = (ReadingField){.name = "oversampling", .value = window->oversampling};
+            fields[fieldCount++] = (ReadingField){.name = "noise_pa", .value = window->noisePascals, .decimals = 2};
+            fields[fieldCount++] = (ReadingField){.name = "sampling_changes", .value = window->samplingChanges};
+        }
+        EnqueueReading("pressure", UploadRecordKind_Reading, fields, fieldCount);
+
+        Log_Debug("Number of pressure samples = %d\n", samples->count);
     }
     else {
         // Pressure sensor is probably not running
         Log_Debug("Pressure not valid\n");
     }
-    dataBlock->pressureSamplesReceived = 0;
+}
+
+static void ReduceTemperatureWindow(const PressureWindow *window)
+{
+    const Aggregate *temperature = &window->temperature;
+    if (temperature->count > 0) {
+        const ReadingField fields[] = {{.name = "temperature", .value = Aggregate_Mean(temperature), .decimals = 2},
+                                       {.name = "temperature_min", .value = temperature->min, .decimals = 1},
+                                       {.name = "temperature_max", .value = temperature->max, .decimals = 1},
+                                       {.name = "samples", .value = temperature->count},
+                                       {.name = "window_start", .value = NanosecondsToSeconds(window->startNanoseconds), .decimals = 3},
+                                       {.name = "window_end", .value = NanosecondsToSeconds(window->endNanoseconds), .decimals = 3},
+                                       {.name = "window_start_utc", .type = ReadingFieldType_Timestamp, .integer = window->startUtcMilliseconds},
+                                       {.name = "window_end_utc", .type = ReadingFieldType_Timestamp, .integer = window->endUtcMilliseconds}};
+        EnqueueReading("temperature", UploadRecordKind_Reading, fields, sizeof(fields) / sizeof(fields[0]));
+    }
+    else {
+        Log_Debug("Temperature not valid\n");
+    }
+}
+
+/// <summary>
+///     Report the barometer's bus health every minute, including minutes where the sensor
+///     was missing and no pressure reading could be sent.
+/// </summary>
+static void ReduceBarometerHealth(const PressureWindow *window)
+{
+    BarometerStats stats;
+    Barometer_GetStats(&stats);
+
+    const ReadingField fields[] = {{.name = "connected", .value = stats.connected},
+                                   {.name = "bus_errors", .value = stats.busErrors},
+                                   {.name = "sensor_losses", .value = stats.sensorLosses},
+                                   {.name = "recoveries", .value = stats.recoveries},
+                                   {.name = "probe_attempts", .value = stats.probeAttempts},
+                                   {.name = "rejected_bus", .value = window->rejectedSamples[SampleQuality_BusError]},
+                                   {.name = "rejected_range", .value = window->rejectedSamples[SampleQuality_OutOfRange]},
+                                   {.name = "rejected_stale", .value = window->rejectedSamples[SampleQuality_Stale]},
+                                   {.name = "window_start", .value = NanosecondsToSeconds(window->startNanoseconds), .decimals = 3},
+                                   {.name = "window_end", .value = NanosecondsToSeconds(window->endNanoseconds), .decimals = 3},
+                                   {.name = "window_start_utc", .type = ReadingFieldType_Timestamp, .integer = window->startUtcMilliseconds},
+                                   {.name = "window_end_utc", .type = ReadingFieldType_Timestamp, .integer = window->endUtcMilliseconds}};
+    EnqueueReading("barometer_health", UploadRecordKind_Telemetry, fields, sizeof(fields) / sizeof(fields[0]));
+}
+
+/// <summary>
+///     Report the upload queue's backlog and delivery counters, so that connectivity gaps
+///     and dropped readings are visible server side once the backlog gets through.
+/// </summary>
+static void ReduceUploadQueue(void)
+{
+    UploadQueueStats stats;
+    UploadQueue_GetStats(&stats);
+
+    const ReadingField fields[] = {{.name = "depth", .value = stats.depth},
+                                   {.name = "bytes", .value = stats.bytes},
+                                   {.name = "dropped", .value = stats.dropped},
+                                   {.name = "dropped_readings", .value = stats.droppedReadings},
+                                   {.name = "retries", .value = stats.retries},
+                                   {.name = "sent", .value = stats.sent},
+                                   {.name = "requests", .value = stats.requests},
+                                   {.name = "bytes_sent", .value = stats.bytesSent}};
+    EnqueueReading("upload_queue", UploadRecordKind_Telemetry, fields, sizeof(fields) / sizeof(fields[0]));
+}
+
+/// <summary>
+///     Timer dispatch statistics summed over every named timer.
+/// </summary>
+typedef struct TimerDiagnostics {
+    uint32_t dispatches;
+    uint32_t missedExpirations;
+    uint32_t maxLatenessMicroseconds;
+    double latenessHistogram[EVENT_LOOP_TIMER_LATENESS_BUCKETS];
+} TimerDiagnostics;
+
+static void SumTimerStats(EventLoopTimer *timer, const char *name, const EventLoopTimerStats *stats,
+                          void *context)
+{
+    TimerDiagnostics *totals = context;
+    if (stats->dispatches != 0) {
+        Log_Debug("%s timer: %u dispatches, %u missed, up to %u us late\n", name,
+                  stats->dispatches, stats->missedExpirations, stats->maxLatenessMicroseconds);
+    }
+
+    totals->dispatches += stats->dispatches;
+    totals->missedExpirations += stats->missedExpirations;
+    if (stats->maxLatenessMicroseconds > totals->maxLatenessMicroseconds) {
+        totals->maxLatenessMicroseconds = stats->maxLatenessMicroseconds;
+    }
+    for (size_t i = 0; i < EVENT_LOOP_TIMER_LATENESS_BUCKETS; i++) {
+        totals->latenessHistogram[i] += stats->latenessHistogram[i];
+    }
+    ResetEventLoopTimerStats(timer);
+}
+
+#if LOOP_PROFILER
+/// <summary>
+///     Handler execution times summed over every profiled section.
+/// </summary>
+typedef struct ProfilerDiagnostics {
+    uint32_t calls;
+    int64_t maxNanoseconds;
+    double histogram[LOOP_PROFILER_BUCKETS];
+} ProfilerDiagnostics;
+
+static void SumProfilerSection(const LoopProfilerSection *section, void *context)
+{
+    if (section->calls == 0) {
+        return;
+    }
+
+    ProfilerDiagnostics *totals = context;
+    Log_Debug("%s handler: %u calls, %lld us in total, up to %lld us\n", section->name,
+              section->calls, (long long)(section->totalNanoseconds / 1000),
+              (long long)(section->maxNanoseconds / 1000));
+
+    totals->calls += section->calls;
+    if (section->maxNanoseconds > totals->maxNanoseconds) {
+        totals->maxNanoseconds = section->maxNanoseconds;
+    }
+    for (size_t i = 0; i < LOOP_PROFILER_BUCKETS; i++) {
+        totals->histogram[i] += section->histogram[i];
+    }
+}
+#endif
+
+/// <summary>
+///     Upload one telemetry reading summing up how the event loop kept time since the last
+///     one, and with LOOP_PROFILER how busy its handlers kept it. Per-timer and per-handler
+///     figures only go to the debug log. The lateness histogram counts dispatches in the
+///     buckets of EventLoopTimerLatenessBucketMicroseconds, the handler histogram calls in
+///     those of LoopProfilerBucketMicroseconds.
+/// </summary>
+static void ReduceDiagnostics(void)
+{
+    TimerDiagnostics timers = {0};
+    ForEachEventLoopTimer(eventLoop, SumTimerStats, &timers);
+
+    ReadingField fields[9] = {
+        {.name = "windows", .value = diagnosticsWindows},
+        {.name = "timer_dispatches", .value = timers.dispatches},
+        {.name = "timer_missed", .value = timers.missedExpirations},
+        {.name = "timer_max_lateness_us", .value = timers.maxLatenessMicroseconds},
+        {.name = "timer_lateness", .type = ReadingFieldType_Array, .values = timers.latenessHistogram,
+         .valueCount = EVENT_LOOP_TIMER_LATENESS_BUCKETS}};
+    size_t fieldCount = 5;
+
+#if LOOP_PROFILER
+    LoopProfilerSummary summary;
+    LoopProfiler_GetSummary(&summary);
+    ProfilerDiagnostics handlers = {0};
+    LoopProfiler_ForEachSection(SumProfilerSection, &handlers);
+    LoopProfiler_Reset();
+
+    if (summary.wallNanoseconds > 0) {
+        fields[fieldCount++] = (ReadingField){
+            .name = "busy_pct",
+            .value = 100.0 * (double)summary.busyNanoseconds / (double)summary.wallNanoseconds,
+            .decimals = 3};
+        fields[fieldCount++] = (ReadingField){.name = "iterations", .value = summary.iterations};
+        fields[fieldCount++] =
+            (ReadingField){.name = "handler_max_us", .value = (double)(handlers.maxNanoseconds / 1000)};
+        fields[fieldCount++] = (ReadingField){.name = "handler_time",
+                                              .type = ReadingFieldType_Array,
+                                              .values = handlers.histogram,
+                                              .valueCount = LOOP_PROFILER_BUCKETS};
+    }
+#endif
+
+    EnqueueReading("diagnostics", UploadRecordKind_Telemetry, fields, fieldCount);
+}
+
+static void ReduceFinishedWindows(void)
+{
+    for (uint32_t i = 0; i < GEIGER_COUNT; i++) {
+        ReduceGeigerWindow(i, &dataBlock->geiger[finishedWindow][i]);
+    }
+    ReducePressureWindow(&dataBlock->pressure[finishedWindow]);
+    ReduceTemperatureWindow(&dataBlock->pressure[finishedWindow]);
+    ReduceBarometerHealth(&dataBlock->pressure[finishedWindow]);
+    ReduceUploadQueue();
+
+    if (++windowsSinceDiagnostics == diagnosticsWindows) {
+        windowsSinceDiagnostics = 0;
+        ReduceDiagnostics();
+    }
+}
+
+static void ReductionTimerEventHandler(EventLoopTimer *timer)
+{
+    if (ConsumeEventLoopTimerEvent(timer) != 0) {
+        LogErrno("ERROR: cannot consume the timer event");
+        return;
+    }
+
+    ReduceFinishedWindows();
+}
+
+/// <summary>
+///     Close the active windows and open fresh ones in their place. This is O(1): the
+///     spare windows are reset and the active index flipped, so producers never pause.
+/// </summary>
+static void SwapWindows(int64_t now, int64_t nowUtcMilliseconds)
+{
+    uint32_t active = atomic_load_explicit(&dataBlock->activeWindow, memory_order_relaxed);
+    uint32_t next = active ^ 1;
+
+    for (uint32_t i = 0; i < GEIGER_COUNT; i++) {
+        GeigerWindow *geiger = &dataBlock->geiger[next][i];
+        geiger->startNanoseconds = now;
+        geiger->endNanoseconds = 0;
+        geiger->startUtcMilliseconds = nowUtcMilliseconds;
+        geiger->endUtcMilliseconds = 0;
+        geiger->cpm = 0;
+        geiger->nanosievertsPerHour = 0;
+        geiger->cpmMessagesReceived = 0;
+    }
+
+    PressureWindow *pressure = &dataBlock->pressure[next];
+    pressure->startNanoseconds = now;
+    pressure->endNanoseconds = 0;
+    pressure->startUtcMilliseconds = nowUtcMilliseconds;
+    pressure->endUtcMilliseconds = 0;
+    Aggregate_Reset(&pressure->samples);
+    Aggregate_Reset(&pressure->temperature);
+    pressure->samplesPerMinute = 0;
+    pressure->samplingChanges = 0;
+    memset(pressure->rejectedSamples, 0, sizeof(pressure->rejectedSamples));
+
+    atomic_store_explicit(&dataBlock->activeWindow, next, memory_order_release);
+
+    for (uint32_t i = 0; i < GEIGER_COUNT; i++) {
+        dataBlock->geiger[active][i].endNanoseconds = now;
+        dataBlock->geiger[active][i].endUtcMilliseconds = nowUtcMilliseconds;
+    }
+    dataBlock->pressure[active].endNanoseconds = now;
+    dataBlock->pressure[active].endUtcMilliseconds = nowUtcMilliseconds;
+    finishedWindow = active;
+}
+
+static void ArmUploadTimer(int64_t delayMilliseconds)
+{
+    const struct timespec delay = {.tv_sec = (time_t)(delayMilliseconds / 1000),
+                                   .tv_nsec = (long)(delayMilliseconds % 1000) * 1000 * 1000};
+    if (SetEventLoopTimerOneShot(uploadTimer, &delay) != 0) {
+        LogErrno("ERROR: could not schedule the end of the measurement window");
+    }
+}
+
+/// <summary>
+///     Arm the upload timer for the next wall-clock minute boundary. Until NTP has set the
+///     clock, windows simply run for a minute; they fall into line at the first boundary
+///     after it has been set.
+/// </summary>
+static void ScheduleWindowEnd(int64_t nowUtcMilliseconds)
+{
+    if (nowUtcMilliseconds == 0) {
+        windowEndUtcMilliseconds = 0;
+        ArmUploadTimer(windowMilliseconds);
+        return;
+    }
+
+    windowEndUtcMilliseconds =
+        ((nowUtcMilliseconds + alignmentToleranceMilliseconds) / windowMilliseconds + 1) * windowMilliseconds;
+    ArmUploadTimer(windowEndUtcMilliseconds - nowUtcMilliseconds);
+}
+
+static void UploadTimerEventHandler(EventLoopTimer *timer)
+{
+    if (ConsumeEventLoopTimerEvent(timer) != 0) {
+        LogErrno("ERROR: cannot consume the timer event");
+        return;
+    }
+
+    // The timer runs on monotonic time, so a wall clock correction since it was armed
+    // shows up as a change in the offset between the two clocks
+    int64_t now = GetMonotonicNanoseconds();
+    int64_t nowUtc = Upload_GetUtcMilliseconds();
+    int64_t offset = nowUtc == 0 ? 0 : nowUtc - now / (1000 * 1000);
+    if (nowUtc != 0 && wallClockOffsetMilliseconds != 0 &&
+        llabs(offset - wallClockOffsetMilliseconds) > alignmentToleranceMilliseconds) {
+        Log_Debug("Wall clock moved by %lld ms, re-aligning the measurement windows\n",
+                  (long long)(offset - wallClockOffsetMilliseconds));
+    }
+    wallClockOffsetMilliseconds = offset;
+
+    if (windowEndUtcMilliseconds != 0 && nowUtc != 0 &&
+        nowUtc < windowEndUtcMilliseconds - alignmentToleranceMilliseconds &&
+        windowEndUtcMilliseconds - nowUtc <= windowMilliseconds) {
+        // The clock was set back; keep the window open until it reaches the boundary
+        ArmUploadTimer(windowEndUtcMilliseconds - nowUtc);
+        return;
+    }
+
+    Log_Debug("Uploading data\n");
+
+    SwapWindows(now, nowUtc);
+    ScheduleWindowEnd(nowUtc);
+
+    if (deferReduction) {
+        // Let any I/O that is already pending run before the reduction
+        static const struct timespec soon = {.tv_sec = 0, .tv_nsec = 1};
+        if (SetEventLoopTimerOneShot(reductionTimer, &soon) == 0) {
+            return;
+        }
+    }
+
+    ReduceFinishedWindows();
 }
 
 ExitCode Upload_Init(EventLoop *eventLoopInstance, datablock_t * dataBlockInstance)
@@ -83,13 +557,33 @@ ExitCode Upload_Init(EventLoop *eventLoopInstance, datablock_t * dataBlockInstan
     eventLoop = eventLoopInstance;
     dataBlock = dataBlockInstance;
 
-    static const struct timespec uploadInterval = {.tv_sec = 60, .tv_nsec = 0};
-    uploadTimer = CreateEventLoopPeriodicTimer(eventLoop, &UploadTimerEventHandler,
-                                                    &uploadInterval);
+    int64_t now = GetMonotonicNanoseconds();
+    int64_t nowUtc = Upload_GetUtcMilliseconds();
+    for (size_t i = 0; i < 2; i++) {
+        for (uint32_t j = 0; j < GEIGER_COUNT; j++) {
+            dataBlock->geiger[i][j].startNanoseconds = now;
+            dataBlock->geiger[i][j].startUtcMilliseconds = nowUtc;
+        }
+        dataBlock->pressure[i].startNanoseconds = now;
+        dataBlock->pressure[i].startUtcMilliseconds = nowUtc;
+    }
+    wallClockOffsetMilliseconds = nowUtc == 0 ? 0 : nowUtc - now / (1000 * 1000);
+    windowsSinceDiagnostics = 0;
+
+    reductionTimer = CreateEventLoopDisarmedTimer(eventLoop, &ReductionTimerEventHandler);
+    if (reductionTimer == NULL) {
+        return ExitCode_UploadInit_Timer;
+    }
+    SetEventLoopTimerName(reductionTimer, "reduction");
 
+    // The first window runs to the next minute boundary, so it is usually short and only
+    // its health figures are uploaded
+    uploadTimer = CreateEventLoopDisarmedTimer(eventLoop, &UploadTimerEventHandler);
     if (uploadTimer == NULL) {
         return ExitCode_UploadInit_Timer;
     }
+    SetEventLoopTimerName(uploadTimer, "upload");
+    ScheduleWindowEnd(nowUtc);
 
     return ExitCode_Success;
 }
@@ -97,4 +591,5 @@ ExitCode Upload_Init(EventLoop *eventLoopInstance, datablock_t * dataBlockInstan
 void Upload_Fini(void)
 {
     DisposeEventLoopTimer(uploadTimer);
+    DisposeEventLoopTimer(reductionTimer);
 }
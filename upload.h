@@ -3,5 +3,19 @@
 #include <applibs/eventloop.h>
 #include "main.h"
 
+#include "reading.h"
+
 ExitCode Upload_Init(EventLoop *eventLoopInstance, datablock_t * dataBlockInstance);
 void Upload_Fini(void);
+
+/// <summary>
+/// Current UTC time in milliseconds since the epoch, or 0 if NTP hasn't set the clock yet,
+/// for a Timestamp reading field.
+/// </summary>
+int64_t Upload_GetUtcMilliseconds(void);
+
+/// <summary>
+/// Send an urgent reading straight away, ahead of the routine upload queue. If it can't be
+/// sent now it falls back to the queue.
+/// </summary>
+void Upload_SendAlert(const char *sensor, const ReadingField *fields, size_t fieldCount);
@@ -0,0 +1,522 @@
+#include <errno.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+// applibs_versions.h defines the API struct versions to use for applibs APIs.
+#include "applibs_versions.h"
+#include <applibs/log.h>
+#include <applibs/storage.h>
+
+#include "eventloop_timer_utilities.h"
+#include "log_utils.h"
+
+#include "logstash.h"
+#include "upload_queue.h"
+
+// The mutable storage file is divided into fixed-size slots: slot 0 holds the header and
+// the rest hold records, written round-robin by sequence number. Records are never
+// rewritten in place; sending one only advances the head sequence in the header.
+#define SLOT_SIZE 1024
+#define QUEUE_CAPACITY 63 // fits the 64 KB of mutable storage requested in the manifest
+
+static const uint32_t HeaderMagic = 0x51505547; // "GUPQ"
+static const uint32_t RecordMagic = 0x52505547; // "GUPR"
+static const uint32_t FormatVersion = 1;
+
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t headSequence;
+} QueueHeader;
+
+typedef struct {
+    uint32_t magic;
+    uint32_t sequence;
+    int64_t timestamp;
+    uint32_t checksum;
+    uint16_t bodyLength;
+    uint8_t format; // LogstashFormat
+    uint8_t kind;   // UploadRecordKind
+    char url[UPLOAD_QUEUE_MAX_URL];
+    uint8_t body[UPLOAD_QUEUE_MAX_BODY + 1];
+} QueueRecord;
+
+_Static_assert(sizeof(QueueRecord) <= SLOT_SIZE, "queue record must fit in a slot");
+_Static_assert(sizeof(QueueHeader) <= SLOT_SIZE, "queue header must fit in a slot");
+_Static_assert(QUEUE_CAPACITY <= 64, "dirty slots are tracked in a 64-bit mask");
+
+// Rate at which the backlog is replayed once the network is available
+static const struct timespec drainInterval = {.tv_sec = 2, .tv_nsec = 0};
+// Delay before trying again after a failed or impossible send
+static const struct timespec retryInterval = {.tv_sec = 30, .tv_nsec = 0};
+static const struct timespec drainNow = {.tv_sec = 0, .tv_nsec = 1};
+
+// Consecutive records for the same URL and format are sent together as one body: JSON
+// records are joined into newline-delimited JSON and CBOR records into a CBOR sequence. A
+// batch is sent once it has maxBatchRecords records or its oldest record has waited
+// maxBatchLatency, whichever comes first.
+static const uint32_t maxBatchRecords = 16;
+static const struct timespec maxBatchLatency = {.tv_sec = 5, .tv_nsec = 0};
+#define MAX_BATCH_BYTES 4096
+
+static uint8_t batchBuffer[MAX_BATCH_BYTES];
+
+static QueueRecord records[QUEUE_CAPACITY];
+static uint32_t headSequence = 0;
+static uint32_t nextSequence = 0;
+static uint32_t droppedRecords = 0;
+static uint32_t droppedReadings = 0;
+static uint32_t sentRecords = 0;
+static uint32_t sentRequests = 0;
+static uint32_t sentBytes = 0;
+static uint32_t retriedSends = 0;
+
+static bool sendInFlight = false;
+static uint32_t inFlightSequence = 0;
+static uint32_t inFlightCount = 0;
+static size_t inFlightBytes = 0;
+static bool drainScheduled = false;
+
+static EventLoopTimer *drainTimer = NULL;
+static EventLoop *eventLoop = NULL; // not owned
+
+// Flash writes happen on a background thread so that the event loop never waits for them.
+// The lock protects records[], the dirty flags and the stop flag.
+static int storageFd = -1;
+static pthread_t writerThread;
+static bool writerStarted = false;
+static pthread_mutex_t writerLock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t writerWake = PTHREAD_COND_INITIALIZER;
+static uint64_t dirtySlots = 0;
+static bool headerDirty = false;
+static bool stopWriter = false;
+
+// FNV-1a, continuing from hash
+static uint32_t HashBytes(const void *data, size_t length, uint32_t hash)
+{
+    const uint8_t *bytes = data;
+    for (size_t i = 0; i < length; i++) {
+        hash ^= bytes[i];
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+static uint32_t ComputeChecksum(const QueueRecord *record)
+{
+    // Over the record with the checksum field zeroed
+    QueueRecord copy = *record;
+    copy.checksum = 0;
+    return HashBytes(&copy, sizeof(copy), 2166136261u);
+}
+
+static off_t SlotOffset(uint32_t sequence)
+{
+    return (off_t)(1 + sequence % QUEUE_CAPACITY) * SLOT_SIZE;
+}
+
+/// <summary>
+///     The dirty slot holding the newest record. Slots are written newest first, so that
+///     when records are moved up a place to close a gap each one is written out before the
+///     slot it came from is overwritten, and a crash part way through can only duplicate a
+///     record, not lose one.
+/// </summary>
+static uint32_t NewestDirtySlot(void)
+{
+    for (uint32_t age = 1;; age++) {
+        uint32_t slot = (nextSequence - age) % QUEUE_CAPACITY;
+        if (dirtySlots & (1ull << slot)) {
+            return slot;
+        }
+    }
+}
+
+static void *WriterThreadMain(void *unused)
+{
+    // Set once something has been written since the last fsync. The file is synced when
+    // the writer runs out of dirty slots, so a burst of records costs one flush.
+    bool unsynced = false;
+
+    pthread_mutex_lock(&writerLock);
+    for (;;) {
+        while (!stopWriter && dirtySlots == 0 && !headerDirty && !unsynced) {
+            pthread_cond_wait(&writerWake, &writerLock);
+        }
+
+        if (dirtySlots != 0) {
+            uint32_t slot = NewestDirtySlot();
+            dirtySlots &= ~(1ull << slot);
+            QueueRecord record = records[slot];
+            pthread_mutex_unlock(&writerLock);
+
+            if (pwrite(storageFd, &record, sizeof(record), SlotOffset(slot)) == -1) {
+                LogErrno("ERROR: Could not persist upload queue record");
+            }
+            unsynced = true;
+
+            pthread_mutex_lock(&writerLock);
+        }
+        else if (headerDirty) {
+            headerDirty = false;
+            QueueHeader header = {
+                .magic = HeaderMagic, .version = FormatVersion, .headSequence = headSequence};
+            pthread_mutex_unlock(&writerLock);
+
+            if (pwrite(storageFd, &header, sizeof(header), 0) == -1) {
+                LogErrno("ERROR: Could not persist upload queue header");
+            }
+            unsynced = true;
+
+            pthread_mutex_lock(&writerLock);
+        }
+        else if (unsynced) {
+            unsynced = false;
+            pthread_mutex_unlock(&writerLock);
+
+            if (fsync(storageFd) == -1) {
+                LogErrno("ERROR: Could not flush the upload queue to storage");
+            }
+
+            pthread_mutex_lock(&writerLock);
+        }
+        else if (stopWriter) {
+            break;
+        }
+    }
+    pthread_mutex_unlock(&writerLock);
+
+    return NULL;
+}
+
+static void WakeWriter(void)
+{
+    pthread_cond_signal(&writerWake);
+}
+
+static bool ReadRecord(uint32_t slot, QueueRecord *record)
+{
+    return pread(storageFd, record, sizeof(*record), SlotOffset(slot)) == sizeof(*record) &&
+           record->magic == RecordMagic && record->checksum == ComputeChecksum(record);
+}
+
+/// <summary>
+///     Rebuild the in-memory queue from mutable storage after a restart. Storage in any
+///     other layout is treated as empty.
+/// </summary>
+static void RecoverQueue(void)
+{
+    QueueHeader header;
+    if (pread(storageFd, &header, sizeof(header), 0) != sizeof(header) ||
+        header.magic != HeaderMagic || header.version != FormatVersion) {
+        Log_Debug("Upload queue storage is empty, starting a new queue\n");
+        // Write a header straight away; otherwise nothing queued before the first send
+        // completes could be recovered
+        headerDirty = true;
+        return;
+    }
+    headSequence = header.headSequence;
+    nextSequence = headSequence;
+
+    bool foundRecord = false;
+    for (uint32_t slot = 0; slot < QUEUE_CAPACITY; slot++) {
+        QueueRecord *record = &records[slot];
+        if (!ReadRecord(slot, record) ||
+            record->bodyLength > UPLOAD_QUEUE_MAX_BODY || record->format >= LogstashFormat_Count ||
+            record->kind > UploadRecordKind_Telemetry ||
+            record->sequence % QUEUE_CAPACITY != slot ||
+            (int32_t)(record->sequence - headSequence) < 0) {
+            memset(record, 0, sizeof(*record));
+            continue;
+        }
+
+        if (!foundRecord || (int32_t)(record->sequence - nextSequence) >= 0) {
+            nextSequence = record->sequence + 1;
+        }
+        foundRecord = true;
+    }
+
+    if (nextSequence - headSequence > QUEUE_CAPACITY) {
+        headSequence = nextSequence - QUEUE_CAPACITY;
+    }
+
+    // Skip over anything torn or missing so that the head always points at a valid record
+    while (headSequence != nextSequence) {
+        const QueueRecord *record = &records[headSequence % QUEUE_CAPACITY];
+        if (record->magic == RecordMagic && record->sequence == headSequence) {
+            break;
+        }
+        headSequence++;
+    }
+
+    Log_Debug("Recovered %u queued uploads (sequence %u to %u)\n", nextSequence - headSequence,
+              headSequence, nextSequence);
+}
+
+static void ScheduleDrain(const struct timespec *delay)
+{
+    if (SetEventLoopTimerOneShot(drainTimer, delay) == 0) {
+        drainScheduled = true;
+    }
+}
+
+static void AdvanceHead(uint32_t newHeadSequence)
+{
+    pthread_mutex_lock(&writerLock);
+    headSequence = newHeadSequence;
+    headerDirty = true;
+    pthread_mutex_unlock(&writerLock);
+    WakeWriter();
+}
+
+static void SendCompleteCallback(bool succeeded, void *context)
+{
+    sendInFlight = false;
+
+    if (!succeeded) {
+        Log_Debug("Queued uploads %u to %u failed, will retry\n", inFlightSequence,
+                  inFlightSequence + inFlightCount - 1);
+        retriedSends++;
+        ScheduleDrain(&retryInterval);
+        return;
+    }
+
+    // Some of the records may already have been dropped to make room while they were in flight
+    uint32_t newHeadSequence = inFlightSequence + inFlightCount;
+    if ((int32_t)(newHeadSequence - headSequence) > 0) {
+        AdvanceHead(newHeadSequence);
+    }
+    sentRecords += inFlightCount;
+    sentRequests++;
+    sentBytes += (uint32_t)inFlightBytes;
+
+    if (headSequence != nextSequence) {
+        ScheduleDrain(&drainInterval);
+    }
+}
+
+static void DrainTimerEventHandler(EventLoopTimer *timer)
+{
+    if (ConsumeEventLoopTimerEvent(timer) != 0) {
+        LogErrno("ERROR: cannot consume the timer event");
+        return;
+    }
+    drainScheduled = false;
+
+    if (sendInFlight || headSequence == nextSequence) {
+        return;
+    }
+
+    // Skip records that were lost from storage, e.g. in a crash part way through a burst
+    uint32_t validSequence = headSequence;
+    while (validSequence != nextSequence &&
+           records[validSequence % QUEUE_CAPACITY].magic != RecordMagic) {
+        validSequence++;
+    }
+    if (validSequence != headSequence) {
+        Log_Debug("Skipping %u missing upload queue records\n", validSequence - headSequence);
+        AdvanceHead(validSequence);
+        if (headSequence == nextSequence) {
+            return;
+        }
+    }
+
+    // Build one body from as many consecutive records for the head's URL as will fit
+    const QueueRecord *first = &records[headSequence % QUEUE_CAPACITY];
+    size_t separatorLength = first->format == LogstashFormat_Json ? 1 : 0;
+    size_t batchLength = 0;
+    uint32_t count = 0;
+    for (uint32_t sequence = headSequence; sequence != nextSequence && count < maxBatchRecords;
+         sequence++) {
+        const QueueRecord *record = &records[sequence % QUEUE_CAPACITY];
+        if (record->magic != RecordMagic || strcmp(record->url, first->url) != 0 ||
+            record->format != first->format ||
+            batchLength + record->bodyLength + separatorLength > sizeof(batchBuffer)) {
+            break;
+        }
+        memcpy(batchBuffer + batchLength, record->body, record->bodyLength);
+        batchLength += record->bodyLength;
+        if (separatorLength != 0) {
+            batchBuffer[batchLength++] = '\n';
+        }
+        count++;
+    }
+
+    inFlightSequence = headSequence;
+    inFlightCount = count;
+    inFlightBytes = batchLength;
+    if (!SendToLogstash(first->url, (LogstashFormat)first->format, batchBuffer, batchLength,
+                        SendCompleteCallback, NULL)) {
+        retriedSends++;
+        ScheduleDrain(&retryInterval);
+        return;
+    }
+    sendInFlight = true;
+}
+
+/// <summary>
+///     Make room in a full queue by dropping the oldest telemetry record, or failing that
+///     the oldest reading. The records older than the dropped one move up a place, so the
+///     queue stays contiguous and in order. Called with the writer lock held.
+/// </summary>
+/// <returns>false if a new telemetry record should be dropped instead, because the
+/// queue holds nothing but readings.</returns>
+static bool MakeRoom(UploadRecordKind kind)
+{
+    uint32_t dropSequence = headSequence;
+    while (dropSequence != nextSequence &&
+           records[dropSequence % QUEUE_CAPACITY].kind != UploadRecordKind_Telemetry) {
+        dropSequence++;
+    }
+    if (dropSequence == nextSequence) {
+        if (kind == UploadRecordKind_Telemetry) {
+            return false;
+        }
+        dropSequence = headSequence;
+        droppedReadings++;
+    }
+
+    for (uint32_t sequence = dropSequence; sequence != headSequence; sequence--) {
+        QueueRecord *record = &records[sequence % QUEUE_CAPACITY];
+        *record = records[(sequence - 1) % QUEUE_CAPACITY];
+        record->sequence = sequence;
+        record->checksum = ComputeChecksum(record);
+        dirtySlots |= 1ull << (sequence % QUEUE_CAPACITY);
+    }
+
+    // A batch in flight that is wholly older than the dropped record has moved up with it
+    if (sendInFlight && (int32_t)(dropSequence - (inFlightSequence + inFlightCount)) >= 0) {
+        inFlightSequence++;
+    }
+
+    headSequence++;
+    headerDirty = true;
+    droppedRecords++;
+    return true;
+}
+
+bool UploadQueue_Enqueue(const char *url, LogstashFormat format, UploadRecordKind kind,
+                         const uint8_t *body, size_t bodyLength)
+{
+    size_t urlLength = strlen(url);
+    if (urlLength >= UPLOAD_QUEUE_MAX_URL || bodyLength > UPLOAD_QUEUE_MAX_BODY) {
+        Log_Debug("ERROR: Upload is too large to queue (%zu bytes)\n", bodyLength);
+        return false;
+    }
+
+    pthread_mutex_lock(&writerLock);
+
+    if (nextSequence - headSequence == QUEUE_CAPACITY && !MakeRoom(kind)) {
+        droppedRecords++;
+        pthread_mutex_unlock(&writerLock);
+        return true;
+    }
+
+    uint32_t slot = nextSequence % QUEUE_CAPACITY;
+    QueueRecord *record = &records[slot];
+    memset(record, 0, sizeof(*record));
+    record->magic = RecordMagic;
+    record->sequence = nextSequence;
+    record->timestamp = (int64_t)time(NULL);
+    record->bodyLength = (uint16_t)bodyLength;
+    record->format = (uint8_t)format;
+    record->kind = (uint8_t)kind;
+    memcpy(record->url, url, urlLength);
+    memcpy(record->body, body, bodyLength);
+    record->checksum = ComputeChecksum(record);
+
+    nextSequence++;
+    dirtySlots |= 1ull << slot;
+
+    pthread_mutex_unlock(&writerLock);
+    WakeWriter();
+
+    if (!sendInFlight) {
+        if (nextSequence - headSequence >= maxBatchRecords) {
+            ScheduleDrain(&drainNow);
+        }
+        else if (!drainScheduled) {
+            ScheduleDrain(&maxBatchLatency);
+        }
+    }
+
+    return true;
+}
+
+void UploadQueue_GetStats(UploadQueueStats *stats)
+{
+    stats->depth = nextSequence - headSequence;
+    stats->bytes = 0;
+    for (uint32_t sequence = headSequence; sequence != nextSequence; sequence++) {
+        stats->bytes += records[sequence % QUEUE_CAPACITY].bodyLength;
+    }
+    stats->dropped = droppedRecords;
+    stats->droppedReadings = droppedReadings;
+    stats->sent = sentRecords;
+    stats->requests = sentRequests;
+    stats->bytesSent = sentBytes;
+    stats->retries = retriedSends;
+    stats->nextSequence = nextSequence;
+}
+
+ExitCode UploadQueue_Init(EventLoop *eventLoopInstance)
+{
+    eventLoop = eventLoopInstance;
+
+    // Start from nothing, so that reopening the queue after UploadQueue_Fini behaves like a
+    // restart and recovers only what is in storage
+    memset(records, 0, sizeof(records));
+    headSequence = nextSequence = 0;
+    droppedRecords = droppedReadings = sentRecords = sentRequests = sentBytes = retriedSends = 0;
+    sendInFlight = drainScheduled = false;
+    dirtySlots = 0;
+    headerDirty = stopWriter = false;
+
+    drainTimer = CreateEventLoopDisarmedTimer(eventLoop, &DrainTimerEventHandler);
+    if (drainTimer == NULL) {
+        return ExitCode_UploadQueueInit_Timer;
+    }
+    SetEventLoopTimerName(drainTimer, "upload_queue");
+
+    storageFd = Storage_OpenMutableFile();
+    if (storageFd == -1) {
+        // Keep queueing in memory; the backlog just won't survive a restart
+        LogErrno("WARNING: Could not open mutable storage, upload queue will not persist");
+    }
+    else {
+        RecoverQueue();
+
+        if (pthread_create(&writerThread, NULL, WriterThreadMain, NULL) != 0) {
+            Log_Debug("ERROR: Could not start upload queue writer thread\n");
+            return ExitCode_UploadQueueInit_Thread;
+        }
+        writerStarted = true;
+    }
+
+    if (headSequence != nextSequence) {
+        ScheduleDrain(&drainNow);
+    }
+
+    return ExitCode_Success;
+}
+
+void UploadQueue_Fini(void)
+{
+    if (writerStarted) {
+        // Let the writer flush whatever is still dirty before it exits
+        pthread_mutex_lock(&writerLock);
+        stopWriter = true;
+        pthread_mutex_unlock(&writerLock);
+        WakeWriter();
+        pthread_join(writerThread, NULL);
+        writerStarted = false;
+    }
+
+    DisposeEventLoopTimer(drainTimer);
+    drainTimer = NULL;
+    CloseFdAndLogOnError(storageFd, "UploadQueue");
+    storageFd = -1;
+}
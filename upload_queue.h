@@ -0,0 +1,54 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include <applibs/eventloop.h>
+#include "logstash.h"
+#include "main.h"
+
+// Largest URL and body that fit in a single queue record
+#define UPLOAD_QUEUE_MAX_URL 96
+#define UPLOAD_QUEUE_MAX_BODY 900
+
+/// <summary>
+/// What a queued record carries. A full queue drops telemetry before readings, so
+/// diagnostics can never push sensor data out of the backlog.
+/// </summary>
+typedef enum {
+    UploadRecordKind_Reading = 0,
+    UploadRecordKind_Telemetry = 1,
+} UploadRecordKind;
+
+typedef struct UploadQueueStats {
+    uint32_t depth;           // records waiting to be sent
+    uint32_t bytes;           // body bytes waiting to be sent
+    uint32_t dropped;         // records overwritten because the queue was full
+    uint32_t droppedReadings; // of which readings, once there was no telemetry left to drop
+    uint32_t sent;            // records acknowledged by the server
+    uint32_t requests;        // successful requests, each carrying one batch of records
+    uint32_t bytesSent;       // body bytes in successful requests
+    uint32_t retries;         // sends that failed or could not start, and were retried later
+    uint32_t nextSequence;    // sequence number of the next record to be enqueued
+} UploadQueueStats;
+
+/// <summary>
+/// Open the persistent upload queue, recover any backlog left by a previous run and
+/// start draining it to Logstash.
+/// </summary>
+ExitCode UploadQueue_Init(EventLoop *eventLoopInstance);
+void UploadQueue_Fini(void);
+
+/// <summary>
+/// Append a payload to the queue: one line of JSON or one CBOR item, depending on format.
+/// The record is persisted in the background and sent in order, batched with neighbouring
+/// records for the same URL and format, once the network is available. If the queue is full
+/// the oldest telemetry record is dropped to make room; if there is none, a new telemetry
+/// record is dropped itself and a new reading replaces the oldest reading.
+/// </summary>
+/// <returns>false if the url or body is too large for a queue record.</returns>
+bool UploadQueue_Enqueue(const char *url, LogstashFormat format, UploadRecordKind kind,
+                         const uint8_t *body, size_t bodyLength);
+
+void UploadQueue_GetStats(UploadQueueStats *stats);